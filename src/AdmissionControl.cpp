@@ -0,0 +1,83 @@
+#include <AdmissionControl.h>
+#include <HttpResponse.h>
+
+#include <unistd.h>
+
+
+int AdmissionControl::init(int targetMillis, int intervalMillis, int retryAfterSeconds)
+{
+    this->targetMillis = targetMillis;
+    this->intervalMillis = intervalMillis;
+
+    intervalStart.store(0);
+    minDelay.store(NO_DELAY);
+    overloaded.store(false);
+
+    responseSize = HttpResponse::serviceUnavailable503(response, RESPONSE_BUFFER_SIZE, retryAfterSeconds);
+    if(responseSize < 0)
+    {
+        responseSize = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void AdmissionControl::addDelay(long long int delayMillis, long long int curMillis)
+{
+    if(!enabled())
+    {
+        return;
+    }
+
+    checkInterval(curMillis);
+
+    long long int curMin = minDelay.load();
+    while(delayMillis < curMin && !minDelay.compare_exchange_weak(curMin, delayMillis));
+}
+
+
+bool AdmissionControl::isOverloaded(long long int curMillis)
+{
+    if(!enabled())
+    {
+        return false;
+    }
+
+    checkInterval(curMillis);
+
+    return overloaded.load();
+}
+
+
+void AdmissionControl::checkInterval(long long int curMillis)
+{
+    long long int start = intervalStart.load();
+
+    if(curMillis - start < intervalMillis)
+    {
+        return;
+    }
+
+    // only one thread finishes interval
+    if(!intervalStart.compare_exchange_strong(start, curMillis))
+    {
+        return;
+    }
+
+    long long int intervalMin = minDelay.exchange(NO_DELAY);
+
+    // interval without connections (all were rejected) ends overload,
+    // so next interval probes whether delay went down.
+    overloaded.store(intervalMin != NO_DELAY && intervalMin >= targetMillis);
+}
+
+
+void AdmissionControl::reject(int fd) const
+{
+    // socket is new, send buffer is empty and response fits into it
+    ssize_t result = write(fd, response, responseSize);
+    (void)result;
+    close(fd);
+}
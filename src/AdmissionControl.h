@@ -0,0 +1,57 @@
+#ifndef ADMISSION_CONTROL_H
+#define ADMISSION_CONTROL_H
+
+#include <atomic>
+#include <climits>
+
+// Overload detection in CoDel style. Poll loops report queueing delay of new connections
+// (time from accept to first processing). If minimal delay during interval is above target,
+// all connections of interval waited too long and server is overloaded till next interval
+// with delay below target.
+// Methods are thread safe, instance is shared by all poll loops.
+
+class AdmissionControl
+{
+public:
+    AdmissionControl() = default;
+
+    AdmissionControl(const AdmissionControl &ac) = delete;
+    AdmissionControl(AdmissionControl &&ac) = delete;
+    AdmissionControl& operator=(const AdmissionControl &ac) = delete;
+    AdmissionControl& operator=(AdmissionControl && ac) = delete;
+
+    // targetMillis == 0 - admission control is disabled
+    int init(int targetMillis, int intervalMillis, int retryAfterSeconds);
+
+    bool enabled() const
+    {
+        return targetMillis > 0;
+    }
+
+    void addDelay(long long int delayMillis, long long int curMillis);
+
+    bool isOverloaded(long long int curMillis);
+
+    // write precomputed 503 response to new connection and close it
+    void reject(int fd) const;
+
+    int intervalMillis = 100;
+
+protected:
+
+    void checkInterval(long long int curMillis);
+
+    static const long long int NO_DELAY = LLONG_MAX;
+
+    int targetMillis = 0;
+
+    std::atomic<long long int> intervalStart { 0 };
+    std::atomic<long long int> minDelay { NO_DELAY };
+    std::atomic_bool overloaded { false };
+
+    static const int RESPONSE_BUFFER_SIZE = 500;
+    char response[RESPONSE_BUFFER_SIZE];
+    int responseSize = 0;
+};
+
+#endif
@@ -0,0 +1,175 @@
+#include <ChunkedDecoder.h>
+
+#include <string.h>
+
+
+static int hexValue(char c)
+{
+    if(c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if(c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if(c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+
+ChunkedDecoder::Result ChunkedDecoder::decode(const char *data, int size, int &consumed, char *payload, int *payloadSize)
+{
+    int i = 0;
+    int outSize = 0;
+
+    while(i < size && state != State::finish && state != State::invalid)
+    {
+        char c = data[i];
+
+        switch(state)
+        {
+        case State::size:
+            {
+                int v = hexValue(c);
+
+                if(v >= 0)
+                {
+                    if(++sizeDigits > MAX_SIZE_DIGITS)
+                    {
+                        state = State::invalid;
+                        break;
+                    }
+                    chunkSize = chunkSize * 16 + v;
+                }
+                else if(sizeDigits == 0)
+                {
+                    state = State::invalid;
+                    break;
+                }
+                else if(c == ';' || c == ' ' || c == '\t')
+                {
+                    state = State::sizeExtension;
+                }
+                else if(c == '\r')
+                {
+                    state = State::sizeLineBreak;
+                }
+                else if(c == '\n')
+                {
+                    state = (chunkSize == 0) ? State::trailer : State::data;
+                }
+                else
+                {
+                    state = State::invalid;
+                    break;
+                }
+                ++i;
+            }
+            break;
+        case State::sizeExtension:
+            {
+                if(c == '\r')
+                {
+                    state = State::sizeLineBreak;
+                }
+                else if(c == '\n')
+                {
+                    state = (chunkSize == 0) ? State::trailer : State::data;
+                }
+                ++i;
+            }
+            break;
+        case State::sizeLineBreak:
+            {
+                if(c != '\n')
+                {
+                    state = State::invalid;
+                    break;
+                }
+                state = (chunkSize == 0) ? State::trailer : State::data;
+                ++i;
+            }
+            break;
+        case State::data:
+            {
+                long long int available = size - i;
+                int length = static_cast<int>((chunkSize < available) ? chunkSize : available);
+
+                if(payload != nullptr)
+                {
+                    memmove(payload + outSize, data + i, length);
+                    outSize += length;
+                }
+
+                chunkSize -= length;
+                i += length;
+
+                if(chunkSize == 0)
+                {
+                    state = State::dataCr;
+                }
+            }
+            break;
+        case State::dataCr:
+        case State::dataLf:
+            {
+                if(c == '\r' && state == State::dataCr)
+                {
+                    state = State::dataLf;
+                }
+                else if(c == '\n')
+                {
+                    state = State::size;
+                    sizeDigits = 0;
+                }
+                else
+                {
+                    state = State::invalid;
+                    break;
+                }
+                ++i;
+            }
+            break;
+        case State::trailer:
+            {
+                if(c == '\n')
+                {
+                    if(lineLength == 0)
+                    {
+                        state = State::finish;
+                    }
+                    lineLength = 0;
+                }
+                else if(c != '\r')
+                {
+                    ++lineLength;
+                }
+                ++i;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    consumed = i;
+
+    if(payloadSize != nullptr)
+    {
+        *payloadSize = outSize;
+    }
+
+    if(state == State::finish)
+    {
+        return Result::finish;
+    }
+    else if(state == State::invalid)
+    {
+        return Result::invalid;
+    }
+    return Result::needMoreData;
+}
@@ -0,0 +1,52 @@
+#ifndef CHUNKED_DECODER_H
+#define CHUNKED_DECODER_H
+
+// Incremental parser of chunked transfer coding.
+// Data can be passed in pieces of any size, state is kept between calls.
+
+class ChunkedDecoder
+{
+public:
+
+    enum class Result
+    {
+        needMoreData, finish, invalid
+    };
+
+    void reset()
+    {
+        state = State::size;
+        chunkSize = 0;
+        sizeDigits = 0;
+        lineLength = 0;
+    }
+
+    // consumed - number of bytes, which belong to chunked body.
+    // if payload is not null, chunk data is copied to payload, payloadSize is set to number of copied bytes.
+    // payload can point to data, decoding in place is possible.
+    Result decode(const char *data, int size, int &consumed, char *payload = nullptr, int *payloadSize = nullptr);
+
+    bool finished() const
+    {
+        return state == State::finish;
+    }
+
+protected:
+
+    enum class State
+    {
+        size, sizeExtension, sizeLineBreak, data, dataCr, dataLf, trailer, finish, invalid
+    };
+
+    State state = State::size;
+
+    long long int chunkSize = 0;
+    int sizeDigits = 0;
+
+    // length of current trailer line
+    int lineLength = 0;
+
+    static const int MAX_SIZE_DIGITS = 15;
+};
+
+#endif
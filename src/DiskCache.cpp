@@ -0,0 +1,621 @@
+#include <DiskCache.h>
+#include <ProxyParameters.h>
+#include <TimeUtils.h>
+#include <Log.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iterator>
+#include <vector>
+
+
+int DiskCache::init(const std::string &folder, long long int maxBytes, Log *log)
+{
+    this->log = log;
+
+    if(folder.empty() || maxBytes <= 0)
+    {
+        return 0;
+    }
+
+    this->folder = folder;
+    this->maxBytes = maxBytes;
+
+    if(mkdir(folder.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        log->error("mkdir failed. folder: %s   error: %s\n", folder.c_str(), strerror(errno));
+        return -1;
+    }
+
+    if(loadIndex(getMilliseconds()) != 0)
+    {
+        return -1;
+    }
+
+    removeUnknownFiles();
+
+    int fd = writeIndex(indexRecords());
+
+    if(fd < 0 || replaceIndex(fd) != 0)
+    {
+        return -1;
+    }
+
+    journalRecords = lru.size();
+
+    log->info("disk cache   entries: %zu   bytes: %lld\n", index.size(), usedBytes);
+
+    return 0;
+}
+
+
+void DiskCache::destroy()
+{
+    if(indexFd >= 0)
+    {
+        close(indexFd);
+        indexFd = -1;
+    }
+
+    lru.clear();
+    index.clear();
+    usedBytes = 0;
+}
+
+
+int DiskCache::open(const std::string &key, long long int curMillis, ResponseCache::Status &status, Hit &hit)
+{
+    status = ResponseCache::Status::miss;
+
+    long long int fileId = 0;
+    std::string journal;
+    bool compact = false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto iter = index.find(key);
+        if(iter == index.end())
+        {
+            return -1;
+        }
+
+        Entry &entry = *iter->second;
+
+        if(curMillis < entry.freshUntil)
+        {
+            status = ResponseCache::Status::hit;
+        }
+        else if(curMillis < entry.staleUntil)
+        {
+            if(curMillis >= entry.revalidateUntil)
+            {
+                // this request revalidates entry
+                entry.revalidateUntil = curMillis + ResponseCache::REVALIDATE_MILLIS;
+                return -1;
+            }
+            status = ResponseCache::Status::stale;
+        }
+        else
+        {
+            remove(iter->second);
+            compact = startCompaction(journal);
+        }
+
+        if(status != ResponseCache::Status::miss)
+        {
+            fileId = entry.fileId;
+            hit.size = entry.size;
+            hit.headersEnd = entry.headersEnd;
+            hit.bodyStart = entry.bodyStart;
+
+            lru.splice(lru.begin(), lru, iter->second);
+        }
+    }
+
+    if(status == ResponseCache::Status::miss)
+    {
+        if(compact)
+        {
+            this->compact(journal);
+        }
+        return -1;
+    }
+
+    // file of entry, which is removed meanwhile, is not found or is open till it is sent
+    hit.fd = ::open(fileName(fileId, false).c_str(), O_RDONLY | O_NONBLOCK);
+
+    if(hit.fd < 0)
+    {
+        log->warning("open of cache file failed: %s\n", strerror(errno));
+        status = ResponseCache::Status::miss;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            auto iter = index.find(key);
+            if(iter != index.end() && iter->second->fileId == fileId)
+            {
+                remove(iter->second);
+            }
+            compact = startCompaction(journal);
+        }
+
+        if(compact)
+        {
+            this->compact(journal);
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int DiskCache::create(long long int &fileId)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        fileId = nextFileId++;
+    }
+
+    // file is read to parse headers, when it is stored
+    int fd = ::open(fileName(fileId, true).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if(fd < 0)
+    {
+        log->error("create of cache file failed: %s\n", strerror(errno));
+    }
+
+    return fd;
+}
+
+
+bool DiskCache::store(const std::string &key, const ProxyParameters &proxy, long long int fileId, int fd,
+                      int maxHeaderBytes, long long int curMillis)
+{
+    Entry entry;
+    entry.key = key;
+    entry.fileId = fileId;
+
+    struct stat st;
+
+    if(fstat(fd, &st) != 0)
+    {
+        discard(fileId, fd);
+        return false;
+    }
+
+    entry.size = st.st_size;
+
+    // headers end with empty line
+    std::vector<char> headers(maxHeaderBytes);
+    ssize_t bytesRead = pread(fd, headers.data(), headers.size(), 0);
+
+    for(ssize_t i = 1; i < bytesRead && entry.bodyStart == 0; ++i)
+    {
+        if(headers[i - 1] == '\n')
+        {
+            if(headers[i] == '\n')
+            {
+                entry.headersEnd = i;
+                entry.bodyStart = i + 1;
+            }
+            else if(headers[i] == '\r' && i + 1 < bytesRead && headers[i + 1] == '\n')
+            {
+                entry.headersEnd = i;
+                entry.bodyStart = i + 2;
+            }
+        }
+    }
+
+    ResponseCache::Freshness freshness;
+    const char *value;
+    int length;
+    int pos = 0;
+
+    if(entry.bodyStart > 0)
+    {
+        freshness = ResponseCache::getFreshness(headers.data(), entry.headersEnd, proxy, curMillis);
+    }
+
+    if(!freshness.storable || entry.size > maxBytes ||
+       ResponseCache::findHeader(headers.data(), entry.headersEnd, "Vary", pos, &value, &length) == 0)
+    {
+        discard(fileId, fd);
+        return false;
+    }
+
+    entry.freshUntil = curMillis + freshness.freshMillis;
+    entry.staleUntil = entry.freshUntil + freshness.staleMillis;
+
+    close(fd);
+
+    if(rename(fileName(fileId, true).c_str(), fileName(fileId, false).c_str()) != 0)
+    {
+        log->error("rename of cache file failed: %s\n", strerror(errno));
+        unlink(fileName(fileId, true).c_str());
+        return false;
+    }
+
+    std::string journal;
+    bool compact;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto iter = index.find(key);
+        if(iter != index.end())
+        {
+            remove(iter->second);
+        }
+
+        while(!lru.empty() && usedBytes + entry.size > maxBytes)
+        {
+            remove(std::prev(lru.end()));
+        }
+
+        lru.push_front(entry);
+        index[key] = lru.begin();
+        usedBytes += entry.size;
+
+        appendRecord(addRecord(entry));
+
+        compact = startCompaction(journal);
+    }
+
+    if(compact)
+    {
+        this->compact(journal);
+    }
+
+    log->debug("response is stored in disk cache, size: %lld   fresh millis: %lld\n", entry.size, freshness.freshMillis);
+
+    return true;
+}
+
+
+void DiskCache::discard(long long int fileId, int fd)
+{
+    close(fd);
+    unlink(fileName(fileId, true).c_str());
+}
+
+
+void DiskCache::erase(const std::string &key)
+{
+    std::string journal;
+    bool compact = false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto iter = index.find(key);
+        if(iter != index.end())
+        {
+            remove(iter->second);
+            compact = startCompaction(journal);
+        }
+    }
+
+    if(compact)
+    {
+        this->compact(journal);
+    }
+}
+
+
+std::string DiskCache::fileName(long long int fileId, bool temporary) const
+{
+    return folder + "/" + std::to_string(fileId) + (temporary ? ".tmp" : "");
+}
+
+
+// journal: "+ fileId size headersEnd bodyStart freshUntil staleUntil keyLength\nkey\n" - entry is stored,
+// "- fileId\n" - entry is removed. entry, which is stored later, is more recently used.
+int DiskCache::loadIndex(long long int curMillis)
+{
+    std::string journal;
+
+    int fd = ::open((folder + "/index").c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return 0;
+    }
+
+    char buf[64 * 1024];
+    ssize_t bytesRead;
+
+    while((bytesRead = read(fd, buf, sizeof(buf))) > 0)
+    {
+        journal.append(buf, bytesRead);
+    }
+
+    close(fd);
+
+    std::unordered_map<long long int, LruList::iterator> files;
+    size_t pos = 0;
+
+    while(pos < journal.size())
+    {
+        size_t lineEnd = journal.find('\n', pos);
+        if(lineEnd == std::string::npos)
+        {
+            break;
+        }
+
+        std::string line = journal.substr(pos, lineEnd - pos);
+        pos = lineEnd + 1;
+
+        Entry entry;
+        size_t keyLength = 0;
+
+        if(sscanf(line.c_str(), "+ %lld %lld %d %d %lld %lld %zu", &entry.fileId, &entry.size, &entry.headersEnd,
+                  &entry.bodyStart, &entry.freshUntil, &entry.staleUntil, &keyLength) == 7)
+        {
+            // record, which was not written completely
+            if(pos + keyLength + 1 > journal.size())
+            {
+                break;
+            }
+
+            entry.key = journal.substr(pos, keyLength);
+            pos += keyLength + 1;
+
+            auto iter = index.find(entry.key);
+            if(iter != index.end())
+            {
+                files.erase(iter->second->fileId);
+                lru.erase(iter->second);
+            }
+
+            lru.push_front(entry);
+            index[entry.key] = lru.begin();
+            files[entry.fileId] = lru.begin();
+        }
+        else if(sscanf(line.c_str(), "- %lld", &entry.fileId) == 1)
+        {
+            auto iter = files.find(entry.fileId);
+            if(iter != files.end())
+            {
+                index.erase(iter->second->key);
+                lru.erase(iter->second);
+                files.erase(iter);
+            }
+        }
+        else
+        {
+            log->warning("invalid record in index of disk cache\n");
+            break;
+        }
+
+        if(entry.fileId >= nextFileId)
+        {
+            nextFileId = entry.fileId + 1;
+        }
+    }
+
+    // entries without files and expired entries are dropped
+    for(auto iter = lru.begin(); iter != lru.end();)
+    {
+        struct stat st;
+
+        if(stat(fileName(iter->fileId, false).c_str(), &st) != 0 || st.st_size != iter->size ||
+           iter->staleUntil <= curMillis)
+        {
+            unlink(fileName(iter->fileId, false).c_str());
+            index.erase(iter->key);
+            iter = lru.erase(iter);
+        }
+        else
+        {
+            usedBytes += iter->size;
+            ++iter;
+        }
+    }
+
+    while(!lru.empty() && usedBytes > maxBytes)
+    {
+        auto last = std::prev(lru.end());
+
+        unlink(fileName(last->fileId, false).c_str());
+        usedBytes -= last->size;
+        index.erase(last->key);
+        lru.erase(last);
+    }
+
+    return 0;
+}
+
+
+std::string DiskCache::indexRecords() const
+{
+    std::string journal;
+
+    for(auto iter = lru.rbegin(); iter != lru.rend(); ++iter)
+    {
+        journal += addRecord(*iter);
+    }
+
+    return journal;
+}
+
+
+int DiskCache::writeIndex(const std::string &journal)
+{
+    std::string tempName = folder + "/index.tmp";
+
+    int fd = ::open(tempName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if(fd < 0)
+    {
+        log->error("create of disk cache index failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if(write(fd, journal.data(), journal.size()) != static_cast<ssize_t>(journal.size()) || fsync(fd) != 0)
+    {
+        log->error("write of disk cache index failed: %s\n", strerror(errno));
+        close(fd);
+        unlink(tempName.c_str());
+        return -1;
+    }
+
+    return fd;
+}
+
+
+int DiskCache::replaceIndex(int fd)
+{
+    if(rename((folder + "/index.tmp").c_str(), (folder + "/index").c_str()) != 0)
+    {
+        log->error("rename of disk cache index failed: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if(indexFd >= 0)
+    {
+        close(indexFd);
+    }
+
+    indexFd = fd;
+
+    return 0;
+}
+
+
+bool DiskCache::startCompaction(std::string &journal)
+{
+    if(compacting || indexFd < 0 || journalRecords <= COMPACT_RECORDS + 2 * static_cast<long long int>(lru.size()))
+    {
+        return false;
+    }
+
+    journal = indexRecords();
+    journalRecords = lru.size();
+
+    compacting = true;
+    compactRecords.clear();
+
+    return true;
+}
+
+
+// old journal gets all records till new one replaces it, so index is complete after crash at any moment
+void DiskCache::compact(const std::string &journal)
+{
+    int fd = writeIndex(journal);
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    compacting = false;
+
+    if(fd >= 0 && write(fd, compactRecords.data(), compactRecords.size()) !=
+                  static_cast<ssize_t>(compactRecords.size()))
+    {
+        log->error("write of disk cache index failed: %s\n", strerror(errno));
+        close(fd);
+        unlink((folder + "/index.tmp").c_str());
+        fd = -1;
+    }
+
+    compactRecords.clear();
+
+    if(fd >= 0)
+    {
+        replaceIndex(fd);
+    }
+}
+
+
+// files of entries are named by number, temporary files are left by stopped server
+void DiskCache::removeUnknownFiles()
+{
+    DIR *dir = opendir(folder.c_str());
+    if(dir == nullptr)
+    {
+        return;
+    }
+
+    std::unordered_map<long long int, bool> files;
+    for(const Entry &entry : lru)
+    {
+        files[entry.fileId] = true;
+    }
+
+    struct dirent *item;
+
+    while((item = readdir(dir)) != nullptr)
+    {
+        char *end;
+        long long int fileId = strtoll(item->d_name, &end, 10);
+
+        if(end == item->d_name)
+        {
+            continue;
+        }
+
+        if((*end == 0 && files.find(fileId) == files.end()) || strcmp(end, ".tmp") == 0)
+        {
+            unlink((folder + "/" + item->d_name).c_str());
+        }
+    }
+
+    closedir(dir);
+}
+
+
+void DiskCache::remove(LruList::iterator iter)
+{
+    unlink(fileName(iter->fileId, false).c_str());
+    appendRecord(removeRecord(iter->fileId));
+
+    usedBytes -= iter->size;
+    index.erase(iter->key);
+    lru.erase(iter);
+}
+
+
+void DiskCache::appendRecord(const std::string &record)
+{
+    if(indexFd < 0)
+    {
+        return;
+    }
+
+    if(write(indexFd, record.data(), record.size()) != static_cast<ssize_t>(record.size()))
+    {
+        log->error("write of disk cache index failed: %s\n", strerror(errno));
+    }
+
+    if(compacting)
+    {
+        compactRecords += record;
+    }
+
+    ++journalRecords;
+}
+
+
+std::string DiskCache::addRecord(const Entry &entry)
+{
+    char buf[200];
+
+    snprintf(buf, sizeof(buf), "+ %lld %lld %d %d %lld %lld %zu\n", entry.fileId, entry.size, entry.headersEnd,
+             entry.bodyStart, entry.freshUntil, entry.staleUntil, entry.key.size());
+
+    return buf + entry.key + "\n";
+}
+
+
+std::string DiskCache::removeRecord(long long int fileId)
+{
+    return "- " + std::to_string(fileId) + "\n";
+}
@@ -0,0 +1,140 @@
+#ifndef DISK_CACHE_H
+#define DISK_CACHE_H
+
+#include <ResponseCache.h>
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class Log;
+struct ProxyParameters;
+
+// Second tier of ResponseCache for responses, which are too large for memory. Every entry is file in cache folder
+// with status line, headers and body as received from upstream, body is sent to clients by FileExecutor.
+// Index is journal in same folder: records of stored and removed entries are appended to it and journal is
+// compacted on start, so index survives restart and crash. Files, which are not in index, are removed on start.
+// Journal, which grows too long, is compacted by request, which appended last record, without lock.
+// Entries are evicted in LRU order, when size of files exceeds limit. Responses with Vary are not stored.
+
+class DiskCache
+{
+public:
+    DiskCache() = default;
+
+    ~DiskCache()
+    {
+        destroy();
+    }
+
+    DiskCache(const DiskCache &cache) = delete;
+    DiskCache(DiskCache &&cache) = delete;
+    DiskCache& operator=(const DiskCache &cache) = delete;
+    DiskCache& operator=(DiskCache && cache) = delete;
+
+    // empty folder or maxBytes == 0 - disk cache is disabled
+    int init(const std::string &folder, long long int maxBytes, Log *log);
+
+    void destroy();
+
+    bool enabled() const
+    {
+        return indexFd >= 0;
+    }
+
+    struct Hit
+    {
+        int fd = -1;
+        long long int size = 0;
+        int headersEnd = 0;
+        int bodyStart = 0;
+    };
+
+    // opens file of entry for key, status is set as in ResponseCache::find. returns -1 if entry can not be used.
+    int open(const std::string &key, long long int curMillis, ResponseCache::Status &status, Hit &hit);
+
+    // creates temporary file for response, which is received. returns fd of file, fileId is set.
+    int create(long long int &fileId);
+
+    // file is complete response, it is stored, if it is cacheable, otherwise it is removed. fd is closed.
+    // maxHeaderBytes - headers of stored response are not longer, so they can be sent from buffer of executor.
+    bool store(const std::string &key, const ProxyParameters &proxy, long long int fileId, int fd,
+               int maxHeaderBytes, long long int curMillis);
+
+    // removes temporary file, fd is closed
+    void discard(long long int fileId, int fd);
+
+    void erase(const std::string &key);
+
+protected:
+
+    struct Entry
+    {
+        std::string key;
+        long long int fileId = 0;
+        long long int size = 0;
+        int headersEnd = 0;
+        int bodyStart = 0;
+        long long int freshUntil = 0;
+        long long int staleUntil = 0;
+        long long int revalidateUntil = 0;
+    };
+
+    // most recently used entries are at front
+    typedef std::list<Entry> LruList;
+
+    std::string fileName(long long int fileId, bool temporary) const;
+
+    int loadIndex(long long int curMillis);
+
+    // records of current entries, called under lock
+    std::string indexRecords() const;
+
+    // writes journal to temporary file of index and syncs it. returns fd of file, which is open for append.
+    int writeIndex(const std::string &journal);
+
+    // temporary file of index replaces index, fd is used for next records
+    int replaceIndex(int fd);
+
+    // journal is set to records of current entries, when journal needs compaction. called under lock.
+    bool startCompaction(std::string &journal);
+
+    // journal is written without lock, records appended meanwhile are added to it
+    void compact(const std::string &journal);
+
+    void removeUnknownFiles();
+
+    // removes entry and its file, called under lock
+    void remove(LruList::iterator iter);
+
+    void appendRecord(const std::string &record);
+
+    static std::string addRecord(const Entry &entry);
+
+    static std::string removeRecord(long long int fileId);
+
+    // journal is compacted, when it has more records than this number plus twice number of entries
+    static const int COMPACT_RECORDS = 1000;
+
+    std::mutex mutex;
+
+    LruList lru;
+    std::unordered_map<std::string, LruList::iterator> index;
+
+    std::string folder;
+    long long int maxBytes = 0;
+    long long int usedBytes = 0;
+    long long int nextFileId = 1;
+
+    int indexFd = -1;
+    long long int journalRecords = 0;
+
+    bool compacting = false;
+    // records appended during compaction, they are written to index too
+    std::string compactRecords;
+
+    Log *log = nullptr;
+};
+
+#endif
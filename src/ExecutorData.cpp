@@ -1,8 +1,13 @@
 #include <ExecutorData.h>
 #include <Log.h>
 #include <Executor.h>
+#include <UpstreamGroup.h>
+#include <PipePool.h>
+#include <ResponseCache.h>
+#include <DiskCache.h>
 
 #include <unistd.h>
+#include <string.h>
 
 #ifdef USE_SSL
 #    include <openssl/ssl.h>
@@ -19,19 +24,83 @@ void ExecutorData::down()
     }
 #endif
 
+    finishRequest();
+
     if(fd0 > 0)
     {
         close(fd0);
         fd0 = -1;
     }
+    pollData0 = nullptr;
+
+    state = State::invalid;
+    pExecutor = nullptr;
+
+    createTime = 0;
+    acceptTime = 0;
+    lastProcessTime = 0;
+    removeOnTimeout = true;
+
+    connectionType = (int)ConnectionType::none;
+
+    listen = nullptr;
+
+    return;
+}
+
+
+void ExecutorData::finishRequest()
+{
+    // waiter is removed before its eventfd is closed, fill of failed request is abandoned
+    if(cacheFill)
+    {
+        if(cacheFillWaiter)
+        {
+            cacheFill->removeWaiter(fd1);
+        }
+        else
+        {
+            cacheFill->abandon();
+        }
+        cacheFill.reset();
+    }
+    cacheFillWaiter = false;
+
+    if(cacheFileFd >= 0)
+    {
+        diskCache->discard(cacheFileId, cacheFileFd);
+        cacheFileFd = -1;
+    }
+    cacheFileId = 0;
+    cacheFileSize = 0;
+    diskCache = nullptr;
+
+#ifdef USE_SSL
+    if(upstreamSsl != nullptr)
+    {
+        SSL_free(upstreamSsl);
+        upstreamSsl = nullptr;
+    }
+#endif
     if(fd1 > 0)
     {
         close(fd1);
         fd1 = -1;
     }
-    pollData0 = nullptr;
+    if(fd2 > 0)
+    {
+        close(fd2);
+        fd2 = -1;
+    }
     pollData1 = nullptr;
+    pollData2 = nullptr;
 
+    if(pipePool != nullptr && pipeReadFd > 0 && pipeWriteFd > 0)
+    {
+        pipePool->put(pipeReadFd, pipeWriteFd, pipeCapacity);
+        pipeReadFd = -1;
+        pipeWriteFd = -1;
+    }
     if(pipeReadFd > 0)
     {
         close(pipeReadFd);
@@ -43,26 +112,115 @@ void ExecutorData::down()
         pipeWriteFd = -1;
     }
     bytesInPipe = 0;
+    pipeCapacity = 0;
 
-    state = State::invalid;
-    pExecutor = nullptr;
+    if(pipePool != nullptr && tunnelPipeReadFd > 0 && tunnelPipeWriteFd > 0)
+    {
+        pipePool->put(tunnelPipeReadFd, tunnelPipeWriteFd, tunnelPipeCapacity);
+        tunnelPipeReadFd = -1;
+        tunnelPipeWriteFd = -1;
+    }
+    if(tunnelPipeReadFd > 0)
+    {
+        close(tunnelPipeReadFd);
+        tunnelPipeReadFd = -1;
+    }
+    if(tunnelPipeWriteFd > 0)
+    {
+        close(tunnelPipeWriteFd);
+        tunnelPipeWriteFd = -1;
+    }
+    tunnelBytesInPipe = 0;
+    tunnelPipeCapacity = 0;
+    tunnelClientClosed = false;
+    tunnelUpstreamClosed = false;
+    tunnelClientShutdown = false;
+    tunnelUpstreamShutdown = false;
+    pipePool = nullptr;
 
     bytesToSend = 0;
     filePosition = 0;
 
     buffer.clear();
 
-    createTime = 0;
-    lastProcessTime = 0;
-    removeOnTimeout = true;
-
-    connectionType = (int)ConnectionType::none;
-
     retryCounter = 0;
 
     proxy = nullptr;
+    clientKeepAlive = false;
 
-    return;
+    requestBodyLeft = 0;
+    requestChunked = false;
+    chunkedDecoder.reset();
+    requestSplice = false;
+
+    if(upstreamQueue != nullptr)
+    {
+        upstreamQueue->removeQueued(this);
+    }
+    queueTime = 0;
+
+    if(upstream != nullptr && hedgeBackendIndex >= 0)
+    {
+        upstream->finishRequest(hedgeBackendIndex);
+    }
+    hedgeBackendIndex = -1;
+    hedgeState = HedgeState::none;
+    hedgeReused = false;
+    hedgeCreateTime = 0;
+    hedgeStartTime = 0;
+    hedgeBytesSent = 0;
+    upstreamRetries = 0;
+
+    if(upstream != nullptr)
+    {
+        upstream->finishRequest(backendIndex);
+        upstream = nullptr;
+    }
+    backendIndex = -1;
+
+    requestBytes = 0;
+    requestBuffered = false;
+    requestRetryable = false;
+    upstreamReused = false;
+    upstreamCreateTime = 0;
+    upstreamStartTime = 0;
+    responseSplice = false;
+
+    cacheKey.clear();
+    cacheStore = false;
+    cacheEntry.reset();
+
+    responseSpool.reset();
+
+    responseInsert = nullptr;
+    responseInsertLeft = 0;
+    responseBytesWritten = 0;
+}
+
+
+void ExecutorData::setRequestBuffered(bool buffered)
+{
+    requestBuffered = buffered;
+    requestRetryable = false;
+
+    const char *method;
+    int length;
+
+    if(!buffered || request.getMethod(&method, &length) != 0)
+    {
+        return;
+    }
+
+    static const char *idempotentMethods[] = { "GET", "HEAD", "OPTIONS", "PUT", "DELETE" };
+
+    for(const char *idempotent : idempotentMethods)
+    {
+        if(length == static_cast<int>(strlen(idempotent)) && strncmp(method, idempotent, length) == 0)
+        {
+            requestRetryable = true;
+            return;
+        }
+    }
 }
 
 
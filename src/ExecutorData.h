@@ -5,17 +5,30 @@
 #include <ConnectionType.h>
 #include <Log.h>
 #include <HttpRequest.h>
+#include <ChunkedDecoder.h>
+#include <HttpResponseParser.h>
 #include <BlockStorage.h>
+#include <ResponseSpool.h>
 
 #include <sys/types.h>
+#include <memory>
+#include <string>
 
 #ifdef USE_SSL
 #    include <openssl/ssl.h>
+#else
+typedef struct ssl_st SSL;
 #endif
 
 class Executor;
 struct ProxyParameters;
+struct ListenParameters;
 struct PollData;
+class UpstreamGroup;
+class PipePool;
+struct CacheEntry;
+class CacheFill;
+class DiskCache;
 
 struct ExecutorData
 {
@@ -33,16 +46,31 @@ struct ExecutorData
 
     void down();
 
+    // releases state of request, connection of client (fd0, ssl) is kept for next request.
+    // fd1 and fd2 must be removed from poll.
+    void finishRequest();
+
     void writeLog(Log *log, Log::Level level, const char *title) const;
 
+    // sets requestBuffered and requestRetryable by method of request
+    void setRequestBuffered(bool buffered);
+
+    // executor is sending body (file, proxied response or request body)
+    bool isBulkTransfer() const
+    {
+        return state == State::sendFile || state == State::forwardResponse ||
+               state == State::forwardResponseOnlyWrite || state == State::forwardRequestBody ||
+               state == State::sendCachedResponse || state == State::sendCacheFill || state == State::tunnel;
+    }
+
 
     static const int REQUEST_BUFFER_SIZE = 10000;
 
     enum class State
     {
         invalid, readRequest, sendHeaders, sendFile,
-        forwardRequest, forwardResponse, forwardResponseOnlyWrite,
-        waitConnect, sendOnlyHeaders, ok,
+        forwardRequest, forwardRequestBody, forwardResponse, forwardResponseOnlyWrite,
+        waitConnect, sendOnlyHeaders, sendCachedResponse, sendCacheFill, tunnel, waitUpstream, upstreamHandshake, ok,
 
 #ifdef USE_SSL
         sslHandshake
@@ -61,13 +89,28 @@ struct ExecutorData
     int pipeReadFd = -1;
     int pipeWriteFd = -1;
     int bytesInPipe = 0;
+    int pipeCapacity = 0;
+    // pipe is returned to pool by down
+    PipePool *pipePool = nullptr;
+
+    // tunnel forwards upstream -> client through pipe above and client -> upstream through this pipe
+    int tunnelPipeReadFd = -1;
+    int tunnelPipeWriteFd = -1;
+    int tunnelBytesInPipe = 0;
+    int tunnelPipeCapacity = 0;
+    // side of tunnel closed connection, rest of data in pipe is forwarded to other side,
+    // then write side of other connection is shut down (tunnelClientShutdown, tunnelUpstreamShutdown)
+    bool tunnelClientClosed = false;
+    bool tunnelUpstreamClosed = false;
+    bool tunnelClientShutdown = false;
+    bool tunnelUpstreamShutdown = false;
 
     long long int bytesToSend = 0;
     off_t filePosition = 0;
 
     TransferRingBuffer buffer;
 
-    int port = 0;
+    const ListenParameters *listen = nullptr;
 
 #ifdef USE_SSL
     SSL *ssl = nullptr;
@@ -76,6 +119,8 @@ struct ExecutorData
     static const long long int MAX_TIME_TO_LIVE_MILLIS = 1000 * 60 * 30; // 30 minutes
 
     long long int createTime = 0;
+    // time when connection was accepted, is reset after first processing
+    long long int acceptTime = 0;
     long long int lastProcessTime = 0;
     bool removeOnTimeout = true;
 
@@ -88,6 +133,94 @@ struct ExecutorData
 
     ProxyParameters *proxy = nullptr;
 
+    // client allows to send next request over connection and no bytes of it were read with this request
+    bool clientKeepAlive = false;
+
+    // bytes of request body, which are not read from client yet (Content-Length body)
+    long long int requestBodyLeft = 0;
+    bool requestChunked = false;
+    ChunkedDecoder chunkedDecoder;
+    // request body is spliced, otherwise it is forwarded through buffer
+    bool requestSplice = false;
+
+    // size of request with body, if request can be sent again from buffer (body was read with headers)
+    long long int requestBytes = 0;
+    // whole request is in buffer, it can be sent again, till any byte of it is sent
+    bool requestBuffered = false;
+    // request can be sent again also after it was sent: backend can have processed it before it closed connection,
+    // so only idempotent methods are sent again
+    bool requestRetryable = false;
+
+    // backends of proxy and selected backend. request is counted as outstanding, while upstream is set.
+    UpstreamGroup *upstream = nullptr;
+    int backendIndex = -1;
+
+    // request waits in queue of upstream group, while all backends are at limit of requests in flight.
+    // it holds no upstream connection, only request in buffer.
+    UpstreamGroup *upstreamQueue = nullptr;
+    ExecutorData *queuePrev = nullptr;
+    ExecutorData *queueNext = nullptr;
+    long long int queueTime = 0;
+
+    // failed connects, which were retried with other backend
+    int upstreamRetries = 0;
+
+    // hedged request: fd2 is timerfd till hedge delay, then connection to other backend with copy of request.
+    // connection, which receives response first, is used, other one is closed.
+    enum class HedgeState
+    {
+        none, timer, connect, send, wait
+    };
+
+    HedgeState hedgeState = HedgeState::none;
+    int fd2 = -1;
+    PollData *pollData2 = nullptr;
+    int hedgeBackendIndex = -1;
+    bool hedgeReused = false;
+    long long int hedgeCreateTime = 0;
+    long long int hedgeStartTime = 0;
+    long long int hedgeBytesSent = 0;
+
+    // TLS of upstream connection (fd1), if proxy has tls
+    SSL *upstreamSsl = nullptr;
+
+    // upstream connection was taken from pool
+    bool upstreamReused = false;
+    long long int upstreamCreateTime = 0;
+    // time when request was started, is reset when response headers are received
+    long long int upstreamStartTime = 0;
+
+    HttpResponseParser responseParser;
+    // response body is spliced, headers were forwarded through buffer
+    bool responseSplice = false;
+
+    // key of proxied request in ResponseCache, empty if request is not cached
+    std::string cacheKey;
+    // upstream response is collected in cacheFill and stored in cache when it is finished
+    bool cacheStore = false;
+    std::shared_ptr<CacheFill> cacheFill;
+    // response is not requested from upstream, it is sent from cacheFill of other request.
+    // fd1 is eventfd, which is written when cacheFill changes.
+    bool cacheFillWaiter = false;
+    // response, which is too large for memory, is written to temporary file of disk cache
+    int cacheFileFd = -1;
+    long long int cacheFileId = 0;
+    long long int cacheFileSize = 0;
+    // temporary file is removed by down
+    DiskCache *diskCache = nullptr;
+    // cached response, which is sent to client
+    std::shared_ptr<const CacheEntry> cacheEntry;
+
+    // response bytes, which do not fit into buffer, if proxy buffers responses
+    ResponseSpool responseSpool;
+
+    // header (cache status), which is inserted into response before empty line after headers,
+    // bytes of header left to write
+    const char *responseInsert = nullptr;
+    int responseInsertLeft = 0;
+    // bytes of response written to client, without inserted header
+    long long int responseBytesWritten = 0;
+
     BlockStorage<ExecutorData>::ServiceData blockStorageData;
 };
 
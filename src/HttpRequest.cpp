@@ -1,196 +1,721 @@
 #include <HttpRequest.h>
 #include <TimeUtils.h>
+#include <CharClass.h>
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
-bool HttpRequest::checkUrlSymbols[256];
-bool HttpRequest::readUrlSymbols[256];
-bool HttpRequest::readHeaderKeySymbols[256];
+namespace
+{
+
+const CharClass methodSymbols("AZ");
+
+// symbols of url before percent decoding
+const CharClass readUrlSymbols("%%-9==AZ__az");
+
+// symbols allowed in decoded url
+const CharClass checkUrlSymbols("  -9AZ__az");
+
+// symbols of host:port target of CONNECT
+const CharClass readAuthoritySymbols("-.09::AZaz");
+
+const CharClass readHeaderKeySymbols("--AZaz");
+
+const CharClass lineBreakSymbols("\r\r\n\n");
+
+const CharClass urlParametersEndSymbols("  \r\r\n\n");
+
+
+// names of HttpRequest::KnownHeader, in the same order
+constexpr const char *knownHeaderNames[] =
+{
+    "Host", "Content-Length", "Content-Type", "Transfer-Encoding", "Connection", "Keep-Alive",
+    "If-Modified-Since", "If-None-Match", "Range", "Accept-Encoding", "Cache-Control", "Upgrade", "Expect"
+};
+
+const int KNOWN_HEADER_COUNT = static_cast<int>(HttpRequest::KnownHeader::count);
+
+static_assert(sizeof(knownHeaderNames) / sizeof(knownHeaderNames[0]) == KNOWN_HEADER_COUNT,
+              "knownHeaderNames does not match HttpRequest::KnownHeader");
+
+const int HEADER_HASH_SIZE = 32;
+
+constexpr int toLower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+constexpr int constLength(const char *s)
+{
+    return (*s == 0) ? 0 : 1 + constLength(s + 1);
+}
+
+// header keys contain only [A-Za-z-], so result is not negative.
+constexpr int headerHash(const char *key, int length)
+{
+    return (length + toLower(key[0]) + 4 * toLower(key[length / 2]) + toLower(key[length - 1])) & (HEADER_HASH_SIZE - 1);
+}
+
+constexpr int knownHeaderHash(int index)
+{
+    return headerHash(knownHeaderNames[index], constLength(knownHeaderNames[index]));
+}
+
+constexpr bool hashDiffers(int index, int other)
+{
+    return (other >= KNOWN_HEADER_COUNT) ? true :
+           (knownHeaderHash(index) != knownHeaderHash(other) && hashDiffers(index, other + 1));
+}
+
+constexpr bool isPerfectHash(int index)
+{
+    return (index >= KNOWN_HEADER_COUNT) ? true :
+           (hashDiffers(index, index + 1) && isPerfectHash(index + 1));
+}
+
+static_assert(isPerfectHash(0), "known header names collide in headerHash, change hash coefficients");
+
+// index of known header with hash equal to slot, or -1
+constexpr int slotHeader(int slot, int index = 0)
+{
+    return (index >= KNOWN_HEADER_COUNT) ? -1 :
+           ((knownHeaderHash(index) == slot) ? index : slotHeader(slot, index + 1));
+}
+
+#define SLOT_HEADERS_4(n) slotHeader(n), slotHeader(n + 1), slotHeader(n + 2), slotHeader(n + 3)
+
+static_assert(HEADER_HASH_SIZE == 32, "hashSlots initializer must be updated");
+
+constexpr int hashSlots[HEADER_HASH_SIZE] =
+{
+    SLOT_HEADERS_4(0), SLOT_HEADERS_4(4), SLOT_HEADERS_4(8), SLOT_HEADERS_4(12),
+    SLOT_HEADERS_4(16), SLOT_HEADERS_4(20), SLOT_HEADERS_4(24), SLOT_HEADERS_4(28)
+};
+
+#undef SLOT_HEADERS_4
+
+}
 
 
 HttpRequest::HttpRequest()
 {
-    static int unused = initSymbolArrays();
-    (void)unused;
+    urlBuffer[0] = 0;
 }
 
 
-HttpRequest::~HttpRequest()
+HttpRequest::ParseResult HttpRequest::parse(const char *data, int size)
+{
+    this->data = data;
+    this->size = size;
+
+    ParseResult result = parseInternal();
+
+    if(result != ParseResult::finishOk)
+    {
+        return result;
+    }
+
+    return postParse();
+}
+
+
+HttpRequest::ParseResult HttpRequest::postParse()
+{
+    if(decodeUrl() != 0)
+    {
+        state = State::invalid;
+        return ParseResult::finishInvalid;
+    }
+    return ParseResult::finishOk;
+}
+
+
+const char* HttpRequest::getUrl() const
 {
-    if(urlBuffer != nullptr)
+    if(state != State::finishOk)
     {
-        delete[] urlBuffer;
-        urlBuffer = nullptr;
+        return nullptr;
     }
+
+    return urlBuffer;
 }
 
 
-int HttpRequest::initSymbolArrays()
+int HttpRequest::getMethod(const char **ptr, int *size) const
 {
-    for(int i = 0; i < 256 ; ++i)
+    if(state != State::finishOk)
     {
-        if((i >= 'a' && i <= 'z') ||
-           (i >= 'A' && i <= 'Z') ||
-           (i >= '0' && i <= '9') ||
-            i == '/' || i == '.' || i == '_' ||
-            i == '-' || i == ' ')
+        return -1;
+    }
+
+    *ptr = data + methodStart;
+    *size = methodLength;
+    return 0;
+}
+
+
+int HttpRequest::decodeUrl()
+{
+    if(state != State::finishOk)
+    {
+        return -1;
+    }
+
+    // authority is not encoded
+    if(isConnect())
+    {
+        if(!isAuthority(data + urlStart, urlLength) || urlLength > MAX_URL_LENGTH)
         {
-            checkUrlSymbols[i] = true;
+            return -1;
         }
-        else
+        memcpy(urlBuffer, data + urlStart, urlLength);
+        urlBuffer[urlLength] = 0;
+        return 0;
+    }
+
+    // decoded url is not longer than encoded
+    if(urlLength > 0 && urlLength <= MAX_URL_LENGTH)
+    {
+        if(percentDecodeCheck(data + urlStart, urlBuffer, urlLength) != 0)
+        {
+            return -1;
+        }
+        return 0;
+    }
+    else
+    {
+        return -1;
+    }
+}
+
+
+int HttpRequest::knownHeaderIndex(const char *key, int length)
+{
+    if(length <= 0)
+    {
+        return -1;
+    }
+
+    int index = hashSlots[headerHash(key, length)];
+
+    if(index >= 0 &&
+       strncasecmp(knownHeaderNames[index], key, length) == 0 &&
+       knownHeaderNames[index][length] == 0)
+    {
+        return index;
+    }
+
+    return -1;
+}
+
+
+int HttpRequest::getHeaderValue(KnownHeader header, const char **ptr, int *size) const
+{
+    if(state != State::finishOk)
+    {
+        return -1;
+    }
+
+    const Field &value = knownHeaders[static_cast<int>(header)];
+
+    if(value.start == 0)
+    {
+        return -1;
+    }
+
+    *ptr = data + value.start;
+    *size = value.length;
+    return 0;
+}
+
+
+int HttpRequest::getHeaderValue(const char *key, const char **ptr, int *size) const
+{
+    if(state != State::finishOk)
+    {
+        return -1;
+    }
+
+    int keyLength = strlen(key);
+
+    int index = knownHeaderIndex(key, keyLength);
+    if(index >= 0)
+    {
+        return getHeaderValue(static_cast<KnownHeader>(index), ptr, size);
+    }
+
+    for(int i = 0; i < headerCount; ++i)
+    {
+        const Header &head = headers[i];
+
+        if(head.key.length == keyLength && strncasecmp(key, data + head.key.start, keyLength) == 0)
         {
-            checkUrlSymbols[i] = false;
+            *ptr = data + head.value.start;
+            *size = head.value.length;
+            return 0;
         }
     }
 
-    for(int i = 0; i < 256 ; ++i)
+    return findOverflowHeader(key, keyLength, ptr, size);
+}
+
+
+int HttpRequest::findOverflowHeader(const char *key, int keyLength, const char **ptr, int *size) const
+{
+    const char *p = data + overflowHeaders.start;
+    const char *end = p + overflowHeaders.length;
+
+    while(p < end)
     {
-        if((i >= 'a' && i <= 'z') ||
-           (i >= 'A' && i <= 'Z') ||
-           (i >= '0' && i <= '9') ||
-            i == '/' || i == '.' || i == '_' ||
-            i == '=' || i == '-' || i == '%')
+        const char *colon = static_cast<const char*>(memchr(p, ':', end - p));
+        if(colon == nullptr)
         {
-            readUrlSymbols[i] = true;
+            break;
         }
-        else
+
+        int length = colon - p;
+
+        // same rules as readHeaderSpace
+        const char *value = colon;
+        while(value < end && (*value == ':' || *value == ' '))
+        {
+            ++value;
+        }
+
+        int valueLength = lineBreakSymbols.find(value, end - value);
+
+        if(length == keyLength && strncasecmp(key, p, keyLength) == 0)
         {
-            readUrlSymbols[i] = false;
+            *ptr = value;
+            *size = valueLength;
+            return 0;
         }
+
+        p = value + valueLength;
+        p += lineBreakSymbols.skip(p, end - p);
     }
 
-    for(int i = 0; i < 256 ; ++i)
+    return -1;
+}
+
+
+bool HttpRequest::isChunked() const
+{
+    const char *ptr;
+    int length;
+
+    if(getHeaderValue(KnownHeader::transferEncoding, &ptr, &length) != 0)
+    {
+        return false;
+    }
+
+    return isChunkedCoding(ptr, length);
+}
+
+
+bool HttpRequest::isChunkedCoding(const char *value, int length)
+{
+    const char *chunked = "chunked";
+    const int chunkedLength = 7;
+
+    for(; length > 0 && (value[length - 1] == ' ' || value[length - 1] == '\t'); --length);
+
+    if(length < chunkedLength || strncasecmp(value + length - chunkedLength, chunked, chunkedLength) != 0)
+    {
+        return false;
+    }
+
+    // "chunked" must be separate coding: "gzip, chunked"
+    return (length == chunkedLength || value[length - chunkedLength - 1] == ',' || value[length - chunkedLength - 1] == ' ');
+}
+
+
+bool HttpRequest::hasToken(const char *value, int length, const char *token)
+{
+    int tokenLength = strlen(token);
+    const char *end = value + length;
+
+    while(value < end)
     {
-        if((i >= 'A' && i <= 'Z') ||
-           (i >= 'a' && i <= 'z') || i == '-')
+        for(; value < end && (*value == ' ' || *value == '\t' || *value == ','); ++value);
+
+        const char *itemEnd = static_cast<const char*>(memchr(value, ',', end - value));
+        if(itemEnd == nullptr)
         {
-            readHeaderKeySymbols[i] = true;
+            itemEnd = end;
         }
-        else
+
+        int itemLength = itemEnd - value;
+        for(; itemLength > 0 && (value[itemLength - 1] == ' ' || value[itemLength - 1] == '\t'); --itemLength);
+
+        if(itemLength == tokenLength && strncasecmp(value, token, tokenLength) == 0)
+        {
+            return true;
+        }
+
+        value = itemEnd;
+    }
+
+    return false;
+}
+
+
+bool HttpRequest::keepAlive() const
+{
+    const char *ptr;
+    int length;
+
+    if(getHeaderValue(KnownHeader::connection, &ptr, &length) == 0)
+    {
+        if(hasToken(ptr, length, "close"))
+        {
+            return false;
+        }
+        if(hasToken(ptr, length, "keep-alive"))
+        {
+            return minorVersion >= 0;
+        }
+    }
+
+    return minorVersion >= 1;
+}
+
+
+// " HTTP/1.1\r\n" after url
+void HttpRequest::parseVersion(int length)
+{
+    const char *line = data + cur;
+    int i = 0;
+
+    for(; i < length && line[i] == ' '; ++i);
+
+    const char *version = "HTTP/1.";
+    const int versionLength = 7;
+
+    if(length - i > versionLength && strncmp(line + i, version, versionLength) == 0 &&
+       line[i + versionLength] >= '0' && line[i + versionLength] <= '9')
+    {
+        minorVersion = line[i + versionLength] - '0';
+    }
+}
+
+
+void HttpRequest::parseUrlParameters() const
+{
+    urlParameterCount = 0;
+    urlParametersOverflow = false;
+
+    int i = urlParametersStart;
+    int end = urlParametersStart + urlParametersLength;
+
+    if(i < end && data[i] == '?')
+    {
+        ++i;
+    }
+
+    while(i < end)
+    {
+        const char *ampersand = static_cast<const char*>(memchr(data + i, '&', end - i));
+        int partEnd = (ampersand != nullptr) ? static_cast<int>(ampersand - data) : end;
+
+        if(partEnd > i)
         {
-            readHeaderKeySymbols[i] = false;
+            if(urlParameterCount == MAX_URL_PARAMETERS)
+            {
+                urlParametersOverflow = true;
+                return;
+            }
+
+            Header &param = urlParameters[urlParameterCount];
+
+            const char *equal = static_cast<const char*>(memchr(data + i, '=', partEnd - i));
+
+            param.key.start = i;
+
+            if(equal != nullptr)
+            {
+                int equalIndex = static_cast<int>(equal - data);
+                param.key.length = equalIndex - i;
+                param.value.start = equalIndex + 1;
+                param.value.length = partEnd - equalIndex - 1;
+            }
+            else
+            {
+                param.key.length = partEnd - i;
+                param.value.start = 0;
+                param.value.length = 0;
+            }
+
+            ++urlParameterCount;
         }
+
+        i = partEnd + 1;
     }
+}
+
+
+int HttpRequest::getUrlParameterCount() const
+{
+    if(state != State::finishOk)
+    {
+        return -1;
+    }
+
+    if(urlParameterCount < 0)
+    {
+        parseUrlParameters();
+    }
+
+    return urlParameterCount;
+}
+
+
+int HttpRequest::getUrlParameter(int index, const char **key, int *keyLength, const char **value, int *valueLength) const
+{
+    if(index < 0 || index >= getUrlParameterCount())
+    {
+        return -1;
+    }
+
+    const Header &param = urlParameters[index];
+
+    *key = data + param.key.start;
+    *keyLength = param.key.length;
+    *value = (param.value.start == 0) ? nullptr : data + param.value.start;
+    *valueLength = param.value.length;
 
     return 0;
 }
 
 
-HttpRequest::ParseResult HttpRequest::parse(const char *data, int size)
+int HttpRequest::getUrlParameter(const char *key, const char **value, int *valueLength) const
 {
-    this->data = data;
-    this->size = size;
+    int count = getUrlParameterCount();
+    int keyLength = strlen(key);
 
-    ParseResult result = parseInternal();
+    for(int i = 0; i < count; ++i)
+    {
+        const Header &param = urlParameters[i];
 
-    if(result != ParseResult::finishOk)
+        if(compareDecoded(data + param.key.start, param.key.length, key, keyLength) == 0)
+        {
+            *value = (param.value.start == 0) ? nullptr : data + param.value.start;
+            *valueLength = param.value.length;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+
+int HttpRequest::decodeUrlParameter(const char *src, int srcLength, char *dst, int dstSize)
+{
+    int pos = 0;
+    int di = 0;
+    int c;
+
+    while((c = nextDecoded(src, srcLength, pos)) >= 0)
     {
-        return result;
+        if(di >= dstSize)
+        {
+            return -1;
+        }
+        dst[di++] = static_cast<char>(c);
     }
 
-    return postParse();
+    return di;
 }
 
 
-HttpRequest::ParseResult HttpRequest::postParse()
-{
-    if(decodeUrl() != 0)
-    {
-        state = State::invalid;
-        return ParseResult::finishInvalid;
+int HttpRequest::getNormalizedUrlParameters(char *dst, int dstSize, const char * const *exclude) const
+{
+    int count = getUrlParameterCount();
+
+    // key of request with lost parameters would match other requests
+    if(count < 0 || urlParametersOverflow || dstSize <= 0)
+    {
+        return -1;
+    }
+
+    int order[MAX_URL_PARAMETERS];
+    int orderCount = 0;
+
+    for(int i = 0; i < count; ++i)
+    {
+        const Field &key = urlParameters[i].key;
+
+        bool excluded = false;
+        for(const char * const *ex = exclude; ex != nullptr && *ex != nullptr && !excluded; ++ex)
+        {
+            excluded = (compareDecoded(data + key.start, key.length, *ex, strlen(*ex)) == 0);
+        }
+
+        if(excluded)
+        {
+            continue;
+        }
+
+        // insertion sort by key, then by value. parameter without value is before parameter with empty value.
+        int k = orderCount;
+        for(; k > 0; --k)
+        {
+            const Header &a = urlParameters[order[k - 1]];
+            const Header &b = urlParameters[i];
+
+            int cmp = compareDecoded(data + a.key.start, a.key.length, data + b.key.start, b.key.length);
+            if(cmp == 0)
+            {
+                cmp = compareDecoded(data + a.value.start, a.value.length, data + b.value.start, b.value.length);
+            }
+            if(cmp == 0)
+            {
+                cmp = (a.value.start != 0) - (b.value.start != 0);
+            }
+            if(cmp <= 0)
+            {
+                break;
+            }
+            order[k] = order[k - 1];
+        }
+        order[k] = i;
+        ++orderCount;
+    }
+
+    int di = 0;
+
+    for(int k = 0; k < orderCount; ++k)
+    {
+        const Header &param = urlParameters[order[k]];
+
+        if(k > 0)
+        {
+            if(di >= dstSize)
+            {
+                return -1;
+            }
+            dst[di++] = '&';
+        }
+
+        int length = encodeNormalized(data + param.key.start, param.key.length, dst + di, dstSize - di);
+        if(length < 0)
+        {
+            return -1;
+        }
+        di += length;
+
+        if(param.value.start != 0)
+        {
+            if(di >= dstSize)
+            {
+                return -1;
+            }
+            dst[di++] = '=';
+
+            length = encodeNormalized(data + param.value.start, param.value.length, dst + di, dstSize - di);
+            if(length < 0)
+            {
+                return -1;
+            }
+            di += length;
+        }
     }
-    if(checkUrl() != 0)
+
+    if(di >= dstSize)
     {
-        state = State::invalid;
-        return ParseResult::finishInvalid;
+        return -1;
     }
-    return ParseResult::finishOk;
+    dst[di] = 0;
+
+    return di;
 }
 
 
-const char* HttpRequest::getUrl() const
+// returns next decoded symbol of query string component or -1 at end.
+// '%' which is not followed by two hex digits is returned as is.
+int HttpRequest::nextDecoded(const char *s, int length, int &pos)
 {
-    if(state != State::finishOk)
+    if(pos >= length)
     {
-        return nullptr;
+        return -1;
     }
 
-    return urlBuffer;
-}
-
+    char c = s[pos++];
 
-int HttpRequest::decodeUrl()
-{
-    if(state != State::finishOk)
+    if(c == '+')
     {
-        return -1;
+        return ' ';
     }
 
-    if(urlLength > 0)
+    if(c == '%' && pos + 1 < length)
     {
-        if(urlBufferSize < urlLength + 1)
-        {
-            if(urlBuffer != nullptr)
-            {
-                delete[] urlBuffer;
-                urlBuffer = nullptr;
-            }
-            urlBuffer = new char[urlLength + 1];
-            urlBufferSize = urlLength + 1;
-        }
-        if(percentDecode(data + urlStart, urlBuffer, urlLength) != 0)
+        int v1 = hex2int(s[pos]);
+        int v2 = hex2int(s[pos + 1]);
+
+        if(v1 >= 0 && v2 >= 0)
         {
-            return -1;
+            pos += 2;
+            return (v1 << 4) | v2;
         }
-        return 0;
-    }
-    else
-    {
-        return -1;
     }
+
+    return static_cast<unsigned char>(c);
 }
 
 
-int HttpRequest::checkUrl() const
+int HttpRequest::compareDecoded(const char *s1, int length1, const char *s2, int length2)
 {
-    char prevChar = 0;
+    int pos1 = 0, pos2 = 0;
 
-    for(int i = 0; urlBuffer[i] != 0 ; ++i)
+    while(true)
     {
-        if(!checkUrlSymbols[static_cast<unsigned char>(urlBuffer[i])])
-        {
-            return -1;
-        }
-        if(urlBuffer[i] == '.' && urlBuffer[i] == prevChar)
+        int c1 = nextDecoded(s1, length1, pos1);
+        int c2 = nextDecoded(s2, length2, pos2);
+
+        if(c1 != c2 || c1 < 0)
         {
-            return -1;
+            return c1 - c2;
         }
-        prevChar = urlBuffer[i];
     }
-    return 0;
 }
 
 
-int HttpRequest::getHeaderValue(const char *key, const char **ptr, int *size) const
+// decodes component and encodes all symbols except unreserved ones (RFC 3986) as %XX
+int HttpRequest::encodeNormalized(const char *src, int srcLength, char *dst, int dstSize)
 {
-    if(state != State::finishOk)
-    {
-        return -1;
-    }
+    static const char hexDigits[] = "0123456789ABCDEF";
+
+    int pos = 0;
+    int di = 0;
+    int c;
 
-    for(const Header & head : headers)
+    while((c = nextDecoded(src, srcLength, pos)) >= 0)
     {
-        if(strncasecmp(key, data + head.key.start, head.key.length) == 0)
+        bool unreserved = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                          c == '-' || c == '.' || c == '_' || c == '~';
+
+        if(unreserved)
         {
-            *ptr = data + head.value.start;
-            *size = head.value.length;
-            return 0;
+            if(di >= dstSize)
+            {
+                return -1;
+            }
+            dst[di++] = static_cast<char>(c);
+        }
+        else
+        {
+            if(di + 3 > dstSize)
+            {
+                return -1;
+            }
+            dst[di++] = '%';
+            dst[di++] = hexDigits[c >> 4];
+            dst[di++] = hexDigits[c & 0xF];
         }
     }
 
-    return -1;
+    return di;
 }
 
 
@@ -198,7 +723,7 @@ time_t HttpRequest::getIfModifiedSince() const
 {
     const char *ptr;
     int length;
-    if(getHeaderValue("If-Modified-Since", &ptr, &length) == 0)
+    if(getHeaderValue(KnownHeader::ifModifiedSince, &ptr, &length) == 0)
     {
         char buf[101];
         if(length > 100)
@@ -277,13 +802,19 @@ int HttpRequest::print() const
     {
         printf("url params: [%.*s]\n", urlParametersLength, data + urlParametersStart);
     }
-    for(const Header & head : headers)
+    for(int i = 0; i < headerCount; ++i)
     {
+        const Header &head = headers[i];
         printf("[%.*s]: [%.*s]\n", head.key.length, data + head.key.start, head.value.length, data + head.value.start);
     }
+    if(overflowHeaders.length > 0)
+    {
+        printf("overflow headers:\n%.*s\n", overflowHeaders.length, data + overflowHeaders.start);
+    }
     if(contentLength > 0)
     {
-        printf("content (%d): [%.*s]\n", contentLength, contentLength, data + contentStart);
+        int printLength = (contentLength < size - contentStart) ? static_cast<int>(contentLength) : size - contentStart;
+        printf("content (%lld): [%.*s]\n", contentLength, printLength, data + contentStart);
     }
 
     return 0;
@@ -292,25 +823,21 @@ int HttpRequest::print() const
 
 HttpRequest::ReadResult HttpRequest::readMethod(int &length)
 {
-    int i = cur;
+    int i = cur + methodSymbols.skip(data + cur, size - cur);
 
-    while(i < size)
+    if(i == size)
     {
-        if(data[i] >= 'A' && data[i] <= 'Z')
-        {
-            ++i;
-        }
-        else if(data[i] == ' ')
-        {
-            length = i - cur;
-            return ReadResult::ok;
-        }
-        else
-        {
-            return ReadResult::invalid;
-        }
+        return ReadResult::needMoreData;
+    }
+    else if(data[i] == ' ')
+    {
+        length = i - cur;
+        return ReadResult::ok;
+    }
+    else
+    {
+        return ReadResult::invalid;
     }
-    return ReadResult::needMoreData;
 }
 
 
@@ -338,38 +865,34 @@ HttpRequest::ReadResult HttpRequest::readSpaces(int &length)
 
 HttpRequest::ReadResult HttpRequest::readUrl(int &length)
 {
-    int i = cur;
+    bool connect = isConnect();
 
-    while(i < size)
+    int i = cur + (connect ? readAuthoritySymbols : readUrlSymbols).skip(data + cur, size - cur);
+
+    if(i == size)
     {
-        if(readUrlSymbols[static_cast<unsigned char>(data[i])])
-        {
-            ++i;
-        }
-        else if(data[i] == ' ')
-        {
-            length = i - cur;
-            return ReadResult::ok;
-        }
-        else if(data[i] == '?')
-        {
-            length = i - cur;
-            return ReadResult::question;
-        }
-        else
-        {
-            return ReadResult::invalid;
-        }
+        return ReadResult::needMoreData;
+    }
+    else if(data[i] == ' ')
+    {
+        length = i - cur;
+        return ReadResult::ok;
+    }
+    else if(data[i] == '?' && !connect)
+    {
+        length = i - cur;
+        return ReadResult::question;
+    }
+    else
+    {
+        return ReadResult::invalid;
     }
-    return ReadResult::needMoreData;
 }
 
 
 HttpRequest::ReadResult HttpRequest::readUrlParameters(int &length)
 {
-    int i;
-
-    for(i = cur; i < size && data[i] != ' '; ++i);
+    int i = cur + urlParametersEndSymbols.find(data + cur, size - cur);
 
     if(i == size)
     {
@@ -389,9 +912,7 @@ HttpRequest::ReadResult HttpRequest::readUrlParameters(int &length)
 
 HttpRequest::ReadResult HttpRequest::readToNextLine(int &length)
 {
-    int i;
-
-    for(i = cur; i < size && data[i] != '\r' && data[i] != '\n'; ++i);
+    int i = cur + lineBreakSymbols.find(data + cur, size - cur);
 
     if(i == size)
     {
@@ -424,25 +945,21 @@ HttpRequest::ReadResult HttpRequest::readToNextLine(int &length)
 
 HttpRequest::ReadResult HttpRequest::readHeaderKey(int &length)
 {
-    int i = cur;
+    int i = cur + readHeaderKeySymbols.skip(data + cur, size - cur);
 
-    while(i < size)
+    if(i == size)
     {
-        if(readHeaderKeySymbols[static_cast<unsigned char>(data[i])])
-        {
-            ++i;
-        }
-        else if(data[i] == ':')
-        {
-            length = i - cur;
-            return ReadResult::ok;
-        }
-        else
-        {
-            return ReadResult::invalid;
-        }
+        return ReadResult::needMoreData;
+    }
+    else if(data[i] == ':')
+    {
+        length = i - cur;
+        return ReadResult::ok;
+    }
+    else
+    {
+        return ReadResult::invalid;
     }
-    return ReadResult::needMoreData;
 }
 
 
@@ -472,21 +989,15 @@ HttpRequest::ReadResult HttpRequest::readHeaderSpace(int &length)
 
 HttpRequest::ReadResult HttpRequest::readHeaderValue(int &length)
 {
-    int i = cur;
+    int i = cur + lineBreakSymbols.find(data + cur, size - cur);
 
-    while(i < size)
+    if(i == size)
     {
-        if(data[i] != '\r' && data[i] != '\n')
-        {
-            ++i;
-        }
-        else
-        {
-            length = i - cur;
-            return ReadResult::ok;
-        }
+        return ReadResult::needMoreData;
     }
-    return ReadResult::needMoreData;
+
+    length = i - cur;
+    return ReadResult::ok;
 }
 
 
@@ -534,6 +1045,7 @@ HttpRequest::ParseResult HttpRequest::parseInternal()
                 {
                     methodStart = cur;
                     methodLength = length;
+                    connect = (length == 7 && strncmp(data + cur, "CONNECT", length) == 0);
 
                     cur += length;
                     state = State::spaceAfterMethod;
@@ -590,6 +1102,8 @@ HttpRequest::ParseResult HttpRequest::parseInternal()
                     cur += length;
                     state = State::spaceAfterUrl;
                 }
+                else if(result == ReadResult::needMoreData) return ParseResult::needMoreData;
+                else return ParseResult::finishInvalid;
             }
             break;
         case State::spaceAfterUrl:
@@ -598,6 +1112,8 @@ HttpRequest::ParseResult HttpRequest::parseInternal()
 
                 if(result == ReadResult::ok)
                 {
+                    parseVersion(length);
+
                     cur += length;
                     state = State::headerKey;
                 }
@@ -644,22 +1160,57 @@ HttpRequest::ParseResult HttpRequest::parseInternal()
                     h.key = curKey;
                     h.value.start = cur;
                     h.value.length = length;
-                    headers.push_back(h);
-
-                    if(strncasecmp("Content-Length", data + h.key.start, h.key.length) == 0)
+                    if(headerCount < MAX_HEADERS)
+                    {
+                        headers[headerCount] = h;
+                        ++headerCount;
+                    }
+                    else
                     {
-                        const int BUF_CHARS = 30;
+                        if(overflowHeaders.start == 0)
+                        {
+                            overflowHeaders.start = h.key.start;
+                        }
+                        overflowHeaders.length = h.value.start + h.value.length - overflowHeaders.start;
+                    }
+
+                    int index = knownHeaderIndex(data + h.key.start, h.key.length);
 
-                        if(h.value.length > BUF_CHARS)
+                    if(index >= 0)
+                    {
+                        if(knownHeaders[index].start == 0)
+                        {
+                            knownHeaders[index] = h.value;
+                        }
+                        else if(index == static_cast<int>(KnownHeader::contentLength))
                         {
+                            // conflicting message length, possible request smuggling
                             return ParseResult::finishInvalid;
                         }
+                    }
+
+                    if(index == static_cast<int>(KnownHeader::contentLength))
+                    {
+                        // 18 digits fit in long long int
+                        const int MAX_DIGITS = 18;
 
-                        char buf[BUF_CHARS + 1];
-                        strncpy(buf, data + h.value.start, h.value.length);
-                        buf[h.value.length] = 0; // strncpy does not put 0 terminator
+                        int end = h.value.start + h.value.length;
+                        for(; end > h.value.start && (data[end - 1] == ' ' || data[end - 1] == '\t'); --end);
 
-                        contentLength = atoi(buf);
+                        if(end == h.value.start || end - h.value.start > MAX_DIGITS)
+                        {
+                            return ParseResult::finishInvalid;
+                        }
+
+                        contentLength = 0;
+                        for(int i = h.value.start; i < end; ++i)
+                        {
+                            if(data[i] < '0' || data[i] > '9')
+                            {
+                                return ParseResult::finishInvalid;
+                            }
+                            contentLength = contentLength * 10 + (data[i] - '0');
+                        }
                     }
 
                     cur += length;
@@ -680,14 +1231,16 @@ HttpRequest::ParseResult HttpRequest::parseInternal()
                 }
                 else if(result == ReadResult::endOfHeaders)
                 {
-                    if(contentLength == 0)
+                    cur += length;
+                    contentStart = cur;
+
+                    if(contentLength == 0 || !waitContent)
                     {
                         state = State::finishOk;
                         return ParseResult::finishOk;
                     }
                     else
                     {
-                        cur += length;
                         state = State::content;
                     }
                 }
@@ -699,7 +1252,6 @@ HttpRequest::ParseResult HttpRequest::parseInternal()
             {
                 if(size - cur >= contentLength)
                 {
-                    contentStart = cur;
                     state = State::finishOk;
                     return ParseResult::finishOk;
                 }
@@ -733,36 +1285,64 @@ int HttpRequest::hex2int(char c)
 }
 
 
-int HttpRequest::percentDecode(const char *src, char *dst, int srcLength)
+// decodes url and checks symbols of decoded url in one pass.
+// runs of not encoded valid symbols are found with CharClass::skip and copied at once.
+int HttpRequest::percentDecodeCheck(const char *src, char *dst, int srcLength)
 {
     int si = 0;
     int di = 0;
 
-    while(si < srcLength && src[si] != 0)
+    while(si < srcLength)
     {
-        if(src[si] == '%' && si + 2 < srcLength)
+        int run = checkUrlSymbols.skip(src + si, srcLength - si);
+
+        if(run > 0)
         {
-            int v1 = hex2int(src[si + 1]);
-            if(v1 < 0)
+            memcpy(dst + di, src + si, run);
+
+            // include previous symbol to find ".." on border of runs
+            int checkStart = (di > 0) ? di - 1 : 0;
+            if(hasDoubleDot(dst + checkStart, di + run - checkStart))
             {
                 return -1;
             }
-            int v2 = hex2int(src[si + 2]);
-            if(v2 < 0)
+
+            si += run;
+            di += run;
+
+            if(si == srcLength)
             {
-                return -1;
+                break;
             }
-            dst[di] = ((v1 << 4) | v2);
+        }
 
-            si += 3;
-            ++di;
+        if(src[si] != '%' || si + 2 >= srcLength)
+        {
+            return -1;
         }
-        else
+
+        int v1 = hex2int(src[si + 1]);
+        if(v1 < 0)
+        {
+            return -1;
+        }
+        int v2 = hex2int(src[si + 2]);
+        if(v2 < 0)
+        {
+            return -1;
+        }
+
+        char c = static_cast<char>((v1 << 4) | v2);
+
+        if(!checkUrlSymbols.contains(c) || (c == '.' && di > 0 && dst[di - 1] == '.'))
         {
-            dst[di] = src[si];
-            ++si;
-            ++di;
+            return -1;
         }
+
+        dst[di] = c;
+
+        si += 3;
+        ++di;
     }
 
     dst[di] = 0;
@@ -770,3 +1350,53 @@ int HttpRequest::percentDecode(const char *src, char *dst, int srcLength)
     return 0;
 }
 
+
+bool HttpRequest::isAuthority(const char *src, int srcLength)
+{
+    const char *colon = static_cast<const char*>(memchr(src, ':', srcLength));
+
+    if(colon == nullptr || colon == src)
+    {
+        return false;
+    }
+
+    int portLength = static_cast<int>(src + srcLength - colon - 1);
+    if(portLength < 1 || portLength > 5)
+    {
+        return false;
+    }
+
+    int port = 0;
+    for(int i = 1; i <= portLength; ++i)
+    {
+        if(colon[i] < '0' || colon[i] > '9')
+        {
+            return false;
+        }
+        port = port * 10 + (colon[i] - '0');
+    }
+
+    return port >= 1 && port <= 65535;
+}
+
+
+bool HttpRequest::hasDoubleDot(const char *s, int length)
+{
+    const char *end = s + length;
+    const char *p = s;
+
+    while((p = static_cast<const char*>(memchr(p, '.', end - p))) != nullptr)
+    {
+        ++p;
+        if(p == end)
+        {
+            return false;
+        }
+        if(*p == '.')
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
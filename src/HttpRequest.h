@@ -2,33 +2,116 @@
 #define HTTP_REQUEST_H
 
 #include <time.h>
-#include <vector>
 
+// Parsing does not allocate memory: headers and decoded url are stored inline.
 class HttpRequest
 {
 public:
     HttpRequest();
 
-    ~HttpRequest();
+    static const int MAX_URL_LENGTH = 2048;
+
+    // headers after MAX_HEADERS are kept as one raw block and searched linearly
+    static const int MAX_HEADERS = 32;
+
+    // parameters of query string after MAX_URL_PARAMETERS are not accessible
+    static const int MAX_URL_PARAMETERS = 32;
 
     enum class ParseResult
     {
         finishOk, finishInvalid, needMoreData
     };
 
+    // headers with O(1) lookup. names are in HttpRequest.cpp, in the same order.
+    enum class KnownHeader
+    {
+        host, contentLength, contentType, transferEncoding, connection, keepAlive,
+        ifModifiedSince, ifNoneMatch, range, acceptEncoding, cacheControl, upgrade, expect,
+        count
+    };
+
 
     ParseResult parse(const char *data, int size);
 
     const char* getUrl() const;
 
+    int getMethod(const char **ptr, int *size) const;
+
+    // CONNECT request, url is its authority-form target host:port. valid after request line is parsed.
+    bool isConnect() const
+    {
+        return connect;
+    }
+
     int getHeaderValue(const char *key, const char **ptr, int *size) const;
 
+    int getHeaderValue(KnownHeader header, const char **ptr, int *size) const;
+
     time_t getIfModifiedSince() const;
 
     int print() const;
 
     bool isUrlPrefix(const char *prefix) const;
 
+    // if wait is false, parse finishes after headers and content is read by caller.
+    // kept after reset.
+    void setWaitContent(bool wait)
+    {
+        waitContent = wait;
+    }
+
+    // offset of content in request data
+    int getContentStart() const
+    {
+        return contentStart;
+    }
+
+    long long int getContentLength() const
+    {
+        return contentLength;
+    }
+
+    // Transfer-Encoding is present and last transfer coding is chunked
+    bool isChunked() const;
+
+    // minor version of HTTP/1.x request line, -1 if version is not HTTP/1.x
+    int getMinorVersion() const
+    {
+        return minorVersion;
+    }
+
+    // connection is persistent: HTTP/1.1 without Connection: close or HTTP/1.0 with Connection: keep-alive
+    bool keepAlive() const;
+
+    // Primitives of header values, which are shared with HttpResponseParser.
+    // returns index of KnownHeader or -1
+    static int knownHeaderIndex(const char *key, int length);
+
+    // value is comma separated list, token is compared case insensitive
+    static bool hasToken(const char *value, int length, const char *token);
+
+    // last transfer coding of Transfer-Encoding value is chunked
+    static bool isChunkedCoding(const char *value, int length);
+
+    // Query string parameters. Table of parameters is built on first call, keys and values
+    // point into request data and are not decoded. value is nullptr if parameter has no '='.
+    // returns number of accessible parameters or -1 if request is not parsed.
+    int getUrlParameterCount() const;
+
+    int getUrlParameter(int index, const char **key, int *keyLength, const char **value, int *valueLength) const;
+
+    // key is compared with decoded parameter key
+    int getUrlParameter(const char *key, const char **value, int *valueLength) const;
+
+    // decodes %XX and '+'. returns length of decoded value or -1 if dstSize is too small.
+    static int decodeUrlParameter(const char *src, int srcLength, char *dst, int dstSize);
+
+    // Writes query string in normal form for cache keys: parameters are sorted by decoded key and value,
+    // parameters with keys from exclude (nullptr terminated array, can be nullptr) are skipped,
+    // keys and values are decoded and encoded again in one way.
+    // returns length of result (without terminating zero) or -1 if dst is too small or there are too many parameters.
+    int getNormalizedUrlParameters(char *dst, int dstSize, const char * const *exclude = nullptr) const;
+
 
 protected:
 
@@ -55,11 +138,24 @@ protected:
     ParseResult postParse();
 
     int decodeUrl();
-    int checkUrl() const;
 
-    static int percentDecode(const char *src, char *dst, int srcLength);
+    int findOverflowHeader(const char *key, int keyLength, const char **ptr, int *size) const;
+
+    void parseVersion(int length);
+
+    static int percentDecodeCheck(const char *src, char *dst, int srcLength);
+
+    // host:port with port 1-65535
+    static bool isAuthority(const char *src, int srcLength);
+    static bool hasDoubleDot(const char *s, int length);
     static int hex2int(char c);
 
+    void parseUrlParameters() const;
+
+    static int nextDecoded(const char *s, int length, int &pos);
+    static int compareDecoded(const char *s1, int length1, const char *s2, int length2);
+    static int encodeNormalized(const char *src, int srcLength, char *dst, int dstSize);
+
 public:
 
     void reset()
@@ -71,12 +167,17 @@ public:
 
         methodStart = 0;
         methodLength = 0;
+        connect = false;
 
         urlStart = 0;
         urlLength = 0;
 
         urlParametersStart = 0;
         urlParametersLength = 0;
+        urlParameterCount = -1;
+        urlParametersOverflow = false;
+
+        minorVersion = -1;
 
         contentStart = 0;
         contentLength = 0;
@@ -84,14 +185,23 @@ public:
         curKey.start = 0;
         curKey.length = 0;
 
-        headers.clear();
+        headerCount = 0;
+
+        overflowHeaders.start = 0;
+        overflowHeaders.length = 0;
+
+        urlBuffer[0] = 0;
+
+        for(Field &f : knownHeaders)
+        {
+            f.start = 0;
+            f.length = 0;
+        }
     }
 
 
 protected:
 
-    static int initSymbolArrays();
-
     int cur = 0;
     const char *data = nullptr;
     int size = 0;
@@ -100,14 +210,21 @@ protected:
     int methodStart = 0;
     int methodLength = 0;
 
+    // is kept, when data is overwritten after parse (response is read into buffer of request)
+    bool connect = false;
+
     int urlStart = 0;
     int urlLength = 0;
 
     int urlParametersStart = 0;
     int urlParametersLength = 0;
 
+    int minorVersion = -1;
+
     int contentStart = 0;
-    int contentLength = 0;
+    long long int contentLength = 0;
+
+    bool waitContent = true;
 
     struct Field
     {
@@ -123,14 +240,26 @@ protected:
 
     Field curKey;
 
-    std::vector<Header> headers;
+    Header headers[MAX_HEADERS];
+    int headerCount = 0;
+
+    // query string parameters, built by parseUrlParameters.
+    // urlParameterCount is -1 before table is built, value.start is 0 for parameter without '='.
+    mutable Header urlParameters[MAX_URL_PARAMETERS];
+    mutable int urlParameterCount = -1;
+    mutable bool urlParametersOverflow = false;
+
+    // raw text of headers, which did not fit into headers array
+    Field overflowHeaders;
+
+    static const int KNOWN_HEADER_COUNT = static_cast<int>(KnownHeader::count);
 
-    char *urlBuffer = nullptr;
-    int urlBufferSize = 0;
+    // values of known headers, start == 0 if header is not present.
+    Field knownHeaders[KNOWN_HEADER_COUNT];
 
-    static bool checkUrlSymbols[256];
-    static bool readUrlSymbols[256];
-    static bool readHeaderKeySymbols[256];
+    // decoded url. decoding can not be done in place:
+    // request buffer is forwarded to upstream as is by proxy executors.
+    char urlBuffer[MAX_URL_LENGTH + 1];
 };
 
 #endif // HTTP_REQUEST_H
@@ -65,3 +65,19 @@ int HttpResponse::notModified304(char *buffer, int size)
     return ret;
 }
 
+
+int HttpResponse::serviceUnavailable503(char *buffer, int size, int retryAfterSeconds)
+{
+    int ret = snprintf(buffer, size,
+                       "HTTP/1.1 503 Service Unavailable\r\n"
+                       "Retry-After: %d\r\n"
+                       "Content-Length: 0\r\n"
+                       "Connection: close\r\n\r\n", retryAfterSeconds);
+
+    if(ret >= size)
+    {
+        return -1;
+    }
+
+    return ret;
+}
@@ -3,7 +3,7 @@
 
 #include <time.h>
 
-enum HttpCode { ok = 200, notModified = 304, notFound = 404 };
+enum HttpCode { ok = 200, notModified = 304, notFound = 404, serviceUnavailable = 503 };
 
 class HttpResponse
 {
@@ -12,6 +12,7 @@ public:
     static int ok200(char *buffer, int size, long long int contentLength, time_t lastModified);
     static int notFound404(char *buffer, int size);
     static int notModified304(char *buffer, int size);
+    static int serviceUnavailable503(char *buffer, int size, int retryAfterSeconds);
 
 };
 
@@ -0,0 +1,334 @@
+#include <HttpResponseParser.h>
+#include <HttpRequest.h>
+
+#include <string.h>
+
+
+void HttpResponseParser::reset(bool headRequest)
+{
+    this->headRequest = headRequest;
+
+    state = State::statusLine;
+    bodyType = BodyType::untilClose;
+
+    keepAliveFlag = false;
+    chunked = false;
+    transferEncoding = false;
+    hasContentLength = false;
+    malformed = false;
+
+    status = 0;
+    contentLength = 0;
+    bodyLeft = 0;
+    parsedBytes = 0;
+
+    lineStart = 0;
+    responseStart = 0;
+    headersEnd = -1;
+
+    chunkedDecoder.reset();
+
+    lineLength = 0;
+    lineOverflow = false;
+}
+
+
+HttpResponseParser::Result HttpResponseParser::parse(const char *data, int size, int &consumed)
+{
+    int i = 0;
+
+    while(i < size && state != State::finish)
+    {
+        if(state == State::statusLine || state == State::headerLine)
+        {
+            const char *lf = static_cast<const char*>(memchr(data + i, '\n', size - i));
+            int end = (lf != nullptr) ? static_cast<int>(lf - data) : size;
+
+            int length = end - i;
+            int space = MAX_LINE - lineLength;
+
+            if(length > space)
+            {
+                length = space;
+                lineOverflow = true;
+            }
+
+            memcpy(line + lineLength, data + i, length);
+            lineLength += length;
+
+            i = end;
+
+            if(lf != nullptr)
+            {
+                ++i;
+                processLine();
+                lineLength = 0;
+                lineOverflow = false;
+                lineStart = parsedBytes + i;
+            }
+        }
+        else if(bodyType == BodyType::length)
+        {
+            long long int available = size - i;
+            int length = static_cast<int>((bodyLeft < available) ? bodyLeft : available);
+
+            i += length;
+            bodyLeft -= length;
+
+            if(bodyLeft == 0)
+            {
+                state = State::finish;
+            }
+        }
+        else if(bodyType == BodyType::chunked)
+        {
+            int chunkedConsumed = 0;
+            ChunkedDecoder::Result result = chunkedDecoder.decode(data + i, size - i, chunkedConsumed);
+
+            i += chunkedConsumed;
+
+            if(result == ChunkedDecoder::Result::finish)
+            {
+                state = State::finish;
+            }
+            else if(result == ChunkedDecoder::Result::invalid)
+            {
+                setMalformed();
+            }
+        }
+        else
+        {
+            i = size;
+        }
+    }
+
+    consumed = i;
+    parsedBytes += i;
+
+    return (state == State::finish) ? Result::finish : Result::needMoreData;
+}
+
+
+void HttpResponseParser::skipBody(long long int bytes)
+{
+    parsedBytes += bytes;
+
+    if(state == State::body && bodyType == BodyType::length)
+    {
+        bodyLeft -= bytes;
+
+        if(bodyLeft <= 0)
+        {
+            bodyLeft = 0;
+            state = State::finish;
+        }
+    }
+}
+
+
+void HttpResponseParser::processLine()
+{
+    if(lineLength > 0 && line[lineLength - 1] == '\r')
+    {
+        --lineLength;
+    }
+
+    if(state == State::statusLine)
+    {
+        // empty lines before status line are ignored
+        if(lineLength > 0)
+        {
+            processStatusLine();
+        }
+    }
+    else if(lineLength == 0)
+    {
+        finishHeaders();
+    }
+    else
+    {
+        processHeaderLine();
+    }
+}
+
+
+void HttpResponseParser::processStatusLine()
+{
+    // HTTP/1.x SSS
+    const char *version = "HTTP/1.";
+    const int versionLength = 7;
+
+    if(lineOverflow || lineLength < versionLength + 5 || strncmp(line, version, versionLength) != 0 ||
+       (line[versionLength] != '0' && line[versionLength] != '1') || line[versionLength + 1] != ' ')
+    {
+        setMalformed();
+        return;
+    }
+
+    status = 0;
+    for(int i = versionLength + 2; i < versionLength + 5; ++i)
+    {
+        if(line[i] < '0' || line[i] > '9')
+        {
+            setMalformed();
+            return;
+        }
+        status = status * 10 + (line[i] - '0');
+    }
+
+    // HTTP/1.1 connections are persistent by default
+    keepAliveFlag = (line[versionLength] == '1');
+
+    responseStart = lineStart;
+    state = State::headerLine;
+}
+
+
+void HttpResponseParser::processHeaderLine()
+{
+    const char *colon = static_cast<const char*>(memchr(line, ':', lineLength));
+
+    if(colon == nullptr)
+    {
+        setMalformed();
+        return;
+    }
+
+    int nameLength = colon - line;
+
+    const char *value = colon + 1;
+    const char *end = line + lineLength;
+
+    for(; value < end && (*value == ' ' || *value == '\t'); ++value);
+    for(; end > value && (end[-1] == ' ' || end[-1] == '\t'); --end);
+
+    int valueLength = end - value;
+
+    // names of framing headers are found by index of request headers
+    int header = HttpRequest::knownHeaderIndex(line, nameLength);
+
+    if(header == static_cast<int>(HttpRequest::KnownHeader::contentLength))
+    {
+        long long int length = 0;
+
+        if(lineOverflow || valueLength == 0 || valueLength > 18)
+        {
+            setMalformed();
+            return;
+        }
+
+        for(int i = 0; i < valueLength; ++i)
+        {
+            if(value[i] < '0' || value[i] > '9')
+            {
+                setMalformed();
+                return;
+            }
+            length = length * 10 + (value[i] - '0');
+        }
+
+        if(hasContentLength && length != contentLength)
+        {
+            setMalformed();
+            return;
+        }
+
+        hasContentLength = true;
+        contentLength = length;
+    }
+    else if(header == static_cast<int>(HttpRequest::KnownHeader::transferEncoding))
+    {
+        if(lineOverflow)
+        {
+            setMalformed();
+            return;
+        }
+
+        transferEncoding = true;
+        chunked = HttpRequest::isChunkedCoding(value, valueLength);
+    }
+    else if(header == static_cast<int>(HttpRequest::KnownHeader::connection))
+    {
+        if(lineOverflow || HttpRequest::hasToken(value, valueLength, "close"))
+        {
+            keepAliveFlag = false;
+        }
+        else if(HttpRequest::hasToken(value, valueLength, "keep-alive"))
+        {
+            keepAliveFlag = true;
+        }
+    }
+}
+
+
+void HttpResponseParser::finishHeaders()
+{
+    // interim response (100 Continue), final response follows
+    if(status >= 100 && status < 200 && status != 101)
+    {
+        state = State::statusLine;
+        chunked = false;
+        transferEncoding = false;
+        hasContentLength = false;
+        contentLength = 0;
+        return;
+    }
+
+    state = State::body;
+    headersEnd = lineStart;
+
+    if(headRequest || status == 204 || status == 304)
+    {
+        bodyType = BodyType::none;
+    }
+    else if(status == 101)
+    {
+        // connection is switched to other protocol
+        bodyType = BodyType::untilClose;
+        keepAliveFlag = false;
+    }
+    else if(transferEncoding)
+    {
+        if(chunked)
+        {
+            bodyType = BodyType::chunked;
+            chunkedDecoder.reset();
+        }
+        else
+        {
+            bodyType = BodyType::untilClose;
+            keepAliveFlag = false;
+        }
+
+        // message with both Transfer-Encoding and Content-Length is not trusted
+        if(hasContentLength)
+        {
+            keepAliveFlag = false;
+        }
+    }
+    else if(hasContentLength)
+    {
+        bodyType = BodyType::length;
+        bodyLeft = contentLength;
+    }
+    else
+    {
+        bodyType = BodyType::untilClose;
+        keepAliveFlag = false;
+    }
+
+    if(bodyType == BodyType::none || (bodyType == BodyType::length && bodyLeft == 0))
+    {
+        state = State::finish;
+    }
+}
+
+
+void HttpResponseParser::setMalformed()
+{
+    malformed = true;
+    keepAliveFlag = false;
+    headersEnd = -1;
+    bodyType = BodyType::untilClose;
+    state = State::body;
+}
@@ -0,0 +1,133 @@
+#ifndef HTTP_RESPONSE_PARSER_H
+#define HTTP_RESPONSE_PARSER_H
+
+#include <ChunkedDecoder.h>
+
+// Incremental parser of upstream response framing. Finds end of response
+// (Content-Length, chunked, no body or until close) and whether connection can be reused.
+// Only status line and framing headers are interpreted, response is not stored.
+// Data can be passed in pieces of any size. Malformed response is forwarded till upstream closes connection.
+
+class HttpResponseParser
+{
+public:
+
+    enum class Result
+    {
+        needMoreData, finish
+    };
+
+    enum class BodyType
+    {
+        none, length, chunked, untilClose
+    };
+
+    // headRequest - response to HEAD request has no body
+    void reset(bool headRequest);
+
+    // consumed - number of bytes, which belong to response.
+    // after finish bytes, which follow response, are not consumed.
+    Result parse(const char *data, int size, int &consumed);
+
+    // bytes of Content-Length body were transferred without parse (splice)
+    void skipBody(long long int bytes);
+
+    bool headersFinished() const
+    {
+        return state == State::body || state == State::finish;
+    }
+
+    bool finished() const
+    {
+        return state == State::finish;
+    }
+
+    BodyType getBodyType() const
+    {
+        return bodyType;
+    }
+
+    // bytes of Content-Length body, which are not parsed yet
+    long long int getBodyLeft() const
+    {
+        return bodyLeft;
+    }
+
+    // response is finished and upstream allows to send next request over connection
+    bool keepAlive() const
+    {
+        return finished() && keepAliveFlag;
+    }
+
+    // response could not be parsed, it is forwarded till upstream closes connection
+    bool isMalformed() const
+    {
+        return malformed;
+    }
+
+    int getStatus() const
+    {
+        return status;
+    }
+
+    // number of bytes consumed since reset
+    long long int getParsedBytes() const
+    {
+        return parsedBytes;
+    }
+
+    // offset of status line of final response (after interim responses) since reset
+    long long int getResponseStart() const
+    {
+        return responseStart;
+    }
+
+    // offset of empty line, which ends headers of final response. -1 if headers are not finished
+    // or response is malformed.
+    long long int getHeadersEnd() const
+    {
+        return headersEnd;
+    }
+
+protected:
+
+    enum class State
+    {
+        statusLine, headerLine, body, finish
+    };
+
+    void processLine();
+    void processStatusLine();
+    void processHeaderLine();
+    void finishHeaders();
+    void setMalformed();
+
+    State state = State::statusLine;
+    BodyType bodyType = BodyType::untilClose;
+
+    bool headRequest = false;
+    bool keepAliveFlag = false;
+    bool chunked = false;
+    bool transferEncoding = false;
+    bool hasContentLength = false;
+    bool malformed = false;
+
+    int status = 0;
+    long long int contentLength = 0;
+    long long int bodyLeft = 0;
+    long long int parsedBytes = 0;
+
+    long long int lineStart = 0;
+    long long int responseStart = 0;
+    long long int headersEnd = -1;
+
+    ChunkedDecoder chunkedDecoder;
+
+    // current line. only framing headers are interpreted, they fit into line.
+    static const int MAX_LINE = 256;
+    char line[MAX_LINE];
+    int lineLength = 0;
+    bool lineOverflow = false;
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef LISTEN_PARAMETERS_H
+#define LISTEN_PARAMETERS_H
+
+struct ListenParameters
+{
+    int port = 0;
+
+    // socket options of listening socket, accepted sockets inherit them.
+    // 0 - option is not set, system default is used.
+
+    int tcpNoDelay = 0;
+
+    // limit of unsent bytes in socket send queue. socket is reported writable
+    // only when less data is queued, so slow clients do not hold large kernel buffers.
+    int tcpNotSentLowat = 0;
+
+    int sendBufferSize = 0;
+    int receiveBufferSize = 0;
+
+    // connection is accepted only after client sent data
+    int tcpDeferAcceptSeconds = 0;
+
+    // length of queue of pending TCP fast open requests
+    int tcpFastOpenQueue = 0;
+};
+
+#endif
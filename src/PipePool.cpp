@@ -0,0 +1,158 @@
+#include <PipePool.h>
+#include <Log.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+
+int PipePool::init(int maxPipes, int pipeSize, Log *log)
+{
+    destroy();
+
+    this->maxPipes = maxPipes;
+    this->pipeSize = pipeSize;
+    this->log = log;
+
+    pipes.reserve(maxPipes);
+
+    for(int i = 0; i < maxPipes; ++i)
+    {
+        Pipe p;
+
+        p.capacity = create(p.readFd, p.writeFd);
+        if(p.capacity < 0)
+        {
+            return -1;
+        }
+
+        pipes.push_back(p);
+    }
+
+    return 0;
+}
+
+
+int PipePool::get(int &readFd, int &writeFd)
+{
+    if(!pipes.empty())
+    {
+        Pipe p = pipes.back();
+        pipes.pop_back();
+
+        readFd = p.readFd;
+        writeFd = p.writeFd;
+        return p.capacity;
+    }
+
+    return create(readFd, writeFd);
+}
+
+
+void PipePool::put(int readFd, int writeFd, int capacity)
+{
+    if(static_cast<int>(pipes.size()) < maxPipes && drain(readFd))
+    {
+        Pipe p;
+        p.readFd = readFd;
+        p.writeFd = writeFd;
+        p.capacity = capacity;
+
+        pipes.push_back(p);
+        return;
+    }
+
+    close(readFd);
+    close(writeFd);
+}
+
+
+void PipePool::destroy()
+{
+    for(const Pipe &p : pipes)
+    {
+        close(p.readFd);
+        close(p.writeFd);
+    }
+
+    pipes.clear();
+
+    if(devNullFd >= 0)
+    {
+        close(devNullFd);
+        devNullFd = -1;
+    }
+}
+
+
+int PipePool::create(int &readFd, int &writeFd)
+{
+    int pipeFd[2];
+
+    if(pipe2(pipeFd, O_NONBLOCK) != 0)
+    {
+        log->error("pipe2 failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    readFd = pipeFd[0];
+    writeFd = pipeFd[1];
+
+    // when size is above pipe-max-size or pipe memory limit of user is reached, default size is kept
+    if(fcntl(writeFd, F_SETPIPE_SZ, pipeSize) < 0 && !sizeWarning)
+    {
+        log->warning("F_SETPIPE_SZ %d failed: %s\n", pipeSize, strerror(errno));
+        sizeWarning = true;
+    }
+
+    int capacity = fcntl(writeFd, F_GETPIPE_SZ);
+    if(capacity <= 0)
+    {
+        log->error("F_GETPIPE_SZ failed: %s\n", strerror(errno));
+        close(readFd);
+        close(writeFd);
+        return -1;
+    }
+
+    return capacity;
+}
+
+
+bool PipePool::drain(int readFd)
+{
+    int bytes = 0;
+
+    if(ioctl(readFd, FIONREAD, &bytes) != 0)
+    {
+        return false;
+    }
+
+    if(bytes == 0)
+    {
+        return true;
+    }
+
+    if(devNullFd < 0)
+    {
+        devNullFd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        if(devNullFd < 0)
+        {
+            log->error("open /dev/null failed: %s\n", strerror(errno));
+            return false;
+        }
+    }
+
+    while(bytes > 0)
+    {
+        ssize_t moved = splice(readFd, NULL, devNullFd, NULL, bytes, SPLICE_F_NONBLOCK);
+        if(moved <= 0)
+        {
+            return false;
+        }
+        bytes -= static_cast<int>(moved);
+    }
+
+    return ioctl(readFd, FIONREAD, &bytes) == 0 && bytes == 0;
+}
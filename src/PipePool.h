@@ -0,0 +1,67 @@
+#ifndef PIPE_POOL_H
+#define PIPE_POOL_H
+
+#include <vector>
+
+class Log;
+
+// Pipes for splice, kept by poll loop and reused by executors. Every poll loop has own pool, no locks are used.
+// Pipes are resized to configured capacity once, when they are created.
+// Returned pipe is drained, pipe which can not be drained is closed.
+
+class PipePool
+{
+public:
+    PipePool() = default;
+
+    ~PipePool()
+    {
+        destroy();
+    }
+
+    PipePool(const PipePool &pool) = delete;
+    PipePool(PipePool &&pool) = delete;
+    PipePool& operator=(const PipePool &pool) = delete;
+    PipePool& operator=(PipePool && pool) = delete;
+
+    // creates maxPipes pipes with capacity pipeSize
+    int init(int maxPipes, int pipeSize, Log *log);
+
+    // returns capacity of pipe or -1
+    int get(int &readFd, int &writeFd);
+
+    // pipe is kept in pool or closed if pool is full
+    void put(int readFd, int writeFd, int capacity);
+
+    void destroy();
+
+protected:
+
+    // returns capacity of new pipe or -1
+    int create(int &readFd, int &writeFd);
+
+    // moves data left in pipe to /dev/null
+    bool drain(int readFd);
+
+    struct Pipe
+    {
+        int readFd;
+        int writeFd;
+        int capacity;
+    };
+
+    std::vector<Pipe> pipes;
+
+    int maxPipes = 0;
+    int pipeSize = 0;
+
+    // is opened when pipe with data is returned
+    int devNullFd = -1;
+
+    // capacity is reduced by kernel limits, warning is written once
+    bool sizeWarning = false;
+
+    Log *log = nullptr;
+};
+
+#endif
@@ -18,10 +18,13 @@ struct PollData
     {
         fd = -1;
         execData = nullptr;
+        events = 0;
     }
 
     int fd = -1;
     ExecutorData *execData = nullptr;
+    // events of last add or edit, without EPOLLRDHUP and EPOLLERR
+    int events = 0;
 
     BlockStorage<PollData>::ServiceData blockStorageData;
 };
@@ -3,6 +3,7 @@
 
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <string.h>
 
 
@@ -42,6 +43,13 @@ int PollLoop::init(ServerBase *srv, ServerParameters *params)
         return -1;
     }
 
+    timerExecutor.init(this);
+    if(createTimerFd() != 0)
+    {
+        destroy();
+        return -1;
+    }
+
     serverExecutor.init(this);
     requestExecutor.init(this);
     fileExecutor.init(this);
@@ -54,6 +62,13 @@ int PollLoop::init(ServerBase *srv, ServerParameters *params)
     sslProxyExecutor.init(this);
 #endif
 
+    long long int curMillis = getMilliseconds();
+
+    for(decltype(params->proxies)::size_type i = 0; i < params->proxies.size(); ++i)
+    {
+        upstreamGroups[i].prewarm(curMillis);
+    }
+
     return 0;
 }
 
@@ -85,6 +100,11 @@ int PollLoop::run()
 
         long long int curMillis = getMilliseconds();
 
+        // after iteration budget is spent, bulk transfers are skipped and wait for next epoll_wait,
+        // so executors which read requests are not delayed by large responses.
+        // epoll is level triggered, skipped fds are reported again.
+        bool budgetSpent = false;
+
         for(int i = 0; i < nEvents; ++i)
         {
             PollData *pollData = static_cast<PollData*>(events[i].data.ptr);
@@ -98,45 +118,47 @@ int PollLoop::run()
 
             if(execData->state != ExecutorData::State::invalid)
             {
-                if(((events[i].events & EPOLLRDHUP) || (events[i].events & EPOLLERR)) && pollData->fd == execData->fd0)
+                bool bulkTransfer = execData->isBulkTransfer();
+
+                if(budgetSpent && bulkTransfer && !(events[i].events & (EPOLLRDHUP | EPOLLERR)))
+                {
+                    continue;
+                }
+
+                // tunnel reads rest of bytes of client till end of file and forwards both directions before it ends
+                if(((events[i].events & EPOLLRDHUP) || (events[i].events & EPOLLERR)) && pollData->fd == execData->fd0 &&
+                   execData->state != ExecutorData::State::tunnel)
                 {
                     log->debug("received EPOLLRDHUP or EPOLLERR event on fd\n");
-                    removeExecutorData(execData);
+                    if(!execData->pExecutor->detachClient(*execData))
+                    {
+                        removeExecutorData(execData);
+                    }
                 }
                 else
                 {
                     ProcessResult result = execData->pExecutor->process(*execData, pollData->fd, events[i].events);
 
-                    if(result == ProcessResult::removeExecutorOk)
-                    {
-                        removeExecutorData(execData);
-                    }
-                    else if(result == ProcessResult::removeExecutorError)
-                    {
-                        execData->writeLog(log, Log::Level::warning, "removeExecutorError");
-                        removeExecutorData(execData);
-                    }
-                    else if(result == ProcessResult::shutdown)
+                    if(finishProcess(execData, result, curMillis) != 0)
                     {
                         destroy();
                         return -1;
                     }
-                    else
-                    {
-                        if(execData->retryCounter > ExecutorData::MAX_RETRY_COUNTER)
-                        {
-                            log->warning("retryCounter > MAX_RETRY_COUNTER. destroy executor\n");
-                            removeExecutorData(execData);
-                        }
-                        else
-                        {
-                            execData->lastProcessTime = curMillis;
-                        }
-                    }
+                }
+
+                if(bulkTransfer && parameters->iterationBudgetMillis > 0 && !budgetSpent)
+                {
+                    budgetSpent = (getMilliseconds() - curMillis >= parameters->iterationBudgetMillis);
                 }
             }
         }
 
+        if(startQueuedRequests(curMillis) != 0)
+        {
+            destroy();
+            return -1;
+        }
+
         if(curMillis - lastCheckTimeoutMillis >= parameters->executorTimeoutMillis)
         {
             checkTimeout(curMillis);
@@ -152,6 +174,62 @@ int PollLoop::run()
 }
 
 
+// returns -1 if loop is shut down
+int PollLoop::finishProcess(ExecutorData *execData, ProcessResult result, long long int curMillis)
+{
+    if(result == ProcessResult::removeExecutorOk)
+    {
+        removeExecutorData(execData);
+    }
+    else if(result == ProcessResult::removeExecutorError)
+    {
+        execData->writeLog(log, Log::Level::warning, "removeExecutorError");
+        removeExecutorData(execData);
+    }
+    else if(result == ProcessResult::shutdown)
+    {
+        return -1;
+    }
+    else
+    {
+        if(execData->retryCounter > ExecutorData::MAX_RETRY_COUNTER)
+        {
+            log->warning("retryCounter > MAX_RETRY_COUNTER. destroy executor\n");
+            removeExecutorData(execData);
+        }
+        else
+        {
+            execData->lastProcessTime = curMillis;
+        }
+    }
+
+    return 0;
+}
+
+
+// requests, which wait for backends under limit, are started after backends finished requests of iteration.
+// requests, which waited longer than queue timeout, are rejected.
+int PollLoop::startQueuedRequests(long long int curMillis)
+{
+    for(decltype(parameters->proxies)::size_type i = 0; i < parameters->proxies.size(); ++i)
+    {
+        ExecutorData *execData;
+
+        while((execData = upstreamGroups[i].dequeue(curMillis)) != nullptr)
+        {
+            ProcessResult result = execData->pExecutor->process(*execData, execData->fd0, 0);
+
+            if(finishProcess(execData, result, curMillis) != 0)
+            {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
 void PollLoop::stop()
 {
     runFlag.store(false);
@@ -159,7 +237,7 @@ void PollLoop::stop()
 }
 
 
-int PollLoop::enqueueClientFd(int fd, ExecutorType execType)
+int PollLoop::enqueueClientFd(int fd, ExecutorType execType, long long int acceptTime)
 {
     {
         std::lock_guard<std::mutex> lock(newFdsMutex);
@@ -167,6 +245,7 @@ int PollLoop::enqueueClientFd(int fd, ExecutorType execType)
         NewFdData fdData;
         fdData.fd = fd;
         fdData.execType = execType;
+        fdData.acceptTime = acceptTime;
 
         if(!newFdsQueue.push(fdData))
         {
@@ -185,7 +264,7 @@ int PollLoop::checkNewFd()
     NewFdData fdData;
     while(newFdsQueue.pop(fdData))
     {
-        if(createRequestExecutorInternal(fdData.fd, fdData.execType) != 0)
+        if(createRequestExecutorInternal(fdData.fd, fdData.execType, fdData.acceptTime) != 0)
         {
             close(fdData.fd);
         }
@@ -194,22 +273,41 @@ int PollLoop::checkNewFd()
 }
 
 
-int PollLoop::createRequestExecutor(int fd, ExecutorType execType)
+int PollLoop::checkTimers()
+{
+    long long int curMillis = getMilliseconds();
+
+    serverExecutor.onTimer(curMillis);
+
+    for(decltype(parameters->proxies)::size_type i = 0; i < parameters->proxies.size(); ++i)
+    {
+        upstreamGroups[i].onTimer(curMillis);
+    }
+
+#ifdef USE_SSL
+    sslServerExecutor.onTimer(curMillis);
+#endif
+
+    return 0;
+}
+
+
+int PollLoop::createRequestExecutor(int fd, ExecutorType execType, long long int acceptTime)
 {
     if(parameters->threadCount == 1)
     {
-        return createRequestExecutorInternal(fd, execType);
+        return createRequestExecutorInternal(fd, execType, acceptTime);
     }
     else
     {
-        return srv->createRequestExecutor(fd, execType);
+        return srv->createRequestExecutor(fd, execType, acceptTime);
     }
 }
 
 
 int PollLoop::addPollFd(ExecutorData &data, int fd, int events)
 {
-    if(fd != data.fd0 && fd != data.fd1)
+    if(fd != data.fd0 && fd != data.fd1 && fd != data.fd2)
     {
         log->error("addPollFd invalid fd argument\n");
         return -1;
@@ -227,6 +325,12 @@ int PollLoop::addPollFd(ExecutorData &data, int fd, int events)
         return -1;
     }
 
+    if(fd == data.fd2 && data.pollData2 != nullptr)
+    {
+        log->error("addPollFd: pollData2 != nullptr\n");
+        return -1;
+    }
+
 
     PollData *pollData = pollDatas.allocate();
     if(pollData == nullptr)
@@ -250,6 +354,7 @@ int PollLoop::addPollFd(ExecutorData &data, int fd, int events)
 
     pollData->fd = fd;
     pollData->execData = &data;
+    pollData->events = events;
 
     if(fd == data.fd0)
     {
@@ -259,6 +364,10 @@ int PollLoop::addPollFd(ExecutorData &data, int fd, int events)
     {
         data.pollData1 = pollData;
     }
+    else
+    {
+        data.pollData2 = pollData;
+    }
 
     return 0;
 }
@@ -275,6 +384,10 @@ int PollLoop::editPollFd(ExecutorData &data, int fd, int events)
     {
         pollData = data.pollData1;
     }
+    else if(fd == data.fd2)
+    {
+        pollData = data.pollData2;
+    }
 
     if(pollData == nullptr)
     {
@@ -291,6 +404,8 @@ int PollLoop::editPollFd(ExecutorData &data, int fd, int events)
         return -1;
     }
 
+    pollData->events = events;
+
     return 0;
 }
 
@@ -307,6 +422,10 @@ int PollLoop::removePollFd(ExecutorData &data, int fd)
     {
         pollData = data.pollData1;
     }
+    else if(fd == data.fd2)
+    {
+        pollData = data.pollData2;
+    }
 
     if(pollData == nullptr)
     {
@@ -332,17 +451,21 @@ int PollLoop::removePollFd(ExecutorData &data, int fd)
     {
         data.pollData1 = nullptr;
     }
+    else if(pollData == data.pollData2)
+    {
+        data.pollData2 = nullptr;
+    }
 
     return 0;
 }
 
 
-int PollLoop::listenPort(int port, ExecutorType execType)
+int PollLoop::listenPort(const ListenParameters &listen, ExecutorType execType)
 {
     ExecutorData *pExecData = createExecutorData();
 
     pExecData->pExecutor = getExecutor(execType);
-    pExecData->port = port;
+    pExecData->listen = &listen;
 
 
     if(pExecData->pExecutor->up(*pExecData) != 0)
@@ -362,11 +485,28 @@ void PollLoop::checkTimeout(long long int curMillis)
     for(ExecutorData *execData = execDatas.head();
         execData != nullptr; execData = execDatas.next(execData))
     {
-        if(execData->removeOnTimeout)
+        if(execData->state == ExecutorData::State::tunnel)
+        {
+            // tunnel has no time to live, it is closed only when it is idle
+            if(curMillis - execData->lastProcessTime > execData->proxy->tunnelIdleTimeoutMillis)
+            {
+                removeExecDatas.push_back(execData);
+                execData->writeLog(log, Log::Level::debug, "idle tunnel remove executor");
+            }
+        }
+        else if(execData->removeOnTimeout)
         {
             if((curMillis - execData->lastProcessTime > parameters->executorTimeoutMillis) ||
                     (curMillis - execData->createTime > ExecutorData::MAX_TIME_TO_LIVE_MILLIS))
             {
+                // executor without client gets time to finish its upstream
+                if(curMillis - execData->createTime <= ExecutorData::MAX_TIME_TO_LIVE_MILLIS &&
+                   execData->pExecutor->detachClient(*execData))
+                {
+                    execData->lastProcessTime = curMillis;
+                    continue;
+                }
+
                 removeExecDatas.push_back(execData);
                 execData->writeLog(log, Log::Level::debug, "timeout remove executor");
             }
@@ -409,10 +549,49 @@ int PollLoop::createEventFd()
 }
 
 
+int PollLoop::createTimerFd()
+{
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+
+    if(timerFd < 0)
+    {
+        log->error("timerfd_create failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = TIMER_INTERVAL_MILLIS / 1000;
+    spec.it_interval.tv_nsec = (TIMER_INTERVAL_MILLIS % 1000) * 1000000;
+    spec.it_value = spec.it_interval;
+
+    if(timerfd_settime(timerFd, 0, &spec, nullptr) != 0)
+    {
+        log->error("timerfd_settime failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    ExecutorData *execData = createExecutorData();
+    execData->fd0 = timerFd;
+    execData->pExecutor = &timerExecutor;
+
+    if(addPollFd(*execData, execData->fd0, EPOLLIN) != 0)
+    {
+        removeExecutorData(execData);
+        return -1;
+    }
+
+    execData->pExecutor->up(*execData);
+
+    return 0;
+}
+
+
 void PollLoop::destroy()
 {
     execDatas.destroy();
     pollDatas.destroy();
+    upstreamGroups.reset();
+    pipePool.destroy();
 
     if(epollFd > 0)
     {
@@ -424,15 +603,47 @@ void PollLoop::destroy()
         close(eventFd);
         eventFd = -1;
     }
+    if(timerFd > 0)
+    {
+        close(timerFd);
+        timerFd = -1;
+    }
 }
 
 
 int PollLoop::initDataStructs(const ServerParameters *params)
 {
+    upstreamGroups.reset(new UpstreamGroup[params->proxies.size()]);
+
+#ifdef USE_SSL
+    SSL_CTX *upstreamSslCtx = srv->upstreamSslCtx;
+#else
+    SSL_CTX *upstreamSslCtx = nullptr;
+#endif
+
+    for(decltype(params->proxies)::size_type i = 0; i < params->proxies.size(); ++i)
+    {
+        if(upstreamGroups[i].init(&params->proxies[i], &srv->resolver, upstreamSslCtx, log) != 0)
+        {
+            return -1;
+        }
+    }
+
+    if(pipePool.init(params->pipePoolSize, params->pipeSize, log) != 0)
+    {
+        return -1;
+    }
+
     return 0;
 }
 
 
+UpstreamGroup* PollLoop::getUpstreamGroup(const ProxyParameters &proxy)
+{
+    return &upstreamGroups[proxy.index];
+}
+
+
 Executor* PollLoop::getExecutor(ExecutorType execType)
 {
     switch(execType)
@@ -494,6 +705,10 @@ void PollLoop::removeExecutorData(ExecutorData *execData)
     {
         removePollFd(*execData, execData->fd1);
     }
+    if(execData->pollData2 != nullptr)
+    {
+        removePollFd(*execData, execData->fd2);
+    }
 
     execData->down();
 
@@ -501,7 +716,7 @@ void PollLoop::removeExecutorData(ExecutorData *execData)
 }
 
 
-int PollLoop::createRequestExecutorInternal(int fd, ExecutorType execType)
+int PollLoop::createRequestExecutorInternal(int fd, ExecutorType execType, long long int acceptTime)
 {
     ExecutorData *pExecData = createExecutorData();
 
@@ -512,6 +727,7 @@ int PollLoop::createRequestExecutorInternal(int fd, ExecutorType execType)
 
     pExecData->pExecutor = getExecutor(execType);
     pExecData->fd0 = fd;
+    pExecData->acceptTime = acceptTime;
 
     if(pExecData->pExecutor->up(*pExecData) != 0)
     {
@@ -545,6 +761,16 @@ int PollLoop::closeFd(ExecutorData &data, int fd)
         data.fd1 = -1;
         return 0;
     }
+    else if(fd == data.fd2)
+    {
+        if(data.pollData2 != nullptr)
+        {
+            removePollFd(data, data.fd2);
+        }
+        close(data.fd2);
+        data.fd2 = -1;
+        return 0;
+    }
 
     log->error("closeFd - invalid arguments\n");
     return -1;
@@ -4,6 +4,7 @@
 #include <PollLoopBase.h>
 
 #include <NewFdExecutor.h>
+#include <TimerExecutor.h>
 #include <ServerExecutor.h>
 #include <RequestExecutor.h>
 #include <FileExecutor.h>
@@ -23,6 +24,7 @@
 #include <sys/epoll.h>
 #include <atomic>
 #include <mutex>
+#include <memory>
 #include <boost/lockfree/spsc_queue.hpp>
 
 
@@ -42,11 +44,20 @@ public:
 
     void stop();
 
-    int enqueueClientFd(int fd, ExecutorType execType);
+    int enqueueClientFd(int fd, ExecutorType execType, long long int acceptTime);
 
     int checkNewFd() override;
 
-    int createRequestExecutor(int fd, ExecutorType execType) override;
+    int checkTimers() override;
+
+    UpstreamGroup* getUpstreamGroup(const ProxyParameters &proxy) override;
+
+    PipePool* getPipePool() override
+    {
+        return &pipePool;
+    }
+
+    int createRequestExecutor(int fd, ExecutorType execType, long long int acceptTime) override;
 
     int addPollFd(ExecutorData &data, int fd, int events) override;
 
@@ -56,7 +67,7 @@ public:
 
     int closeFd(ExecutorData &data, int fd) override;
 
-    int listenPort(int port, ExecutorType execType);
+    int listenPort(const ListenParameters &listen, ExecutorType execType);
 
     int numberOfPollFds() const;
 
@@ -64,8 +75,14 @@ protected:
 
     void checkTimeout(long long int curMillis);
 
+    int finishProcess(ExecutorData *execData, ProcessResult result, long long int curMillis);
+
+    int startQueuedRequests(long long int curMillis);
+
     int createEventFd();
 
+    int createTimerFd();
+
     void destroy();
 
     int initDataStructs(const ServerParameters *params);
@@ -76,7 +93,7 @@ protected:
 
     void removeExecutorData(ExecutorData *execData) override;
 
-    int createRequestExecutorInternal(int fd, ExecutorType execType);
+    int createRequestExecutorInternal(int fd, ExecutorType execType, long long int acceptTime);
 
     void logStats();
 
@@ -84,6 +101,7 @@ protected:
 protected:
 
     NewFdExecutor newFdExecutor;
+    TimerExecutor timerExecutor;
     ServerExecutor serverExecutor;
     RequestExecutor requestExecutor;
     FileExecutor fileExecutor;
@@ -99,6 +117,12 @@ protected:
     BlockStorage<ExecutorData> execDatas;
     BlockStorage<PollData> pollDatas;
 
+    // one group for every ServerParameters::proxies entry
+    std::unique_ptr<UpstreamGroup[]> upstreamGroups;
+
+    // pipes of proxy executors, are returned by ExecutorData::down, so pool is destroyed after execDatas
+    PipePool pipePool;
+
 
     static const int MAX_EPOLL_EVENTS = 1000;
     epoll_event events[MAX_EPOLL_EVENTS];
@@ -110,6 +134,7 @@ protected:
     {
         ExecutorType execType;
         int fd;
+        long long int acceptTime;
     };
 
     boost::lockfree::spsc_queue<NewFdData, boost::lockfree::capacity<1000>> newFdsQueue;
@@ -118,6 +143,7 @@ protected:
 
     int epollFd = -1;
     int eventFd = -1;
+    int timerFd = -1;
 
     long long int lastCheckTimeoutMillis = 0;
 
@@ -6,6 +6,8 @@
 #include <ExecutorType.h>
 #include <ExecutorData.h>
 #include <ServerParameters.h>
+#include <UpstreamGroup.h>
+#include <PipePool.h>
 
 
 class PollLoopBase
@@ -22,8 +24,15 @@ public:
 
     virtual int closeFd(ExecutorData &data, int fd) = 0;
 
-    virtual int createRequestExecutor(int fd, ExecutorType execType) = 0;
+    virtual int createRequestExecutor(int fd, ExecutorType execType, long long int acceptTime) = 0;
     virtual int checkNewFd() = 0;
+    virtual int checkTimers() = 0;
+
+    virtual UpstreamGroup* getUpstreamGroup(const ProxyParameters &proxy) = 0;
+
+    virtual PipePool* getPipePool() = 0;
+
+    static const int TIMER_INTERVAL_MILLIS = 50;
 
 
     Log *log = nullptr;
@@ -5,17 +5,129 @@
 #include <SocketType.h>
 
 #include <string>
+#include <vector>
 
-struct ProxyParameters
+struct BackendParameters
 {
-    std::string prefix;
     std::string address;
     int port = 0;
 
+    SocketType socketType = SocketType::none;
+
+    // share of requests relative to other backends of proxy
+    int weight = 1;
+
+    // limit of requests in flight to backend per poll loop, -1 - limit of proxy is used
+    int maxInFlight = -1;
+};
+
+enum class BalancePolicy
+{
+    roundRobin, leastOutstanding, ewma, hash
+};
+
+enum class HashKeyType
+{
+    path, header, cookie
+};
+
+struct ProxyParameters
+{
+    std::string prefix;
+
+    std::vector<BackendParameters> backends;
+
+    BalancePolicy balance = BalancePolicy::roundRobin;
+
+    // key of consistent hash, name is set for header and cookie
+    HashKeyType hashKeyType = HashKeyType::path;
+    std::string hashKeyName;
+
     // is declared int, because bitwise operations are performed with value
     int connectionType = (int)ConnectionType::none;
 
-    SocketType socketType = SocketType::none;
+    // position in ServerParameters::proxies
+    int index = 0;
+
+    // max idle keep-alive connections to backend per poll loop. 0 - connections are not reused.
+    int poolSize = 16;
+    // idle connection is closed after timeout, should be less than keep-alive timeout of backend
+    int poolIdleTimeoutMillis = 4000;
+    // connection is not reused after max age. 0 - no limit.
+    int poolMaxAgeMillis = 60000;
+    // connections to every backend opened by every poll loop at startup
+    int poolPrewarm = 0;
+
+    // backend is ejected after maxFails consecutive failed connects or responses. 0 - disabled.
+    int maxFails = 3;
+    // ejected backend gets requests again after timeout, if active health checks are disabled
+    int failTimeoutMillis = 10000;
+    // active health check: connect to backend or GET healthCheckPath, if it is set. 0 - disabled.
+    int healthCheckIntervalMillis = 0;
+    int healthCheckTimeoutMillis = 1000;
+    std::string healthCheckPath;
+    // weight of recovered backend grows from 10% to full weight during this time. 0 - disabled.
+    int slowStartMillis = 0;
+
+    // failed connect is retried with other backend up to this number of times. 0 - disabled.
+    int retryAttempts = 1;
+    // retries and hedged requests are limited to this share of requests, in percents
+    int retryBudgetPercent = 20;
+    // GET and HEAD requests, which have no response headers after this percentile of response times,
+    // are sent to other backend too, first response is used. 0 - disabled.
+    int hedgePercentile = 0;
+    // hedged request is not sent earlier. it is delay of hedging, till response times are collected.
+    int hedgeMinDelayMillis = 20;
+
+    // requests in flight to every backend per poll loop. 0 - no limit.
+    int maxInFlight = 0;
+    // limit is lowered, when response times grow, and raised back up to maxInFlight, when they recover
+    bool maxInFlightAdaptive = false;
+    // requests, which wait for backend under limit, per poll loop. full queue and timeout are answered with 503.
+    int queueSize = 100;
+    int queueTimeoutMillis = 1000;
+
+    // responses to GET requests are stored in ResponseCache of server
+    bool cache = false;
+    // request headers, which are added to cache key
+    std::vector<std::string> cacheKeyHeaders;
+    // larger responses are not stored
+    int cacheMaxEntryBytes = 1024 * 1024;
+    // freshness of response without max-age and Expires. 0 - such responses are not stored.
+    int cacheDefaultSeconds = 0;
+    // time stale response is served while it is revalidated, if response does not set stale-while-revalidate
+    int cacheStaleSeconds = 0;
+    // requests, which miss cache while same response is received from upstream, wait for it.
+    // only responses with Content-Length up to cacheMaxEntryBytes are shared, they come at speed of first client.
+    bool cacheCollapse = true;
+    // responses, which are larger than cacheMaxEntryBytes, are stored in disk cache up to this size. 0 - disabled.
+    int cacheDiskMaxEntryBytes = 256 * 1024 * 1024;
+
+    // request and response bodies of known size, which are shorter, are copied through buffer of executor,
+    // longer bodies and bodies till close are spliced. 0 - all bodies are spliced.
+    int spliceMinBytes = 16384;
+
+    // response is read from upstream as fast as backend sends it, bytes, which client did not receive yet,
+    // are kept in memory up to bufferMemoryBytes and then in file up to bufferFileMaxBytes.
+    // upstream connection is released, when response is read, not when client received it.
+    bool bufferResponse = false;
+    int bufferMemoryBytes = 1024 * 1024;
+    int bufferFileMaxBytes = 256 * 1024 * 1024;
+
+    // connection, which is switched to other protocol (101 response to Upgrade request, 2xx response to CONNECT),
+    // is forwarded in both directions till one side closes it or it is idle for this time. 0 - tunnels are disabled.
+    int tunnelIdleTimeoutMillis = 300000;
+    // CONNECT requests (target host:port, not path) are forwarded to backends of first proxy with connect,
+    // backends are forward proxies, which open tunnels to target.
+    bool connect = false;
+
+    // backends are connected with TLS. sessions are resumed on new connections, idle connections are pooled
+    // after handshake. bodies of TLS connections are not spliced, except request body with kTLS send offload.
+    bool tls = false;
+    // certificate of backend is checked with CA certificates of ServerParameters::upstreamTlsCaFile
+    bool tlsVerify = true;
+    // name for SNI and certificate check. empty - address of backend, if it is host name.
+    std::string tlsServerName;
 };
 
 #endif
@@ -0,0 +1,153 @@
+#include <ProxyRoutes.h>
+#include <ProxyParameters.h>
+
+
+void ProxyRoutes::build(const std::vector<ProxyParameters> &proxies)
+{
+    nodes.clear();
+    nodes.emplace_back();
+
+    connectProxy = -1;
+
+    for(const ProxyParameters &proxy : proxies)
+    {
+        if(proxy.connect && connectProxy < 0)
+        {
+            connectProxy = proxy.index;
+        }
+
+        std::string::size_type start = proxy.prefix.find_first_not_of('/');
+        std::string::size_type end = proxy.prefix.find_last_not_of('/');
+
+        if(start == std::string::npos)
+        {
+            insert(std::string(), proxy.index);
+        }
+        else
+        {
+            insert(proxy.prefix.substr(start, end - start + 1), proxy.index);
+        }
+    }
+}
+
+
+void ProxyRoutes::insert(const std::string &prefix, int proxy)
+{
+    int current = 0;
+    std::string::size_type pos = 0;
+
+    while(pos < prefix.size())
+    {
+        int child = findChild(nodes[current], prefix[pos]);
+
+        if(child < 0)
+        {
+            Node node;
+            node.label = prefix.substr(pos);
+            node.proxy = proxy;
+
+            nodes.push_back(node);
+            child = static_cast<int>(nodes.size()) - 1;
+
+            std::vector<int> &children = nodes[current].children;
+            std::vector<int>::size_type i = 0;
+            for(; i < children.size() && nodes[children[i]].label[0] < prefix[pos]; ++i);
+            children.insert(children.begin() + i, child);
+
+            return;
+        }
+
+        const std::string &label = nodes[child].label;
+        std::string::size_type common = 0;
+
+        for(; common < label.size() && pos + common < prefix.size() && label[common] == prefix[pos + common]; ++common);
+
+        if(common < label.size())
+        {
+            // child is split, common part of label becomes new node
+            Node node;
+            node.label = label.substr(0, common);
+            node.children.push_back(child);
+
+            nodes[child].label.erase(0, common);
+
+            nodes.push_back(node);
+            int split = static_cast<int>(nodes.size()) - 1;
+
+            for(int &c : nodes[current].children)
+            {
+                if(c == child)
+                {
+                    c = split;
+                }
+            }
+
+            child = split;
+        }
+
+        current = child;
+        pos += common;
+    }
+
+    // first proxy with same prefix is used
+    if(nodes[current].proxy < 0)
+    {
+        nodes[current].proxy = proxy;
+    }
+}
+
+
+int ProxyRoutes::findChild(const Node &node, char c) const
+{
+    for(int child : node.children)
+    {
+        if(nodes[child].label[0] == c)
+        {
+            return child;
+        }
+    }
+
+    return -1;
+}
+
+
+int ProxyRoutes::find(const char *url) const
+{
+    if(url == nullptr || nodes.empty())
+    {
+        return -1;
+    }
+
+    for(; *url == '/'; ++url);
+
+    // root prefix matches every url
+    int result = nodes[0].proxy;
+    const Node *node = &nodes[0];
+
+    while(*url != 0)
+    {
+        int child = findChild(*node, *url);
+        if(child < 0)
+        {
+            break;
+        }
+
+        node = &nodes[child];
+
+        const char *label = node->label.c_str();
+        for(; *label != 0 && *url == *label; ++label, ++url);
+
+        if(*label != 0)
+        {
+            break;
+        }
+
+        // prefix ends at segment boundary
+        if(node->proxy >= 0 && (*url == '/' || *url == 0))
+        {
+            result = node->proxy;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,51 @@
+#ifndef PROXY_ROUTES_H
+#define PROXY_ROUTES_H
+
+#include <string>
+#include <vector>
+
+struct ProxyParameters;
+
+// Prefixes of proxies, compiled into compressed radix trie when config is loaded.
+// Url is matched in one pass, proxy with longest matching prefix is found.
+// Prefix matches whole path segments, as HttpRequest::isUrlPrefix: prefix /app matches /app and /app/x, not /apps.
+// Leading and trailing slashes of prefix are not significant.
+
+class ProxyRoutes
+{
+public:
+
+    void build(const std::vector<ProxyParameters> &proxies);
+
+    // returns index of proxy in ServerParameters::proxies or -1
+    int find(const char *url) const;
+
+    // returns index of proxy for CONNECT requests or -1
+    int findConnect() const
+    {
+        return connectProxy;
+    }
+
+protected:
+
+    struct Node
+    {
+        // bytes of prefix from parent to this node
+        std::string label;
+        // index of proxy, which prefix ends at this node, or -1
+        int proxy = -1;
+        // indexes of child nodes, sorted by first byte of label
+        std::vector<int> children;
+    };
+
+    void insert(const std::string &prefix, int proxy);
+
+    int findChild(const Node &node, char c) const;
+
+    // root has empty label
+    std::vector<Node> nodes;
+
+    int connectProxy = -1;
+};
+
+#endif
@@ -0,0 +1,543 @@
+#include <Resolver.h>
+#include <ServerParameters.h>
+#include <TimeUtils.h>
+#include <Log.h>
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+
+int Resolver::init(const ServerParameters &parameters, Log *log)
+{
+    destroy();
+
+    this->log = log;
+    timeoutMillis = parameters.resolverTimeoutMillis;
+
+    hosts.clear();
+
+    for(const ProxyParameters &proxy : parameters.proxies)
+    {
+        for(const BackendParameters &backend : proxy.backends)
+        {
+            in_addr addr;
+
+            if(backend.socketType == SocketType::tcp && inet_pton(AF_INET, backend.address.c_str(), &addr) != 1 &&
+               findHost(backend.address) < 0)
+            {
+                Host host;
+                host.name = backend.address;
+                hosts.push_back(host);
+            }
+        }
+    }
+
+    if(hosts.empty())
+    {
+        return 0;
+    }
+
+    if(loadNameserver(parameters.resolver) != 0)
+    {
+        return -1;
+    }
+
+    std::random_device device;
+    random.seed(device());
+
+    std::unordered_map<std::string, std::vector<uint32_t>> fileHosts;
+    loadHostsFile(fileHosts);
+
+    for(Host &host : hosts)
+    {
+        auto iter = fileHosts.find(host.name);
+
+        if(iter != fileHosts.end())
+        {
+            host.addresses = iter->second;
+            host.refreshTime = LLONG_MAX;
+            log->info("resolver: %s is found in /etc/hosts\n", host.name.c_str());
+            continue;
+        }
+
+        // poll loops are not started yet, names are resolved before first request
+        std::vector<uint32_t> addresses;
+        long long int ttlSeconds = 0;
+
+        int result = query(host.name, addresses, ttlSeconds);
+        update(host, result, addresses, ttlSeconds, getMilliseconds());
+    }
+
+    stopFlag = false;
+    thread = std::thread(&Resolver::threadEntry, this);
+
+    return 0;
+}
+
+
+void Resolver::destroy()
+{
+    if(thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopFlag = true;
+        }
+        stopCondition.notify_all();
+
+        thread.join();
+    }
+}
+
+
+int Resolver::findHost(const std::string &host) const
+{
+    for(std::vector<Host>::size_type i = 0; i < hosts.size(); ++i)
+    {
+        if(hosts[i].name == host)
+        {
+            return static_cast<int>(i);
+        }
+    }
+
+    return -1;
+}
+
+
+bool Resolver::getAddress(int host, uint32_t &address)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Host &h = hosts[host];
+
+    if(h.addresses.empty())
+    {
+        return false;
+    }
+
+    address = h.addresses[h.next % h.addresses.size()];
+    ++h.next;
+
+    return true;
+}
+
+
+void Resolver::threadEntry()
+{
+    pthread_setname_np(pthread_self(), "resolver");
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while(!stopFlag)
+    {
+        long long int nextRefresh = LLONG_MAX;
+
+        for(Host &host : hosts)
+        {
+            if(host.refreshTime <= getMilliseconds())
+            {
+                std::string name = host.name;
+                std::vector<uint32_t> addresses;
+                long long int ttlSeconds = 0;
+
+                // poll loops take addresses while query waits for answer
+                lock.unlock();
+                int result = query(name, addresses, ttlSeconds);
+                lock.lock();
+
+                if(stopFlag)
+                {
+                    return;
+                }
+
+                update(host, result, addresses, ttlSeconds, getMilliseconds());
+            }
+
+            nextRefresh = std::min(nextRefresh, host.refreshTime);
+        }
+
+        if(nextRefresh == LLONG_MAX)
+        {
+            stopCondition.wait(lock, [this]{ return stopFlag; });
+        }
+        else
+        {
+            long long int waitMillis = nextRefresh - getMilliseconds();
+
+            if(waitMillis > 0)
+            {
+                stopCondition.wait_for(lock, std::chrono::milliseconds(waitMillis), [this]{ return stopFlag; });
+            }
+        }
+    }
+}
+
+
+void Resolver::update(Host &host, int result, std::vector<uint32_t> &addresses, long long int ttlSeconds,
+                      long long int curMillis)
+{
+    if(result == 0)
+    {
+        if(addresses != host.addresses)
+        {
+            std::string list;
+            for(uint32_t address : addresses)
+            {
+                char buf[INET_ADDRSTRLEN];
+                in_addr addr;
+                addr.s_addr = address;
+
+                list += (list.empty() ? "" : " ") + std::string(inet_ntop(AF_INET, &addr, buf, sizeof(buf)));
+            }
+            log->info("resolver: %s -> %s   ttl: %lld\n", host.name.c_str(), list.c_str(), ttlSeconds);
+        }
+
+        host.addresses.swap(addresses);
+        host.refreshTime = curMillis + std::max(ttlSeconds * 1000, static_cast<long long int>(MIN_TTL_MILLIS));
+    }
+    else
+    {
+        // previous addresses are used till name is resolved again
+        log->warning("resolver: %s is not resolved%s\n", host.name.c_str(),
+                     host.addresses.empty() ? "" : ", previous addresses are used");
+
+        host.refreshTime = curMillis + RETRY_MILLIS;
+    }
+}
+
+
+int Resolver::query(const std::string &name, std::vector<uint32_t> &addresses, long long int &ttlSeconds)
+{
+    unsigned char buf[MAX_MESSAGE_SIZE];
+    uint16_t id = static_cast<uint16_t>(random());
+
+    int size = buildQuery(name, id, buf, sizeof(buf));
+    if(size < 0)
+    {
+        log->error("resolver: invalid name %s\n", name.c_str());
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if(fd < 0)
+    {
+        log->error("resolver: socket failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = nameserverAddress;
+    addr.sin_port = htons(nameserverPort);
+
+    // connected socket receives datagrams only from nameserver
+    if(connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || send(fd, buf, size, 0) != size)
+    {
+        log->error("resolver: send failed: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    int result = -1;
+    long long int deadline = getMilliseconds() + timeoutMillis;
+
+    for(long long int curMillis = getMilliseconds(); curMillis < deadline; curMillis = getMilliseconds())
+    {
+        pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+
+        if(poll(&pfd, 1, static_cast<int>(deadline - curMillis)) <= 0)
+        {
+            continue;
+        }
+
+        ssize_t bytes = recv(fd, buf, sizeof(buf), 0);
+        if(bytes <= 0)
+        {
+            continue;
+        }
+
+        addresses.clear();
+
+        // answer to other query is skipped
+        result = parseAnswer(buf, static_cast<int>(bytes), id, addresses, ttlSeconds);
+        if(result >= 0)
+        {
+            break;
+        }
+    }
+
+    close(fd);
+
+    return result;
+}
+
+
+int Resolver::buildQuery(const std::string &name, uint16_t id, unsigned char *buf, int size)
+{
+    const unsigned char header[12] = {
+        static_cast<unsigned char>(id >> 8), static_cast<unsigned char>(id & 0xff),
+        0x01, 0x00,   // recursion desired
+        0x00, 0x01,   // one question
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+    };
+
+    if(name.empty() || name.size() > 253 || size < static_cast<int>(sizeof(header) + name.size() + 6))
+    {
+        return -1;
+    }
+
+    memcpy(buf, header, sizeof(header));
+    int pos = sizeof(header);
+
+    std::string::size_type start = 0;
+
+    while(start < name.size())
+    {
+        std::string::size_type end = name.find('.', start);
+        if(end == std::string::npos)
+        {
+            end = name.size();
+        }
+
+        int length = static_cast<int>(end - start);
+        if(length == 0 || length > 63)
+        {
+            return -1;
+        }
+
+        buf[pos++] = static_cast<unsigned char>(length);
+        memcpy(buf + pos, name.data() + start, length);
+        pos += length;
+
+        start = end + 1;
+    }
+
+    const unsigned char question[5] = {
+        0x00,         // end of name
+        0x00, 0x01,   // type A
+        0x00, 0x01    // class IN
+    };
+
+    memcpy(buf + pos, question, sizeof(question));
+
+    return pos + sizeof(question);
+}
+
+
+// returns position after name or -1
+static int skipName(const unsigned char *buf, int size, int pos)
+{
+    while(pos < size)
+    {
+        int length = buf[pos];
+
+        if(length == 0)
+        {
+            return pos + 1;
+        }
+        else if((length & 0xc0) == 0xc0)
+        {
+            // compressed name ends with pointer
+            return (pos + 2 <= size) ? pos + 2 : -1;
+        }
+        else if((length & 0xc0) != 0)
+        {
+            return -1;
+        }
+
+        pos += length + 1;
+    }
+
+    return -1;
+}
+
+
+static unsigned int read16(const unsigned char *p)
+{
+    return (static_cast<unsigned int>(p[0]) << 8) | p[1];
+}
+
+
+int Resolver::parseAnswer(const unsigned char *buf, int size, uint16_t id,
+                          std::vector<uint32_t> &addresses, long long int &ttlSeconds)
+{
+    if(size < 12 || read16(buf) != id || (buf[2] & 0x80) == 0)
+    {
+        return -1;
+    }
+
+    int rcode = buf[3] & 0x0f;
+
+    // name does not exist
+    if(rcode == 3)
+    {
+        return 1;
+    }
+    else if(rcode != 0)
+    {
+        return -1;
+    }
+
+    unsigned int questions = read16(buf + 4);
+    unsigned int answers = read16(buf + 6);
+
+    int pos = 12;
+
+    for(unsigned int i = 0; i < questions; ++i)
+    {
+        pos = skipName(buf, size, pos);
+        if(pos < 0 || pos + 4 > size)
+        {
+            return -1;
+        }
+        pos += 4;
+    }
+
+    ttlSeconds = LLONG_MAX;
+
+    for(unsigned int i = 0; i < answers; ++i)
+    {
+        pos = skipName(buf, size, pos);
+        if(pos < 0 || pos + 10 > size)
+        {
+            return -1;
+        }
+
+        unsigned int type = read16(buf + pos);
+        unsigned int dataClass = read16(buf + pos + 2);
+        long long int ttl = (static_cast<long long int>(read16(buf + pos + 4)) << 16) | read16(buf + pos + 6);
+        int length = read16(buf + pos + 8);
+
+        pos += 10;
+
+        if(pos + length > size)
+        {
+            return -1;
+        }
+
+        // CNAME records are followed by A records of canonical name
+        if(type == 1 && dataClass == 1 && length == 4)
+        {
+            uint32_t address;
+            memcpy(&address, buf + pos, 4);
+
+            if(std::find(addresses.begin(), addresses.end(), address) == addresses.end())
+            {
+                addresses.push_back(address);
+            }
+
+            ttlSeconds = std::min(ttlSeconds, ttl);
+        }
+
+        pos += length;
+    }
+
+    if(addresses.empty())
+    {
+        ttlSeconds = 0;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+int Resolver::loadNameserver(const std::string &address)
+{
+    std::string server = address;
+
+    if(server.empty())
+    {
+        std::ifstream file("/etc/resolv.conf");
+        std::string line;
+
+        while(server.empty() && std::getline(file, line))
+        {
+            std::istringstream stream(line);
+            std::string key;
+            std::string value;
+            in_addr addr;
+
+            if(stream >> key >> value && key == "nameserver" && inet_pton(AF_INET, value.c_str(), &addr) == 1)
+            {
+                server = value;
+            }
+        }
+
+        if(server.empty())
+        {
+            log->error("resolver: IPv4 nameserver is not found in /etc/resolv.conf\n");
+            return -1;
+        }
+    }
+
+    std::string::size_type colon = server.find(':');
+    nameserverPort = DNS_PORT;
+
+    if(colon != std::string::npos)
+    {
+        nameserverPort = atoi(server.c_str() + colon + 1);
+        server.erase(colon);
+    }
+
+    in_addr addr;
+
+    if(inet_pton(AF_INET, server.c_str(), &addr) != 1 || nameserverPort <= 0 || nameserverPort > 65535)
+    {
+        log->error("resolver: invalid nameserver %s\n", address.c_str());
+        return -1;
+    }
+
+    nameserverAddress = addr.s_addr;
+
+    log->info("resolver: nameserver %s:%d\n", server.c_str(), nameserverPort);
+
+    return 0;
+}
+
+
+void Resolver::loadHostsFile(std::unordered_map<std::string, std::vector<uint32_t>> &fileHosts)
+{
+    std::ifstream file("/etc/hosts");
+    std::string line;
+
+    while(std::getline(file, line))
+    {
+        line.erase(std::min(line.find('#'), line.size()));
+
+        std::istringstream stream(line);
+        std::string value;
+        in_addr addr;
+
+        if(!(stream >> value) || inet_pton(AF_INET, value.c_str(), &addr) != 1)
+        {
+            continue;
+        }
+
+        std::string name;
+        while(stream >> name)
+        {
+            std::vector<uint32_t> &addresses = fileHosts[name];
+
+            if(std::find(addresses.begin(), addresses.end(), addr.s_addr) == addresses.end())
+            {
+                addresses.push_back(addr.s_addr);
+            }
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+class Log;
+struct ServerParameters;
+
+// Addresses of backends, which are set by host name. Names are resolved with DNS queries to nameserver of
+// parameters or first nameserver of /etc/resolv.conf, names from /etc/hosts are not queried.
+// Names are resolved at start, then thread of resolver refreshes every name, when TTL of its answer expires.
+// When query fails, previous addresses are used till next retry. Poll loops only take resolved address under lock,
+// they never wait for DNS.
+
+class Resolver
+{
+public:
+    Resolver() = default;
+
+    ~Resolver()
+    {
+        destroy();
+    }
+
+    Resolver(const Resolver &resolver) = delete;
+    Resolver(Resolver &&resolver) = delete;
+    Resolver& operator=(const Resolver &resolver) = delete;
+    Resolver& operator=(Resolver && resolver) = delete;
+
+    // collects host names of tcp backends, resolves them and starts thread, if there are names
+    int init(const ServerParameters &parameters, Log *log);
+
+    void destroy();
+
+    // returns index of name or -1, if host is IPv4 address or name is unknown
+    int findHost(const std::string &host) const;
+
+    // next address of name in network byte order, addresses are rotated. returns false if name is not resolved.
+    bool getAddress(int host, uint32_t &address);
+
+    // DNS message of A query, returns size of message or -1 if name is invalid
+    static int buildQuery(const std::string &name, uint16_t id, unsigned char *buf, int size);
+
+    // A records of answer are added to addresses, ttl is minimal TTL of them.
+    // returns 0 if answer has addresses, 1 if name has no addresses, -1 if answer is invalid or failed.
+    static int parseAnswer(const unsigned char *buf, int size, uint16_t id,
+                           std::vector<uint32_t> &addresses, long long int &ttlSeconds);
+
+protected:
+
+    struct Host
+    {
+        std::string name;
+        std::vector<uint32_t> addresses;
+        // position of next address for getAddress
+        unsigned int next = 0;
+        long long int refreshTime = 0;
+    };
+
+    void threadEntry();
+
+    // result of query for host is applied, refreshTime is set. called under lock.
+    void update(Host &host, int result, std::vector<uint32_t> &addresses, long long int ttlSeconds,
+                long long int curMillis);
+
+    // returns result as parseAnswer
+    int query(const std::string &name, std::vector<uint32_t> &addresses, long long int &ttlSeconds);
+
+    // address is ip or ip:port, if it is empty, first nameserver of /etc/resolv.conf is used
+    int loadNameserver(const std::string &address);
+
+    static void loadHostsFile(std::unordered_map<std::string, std::vector<uint32_t>> &fileHosts);
+
+    static const int DNS_PORT = 53;
+    static const int MAX_MESSAGE_SIZE = 1232;
+
+    // answers with shorter TTL are still kept so long, failed queries are retried after this time
+    static const int MIN_TTL_MILLIS = 1000;
+    static const int RETRY_MILLIS = 1000;
+
+    // is not resized after init, so poll loops keep index of host
+    std::vector<Host> hosts;
+
+    uint32_t nameserverAddress = 0;
+    int nameserverPort = DNS_PORT;
+    int timeoutMillis = 1000;
+
+    // ids of queries, is used only by thread of resolver
+    std::minstd_rand random;
+
+    // protects hosts
+    std::mutex mutex;
+    std::condition_variable stopCondition;
+    bool stopFlag = false;
+
+    std::thread thread;
+
+    Log *log = nullptr;
+};
+
+#endif
@@ -0,0 +1,809 @@
+#include <ResponseCache.h>
+#include <ProxyParameters.h>
+#include <HttpRequest.h>
+#include <TimeUtils.h>
+#include <Log.h>
+
+#include <iterator>
+#include <sys/eventfd.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <time.h>
+
+
+int ResponseCache::init(long long int maxBytes, Log *log)
+{
+    if(maxBytes < 0)
+    {
+        return -1;
+    }
+
+    this->maxBytes = maxBytes;
+    this->log = log;
+
+    return 0;
+}
+
+
+// returns 1 if directive is found in comma separated list. number is set to value of "name=number"
+// or to -1 if directive has no value.
+static int findDirective(const char *value, int length, const char *name, long long int &number)
+{
+    int nameLength = strlen(name);
+    const char *end = value + length;
+    const char *token = value;
+
+    while(token < end)
+    {
+        for(; token < end && (*token == ' ' || *token == '\t' || *token == ','); ++token);
+
+        const char *tokenEnd = static_cast<const char*>(memchr(token, ',', end - token));
+        if(tokenEnd == nullptr)
+        {
+            tokenEnd = end;
+        }
+
+        if(tokenEnd - token >= nameLength && strncasecmp(token, name, nameLength) == 0 &&
+           (tokenEnd - token == nameLength || token[nameLength] == '=' || token[nameLength] == ' '))
+        {
+            number = -1;
+
+            const char *p = token + nameLength;
+            for(; p < tokenEnd && (*p == ' ' || *p == '=' || *p == '"'); ++p);
+
+            if(p < tokenEnd && *p >= '0' && *p <= '9')
+            {
+                number = 0;
+                for(; p < tokenEnd && *p >= '0' && *p <= '9' && number < 1000000000; ++p)
+                {
+                    number = number * 10 + (*p - '0');
+                }
+            }
+
+            return 1;
+        }
+
+        token = tokenEnd;
+    }
+
+    return 0;
+}
+
+
+int ResponseCache::makeKey(const HttpRequest &request, const ProxyParameters &proxy, std::string &key, bool &revalidate)
+{
+    const char *method;
+    int methodLength;
+
+    if(request.getMethod(&method, &methodLength) != 0 ||
+       !((methodLength == 3 && strncmp(method, "GET", 3) == 0) || (methodLength == 4 && strncmp(method, "HEAD", 4) == 0)))
+    {
+        return -1;
+    }
+
+    const char *ptr;
+    int length;
+
+    // requests with body, partial requests, upgrade requests and requests with credentials are not cached
+    if(request.getContentLength() > 0 || request.isChunked() ||
+       request.getHeaderValue(HttpRequest::KnownHeader::range, &ptr, &length) == 0 ||
+       request.getHeaderValue(HttpRequest::KnownHeader::upgrade, &ptr, &length) == 0 ||
+       request.getHeaderValue("Authorization", &ptr, &length) == 0)
+    {
+        return -1;
+    }
+
+    long long int number;
+    revalidate = false;
+
+    if(request.getHeaderValue(HttpRequest::KnownHeader::cacheControl, &ptr, &length) == 0)
+    {
+        if(findDirective(ptr, length, "no-store", number))
+        {
+            return -1;
+        }
+
+        revalidate = findDirective(ptr, length, "no-cache", number) ||
+                     (findDirective(ptr, length, "max-age", number) && number == 0);
+    }
+    else if(request.getHeaderValue("Pragma", &ptr, &length) == 0)
+    {
+        revalidate = findDirective(ptr, length, "no-cache", number);
+    }
+
+    const char *url = request.getUrl();
+    if(url == nullptr)
+    {
+        return -1;
+    }
+
+    key.clear();
+    key += std::to_string(proxy.index);
+    key += ' ';
+    key += url;
+
+    if(request.getUrlParameterCount() > 0)
+    {
+        // every byte can be encoded as %XX
+        char parameters[HttpRequest::MAX_URL_LENGTH * 3 + 1];
+
+        int parametersLength = request.getNormalizedUrlParameters(parameters, sizeof(parameters));
+        if(parametersLength < 0)
+        {
+            return -1;
+        }
+
+        key += '?';
+        key.append(parameters, parametersLength);
+    }
+
+    for(const std::string &name : proxy.cacheKeyHeaders)
+    {
+        key += '\n';
+        key += name;
+        key += ':';
+
+        if(request.getHeaderValue(name.c_str(), &ptr, &length) == 0)
+        {
+            key.append(ptr, length);
+        }
+    }
+
+    return 0;
+}
+
+
+std::shared_ptr<const CacheEntry> ResponseCache::find(const std::string &key, const HttpRequest &request,
+                                                      long long int curMillis, Status &status)
+{
+    status = Status::miss;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto iter = index.find(key);
+    if(iter == index.end())
+    {
+        return nullptr;
+    }
+
+    size_t variant = findVariant(iter->second, request);
+    if(variant == iter->second.size())
+    {
+        return nullptr;
+    }
+
+    LruList::iterator lruIter = iter->second[variant];
+    std::shared_ptr<CacheEntry> entry = *lruIter;
+
+    if(curMillis < entry->freshUntil)
+    {
+        lru.splice(lru.begin(), lru, lruIter);
+        status = Status::hit;
+        return entry;
+    }
+
+    if(curMillis < entry->staleUntil)
+    {
+        if(curMillis < entry->revalidateUntil)
+        {
+            lru.splice(lru.begin(), lru, lruIter);
+            status = Status::stale;
+            return entry;
+        }
+
+        entry->revalidateUntil = curMillis + REVALIDATE_MILLIS;
+        return nullptr;
+    }
+
+    remove(iter, variant);
+
+    return nullptr;
+}
+
+
+bool ResponseCache::store(const std::string &key, const HttpRequest &request, const ProxyParameters &proxy,
+                          std::string response, int headersEnd, long long int curMillis)
+{
+    int size = static_cast<int>(response.size());
+
+    if(!enabled() || headersEnd <= 0 || headersEnd > size)
+    {
+        return false;
+    }
+
+    Freshness freshness = getFreshness(response.data(), headersEnd, proxy, curMillis);
+
+    std::shared_ptr<CacheEntry> entry;
+
+    if(freshness.storable)
+    {
+        entry = std::make_shared<CacheEntry>();
+
+        if(getVary(response.data(), headersEnd, request, entry->varyNames, entry->varyValues) != 0)
+        {
+            entry.reset();
+        }
+    }
+
+    if(entry)
+    {
+        entry->key = key;
+        entry->response = std::move(response);
+        entry->headersEnd = headersEnd;
+        entry->bodyStart = headersEnd + ((entry->response[headersEnd] == '\r') ? 2 : 1);
+        entry->storeTime = curMillis;
+        entry->freshUntil = curMillis + freshness.freshMillis;
+        entry->staleUntil = entry->freshUntil + freshness.staleMillis;
+
+        if(static_cast<long long int>(entry->memorySize()) > maxBytes)
+        {
+            entry.reset();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto iter = index.find(key);
+    if(iter != index.end())
+    {
+        size_t variant = findVariant(iter->second, request);
+        if(variant < iter->second.size())
+        {
+            remove(iter, variant);
+        }
+    }
+
+    if(!entry)
+    {
+        return false;
+    }
+
+    long long int memorySize = entry->memorySize();
+
+    while(!lru.empty() && usedBytes + memorySize > maxBytes)
+    {
+        LruList::iterator last = std::prev(lru.end());
+
+        iter = index.find((*last)->key);
+
+        for(size_t i = 0; i < iter->second.size(); ++i)
+        {
+            if(iter->second[i] == last)
+            {
+                remove(iter, i);
+                break;
+            }
+        }
+    }
+
+    lru.push_front(entry);
+    index[key].push_back(lru.begin());
+    usedBytes += memorySize;
+
+    log->debug("response is stored in cache, size: %d   fresh millis: %lld\n", size, freshness.freshMillis);
+
+    return true;
+}
+
+
+void ResponseCache::erase(const std::string &key, const HttpRequest &request)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto iter = index.find(key);
+    if(iter != index.end())
+    {
+        size_t variant = findVariant(iter->second, request);
+        if(variant < iter->second.size())
+        {
+            remove(iter, variant);
+        }
+    }
+}
+
+
+std::shared_ptr<CacheFill> ResponseCache::startFill(const std::string &key, bool shared, bool &created)
+{
+    created = true;
+
+    if(!shared)
+    {
+        return std::make_shared<CacheFill>(nullptr, key);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::shared_ptr<CacheFill> &fill = fills[key];
+
+    if(fill)
+    {
+        created = false;
+        return fill;
+    }
+
+    fill = std::make_shared<CacheFill>(this, key);
+    return fill;
+}
+
+
+void ResponseCache::endFill(const std::string &key, const CacheFill *fill)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto iter = fills.find(key);
+    if(iter != fills.end() && iter->second.get() == fill)
+    {
+        fills.erase(iter);
+    }
+}
+
+
+size_t ResponseCache::findVariant(const std::vector<LruList::iterator> &variants, const HttpRequest &request) const
+{
+    for(size_t i = 0; i < variants.size(); ++i)
+    {
+        if(varyMatches((*variants[i])->varyNames, (*variants[i])->varyValues, request))
+        {
+            return i;
+        }
+    }
+
+    return variants.size();
+}
+
+
+void ResponseCache::remove(Index::iterator iter, size_t variant)
+{
+    LruList::iterator lruIter = iter->second[variant];
+
+    usedBytes -= (*lruIter)->memorySize();
+    lru.erase(lruIter);
+
+    iter->second.erase(iter->second.begin() + variant);
+
+    if(iter->second.empty())
+    {
+        index.erase(iter);
+    }
+}
+
+
+int ResponseCache::getVary(const char *headers, int size, const HttpRequest &request,
+                           std::vector<std::string> &names, std::vector<std::string> &values)
+{
+    names.clear();
+    values.clear();
+
+    // Vary: Accept-Encoding, Accept-Language
+    int pos = 0;
+    const char *value;
+    int length;
+
+    while(findHeader(headers, size, "Vary", pos, &value, &length) == 0)
+    {
+        const char *end = value + length;
+
+        while(value < end)
+        {
+            for(; value < end && (*value == ' ' || *value == '\t' || *value == ','); ++value);
+
+            const char *nameEnd = value;
+            for(; nameEnd < end && *nameEnd != ',' && *nameEnd != ' ' && *nameEnd != '\t'; ++nameEnd);
+
+            if(nameEnd == value)
+            {
+                break;
+            }
+
+            std::string name(value, nameEnd - value);
+
+            // response depends on something else than request headers
+            if(name == "*")
+            {
+                return -1;
+            }
+
+            for(char &c : name)
+            {
+                c = tolower(c);
+            }
+
+            const char *requestValue;
+            int requestValueLength;
+
+            names.push_back(name);
+
+            if(request.getHeaderValue(name.c_str(), &requestValue, &requestValueLength) == 0)
+            {
+                values.emplace_back(requestValue, requestValueLength);
+            }
+            else
+            {
+                values.emplace_back();
+            }
+
+            value = nameEnd;
+        }
+    }
+
+    return 0;
+}
+
+
+bool ResponseCache::varyMatches(const std::vector<std::string> &names, const std::vector<std::string> &values,
+                                const HttpRequest &request)
+{
+    for(size_t i = 0; i < names.size(); ++i)
+    {
+        const char *value;
+        int length;
+
+        if(request.getHeaderValue(names[i].c_str(), &value, &length) != 0)
+        {
+            length = 0;
+        }
+
+        if(values[i].size() != static_cast<size_t>(length) ||
+           values[i].compare(0, length, value, length) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+int ResponseCache::findHeader(const char *headers, int size, const char *name, int &pos, const char **value, int *length)
+{
+    int nameLength = strlen(name);
+
+    // status line
+    if(pos == 0)
+    {
+        const char *lf = static_cast<const char*>(memchr(headers, '\n', size));
+        if(lf == nullptr)
+        {
+            return -1;
+        }
+        pos = lf - headers + 1;
+    }
+
+    while(pos < size)
+    {
+        const char *line = headers + pos;
+        const char *lf = static_cast<const char*>(memchr(line, '\n', size - pos));
+        const char *end = (lf != nullptr) ? lf : headers + size;
+
+        pos = end - headers + 1;
+
+        if(end - line > nameLength && line[nameLength] == ':' && strncasecmp(line, name, nameLength) == 0)
+        {
+            const char *p = line + nameLength + 1;
+
+            for(; p < end && (*p == ' ' || *p == '\t'); ++p);
+            for(; end > p && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'); --end);
+
+            *value = p;
+            *length = end - p;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+
+ResponseCache::Freshness ResponseCache::getFreshness(const char *headers, int size, const ProxyParameters &proxy,
+                                                     long long int curMillis)
+{
+    Freshness freshness;
+
+    // HTTP/1.x SSS
+    if(size < 12 || strncmp(headers, "HTTP/1.", 7) != 0)
+    {
+        return freshness;
+    }
+
+    int status = atoi(headers + 9);
+
+    // responses, which are cacheable by default
+    if(status != 200 && status != 203 && status != 204 && status != 301 && status != 404 && status != 410)
+    {
+        return freshness;
+    }
+
+    int pos = 0;
+    const char *value;
+    int length;
+
+    // personal response
+    if(findHeader(headers, size, "Set-Cookie", pos, &value, &length) == 0)
+    {
+        return freshness;
+    }
+
+    long long int maxAge = -1;
+    long long int sharedMaxAge = -1;
+    long long int staleSeconds = -1;
+    long long int number;
+
+    pos = 0;
+
+    while(findHeader(headers, size, "Cache-Control", pos, &value, &length) == 0)
+    {
+        // no-cache requires revalidation on every request, which is not implemented
+        if(findDirective(value, length, "no-store", number) || findDirective(value, length, "private", number) ||
+           findDirective(value, length, "no-cache", number))
+        {
+            return freshness;
+        }
+
+        if(findDirective(value, length, "s-maxage", number) && number >= 0)
+        {
+            sharedMaxAge = number;
+        }
+        if(findDirective(value, length, "max-age", number) && number >= 0)
+        {
+            maxAge = number;
+        }
+        if(findDirective(value, length, "stale-while-revalidate", number) && number >= 0)
+        {
+            staleSeconds = number;
+        }
+    }
+
+    if(sharedMaxAge >= 0)
+    {
+        freshness.freshMillis = sharedMaxAge * 1000;
+    }
+    else if(maxAge >= 0)
+    {
+        freshness.freshMillis = maxAge * 1000;
+    }
+    else
+    {
+        pos = 0;
+
+        if(findHeader(headers, size, "Expires", pos, &value, &length) == 0)
+        {
+            long long int expires = parseHttpDate(value, length);
+            long long int date = curMillis;
+
+            pos = 0;
+            if(findHeader(headers, size, "Date", pos, &value, &length) == 0)
+            {
+                long long int d = parseHttpDate(value, length);
+                if(d > 0)
+                {
+                    date = d;
+                }
+            }
+
+            // invalid date means expired
+            freshness.freshMillis = (expires > 0) ? expires - date : 0;
+        }
+        else if(proxy.cacheDefaultSeconds > 0)
+        {
+            freshness.freshMillis = proxy.cacheDefaultSeconds * 1000LL;
+        }
+        else
+        {
+            return freshness;
+        }
+    }
+
+    // response was stored by other cache
+    pos = 0;
+    if(findHeader(headers, size, "Age", pos, &value, &length) == 0)
+    {
+        freshness.freshMillis -= atoll(value) * 1000;
+    }
+
+    freshness.staleMillis = ((staleSeconds >= 0) ? staleSeconds : proxy.cacheStaleSeconds) * 1000LL;
+    freshness.storable = (freshness.freshMillis > 0);
+
+    return freshness;
+}
+
+
+long long int ResponseCache::parseHttpDate(const char *value, int length)
+{
+    char buf[101];
+
+    if(length > 100)
+    {
+        return -1;
+    }
+
+    memcpy(buf, value, length);
+    buf[length] = 0;
+
+    struct tm timeData;
+    memset(&timeData, 0, sizeof(timeData));
+
+    if(strptime(buf, RFC1123FMT, &timeData) == NULL)
+    {
+        return -1;
+    }
+
+    return timegm(&timeData) * 1000LL;
+}
+
+
+void CacheFill::append(const char *p, int size)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    while(size > 0)
+    {
+        int offset = static_cast<int>(this->size % CHUNK_SIZE);
+
+        if(offset == 0)
+        {
+            chunks.emplace_back(new char[CHUNK_SIZE]);
+        }
+
+        int count = (size < CHUNK_SIZE - offset) ? size : CHUNK_SIZE - offset;
+
+        memcpy(chunks.back().get() + offset, p, count);
+
+        this->size += count;
+        p += count;
+        size -= count;
+    }
+
+    if(state == State::ready)
+    {
+        notify();
+    }
+}
+
+
+void CacheFill::setReady(long long int start, long long int headersEnd,
+                         std::vector<std::string> &&varyNames, std::vector<std::string> &&varyValues)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    this->start = start;
+    this->headersEnd = headersEnd;
+    this->varyNames = std::move(varyNames);
+    this->varyValues = std::move(varyValues);
+
+    state = State::ready;
+    notify();
+}
+
+
+void CacheFill::finish()
+{
+    setState(State::finished);
+}
+
+
+void CacheFill::abandon()
+{
+    setState(State::abandoned);
+}
+
+
+// fill is removed from registry before waiters are woken, so waiters, which go upstream, do not find it again
+void CacheFill::setState(State newState)
+{
+    if(cache != nullptr)
+    {
+        cache->endFill(key, this);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if(state == State::receiving || state == State::ready)
+    {
+        state = newState;
+        notify();
+    }
+}
+
+
+CacheFill::State CacheFill::getState() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return state;
+}
+
+
+long long int CacheFill::getSize() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return size;
+}
+
+
+long long int CacheFill::read(long long int position, const char **p) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if(position >= size)
+    {
+        return 0;
+    }
+
+    long long int offset = position % CHUNK_SIZE;
+    long long int available = size - position;
+
+    if(available > CHUNK_SIZE - offset)
+    {
+        available = CHUNK_SIZE - offset;
+    }
+
+    // chunks are not moved or changed after bytes are appended, so they are read without lock
+    *p = chunks[position / CHUNK_SIZE].get() + offset;
+
+    return available;
+}
+
+
+void CacheFill::copy(long long int position, long long int size, std::string &result) const
+{
+    result.clear();
+    result.reserve(size);
+
+    const char *p;
+    long long int available;
+
+    while(size > 0 && (available = read(position, &p)) > 0)
+    {
+        if(available > size)
+        {
+            available = size;
+        }
+
+        result.append(p, available);
+        position += available;
+        size -= available;
+    }
+}
+
+
+bool CacheFill::varyMatches(const HttpRequest &request) const
+{
+    return ResponseCache::varyMatches(varyNames, varyValues, request);
+}
+
+
+void CacheFill::addWaiter(int eventFd)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    waiters.push_back(eventFd);
+
+    // waiter checks state of fill in first iteration
+    eventfd_write(eventFd, 1);
+}
+
+
+void CacheFill::removeWaiter(int eventFd)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for(size_t i = 0; i < waiters.size(); ++i)
+    {
+        if(waiters[i] == eventFd)
+        {
+            waiters.erase(waiters.begin() + i);
+            return;
+        }
+    }
+}
+
+
+// called under lock, so waiter is not removed and its eventfd is not closed while it is written
+void CacheFill::notify()
+{
+    for(int eventFd : waiters)
+    {
+        eventfd_write(eventFd, 1);
+    }
+}
@@ -0,0 +1,269 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Log;
+class HttpRequest;
+struct ProxyParameters;
+class ResponseCache;
+
+// Complete upstream response, stored as received. Entry is not changed after it is stored,
+// executors, which send it to clients, hold shared_ptr, so evicted entry lives till it is sent.
+struct CacheEntry
+{
+    std::string key;
+    std::string response;
+
+    // offset of empty line after headers, offset of body
+    int headersEnd = 0;
+    int bodyStart = 0;
+
+    // request headers, which were used by upstream to select response (Vary), lower case names.
+    std::vector<std::string> varyNames;
+    std::vector<std::string> varyValues;
+
+    long long int storeTime = 0;
+    // entry is fresh before freshUntil, it can be served stale till staleUntil, while it is revalidated
+    long long int freshUntil = 0;
+    long long int staleUntil = 0;
+
+    // memory used by entry in cache
+    size_t memorySize() const
+    {
+        return key.size() + response.size() + 256;
+    }
+
+protected:
+    friend class ResponseCache;
+
+    // stale entry is revalidated by one request till this time, other requests get stale entry.
+    // is changed under lock of cache.
+    long long int revalidateUntil = 0;
+};
+
+
+// Upstream response, which is received for cache. Requests with same key, which come while it is received,
+// wait for it instead of going upstream (request collapsing). Response is appended to chain of fixed chunks,
+// so waiters in every poll loop can send bytes received so far without copying.
+// Waiters are woken through their eventfd, when response gets more bytes or its state changes.
+// Only response with Content-Length, which fits into cacheMaxEntryBytes, is shared, so it is not abandoned
+// after waiters sent part of it. Fill gets bytes as fast as leading request sends them to its client,
+// unless proxy has bufferResponse, which reads response ahead of client.
+class CacheFill
+{
+public:
+    // cache - registry of fill, nullptr if fill is not shared with other requests
+    CacheFill(ResponseCache *cache, const std::string &key): cache(cache), key(key)
+    {
+    }
+
+    CacheFill(const CacheFill &fill) = delete;
+    CacheFill(CacheFill &&fill) = delete;
+    CacheFill& operator=(const CacheFill &fill) = delete;
+    CacheFill& operator=(CacheFill && fill) = delete;
+
+    enum class State
+    {
+        // headers are not received
+        receiving,
+        // response is cacheable, received bytes can be sent to waiters
+        ready,
+        // whole response is received
+        finished,
+        // response is not cacheable or upstream failed, waiters go upstream themselves
+        abandoned
+    };
+
+    static const int CHUNK_SIZE = 64 * 1024;
+
+    void append(const char *p, int size);
+
+    // start - offset of status line after interim responses, headersEnd - offset of empty line after headers.
+    // varyNames, varyValues - request headers, which were used by upstream to select response.
+    void setReady(long long int start, long long int headersEnd,
+                  std::vector<std::string> &&varyNames, std::vector<std::string> &&varyValues);
+
+    void finish();
+
+    void abandon();
+
+    State getState() const;
+
+    long long int getSize() const;
+
+    bool shared() const
+    {
+        return cache != nullptr;
+    }
+
+    long long int getStart() const
+    {
+        return start;
+    }
+
+    long long int getHeadersEnd() const
+    {
+        return headersEnd;
+    }
+
+    // returns number of contiguous bytes available at position, p is set to them
+    long long int read(long long int position, const char **p) const;
+
+    void copy(long long int position, long long int size, std::string &result) const;
+
+    // request has same values of Vary headers as request, which was sent upstream. call after fill is ready.
+    bool varyMatches(const HttpRequest &request) const;
+
+    // response depends on request headers. call after fill is ready.
+    bool varies() const
+    {
+        return !varyNames.empty();
+    }
+
+    // eventfd of waiter is written, when fill changes
+    void addWaiter(int eventFd);
+
+    void removeWaiter(int eventFd);
+
+protected:
+
+    void notify();
+
+    void setState(State newState);
+
+    ResponseCache *cache;
+    const std::string key;
+
+    mutable std::mutex mutex;
+
+    State state = State::receiving;
+
+    std::vector<std::unique_ptr<char[]>> chunks;
+    long long int size = 0;
+
+    // are set once, before state is ready
+    long long int start = 0;
+    long long int headersEnd = -1;
+    std::vector<std::string> varyNames;
+    std::vector<std::string> varyValues;
+
+    std::vector<int> waiters;
+};
+
+
+// Cache of proxied GET responses, shared by all poll loops. Freshness is taken from Cache-Control,
+// Expires and Date of response, variants are selected by Vary headers. Entries are evicted in LRU order,
+// when memory limit is reached.
+// Stale-while-revalidate: first request for stale entry goes upstream and stores new response,
+// requests, which come while response is not stored, get stale entry.
+// Misses of same key, which come while response is received, share one upstream request (CacheFill).
+
+class ResponseCache
+{
+public:
+    ResponseCache() = default;
+
+    ResponseCache(const ResponseCache &cache) = delete;
+    ResponseCache(ResponseCache &&cache) = delete;
+    ResponseCache& operator=(const ResponseCache &cache) = delete;
+    ResponseCache& operator=(ResponseCache && cache) = delete;
+
+    enum class Status
+    {
+        miss, hit, stale
+    };
+
+    // time for one request to revalidate stale entry. if response is not stored during this time,
+    // next request goes upstream.
+    static const int REVALIDATE_MILLIS = 5000;
+
+    // maxBytes == 0 - cache is disabled
+    int init(long long int maxBytes, Log *log);
+
+    bool enabled() const
+    {
+        return maxBytes > 0;
+    }
+
+    // Cache key: proxy, decoded path, normalized query string and values of proxy->cacheKeyHeaders.
+    // returns -1 if request can not be served from cache.
+    // revalidate is set if client does not accept cached response (no-cache), response can be stored.
+    static int makeKey(const HttpRequest &request, const ProxyParameters &proxy, std::string &key, bool &revalidate);
+
+    // returns entry to serve with status hit or stale, or nullptr with status miss
+    std::shared_ptr<const CacheEntry> find(const std::string &key, const HttpRequest &request,
+                                           long long int curMillis, Status &status);
+
+    // response - complete response to GET request, which was sent to upstream.
+    // response is stored if Cache-Control, Expires or proxy->cacheDefaultSeconds allow it.
+    // if response can not be stored, stored variant for request is removed.
+    bool store(const std::string &key, const HttpRequest &request, const ProxyParameters &proxy,
+               std::string response, int headersEnd, long long int curMillis);
+
+    // removes variant of key, which matches request
+    void erase(const std::string &key, const HttpRequest &request);
+
+    // returns fill, which receives response for key. if there is no such fill, new fill is returned
+    // and created is set. shared - fill is registered, so requests with same key can wait for it.
+    std::shared_ptr<CacheFill> startFill(const std::string &key, bool shared, bool &created);
+
+    // fill is not registered for key anymore, next request starts new fill
+    void endFill(const std::string &key, const CacheFill *fill);
+
+    // reads names of Vary header of response and values of these headers in request.
+    // returns -1 if response varies on something else than request headers (Vary: *).
+    static int getVary(const char *headers, int size, const HttpRequest &request,
+                       std::vector<std::string> &names, std::vector<std::string> &values);
+
+    static bool varyMatches(const std::vector<std::string> &names, const std::vector<std::string> &values,
+                            const HttpRequest &request);
+
+    // returns value of response header, headers - status line and headers.
+    // pos - offset to start search from, is set after found header, so next header with same name can be found.
+    static int findHeader(const char *headers, int size, const char *name, int &pos, const char **value, int *length);
+
+    struct Freshness
+    {
+        bool storable = false;
+        long long int freshMillis = 0;
+        long long int staleMillis = 0;
+    };
+
+    // freshness of response from status and headers, curMillis is used when Expires is relative to Date
+    static Freshness getFreshness(const char *headers, int size, const ProxyParameters &proxy, long long int curMillis);
+
+protected:
+
+    typedef std::list<std::shared_ptr<CacheEntry>> LruList;
+    // variants of key with different values of Vary headers
+    typedef std::unordered_map<std::string, std::vector<LruList::iterator>> Index;
+
+    // returns index of variant, which matches Vary headers of request, or variants.size()
+    size_t findVariant(const std::vector<LruList::iterator> &variants, const HttpRequest &request) const;
+
+    void remove(Index::iterator iter, size_t variant);
+
+    static long long int parseHttpDate(const char *value, int length);
+
+    std::mutex mutex;
+
+    // most recently used entries are at front
+    LruList lru;
+    Index index;
+
+    // responses, which are received for cache now
+    std::unordered_map<std::string, std::shared_ptr<CacheFill>> fills;
+
+    long long int maxBytes = 0;
+    long long int usedBytes = 0;
+
+    Log *log = nullptr;
+};
+
+#endif
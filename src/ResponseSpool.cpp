@@ -0,0 +1,244 @@
+#include <ResponseSpool.h>
+#include <Log.h>
+
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+
+bool ResponseSpool::Memory::reserve(long long int bytes)
+{
+    long long int cur = used.load();
+
+    do
+    {
+        if(cur + bytes > maxBytes)
+        {
+            return false;
+        }
+    }
+    while(!used.compare_exchange_weak(cur, cur + bytes));
+
+    return true;
+}
+
+
+void ResponseSpool::init(Memory *memory, long long int memoryLimit, long long int fileLimit,
+                         const std::string *folder, Log *log)
+{
+    reset();
+
+    this->memory = memory;
+    this->memoryLimit = memoryLimit;
+    this->fileLimit = fileLimit;
+    this->folder = folder;
+    this->log = log;
+}
+
+
+void ResponseSpool::reset()
+{
+    chunks.clear();
+
+    if(memory != nullptr)
+    {
+        memory->release(reservedBytes);
+    }
+    reservedBytes = 0;
+    memoryBytes = 0;
+    readOffset = 0;
+    writeOffset = CHUNK_SIZE;
+
+    if(fileFd >= 0)
+    {
+        close(fileFd);
+        fileFd = -1;
+    }
+    fileReadOffset = 0;
+    fileBytes = 0;
+    stage.reset();
+    writeToFile = false;
+
+    memory = nullptr;
+}
+
+
+bool ResponseSpool::startWrite(void* &data, int &size)
+{
+    // bytes are appended to file, till file is read to end
+    if(!writeToFile || fileBytes == 0)
+    {
+        writeToFile = false;
+
+        if(writeOffset < CHUNK_SIZE || addChunk())
+        {
+            data = chunks.back().get() + writeOffset;
+            size = CHUNK_SIZE - writeOffset;
+            return true;
+        }
+
+        writeToFile = true;
+    }
+
+    long long int fileSpace = fileLimit - (fileReadOffset + fileBytes);
+
+    if(fileSpace <= 0)
+    {
+        return false;
+    }
+
+    if(fileFd < 0 && openFile() != 0)
+    {
+        return false;
+    }
+
+    if(!stage)
+    {
+        stage.reset(new char[CHUNK_SIZE]);
+    }
+
+    data = stage.get();
+    size = static_cast<int>(std::min(fileSpace, static_cast<long long int>(CHUNK_SIZE)));
+
+    return true;
+}
+
+
+int ResponseSpool::endWrite(int size)
+{
+    if(!writeToFile)
+    {
+        writeOffset += size;
+        memoryBytes += size;
+        return 0;
+    }
+
+    int written = 0;
+
+    while(written < size)
+    {
+        ssize_t result = pwrite(fileFd, stage.get() + written, size - written, fileReadOffset + fileBytes + written);
+
+        if(result <= 0)
+        {
+            log->error("write of response buffer file failed: %s\n", strerror(errno));
+            return -1;
+        }
+
+        written += result;
+    }
+
+    fileBytes += size;
+
+    return 0;
+}
+
+
+int ResponseSpool::read(void *data, int size)
+{
+    char *out = static_cast<char*>(data);
+    int total = 0;
+
+    while(total < size && memoryBytes > 0)
+    {
+        int chunkEnd = (chunks.size() == 1) ? writeOffset : CHUNK_SIZE;
+        int bytes = std::min(size - total, chunkEnd - readOffset);
+
+        memcpy(out + total, chunks.front().get() + readOffset, bytes);
+
+        readOffset += bytes;
+        total += bytes;
+        memoryBytes -= bytes;
+
+        // chunk is freed, when it is read to end, also last chunk, so idle spool holds no memory
+        if(readOffset == chunkEnd && (chunks.size() > 1 || memoryBytes == 0))
+        {
+            if(chunks.size() == 1)
+            {
+                writeOffset = CHUNK_SIZE;
+            }
+
+            chunks.pop_front();
+            readOffset = 0;
+
+            memory->release(CHUNK_SIZE);
+            reservedBytes -= CHUNK_SIZE;
+        }
+    }
+
+    // file has bytes, which were appended after bytes in memory
+    if(total < size && memoryBytes == 0 && fileBytes > 0)
+    {
+        ssize_t result = pread(fileFd, out + total, std::min(static_cast<long long int>(size - total), fileBytes),
+                               fileReadOffset);
+
+        if(result <= 0)
+        {
+            log->error("read of response buffer file failed: %s\n", strerror(errno));
+            return -1;
+        }
+
+        fileReadOffset += result;
+        fileBytes -= result;
+        total += result;
+
+        if(fileBytes == 0)
+        {
+            fileReadOffset = 0;
+            writeToFile = false;
+
+            if(ftruncate(fileFd, 0) != 0)
+            {
+                log->warning("truncate of response buffer file failed: %s\n", strerror(errno));
+            }
+        }
+    }
+
+    return total;
+}
+
+
+bool ResponseSpool::addChunk()
+{
+    if(memoryLimit - reservedBytes < CHUNK_SIZE || !memory->reserve(CHUNK_SIZE))
+    {
+        return false;
+    }
+
+    reservedBytes += CHUNK_SIZE;
+
+    chunks.emplace_back(new char[CHUNK_SIZE]);
+    writeOffset = 0;
+
+    return true;
+}
+
+
+// file has no name: it is removed, when it is closed, also after crash
+int ResponseSpool::openFile()
+{
+    fileFd = open(folder->c_str(), O_TMPFILE | O_RDWR, 0600);
+
+    if(fileFd < 0)
+    {
+        // file system without O_TMPFILE
+        std::string name = *folder + "/spool.XXXXXX";
+
+        fileFd = mkstemp(&name[0]);
+        if(fileFd >= 0)
+        {
+            unlink(name.c_str());
+        }
+    }
+
+    if(fileFd < 0)
+    {
+        log->error("response buffer file can not be created in %s: %s\n", folder->c_str(), strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
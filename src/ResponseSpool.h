@@ -0,0 +1,119 @@
+#ifndef RESPONSE_SPOOL_H
+#define RESPONSE_SPOOL_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+
+class Log;
+
+// Upstream response, which is read faster than client receives it. Bytes are appended to memory chunks
+// till memory limit of spool or shared memory limit of server is reached, then to temporary file.
+// When file has bytes, new bytes are appended to file too, so bytes are read in order they were appended.
+// Bytes are written as to TransferRingBuffer: startWrite gives free space, endWrite commits it.
+
+class ResponseSpool
+{
+public:
+
+    // memory of all spools of server, is shared by poll loops
+    class Memory
+    {
+    public:
+        void init(long long int maxBytes)
+        {
+            this->maxBytes = maxBytes;
+            used.store(0);
+        }
+
+        bool reserve(long long int bytes);
+
+        void release(long long int bytes)
+        {
+            used.fetch_sub(bytes);
+        }
+
+        long long int getUsed() const
+        {
+            return used.load();
+        }
+
+    protected:
+        std::atomic<long long int> used { 0 };
+        long long int maxBytes = 0;
+    };
+
+    ResponseSpool() = default;
+
+    ~ResponseSpool()
+    {
+        reset();
+    }
+
+    ResponseSpool(const ResponseSpool &spool) = delete;
+    ResponseSpool(ResponseSpool &&spool) = delete;
+    ResponseSpool& operator=(const ResponseSpool &spool) = delete;
+    ResponseSpool& operator=(ResponseSpool && spool) = delete;
+
+    // folder - folder of temporary file, fileLimit == 0 - bytes are not written to file
+    void init(Memory *memory, long long int memoryLimit, long long int fileLimit, const std::string *folder, Log *log);
+
+    // frees memory and closes file, spool is not active till init
+    void reset();
+
+    bool active() const
+    {
+        return memory != nullptr;
+    }
+
+    bool empty() const
+    {
+        return memoryBytes == 0 && fileBytes == 0;
+    }
+
+    long long int size() const
+    {
+        return memoryBytes + fileBytes;
+    }
+
+    // returns false if limits are reached
+    bool startWrite(void* &data, int &size);
+
+    // returns -1 if write to file failed
+    int endWrite(int size);
+
+    // moves up to size bytes from start of spool, returns bytes or -1 if read from file failed
+    int read(void *data, int size);
+
+    static const int CHUNK_SIZE = 64 * 1024;
+
+protected:
+
+    bool addChunk();
+
+    int openFile();
+
+    Memory *memory = nullptr;
+    long long int memoryLimit = 0;
+    long long int fileLimit = 0;
+    const std::string *folder = nullptr;
+    Log *log = nullptr;
+
+    // first chunk is read from readOffset, last chunk is written at writeOffset
+    std::deque<std::unique_ptr<char[]>> chunks;
+    int readOffset = 0;
+    int writeOffset = CHUNK_SIZE;
+    // bytes in chunks and chunks, which are reserved in memory of server
+    long long int memoryBytes = 0;
+    long long int reservedBytes = 0;
+
+    int fileFd = -1;
+    long long int fileReadOffset = 0;
+    long long int fileBytes = 0;
+    // bytes read from upstream for file are staged in this chunk
+    std::unique_ptr<char[]> stage;
+    bool writeToFile = false;
+};
+
+#endif
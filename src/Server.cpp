@@ -166,6 +166,36 @@ int Server::start(ServerParameters &parameters)
 
     parameters.writeToLog(log);
 
+    if(admission.init(parameters.admissionTargetMillis, parameters.admissionIntervalMillis, parameters.retryAfterSeconds) != 0)
+    {
+        log->error("admission control init failed\n");
+        stop();
+        return -1;
+    }
+
+    if(cache.init(parameters.cacheMemoryBytes, log) != 0)
+    {
+        log->error("response cache init failed\n");
+        stop();
+        return -1;
+    }
+
+    if(diskCache.init(parameters.cacheDiskFolder, parameters.cacheDiskMegabytes * 1024LL * 1024LL, log) != 0)
+    {
+        log->error("disk cache init failed\n");
+        stop();
+        return -1;
+    }
+
+    spoolMemory.init(parameters.responseBufferMemoryBytes);
+
+    if(resolver.init(parameters, log) != 0)
+    {
+        log->error("resolver init failed\n");
+        stop();
+        return -1;
+    }
+
 #ifdef USE_SSL
     if(parameters.httpsPorts.size() > 0)
     {
@@ -185,6 +215,36 @@ int Server::start(ServerParameters &parameters)
     }
 #endif
 
+    for(const ProxyParameters &proxy : parameters.proxies)
+    {
+        if(!proxy.tls)
+        {
+            continue;
+        }
+
+#ifdef USE_SSL
+        if(sslInit() != 0)
+        {
+            stop();
+            return -1;
+        }
+
+        upstreamSslCtx = UpstreamConnectionPool::createSslContext(parameters.upstreamTlsCaFile, log);
+
+        if(upstreamSslCtx == nullptr)
+        {
+            stop();
+            return -1;
+        }
+
+        break;
+#else
+        log->error("proxy %s has tls, but server is built without USE_SSL\n", proxy.prefix.c_str());
+        stop();
+        return -1;
+#endif
+    }
+
     loops = new PollLoop[parameters.threadCount];
 
     for(int i = 0; i < parameters.threadCount; ++i)
@@ -199,9 +259,9 @@ int Server::start(ServerParameters &parameters)
     //=================================================
 
     int counter = 0;
-    for(int port : parameters.httpPorts)
+    for(const ListenParameters &listen : parameters.httpPorts)
     {
-        if(loops[counter % parameters.threadCount].listenPort(port, ExecutorType::server) != 0)
+        if(loops[counter % parameters.threadCount].listenPort(listen, ExecutorType::server) != 0)
         {
             stop();
             return -1;
@@ -210,9 +270,9 @@ int Server::start(ServerParameters &parameters)
     }
 
 #ifdef USE_SSL
-    for(int port : parameters.httpsPorts)
+    for(const ListenParameters &listen : parameters.httpsPorts)
     {
-        if(loops[counter % parameters.threadCount].listenPort(port, ExecutorType::serverSsl) != 0)
+        if(loops[counter % parameters.threadCount].listenPort(listen, ExecutorType::serverSsl) != 0)
         {
             stop();
             return -1;
@@ -285,8 +345,16 @@ void Server::stop()
         sslDestroyContext(sslCtx);
         sslCtx = nullptr;
     }
+    if(upstreamSslCtx != nullptr)
+    {
+        SSL_CTX_free(upstreamSslCtx);
+        upstreamSslCtx = nullptr;
+    }
 #endif
 
+    diskCache.destroy();
+    resolver.destroy();
+
     if(log != nullptr)
     {
         delete log;
@@ -295,7 +363,7 @@ void Server::stop()
 }
 
 
-int Server::createRequestExecutor(int fd, ExecutorType execType)
+int Server::createRequestExecutor(int fd, ExecutorType execType, long long int acceptTime)
 {
     int minPollFds = INT_MAX;
     int minIndex = 0;
@@ -310,10 +378,18 @@ int Server::createRequestExecutor(int fd, ExecutorType execType)
         }
     }
 
-    if(loops[minIndex].enqueueClientFd(fd, execType) != 0)
+    if(loops[minIndex].enqueueClientFd(fd, execType, acceptTime) != 0)
     {
         log->error("enqueueClientFd failed\n");
-        close(fd);
+
+        if(execType == ExecutorType::request)
+        {
+            admission.reject(fd);
+        }
+        else
+        {
+            close(fd);
+        }
         return -1;
     }
 
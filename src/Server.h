@@ -21,7 +21,7 @@ public:
 
     void stop();
 
-    int createRequestExecutor(int fd, ExecutorType execType) override;
+    int createRequestExecutor(int fd, ExecutorType execType, long long int acceptTime) override;
 
     void logStats() const;
 
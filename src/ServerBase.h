@@ -3,6 +3,11 @@
 
 #include <Log.h>
 #include <ExecutorType.h>
+#include <AdmissionControl.h>
+#include <ResponseCache.h>
+#include <DiskCache.h>
+#include <Resolver.h>
+#include <ResponseSpool.h>
 
 #ifdef USE_SSL
 #    include <openssl/ssl.h>
@@ -13,12 +18,25 @@ class ServerBase
 {
 public:
 
-    virtual int createRequestExecutor(int fd, ExecutorType execType) = 0;
+    virtual int createRequestExecutor(int fd, ExecutorType execType, long long int acceptTime) = 0;
 
     Log *log = nullptr;
 
+    AdmissionControl admission;
+
+    ResponseCache cache;
+
+    DiskCache diskCache;
+
+    Resolver resolver;
+
+    // memory of response buffers of proxy executors
+    ResponseSpool::Memory spoolMemory;
+
 #ifdef USE_SSL
     SSL_CTX* sslCtx = nullptr;
+    // client context of proxies with tls
+    SSL_CTX* upstreamSslCtx = nullptr;
 #endif
 };
 
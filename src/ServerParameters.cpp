@@ -23,6 +23,74 @@ bool getOptionalInt(const ConfigMapType &params, const char *paramName, ParamTyp
 }
 
 
+static bool loadListenOptions(const ConfigMapType &configMap, const std::string &prefix, ListenParameters &listen)
+{
+    return getOptionalInt(configMap, (prefix + "tcpNoDelay").c_str(), listen.tcpNoDelay) &&
+           getOptionalInt(configMap, (prefix + "tcpNotSentLowat").c_str(), listen.tcpNotSentLowat) &&
+           getOptionalInt(configMap, (prefix + "sendBufferSize").c_str(), listen.sendBufferSize) &&
+           getOptionalInt(configMap, (prefix + "receiveBufferSize").c_str(), listen.receiveBufferSize) &&
+           getOptionalInt(configMap, (prefix + "tcpDeferAcceptSeconds").c_str(), listen.tcpDeferAcceptSeconds) &&
+           getOptionalInt(configMap, (prefix + "tcpFastOpenQueue").c_str(), listen.tcpFastOpenQueue);
+}
+
+
+// returns 1 if backend address is not set
+static int loadBackend(const ConfigMapType &configMap, const std::string &prefix, BackendParameters &backend)
+{
+    auto iter = configMap.find(prefix + "address");
+    if (iter == configMap.end())
+    {
+        return 1;
+    }
+    backend.address = iter->second;
+
+    backend.socketType = SocketType::tcp;
+
+    iter = configMap.find(prefix + "socket");
+    if (iter != configMap.end())
+    {
+        if (iter->second == "tcp")
+        {
+            backend.socketType = SocketType::tcp;
+        }
+        else if (iter->second == "unix")
+        {
+            backend.socketType = SocketType::unix;
+        }
+        else
+        {
+            printf("invalid proxy socket type\n");
+            return -1;
+        }
+    }
+
+    if (!getOptionalInt(configMap, (prefix + "port").c_str(), backend.port) ||
+        !getOptionalInt(configMap, (prefix + "weight").c_str(), backend.weight) ||
+        !getOptionalInt(configMap, (prefix + "maxInFlight").c_str(), backend.maxInFlight))
+    {
+        return -1;
+    }
+
+    if (backend.socketType == SocketType::tcp && backend.port <= 0)
+    {
+        printf("proxy port is not set\n");
+        return -1;
+    }
+    if (backend.weight <= 0 || backend.weight > 100)
+    {
+        printf("invalid proxy weight\n");
+        return -1;
+    }
+    if (backend.maxInFlight < -1)
+    {
+        printf("invalid proxy maxInFlight\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
 int ServerParameters::load(const char *fileName)
 {
     setDefaults();
@@ -42,6 +110,85 @@ int ServerParameters::load(const char *fileName)
     {
         return -1;
     }
+    if (!getOptionalInt(configMap, "sendBudgetBytes", sendBudgetBytes))
+    {
+        return -1;
+    }
+    if (!getOptionalInt(configMap, "iterationBudgetMillis", iterationBudgetMillis))
+    {
+        return -1;
+    }
+    if (!getOptionalInt(configMap, "pipeSize", pipeSize))
+    {
+        return -1;
+    }
+    if (!getOptionalInt(configMap, "pipePoolSize", pipePoolSize))
+    {
+        return -1;
+    }
+    if (!getOptionalInt(configMap, "admissionTargetMillis", admissionTargetMillis))
+    {
+        return -1;
+    }
+    if (!getOptionalInt(configMap, "admissionIntervalMillis", admissionIntervalMillis))
+    {
+        return -1;
+    }
+    if (!getOptionalInt(configMap, "retryAfterSeconds", retryAfterSeconds))
+    {
+        return -1;
+    }
+    if (admissionIntervalMillis <= 0)
+    {
+        printf("invalid admissionIntervalMillis\n");
+        return -1;
+    }
+    if (sendBudgetBytes <= 0)
+    {
+        printf("invalid sendBudgetBytes\n");
+        return -1;
+    }
+    if (pipeSize < 4096 || pipePoolSize < 0)
+    {
+        printf("invalid pipe parameters\n");
+        return -1;
+    }
+    if (!getOptionalInt(configMap, "cacheMemoryBytes", cacheMemoryBytes))
+    {
+        return -1;
+    }
+    if (cacheMemoryBytes < 0)
+    {
+        printf("invalid cacheMemoryBytes\n");
+        return -1;
+    }
+    if (!getOptionalInt(configMap, "cacheDiskMegabytes", cacheDiskMegabytes))
+    {
+        return -1;
+    }
+    if (cacheDiskMegabytes < 0)
+    {
+        printf("invalid cacheDiskMegabytes\n");
+        return -1;
+    }
+    if (!getOptionalInt(configMap, "responseBufferMemoryBytes", responseBufferMemoryBytes))
+    {
+        return -1;
+    }
+    if (responseBufferMemoryBytes < 0)
+    {
+        printf("invalid responseBufferMemoryBytes\n");
+        return -1;
+    }
+    if (!getOptionalInt(configMap, "resolverTimeoutMillis", resolverTimeoutMillis))
+    {
+        return -1;
+    }
+    if (resolverTimeoutMillis <= 0)
+    {
+        printf("invalid resolverTimeoutMillis\n");
+        return -1;
+    }
     if (!getOptionalInt(configMap, "logFileSize", logFileSize))
     {
         return -1;
@@ -63,6 +210,30 @@ int ServerParameters::load(const char *fileName)
         rootFolder = iter->second;
     }
 
+    iter = configMap.find("cacheDiskFolder");
+    if (iter != configMap.end())
+    {
+        cacheDiskFolder = iter->second;
+    }
+
+    iter = configMap.find("responseBufferFolder");
+    if (iter != configMap.end())
+    {
+        responseBufferFolder = iter->second;
+    }
+
+    iter = configMap.find("upstreamTlsCaFile");
+    if (iter != configMap.end())
+    {
+        upstreamTlsCaFile = iter->second;
+    }
+
+    iter = configMap.find("resolver");
+    if (iter != configMap.end())
+    {
+        resolver = iter->second;
+    }
+
     iter = configMap.find("logLevel");
     if (iter != configMap.end())
     {
@@ -89,20 +260,33 @@ int ServerParameters::load(const char *fileName)
         }
     }
 
+    // socket options for all ports, can be overridden for port as httpPortN.optionName
+    ListenParameters defaultListen;
+    if (!loadListenOptions(configMap, "", defaultListen))
+    {
+        return -1;
+    }
+
     for (int portNum = 0; portNum < 100; ++portNum)
     {
         std::string key = "httpPort" + std::to_string(portNum);
 
-        int port = -1;
-        if (!getOptionalInt(configMap, key.c_str(), port))
+        ListenParameters listen = defaultListen;
+        listen.port = -1;
+
+        if (!getOptionalInt(configMap, key.c_str(), listen.port))
         {
             return -1;
         }
-        if (port < 0)
+        if (listen.port < 0)
         {
             break;
         }
-        httpPorts.push_back(port);
+        if (!loadListenOptions(configMap, key + ".", listen))
+        {
+            return -1;
+        }
+        httpPorts.push_back(listen);
     }
 
     if (httpPorts.size() < 1)
@@ -115,89 +299,296 @@ int ServerParameters::load(const char *fileName)
 
     for (int proxyNum = 0; proxyNum < 100; ++proxyNum)
     {
-        std::string key = "proxy" + std::to_string(proxyNum) + ".port";
+        std::string proxyKey = "proxy" + std::to_string(proxyNum) + ".";
 
         ProxyParameters proxy;
 
-        if (!getOptionalInt(configMap, key.c_str(), proxy.port))
+        iter = configMap.find(proxyKey + "prefix");
+        if (iter == configMap.end())
         {
-            return -1;
+            break;
         }
-        if (proxy.port <= 0)
+        proxy.prefix = iter->second;
+
+        // several backends are set as proxyN.backendM.paramName, one backend can be set as proxyN.paramName
+        for (int backendNum = 0; backendNum < 100; ++backendNum)
         {
-            break;
+            BackendParameters backend;
+
+            int result = loadBackend(configMap, proxyKey + "backend" + std::to_string(backendNum) + ".", backend);
+            if (result < 0)
+            {
+                return -1;
+            }
+            if (result > 0)
+            {
+                break;
+            }
+            proxy.backends.push_back(backend);
         }
 
-        key = "proxy" + std::to_string(proxyNum) + ".address";
-        iter = configMap.find(key);
-        if (iter == configMap.end())
+        if (proxy.backends.empty())
         {
-            printf("proxy address is not set\n");
-            return -1;
+            BackendParameters backend;
+
+            int result = loadBackend(configMap, proxyKey, backend);
+            if (result < 0)
+            {
+                return -1;
+            }
+            if (result > 0)
+            {
+                printf("proxy address is not set\n");
+                return -1;
+            }
+            proxy.backends.push_back(backend);
         }
-        proxy.address = iter->second;
 
-        key = "proxy" + std::to_string(proxyNum) + ".prefix";
-        iter = configMap.find(key);
-        if (iter == configMap.end())
+        iter = configMap.find(proxyKey + "balance");
+        if (iter != configMap.end())
         {
-            printf("proxy prefix is not set\n");
-            return -1;
+            if (iter->second == "roundRobin") proxy.balance = BalancePolicy::roundRobin;
+            else if (iter->second == "leastOutstanding") proxy.balance = BalancePolicy::leastOutstanding;
+            else if (iter->second == "ewma") proxy.balance = BalancePolicy::ewma;
+            else if (iter->second == "hash") proxy.balance = BalancePolicy::hash;
+            else
+            {
+                printf("invalid proxy balance\n");
+                return -1;
+            }
         }
-        proxy.prefix = iter->second;
 
-        key = "proxy" + std::to_string(proxyNum) + ".socket";
-        iter = configMap.find(key);
+        // values: path, header:Name, cookie:Name
+        iter = configMap.find(proxyKey + "hashKey");
         if (iter != configMap.end())
         {
-            if (iter->second == "tcp")
+            const std::string &value = iter->second;
+
+            if (value == "path")
             {
-                proxy.socketType = SocketType::tcp;
+                proxy.hashKeyType = HashKeyType::path;
             }
-            else if (iter->second == "unix")
+            else if (value.compare(0, 7, "header:") == 0 && value.size() > 7)
             {
-                proxy.socketType = SocketType::unix;
+                proxy.hashKeyType = HashKeyType::header;
+                proxy.hashKeyName = value.substr(7);
+            }
+            else if (value.compare(0, 7, "cookie:") == 0 && value.size() > 7)
+            {
+                proxy.hashKeyType = HashKeyType::cookie;
+                proxy.hashKeyName = value.substr(7);
             }
             else
             {
-                printf("invalid proxy socket type\n");
+                printf("invalid proxy hashKey\n");
                 return -1;
             }
         }
-        else
+
+        if (!getOptionalInt(configMap, (proxyKey + "poolSize").c_str(), proxy.poolSize) ||
+            !getOptionalInt(configMap, (proxyKey + "poolIdleTimeoutMillis").c_str(), proxy.poolIdleTimeoutMillis) ||
+            !getOptionalInt(configMap, (proxyKey + "poolMaxAgeMillis").c_str(), proxy.poolMaxAgeMillis) ||
+            !getOptionalInt(configMap, (proxyKey + "poolPrewarm").c_str(), proxy.poolPrewarm))
         {
-            proxy.socketType = SocketType::tcp;
+            return -1;
+        }
+        if (proxy.poolSize < 0 || proxy.poolIdleTimeoutMillis < 0 || proxy.poolMaxAgeMillis < 0 || proxy.poolPrewarm < 0)
+        {
+            printf("invalid proxy pool parameters\n");
+            return -1;
+        }
+
+        if (!getOptionalInt(configMap, (proxyKey + "spliceMinBytes").c_str(), proxy.spliceMinBytes) ||
+            !getOptionalInt(configMap, (proxyKey + "tunnelIdleTimeoutMillis").c_str(), proxy.tunnelIdleTimeoutMillis) ||
+            !getOptionalInt(configMap, (proxyKey + "connect").c_str(), proxy.connect))
+        {
+            return -1;
+        }
+        if (proxy.spliceMinBytes < 0 || proxy.tunnelIdleTimeoutMillis < 0)
+        {
+            printf("invalid proxy spliceMinBytes or tunnelIdleTimeoutMillis\n");
+            return -1;
+        }
+
+        if (!getOptionalInt(configMap, (proxyKey + "maxFails").c_str(), proxy.maxFails) ||
+            !getOptionalInt(configMap, (proxyKey + "failTimeoutMillis").c_str(), proxy.failTimeoutMillis) ||
+            !getOptionalInt(configMap, (proxyKey + "healthCheckIntervalMillis").c_str(), proxy.healthCheckIntervalMillis) ||
+            !getOptionalInt(configMap, (proxyKey + "healthCheckTimeoutMillis").c_str(), proxy.healthCheckTimeoutMillis) ||
+            !getOptionalInt(configMap, (proxyKey + "slowStartMillis").c_str(), proxy.slowStartMillis))
+        {
+            return -1;
+        }
+        if (proxy.maxFails < 0 || proxy.failTimeoutMillis < 0 || proxy.healthCheckIntervalMillis < 0 ||
+            proxy.healthCheckTimeoutMillis <= 0 || proxy.slowStartMillis < 0)
+        {
+            printf("invalid proxy health check parameters\n");
+            return -1;
+        }
+
+        if (!getOptionalInt(configMap, (proxyKey + "retryAttempts").c_str(), proxy.retryAttempts) ||
+            !getOptionalInt(configMap, (proxyKey + "retryBudgetPercent").c_str(), proxy.retryBudgetPercent) ||
+            !getOptionalInt(configMap, (proxyKey + "hedgePercentile").c_str(), proxy.hedgePercentile) ||
+            !getOptionalInt(configMap, (proxyKey + "hedgeMinDelayMillis").c_str(), proxy.hedgeMinDelayMillis))
+        {
+            return -1;
+        }
+        if (proxy.retryAttempts < 0 || proxy.retryBudgetPercent < 0 || proxy.hedgePercentile < 0 ||
+            proxy.hedgePercentile > 99 || proxy.hedgeMinDelayMillis <= 0)
+        {
+            printf("invalid proxy retry or hedge parameters\n");
+            return -1;
         }
 
+        if (!getOptionalInt(configMap, (proxyKey + "bufferResponse").c_str(), proxy.bufferResponse) ||
+            !getOptionalInt(configMap, (proxyKey + "bufferMemoryBytes").c_str(), proxy.bufferMemoryBytes) ||
+            !getOptionalInt(configMap, (proxyKey + "bufferFileMaxBytes").c_str(), proxy.bufferFileMaxBytes))
+        {
+            return -1;
+        }
+        if (proxy.bufferMemoryBytes < 0 || proxy.bufferFileMaxBytes < 0)
+        {
+            printf("invalid proxy buffer parameters\n");
+            return -1;
+        }
+
+        if (!getOptionalInt(configMap, (proxyKey + "tls").c_str(), proxy.tls) ||
+            !getOptionalInt(configMap, (proxyKey + "tlsVerify").c_str(), proxy.tlsVerify))
+        {
+            return -1;
+        }
+
+        iter = configMap.find(proxyKey + "tlsServerName");
+        if (iter != configMap.end())
+        {
+            proxy.tlsServerName = iter->second;
+        }
+
+        if (!getOptionalInt(configMap, (proxyKey + "maxInFlight").c_str(), proxy.maxInFlight) ||
+            !getOptionalInt(configMap, (proxyKey + "maxInFlightAdaptive").c_str(), proxy.maxInFlightAdaptive) ||
+            !getOptionalInt(configMap, (proxyKey + "queueSize").c_str(), proxy.queueSize) ||
+            !getOptionalInt(configMap, (proxyKey + "queueTimeoutMillis").c_str(), proxy.queueTimeoutMillis))
+        {
+            return -1;
+        }
+        if (proxy.maxInFlight < 0 || proxy.queueSize < 0 || proxy.queueTimeoutMillis <= 0)
+        {
+            printf("invalid proxy maxInFlight or queue parameters\n");
+            return -1;
+        }
+
+        iter = configMap.find(proxyKey + "healthCheckPath");
+        if (iter != configMap.end())
+        {
+            if (iter->second.empty() || iter->second[0] != '/' ||
+                iter->second.find_first_of(" \r\n") != std::string::npos)
+            {
+                printf("invalid proxy healthCheckPath\n");
+                return -1;
+            }
+            proxy.healthCheckPath = iter->second;
+        }
+
+        int cache = 0;
+        int cacheCollapse = 1;
+
+        if (!getOptionalInt(configMap, (proxyKey + "cache").c_str(), cache) ||
+            !getOptionalInt(configMap, (proxyKey + "cacheCollapse").c_str(), cacheCollapse) ||
+            !getOptionalInt(configMap, (proxyKey + "cacheDiskMaxEntryBytes").c_str(), proxy.cacheDiskMaxEntryBytes) ||
+            !getOptionalInt(configMap, (proxyKey + "cacheMaxEntryBytes").c_str(), proxy.cacheMaxEntryBytes) ||
+            !getOptionalInt(configMap, (proxyKey + "cacheDefaultSeconds").c_str(), proxy.cacheDefaultSeconds) ||
+            !getOptionalInt(configMap, (proxyKey + "cacheStaleSeconds").c_str(), proxy.cacheStaleSeconds))
+        {
+            return -1;
+        }
+        if (proxy.cacheMaxEntryBytes <= 0 || proxy.cacheDefaultSeconds < 0 || proxy.cacheStaleSeconds < 0 ||
+            proxy.cacheDiskMaxEntryBytes < 0)
+        {
+            printf("invalid proxy cache parameters\n");
+            return -1;
+        }
+        proxy.cache = (cache != 0);
+        proxy.cacheCollapse = (cacheCollapse != 0);
+
+        // comma separated header names
+        iter = configMap.find(proxyKey + "cacheKeyHeaders");
+        if (iter != configMap.end())
+        {
+            std::string::size_type start = 0;
+
+            while (start < iter->second.size())
+            {
+                std::string::size_type end = iter->second.find(',', start);
+                if (end == std::string::npos)
+                {
+                    end = iter->second.size();
+                }
+
+                std::string name = iter->second.substr(start, end - start);
+                name.erase(0, name.find_first_not_of(' '));
+                name.erase(name.find_last_not_of(' ') + 1);
+
+                if (!name.empty())
+                {
+                    proxy.cacheKeyHeaders.push_back(name);
+                }
+
+                start = end + 1;
+            }
+        }
+
+        proxy.index = static_cast<int>(proxies.size());
+
         // connectionType parameter is not implemented, just set it to clear.
         proxy.connectionType = static_cast<int>(ConnectionType::clear);
 
         proxies.push_back(proxy);
     }
 
+    proxyRoutes.build(proxies);
+
     return 0;
 }
 
 
+static void writeListenToLog(Log *log, const char *title, const ListenParameters &listen)
+{
+    log->info("%s: %d   tcpNoDelay: %d   tcpNotSentLowat: %d   sendBufferSize: %d   receiveBufferSize: %d   "
+              "tcpDeferAcceptSeconds: %d   tcpFastOpenQueue: %d\n",
+              title, listen.port, listen.tcpNoDelay, listen.tcpNotSentLowat, listen.sendBufferSize,
+              listen.receiveBufferSize, listen.tcpDeferAcceptSeconds, listen.tcpFastOpenQueue);
+}
+
+
 void ServerParameters::writeToLog(Log *log) const
 {
     log->info("----- server parameters -----\n");
     log->info("rootFolder: %s\n", rootFolder.c_str());
     log->info("threadCount: %d\n", threadCount);
     log->info("executorTimeoutMillis: %d\n", executorTimeoutMillis);
+    log->info("sendBudgetBytes: %d\n", sendBudgetBytes);
+    log->info("iterationBudgetMillis: %d\n", iterationBudgetMillis);
+    log->info("pipeSize: %d   pipePoolSize: %d\n", pipeSize, pipePoolSize);
+    log->info("cacheMemoryBytes: %d\n", cacheMemoryBytes);
+    log->info("cacheDiskFolder: %s   cacheDiskMegabytes: %d\n", cacheDiskFolder.c_str(), cacheDiskMegabytes);
+    log->info("responseBufferMemoryBytes: %d   responseBufferFolder: %s\n",
+              responseBufferMemoryBytes, responseBufferFolder.c_str());
+    log->info("upstreamTlsCaFile: %s\n", upstreamTlsCaFile.c_str());
+    log->info("resolver: %s   resolverTimeoutMillis: %d\n", resolver.c_str(), resolverTimeoutMillis);
+    log->info("admissionTargetMillis: %d   admissionIntervalMillis: %d   retryAfterSeconds: %d\n",
+              admissionTargetMillis, admissionIntervalMillis, retryAfterSeconds);
     log->info("logLevel: %s\n", Log::logLevelString(logLevel));
     log->info("logType: %s\n", Log::logTypeString(logType));
     log->info("logFileSize: %d\n", logFileSize);
     log->info("logArchiveCount: %d\n", logArchiveCount);
-    for (int port : httpPorts)
+    for (const ListenParameters &listen : httpPorts)
     {
-        log->info("httpPort: %d\n", port);
+        writeListenToLog(log, "httpPort", listen);
     }
 
 #if USE_SSL
-    for (int port : httpsPorts)
+    for (const ListenParameters &listen : httpsPorts)
     {
-        log->info("httpsPort: %d\n", port);
+        writeListenToLog(log, "httpsPort", listen);
     }
 #endif
 
@@ -225,19 +616,53 @@ void ServerParameters::writeToLog(Log *log) const
         }
 #endif
 
-        const char *socketTypeString = "none";
+        static const char *balanceStrings[] = { "roundRobin", "leastOutstanding", "ewma", "hash" };
+        static const char *hashKeyStrings[] = { "path", "header", "cookie" };
+
+        log->info("proxy   prefix: %s   connection: %s   balance: %s   hashKey: %s %s\n",
+                  proxy.prefix.c_str(), conTypeString, balanceStrings[static_cast<int>(proxy.balance)],
+                  hashKeyStrings[static_cast<int>(proxy.hashKeyType)], proxy.hashKeyName.c_str());
 
-        if (proxy.socketType == SocketType::tcp)
+        for (const BackendParameters &backend : proxy.backends)
         {
-            socketTypeString = "tcp";
+            const char *socketTypeString = "none";
+
+            if (backend.socketType == SocketType::tcp)
+            {
+                socketTypeString = "tcp";
+            }
+            else if (backend.socketType == SocketType::unix)
+            {
+                socketTypeString = "unix";
+            }
+
+            log->info("proxy   backend   address: %s   port: %d   socket: %s   weight: %d   maxInFlight: %d\n",
+                      backend.address.c_str(), backend.port, socketTypeString, backend.weight, backend.maxInFlight);
         }
-        else if (proxy.socketType == SocketType::unix)
+        log->info("proxy   poolSize: %d   poolIdleTimeoutMillis: %d   poolMaxAgeMillis: %d   poolPrewarm: %d   spliceMinBytes: %d   tunnelIdleTimeoutMillis: %d   connect: %d\n",
+                  proxy.poolSize, proxy.poolIdleTimeoutMillis, proxy.poolMaxAgeMillis, proxy.poolPrewarm,
+                  proxy.spliceMinBytes, proxy.tunnelIdleTimeoutMillis, (int)proxy.connect);
+        log->info("proxy   maxFails: %d   failTimeoutMillis: %d   healthCheckIntervalMillis: %d   "
+                  "healthCheckTimeoutMillis: %d   healthCheckPath: %s   slowStartMillis: %d\n",
+                  proxy.maxFails, proxy.failTimeoutMillis, proxy.healthCheckIntervalMillis,
+                  proxy.healthCheckTimeoutMillis, proxy.healthCheckPath.c_str(), proxy.slowStartMillis);
+        log->info("proxy   retryAttempts: %d   retryBudgetPercent: %d   hedgePercentile: %d   hedgeMinDelayMillis: %d\n",
+                  proxy.retryAttempts, proxy.retryBudgetPercent, proxy.hedgePercentile, proxy.hedgeMinDelayMillis);
+        log->info("proxy   bufferResponse: %d   bufferMemoryBytes: %d   bufferFileMaxBytes: %d\n",
+                  (int)proxy.bufferResponse, proxy.bufferMemoryBytes, proxy.bufferFileMaxBytes);
+        log->info("proxy   maxInFlight: %d   maxInFlightAdaptive: %d   queueSize: %d   queueTimeoutMillis: %d\n",
+                  proxy.maxInFlight, (int)proxy.maxInFlightAdaptive, proxy.queueSize, proxy.queueTimeoutMillis);
+        log->info("proxy   tls: %d   tlsVerify: %d   tlsServerName: %s\n",
+                  (int)proxy.tls, (int)proxy.tlsVerify, proxy.tlsServerName.c_str());
+
+        std::string keyHeaders;
+        for (const std::string &name : proxy.cacheKeyHeaders)
         {
-            socketTypeString = "unix";
+            keyHeaders += (keyHeaders.empty() ? "" : ",") + name;
         }
-
-        log->info("proxy   prefix: %s   address: %s   port: %d   connection: %s   socket: %s\n",
-                  proxy.prefix.c_str(), proxy.address.c_str(), proxy.port, conTypeString, socketTypeString);
+        log->info("proxy   cache: %d   cacheKeyHeaders: %s   cacheMaxEntryBytes: %d   cacheDefaultSeconds: %d   cacheStaleSeconds: %d   cacheCollapse: %d   cacheDiskMaxEntryBytes: %d\n",
+                  (int)proxy.cache, keyHeaders.c_str(), proxy.cacheMaxEntryBytes, proxy.cacheDefaultSeconds,
+                  proxy.cacheStaleSeconds, (int)proxy.cacheCollapse, proxy.cacheDiskMaxEntryBytes);
     }
     log->info("-----------------------------\n");
 }
@@ -5,6 +5,8 @@
 #include <vector>
 #include <string>
 #include <ProxyParameters.h>
+#include <ListenParameters.h>
+#include <ProxyRoutes.h>
 
 struct ServerParameters
 {
@@ -25,11 +27,27 @@ struct ServerParameters
 #endif
 
         proxies.clear();
+        proxyRoutes.build(proxies);
         logLevel = Log::Level::info;
         logType = Log::Type::stdout;
         logFileSize = 1024 * 1024;
         logArchiveCount = 10;
         executorTimeoutMillis = 10000;
+        sendBudgetBytes = 256 * 1024;
+        iterationBudgetMillis = 10;
+        pipeSize = 256 * 1024;
+        pipePoolSize = 64;
+        cacheMemoryBytes = 64 * 1024 * 1024;
+        cacheDiskFolder.clear();
+        cacheDiskMegabytes = 1024;
+        responseBufferMemoryBytes = 64 * 1024 * 1024;
+        responseBufferFolder = "/tmp";
+        upstreamTlsCaFile.clear();
+        resolver.clear();
+        resolverTimeoutMillis = 1000;
+        admissionTargetMillis = 0;
+        admissionIntervalMillis = 100;
+        retryAfterSeconds = 1;
         logStats = true;
     }
 
@@ -44,6 +62,39 @@ struct ServerParameters
     int threadCount;
     int executorTimeoutMillis;
 
+    // max bytes one executor sends to client per loop iteration
+    int sendBudgetBytes;
+    // when processing of loop iteration takes longer, bulk transfers yield till next iteration. 0 - disabled.
+    int iterationBudgetMillis;
+
+    // capacity of pipes used by splice, is limited by /proc/sys/fs/pipe-max-size for unprivileged user
+    int pipeSize;
+    // idle pipes kept by every poll loop
+    int pipePoolSize;
+
+    // memory limit of cache of proxied responses, shared by poll loops. 0 - cache is disabled.
+    int cacheMemoryBytes;
+    // folder of disk cache for responses, which are larger than proxy cacheMaxEntryBytes. empty - disabled.
+    std::string cacheDiskFolder;
+    int cacheDiskMegabytes;
+
+    // memory of buffered proxy responses of all connections, larger responses are written to files in folder
+    int responseBufferMemoryBytes;
+    std::string responseBufferFolder;
+
+    // CA certificates (PEM file) for backends of proxies with tls. empty - default CA paths of openssl.
+    std::string upstreamTlsCaFile;
+
+    // nameserver for backends set by host name, ip or ip:port. empty - first nameserver of /etc/resolv.conf.
+    std::string resolver;
+    int resolverTimeoutMillis;
+
+    // when every new connection during interval waited for processing longer than target,
+    // new connections are answered with 503. 0 - disabled.
+    int admissionTargetMillis;
+    int admissionIntervalMillis;
+    int retryAfterSeconds;
+
     Log::Level logLevel;
     Log::Type logType;
     int logFileSize;
@@ -51,13 +102,16 @@ struct ServerParameters
 
     bool logStats;
 
-    std::vector<int> httpPorts;
+    std::vector<ListenParameters> httpPorts;
 
 #if USE_SSL
-    std::vector<int> httpsPorts;
+    std::vector<ListenParameters> httpsPorts;
 #endif
 
     std::vector<ProxyParameters> proxies;
+
+    // built from proxies, when parameters are loaded
+    ProxyRoutes proxyRoutes;
 };
 
 #endif
@@ -0,0 +1,365 @@
+#include <UpstreamConnectionPool.h>
+#include <ProxyParameters.h>
+#include <NetworkUtils.h>
+#include <Resolver.h>
+#include <Log.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifdef USE_SSL
+#    include <openssl/err.h>
+#    include <openssl/x509v3.h>
+#endif
+
+
+int UpstreamConnectionPool::init(const ProxyParameters *proxy, const BackendParameters *backend, Resolver *resolver,
+                                 SSL_CTX *sslCtx, Log *log)
+{
+    destroy();
+
+    this->proxy = proxy;
+    this->backend = backend;
+    this->resolver = resolver;
+    this->sslCtx = proxy->tls ? sslCtx : nullptr;
+    this->log = log;
+
+    if(proxy->tls && sslCtx == nullptr)
+    {
+        log->error("proxy %s has tls, but client ssl context is not created\n", proxy->prefix.c_str());
+        return -1;
+    }
+
+    serverName = proxy->tlsServerName;
+
+    if(backend->socketType == SocketType::tcp)
+    {
+        in_addr addr;
+
+        if(inet_pton(AF_INET, backend->address.c_str(), &addr) == 1)
+        {
+            address = addr.s_addr;
+            resolverHost = -1;
+        }
+        else
+        {
+            resolverHost = resolver->findHost(backend->address);
+
+            if(serverName.empty())
+            {
+                serverName = backend->address;
+            }
+
+            if(resolverHost < 0)
+            {
+                log->error("backend address %s is not resolved\n", backend->address.c_str());
+                return -1;
+            }
+        }
+    }
+
+    maxIdle = proxy->poolSize;
+
+    if(maxIdle < 0)
+    {
+        log->error("invalid pool size\n");
+        return -1;
+    }
+
+    idle.reserve(maxIdle);
+
+    return 0;
+}
+
+
+int UpstreamConnectionPool::connect(bool &connected)
+{
+    if(backend->socketType == SocketType::tcp)
+    {
+        uint32_t addr = address;
+
+        if(resolverHost >= 0 && !resolver->getAddress(resolverHost, addr))
+        {
+            log->error("backend %s has no addresses\n", backend->address.c_str());
+            return -1;
+        }
+
+        return socketConnectNonBlock(addr, backend->port, connected, log);
+    }
+    // splice from unix domain sockets is supported since Linux 4.5, UpstreamGroup checks it
+    else if(backend->socketType == SocketType::unix)
+    {
+        return socketConnectUnixNonBlock(backend->address.c_str(), connected, log);
+    }
+
+    log->error("invalid socket type\n");
+    return -1;
+}
+
+
+int UpstreamConnectionPool::get(long long int curMillis, long long int &createTime, bool &connected, SSL* &ssl)
+{
+    while(!idle.empty())
+    {
+        IdleConnection con = idle.back();
+        idle.pop_back();
+
+        if(!expired(con.createTime, con.idleSince, curMillis) && isAlive(con.fd))
+        {
+            createTime = con.createTime;
+            connected = con.connected;
+            ssl = con.ssl;
+            return con.fd;
+        }
+
+        closeConnection(con.fd, con.ssl);
+    }
+
+    return -1;
+}
+
+
+void UpstreamConnectionPool::put(int fd, SSL *ssl, long long int createTime, long long int curMillis)
+{
+    if(static_cast<int>(idle.size()) >= maxIdle || expired(createTime, curMillis, curMillis))
+    {
+        closeConnection(fd, ssl);
+        return;
+    }
+
+    IdleConnection con;
+    con.fd = fd;
+    con.ssl = ssl;
+    con.createTime = createTime;
+    con.idleSince = curMillis;
+    con.connected = true;
+
+    idle.push_back(con);
+}
+
+
+void UpstreamConnectionPool::prewarm(long long int curMillis)
+{
+    for(int i = 0; i < proxy->poolPrewarm && static_cast<int>(idle.size()) < maxIdle; ++i)
+    {
+        bool connected = false;
+        int fd = connect(connected);
+
+        if(fd < 0)
+        {
+            log->warning("prewarm connection to %s failed\n", backend->address.c_str());
+            return;
+        }
+
+        IdleConnection con;
+        con.fd = fd;
+        con.ssl = nullptr;
+        con.createTime = curMillis;
+        con.idleSince = curMillis;
+        con.connected = connected;
+
+        idle.push_back(con);
+    }
+}
+
+
+void UpstreamConnectionPool::onTimer(long long int curMillis)
+{
+    std::vector<IdleConnection>::size_type keep = 0;
+
+    for(const IdleConnection &con : idle)
+    {
+        if(expired(con.createTime, con.idleSince, curMillis))
+        {
+            closeConnection(con.fd, con.ssl);
+        }
+        else
+        {
+            idle[keep++] = con;
+        }
+    }
+
+    idle.resize(keep);
+}
+
+
+void UpstreamConnectionPool::destroy()
+{
+    for(const IdleConnection &con : idle)
+    {
+        closeConnection(con.fd, con.ssl);
+    }
+    idle.clear();
+
+#ifdef USE_SSL
+    if(session != nullptr)
+    {
+        SSL_SESSION_free(session);
+        session = nullptr;
+    }
+#endif
+}
+
+
+int UpstreamConnectionPool::createSsl(int fd, SSL* &ssl)
+{
+#ifdef USE_SSL
+    ssl = SSL_new(sslCtx);
+
+    if(ssl == nullptr)
+    {
+        log->error("SSL_new for backend %s failed\n", backend->address.c_str());
+        return -1;
+    }
+
+    SSL_set_app_data(ssl, this);
+
+    if(SSL_set_fd(ssl, fd) != 1)
+    {
+        log->error("SSL_set_fd for backend %s failed\n", backend->address.c_str());
+        SSL_free(ssl);
+        ssl = nullptr;
+        return -1;
+    }
+
+    SSL_set_connect_state(ssl);
+
+    if(!serverName.empty())
+    {
+        SSL_set_tlsext_host_name(ssl, serverName.c_str());
+    }
+
+    if(proxy->tlsVerify)
+    {
+        SSL_set_verify(ssl, SSL_VERIFY_PEER, nullptr);
+
+        // backend set by IPv4 address is checked by IP address of certificate
+        int result = serverName.empty() ?
+                     (backend->socketType == SocketType::tcp ?
+                      X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), backend->address.c_str()) : 1) :
+                     SSL_set1_host(ssl, serverName.c_str());
+
+        if(result != 1)
+        {
+            log->error("name for certificate check of backend %s is invalid\n", backend->address.c_str());
+            SSL_free(ssl);
+            ssl = nullptr;
+            return -1;
+        }
+    }
+    else
+    {
+        SSL_set_verify(ssl, SSL_VERIFY_NONE, nullptr);
+    }
+
+    if(session != nullptr)
+    {
+        SSL_set_session(ssl, session);
+    }
+
+    return 0;
+#else
+    (void)fd;
+    ssl = nullptr;
+    log->error("tls of backends is not supported, server is built without USE_SSL\n");
+    return -1;
+#endif
+}
+
+
+#ifdef USE_SSL
+SSL_CTX* UpstreamConnectionPool::createSslContext(const std::string &caFile, Log *log)
+{
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+
+    if(ctx == nullptr)
+    {
+        log->error("SSL_CTX_new for backends failed\n");
+        return nullptr;
+    }
+
+    int result = caFile.empty() ? SSL_CTX_set_default_verify_paths(ctx) :
+                                  SSL_CTX_load_verify_locations(ctx, caFile.c_str(), nullptr);
+    if(result != 1)
+    {
+        log->error("CA certificates for backends are not loaded: %s\n", ERR_error_string(ERR_get_error(), nullptr));
+        SSL_CTX_free(ctx);
+        return nullptr;
+    }
+
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    // records are encrypted and decrypted by kernel, if it supports cipher
+#ifdef SSL_OP_ENABLE_KTLS
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+    // backend, which closes keep-alive connection without close_notify, ends connection as usual
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, newSession);
+
+    return ctx;
+}
+
+
+// is called in thread of poll loop of ssl, which owns pool
+int UpstreamConnectionPool::newSession(SSL *ssl, SSL_SESSION *session)
+{
+    UpstreamConnectionPool *pool = static_cast<UpstreamConnectionPool*>(SSL_get_app_data(ssl));
+
+    if(pool == nullptr)
+    {
+        return 0;
+    }
+
+    if(pool->session != nullptr)
+    {
+        SSL_SESSION_free(pool->session);
+    }
+
+    // reference of session is kept by pool
+    pool->session = session;
+
+    return 1;
+}
+#endif
+
+
+void UpstreamConnectionPool::closeConnection(int fd, SSL *ssl)
+{
+#ifdef USE_SSL
+    if(ssl != nullptr)
+    {
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+    }
+#else
+    (void)ssl;
+#endif
+
+    close(fd);
+}
+
+
+bool UpstreamConnectionPool::expired(long long int createTime, long long int idleSince, long long int curMillis) const
+{
+    return (curMillis - idleSince >= proxy->poolIdleTimeoutMillis) ||
+           (proxy->poolMaxAgeMillis > 0 && curMillis - createTime >= proxy->poolMaxAgeMillis);
+}
+
+
+// idle connection must not have data to read: end of file or data means that
+// backend closed connection or sent something unexpected.
+bool UpstreamConnectionPool::isAlive(int fd)
+{
+    char c;
+    ssize_t result = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+
+    return (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
@@ -0,0 +1,127 @@
+#ifndef UPSTREAM_CONNECTION_POOL_H
+#define UPSTREAM_CONNECTION_POOL_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#ifdef USE_SSL
+#    include <openssl/ssl.h>
+#else
+typedef struct ssl_st SSL;
+typedef struct ssl_ctx_st SSL_CTX;
+#endif
+
+class Log;
+class Resolver;
+struct ProxyParameters;
+struct BackendParameters;
+
+// Idle keep-alive connections to one backend of proxy. Every poll loop has own pools, no locks are used.
+// Idle connections are not registered in poll loop. Connection closed by backend is detected
+// when connection is taken from pool, expired connections are closed by onTimer.
+// Connections to TLS backend are kept with their ssl after handshake. Pool keeps last session of backend,
+// which is received from ssl of this poll loop, new connections resume it.
+
+class UpstreamConnectionPool
+{
+public:
+    UpstreamConnectionPool() = default;
+
+    ~UpstreamConnectionPool()
+    {
+        destroy();
+    }
+
+    UpstreamConnectionPool(const UpstreamConnectionPool &pool) = delete;
+    UpstreamConnectionPool(UpstreamConnectionPool &&pool) = delete;
+    UpstreamConnectionPool& operator=(const UpstreamConnectionPool &pool) = delete;
+    UpstreamConnectionPool& operator=(UpstreamConnectionPool && pool) = delete;
+
+    // sslCtx - client context, if proxy has tls
+    int init(const ProxyParameters *proxy, const BackendParameters *backend, Resolver *resolver, SSL_CTX *sslCtx,
+             Log *log);
+
+    // opens new non blocking connection to backend, next address is used, if backend is set by host name
+    int connect(bool &connected);
+
+    // returns idle connection or -1 if pool is empty.
+    // connected is false if connection was opened by prewarm and connect is not finished yet.
+    // ssl is set, if TLS handshake of connection is finished.
+    int get(long long int curMillis, long long int &createTime, bool &connected, SSL* &ssl);
+
+    // connection, which finished response, is kept in pool or closed if pool is full or connection is too old.
+    void put(int fd, SSL *ssl, long long int createTime, long long int curMillis);
+
+    // ssl of new connection to TLS backend with name for SNI and certificate check and session to resume
+    int createSsl(int fd, SSL* &ssl);
+
+    bool tls() const
+    {
+        return sslCtx != nullptr;
+    }
+
+    // opens proxy->poolPrewarm connections
+    void prewarm(long long int curMillis);
+
+    void onTimer(long long int curMillis);
+
+    void destroy();
+
+    bool enabled() const
+    {
+        return maxIdle > 0;
+    }
+
+#ifdef USE_SSL
+    // client context for all TLS backends. sessions are not cached by context, they are kept by pools.
+    // kTLS is enabled, if openssl supports it.
+    static SSL_CTX* createSslContext(const std::string &caFile, Log *log);
+#endif
+
+protected:
+
+    bool expired(long long int createTime, long long int idleSince, long long int curMillis) const;
+
+    static bool isAlive(int fd);
+
+    static void closeConnection(int fd, SSL *ssl);
+
+#ifdef USE_SSL
+    // new session callback of context, session is kept by pool of ssl
+    static int newSession(SSL *ssl, SSL_SESSION *session);
+
+    SSL_SESSION *session = nullptr;
+#endif
+
+    struct IdleConnection
+    {
+        int fd;
+        SSL *ssl;
+        long long int createTime;
+        long long int idleSince;
+        bool connected;
+    };
+
+    // used as stack: most recently used connection is taken first, old connections expire at bottom.
+    std::vector<IdleConnection> idle;
+
+    const ProxyParameters *proxy = nullptr;
+    const BackendParameters *backend = nullptr;
+
+    // address of tcp backend in network byte order, if backend is set by IPv4 address
+    uint32_t address = 0;
+    // backend is set by host name, addresses are taken from resolver
+    Resolver *resolver = nullptr;
+    int resolverHost = -1;
+
+    SSL_CTX *sslCtx = nullptr;
+    // name for SNI and certificate check, empty if backend is set by address and proxy has no tlsServerName
+    std::string serverName;
+
+    Log *log = nullptr;
+
+    int maxIdle = 0;
+};
+
+#endif
@@ -0,0 +1,903 @@
+#include <UpstreamGroup.h>
+#include <ProxyParameters.h>
+#include <HttpRequest.h>
+#include <NetworkUtils.h>
+#include <ExecutorData.h>
+#include <Log.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+
+int UpstreamGroup::init(const ProxyParameters *proxy, Resolver *resolver, SSL_CTX *sslCtx, Log *log)
+{
+    this->proxy = proxy;
+    this->log = log;
+
+    backendCount = static_cast<int>(proxy->backends.size());
+
+    if(backendCount == 0)
+    {
+        log->error("proxy %s has no backends\n", proxy->prefix.c_str());
+        return -1;
+    }
+
+    backends.reset(new Backend[backendCount]);
+
+    bool spliceUnix = true;
+
+    for(const BackendParameters &parameters : proxy->backends)
+    {
+        if(parameters.socketType == SocketType::unix)
+        {
+            spliceUnix = spliceUnixSupported(log);
+            break;
+        }
+    }
+
+    for(int i = 0; i < backendCount; ++i)
+    {
+        Backend &backend = backends[i];
+
+        backend.parameters = &proxy->backends[i];
+        // bytes of TLS backend are encrypted and decrypted by ssl
+        backend.splice = !proxy->tls && (backend.parameters->socketType != SocketType::unix || spliceUnix);
+        backend.maxInFlight = (backend.parameters->maxInFlight >= 0) ? backend.parameters->maxInFlight : proxy->maxInFlight;
+        backend.limit = backend.maxInFlight;
+
+        if(backend.pool.init(proxy, backend.parameters, resolver, sslCtx, log) != 0)
+        {
+            return -1;
+        }
+
+        // health check of TLS backend only connects
+        if(!proxy->healthCheckPath.empty() && !proxy->tls)
+        {
+            backend.checkRequest = "GET " + proxy->healthCheckPath + " HTTP/1.1\r\nHost: " + checkHost(backend) +
+                                   "\r\nConnection: close\r\nUser-Agent: epoll_http_server health check\r\n\r\n";
+        }
+    }
+
+    hedgeDelayMillis = proxy->hedgeMinDelayMillis;
+    latencySamples.clear();
+    nextSample = 0;
+
+    ring.clear();
+
+    if(proxy->balance == BalancePolicy::hash)
+    {
+        for(int i = 0; i < backendCount; ++i)
+        {
+            const BackendParameters *parameters = backends[i].parameters;
+            int points = parameters->weight * RING_POINTS_PER_WEIGHT;
+
+            for(int k = 0; k < points; ++k)
+            {
+                std::string name = parameters->address + ":" + std::to_string(parameters->port) + "-" + std::to_string(k);
+
+                RingPoint rp;
+                rp.point = hash(name.c_str(), static_cast<int>(name.size()));
+                rp.backend = i;
+                ring.push_back(rp);
+            }
+        }
+
+        std::sort(ring.begin(), ring.end(), [](const RingPoint &a, const RingPoint &b)
+        {
+            return a.point < b.point;
+        });
+    }
+
+    return 0;
+}
+
+
+// backend under limit is selected: caller checks isFull before select
+int UpstreamGroup::select(const HttpRequest &request, long long int curMillis)
+{
+    // every request adds share of retry budget
+    retryBudget += proxy->retryBudgetPercent;
+    if(retryBudget > RETRY_BUDGET_MAX)
+    {
+        retryBudget = RETRY_BUDGET_MAX;
+    }
+
+    if(backendCount == 1)
+    {
+        return 0;
+    }
+
+    totalWeight = updateWeights(curMillis);
+
+    switch(proxy->balance)
+    {
+    case BalancePolicy::leastOutstanding:
+        return selectLeastOutstanding();
+    case BalancePolicy::ewma:
+        return selectEwma();
+    case BalancePolicy::hash:
+        return selectHash(request);
+    default:
+        return selectRoundRobin();
+    }
+}
+
+
+int UpstreamGroup::selectOther(int backend, long long int curMillis)
+{
+    if(backendCount == 1)
+    {
+        return -1;
+    }
+
+    totalWeight = updateWeights(curMillis);
+
+    int best = -1;
+
+    for(int k = 0; k < backendCount; ++k)
+    {
+        int i = (nextStart + k) % backendCount;
+
+        if(i == backend || !backends[i].healthy || backends[i].effectiveWeight == 0)
+        {
+            continue;
+        }
+
+        if(best < 0 ||
+           static_cast<long long int>(backends[i].outstanding + 1) * backends[best].effectiveWeight <
+           static_cast<long long int>(backends[best].outstanding + 1) * backends[i].effectiveWeight)
+        {
+            best = i;
+        }
+    }
+
+    nextStart = (nextStart + 1) % backendCount;
+
+    return best;
+}
+
+
+bool UpstreamGroup::takeRetry()
+{
+    if(retryBudget < RETRY_TOKEN)
+    {
+        return false;
+    }
+
+    retryBudget -= RETRY_TOKEN;
+
+    return true;
+}
+
+
+bool UpstreamGroup::hasCapacity(const Backend &b) const
+{
+    return b.maxInFlight == 0 || b.outstanding < static_cast<int>(b.limit);
+}
+
+
+bool UpstreamGroup::isFull() const
+{
+    for(int i = 0; i < backendCount; ++i)
+    {
+        if(hasCapacity(backends[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool UpstreamGroup::enqueue(ExecutorData *data, long long int curMillis)
+{
+    if(queueLength >= proxy->queueSize)
+    {
+        return false;
+    }
+
+    data->upstreamQueue = this;
+    data->queueTime = curMillis;
+    data->queuePrev = queueTail;
+    data->queueNext = nullptr;
+
+    if(queueTail != nullptr)
+    {
+        queueTail->queueNext = data;
+    }
+    else
+    {
+        queueHead = data;
+    }
+    queueTail = data;
+
+    ++queueLength;
+
+    return true;
+}
+
+
+// oldest request is started first. if it waited more than half of timeout, queue is overloaded:
+// oldest requests will time out anyway, newest request is started, it still has time for response.
+ExecutorData* UpstreamGroup::dequeue(long long int curMillis)
+{
+    if(queueHead == nullptr)
+    {
+        return nullptr;
+    }
+
+    ExecutorData *data = nullptr;
+    long long int waited = curMillis - queueHead->queueTime;
+
+    if(waited > proxy->queueTimeoutMillis)
+    {
+        data = queueHead;
+    }
+    else if(!isFull())
+    {
+        data = (waited > proxy->queueTimeoutMillis / 2) ? queueTail : queueHead;
+    }
+
+    if(data != nullptr)
+    {
+        removeQueued(data);
+    }
+
+    return data;
+}
+
+
+void UpstreamGroup::removeQueued(ExecutorData *data)
+{
+    if(data->queuePrev != nullptr)
+    {
+        data->queuePrev->queueNext = data->queueNext;
+    }
+    else
+    {
+        queueHead = data->queueNext;
+    }
+
+    if(data->queueNext != nullptr)
+    {
+        data->queueNext->queuePrev = data->queuePrev;
+    }
+    else
+    {
+        queueTail = data->queuePrev;
+    }
+
+    data->queuePrev = nullptr;
+    data->queueNext = nullptr;
+    data->upstreamQueue = nullptr;
+
+    --queueLength;
+}
+
+
+void UpstreamGroup::startRequest(int backend)
+{
+    ++backends[backend].outstanding;
+}
+
+
+void UpstreamGroup::finishRequest(int backend)
+{
+    if(backends[backend].outstanding > 0)
+    {
+        --backends[backend].outstanding;
+    }
+}
+
+
+void UpstreamGroup::reportResponse(int backend, long long int millis)
+{
+    Backend &b = backends[backend];
+
+    b.failures = 0;
+
+    if(proxy->hedgePercentile > 0)
+    {
+        if(static_cast<int>(latencySamples.size()) < LATENCY_SAMPLES)
+        {
+            latencySamples.push_back(static_cast<int>(millis));
+        }
+        else
+        {
+            latencySamples[nextSample] = static_cast<int>(millis);
+            nextSample = (nextSample + 1) % LATENCY_SAMPLES;
+        }
+        samplesChanged = true;
+    }
+
+    if(b.ewmaMillis == 0)
+    {
+        b.ewmaMillis = millis;
+    }
+    else
+    {
+        b.ewmaMillis += EWMA_ALPHA * (millis - b.ewmaMillis);
+    }
+
+    if(proxy->maxInFlightAdaptive && b.maxInFlight > 0)
+    {
+        updateLimit(b, millis);
+    }
+}
+
+
+// gradient is ratio of long term and short term average response times. if backend is queueing requests,
+// short term average grows, gradient goes below 1 and limit is lowered. while gradient is 1,
+// limit grows by square root of limit, so it comes back to maxInFlight after recovery.
+void UpstreamGroup::updateLimit(Backend &b, long long int millis)
+{
+    if(b.longEwmaMillis == 0)
+    {
+        b.longEwmaMillis = millis;
+    }
+    else
+    {
+        b.longEwmaMillis += LONG_EWMA_ALPHA * (millis - b.longEwmaMillis);
+    }
+
+    // baseline follows recovery of backend faster than its degradation
+    if(b.longEwmaMillis > 2 * b.ewmaMillis)
+    {
+        b.longEwmaMillis *= 0.95;
+    }
+
+    // milliseconds of local backends are often 0
+    double gradient = LIMIT_TOLERANCE * (b.longEwmaMillis + 1) / (b.ewmaMillis + 1);
+    gradient = std::max(0.5, std::min(1.0, gradient));
+
+    // limit, which is not used, is not raised
+    if(gradient == 1.0 && b.outstanding < b.limit / 2)
+    {
+        return;
+    }
+
+    double newLimit = b.limit * gradient + std::sqrt(b.limit);
+
+    b.limit = b.limit * (1 - LIMIT_SMOOTHING) + newLimit * LIMIT_SMOOTHING;
+    b.limit = std::max(1.0, std::min(static_cast<double>(b.maxInFlight), b.limit));
+}
+
+
+void UpstreamGroup::reportFailure(int backend, long long int curMillis)
+{
+    Backend &b = backends[backend];
+
+    ++b.failures;
+
+    if(b.healthy && proxy->maxFails > 0 && b.failures >= proxy->maxFails)
+    {
+        setHealthy(b, false, curMillis);
+    }
+}
+
+
+void UpstreamGroup::setHealthy(Backend &b, bool healthy, long long int curMillis)
+{
+    b.healthy = healthy;
+    b.failures = 0;
+
+    if(healthy)
+    {
+        b.recoverTime = curMillis;
+        log->info("backend %s:%d of proxy %s is healthy\n",
+                  b.parameters->address.c_str(), b.parameters->port, proxy->prefix.c_str());
+    }
+    else
+    {
+        b.ejectedUntil = curMillis + proxy->failTimeoutMillis;
+        log->warning("backend %s:%d of proxy %s is ejected\n",
+                     b.parameters->address.c_str(), b.parameters->port, proxy->prefix.c_str());
+    }
+}
+
+
+// weights of healthy backends, scaled by WEIGHT_SCALE. recovered backend gets linearly growing share
+// during slow start. if all backends are ejected, all are used: request to ejected backend is better than no request.
+// backends at limit of requests in flight get no requests.
+int UpstreamGroup::updateWeights(long long int curMillis)
+{
+    int total = 0;
+
+    for(int i = 0; i < backendCount; ++i)
+    {
+        Backend &b = backends[i];
+
+        b.effectiveWeight = 0;
+
+        if(b.healthy && hasCapacity(b))
+        {
+            b.effectiveWeight = b.parameters->weight * WEIGHT_SCALE;
+
+            long long int elapsed = curMillis - b.recoverTime;
+
+            if(b.recoverTime > 0 && elapsed < proxy->slowStartMillis)
+            {
+                b.effectiveWeight = std::max(b.effectiveWeight / 10,
+                                             static_cast<int>(b.effectiveWeight * elapsed / proxy->slowStartMillis));
+            }
+        }
+
+        total += b.effectiveWeight;
+    }
+
+    if(total == 0)
+    {
+        for(int i = 0; i < backendCount; ++i)
+        {
+            if(hasCapacity(backends[i]))
+            {
+                backends[i].effectiveWeight = backends[i].parameters->weight * WEIGHT_SCALE;
+                total += backends[i].effectiveWeight;
+            }
+        }
+    }
+
+    return total;
+}
+
+
+void UpstreamGroup::prewarm(long long int curMillis)
+{
+    for(int i = 0; i < backendCount; ++i)
+    {
+        backends[i].pool.prewarm(curMillis);
+    }
+}
+
+
+void UpstreamGroup::onTimer(long long int curMillis)
+{
+    if(samplesChanged)
+    {
+        updateHedgeDelay();
+    }
+
+    for(int i = 0; i < backendCount; ++i)
+    {
+        Backend &b = backends[i];
+
+        b.pool.onTimer(curMillis);
+
+        if(proxy->healthCheckIntervalMillis > 0)
+        {
+            runHealthCheck(b, curMillis);
+        }
+        else if(!b.healthy && curMillis >= b.ejectedUntil)
+        {
+            setHealthy(b, true, curMillis);
+        }
+    }
+}
+
+
+void UpstreamGroup::updateHedgeDelay()
+{
+    samplesChanged = false;
+
+    if(static_cast<int>(latencySamples.size()) < MIN_HEDGE_SAMPLES)
+    {
+        return;
+    }
+
+    sortedSamples = latencySamples;
+
+    auto nth = sortedSamples.begin() + sortedSamples.size() * proxy->hedgePercentile / 100;
+    std::nth_element(sortedSamples.begin(), nth, sortedSamples.end());
+
+    hedgeDelayMillis = std::max(static_cast<long long int>(*nth),
+                                static_cast<long long int>(proxy->hedgeMinDelayMillis));
+}
+
+
+void UpstreamGroup::destroy()
+{
+    for(int i = 0; i < backendCount; ++i)
+    {
+        if(backends[i].checkFd >= 0)
+        {
+            close(backends[i].checkFd);
+            backends[i].checkFd = -1;
+        }
+        backends[i].checkState = Backend::CheckState::idle;
+    }
+}
+
+
+// Check connection is not registered in poll loop: its state is polled with zero timeout
+// on every timer call, checks are rare and timer resolution is enough for them.
+void UpstreamGroup::runHealthCheck(Backend &b, long long int curMillis)
+{
+    if(b.checkState == Backend::CheckState::idle)
+    {
+        if(curMillis >= b.nextCheckTime)
+        {
+            startHealthCheck(b, curMillis);
+        }
+        return;
+    }
+
+    int result = continueHealthCheck(b);
+
+    if(result != 0)
+    {
+        finishHealthCheck(b, result > 0, curMillis);
+    }
+    else if(curMillis - b.checkStartTime >= proxy->healthCheckTimeoutMillis)
+    {
+        log->debug("health check of backend %s:%d timed out\n", b.parameters->address.c_str(), b.parameters->port);
+        finishHealthCheck(b, false, curMillis);
+    }
+}
+
+
+void UpstreamGroup::startHealthCheck(Backend &b, long long int curMillis)
+{
+    bool connected = false;
+
+    b.checkStartTime = curMillis;
+    b.checkBytes = 0;
+    b.checkFd = b.pool.connect(connected);
+
+    if(b.checkFd < 0)
+    {
+        finishHealthCheck(b, false, curMillis);
+        return;
+    }
+
+    b.checkState = Backend::CheckState::connecting;
+
+    int result = continueHealthCheck(b);
+
+    if(result != 0)
+    {
+        finishHealthCheck(b, result > 0, curMillis);
+    }
+}
+
+
+int UpstreamGroup::continueHealthCheck(Backend &b)
+{
+    if(b.checkState == Backend::CheckState::connecting)
+    {
+        struct pollfd pfd;
+        pfd.fd = b.checkFd;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+
+        if(poll(&pfd, 1, 0) <= 0)
+        {
+            return 0;
+        }
+
+        int socketError = 0;
+        socklen_t len = sizeof(socketError);
+
+        if(getsockopt(b.checkFd, SOL_SOCKET, SO_ERROR, &socketError, &len) != 0 || socketError != 0)
+        {
+            return -1;
+        }
+
+        if(b.checkRequest.empty())
+        {
+            return 1;
+        }
+
+        b.checkState = Backend::CheckState::sending;
+    }
+
+    if(b.checkState == Backend::CheckState::sending)
+    {
+        int size = static_cast<int>(b.checkRequest.size()) - b.checkBytes;
+        ssize_t bytesWritten = send(b.checkFd, b.checkRequest.c_str() + b.checkBytes, size, MSG_NOSIGNAL);
+
+        if(bytesWritten < 0)
+        {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+
+        b.checkBytes += static_cast<int>(bytesWritten);
+
+        if(b.checkBytes < static_cast<int>(b.checkRequest.size()))
+        {
+            return 0;
+        }
+
+        b.checkState = Backend::CheckState::receiving;
+        b.checkBytes = 0;
+    }
+
+    // status line: "HTTP/1.1 200 ", only first bytes of response are read
+    const int statusLineSize = 12;
+
+    ssize_t bytesRead = recv(b.checkFd, b.checkResponse + b.checkBytes, statusLineSize - b.checkBytes, 0);
+
+    if(bytesRead < 0)
+    {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+    if(bytesRead == 0)
+    {
+        return -1;
+    }
+
+    b.checkBytes += static_cast<int>(bytesRead);
+
+    if(b.checkBytes < statusLineSize)
+    {
+        return 0;
+    }
+
+    if(strncmp(b.checkResponse, "HTTP/1.", 7) != 0 || b.checkResponse[8] != ' ' ||
+       (b.checkResponse[9] != '2' && b.checkResponse[9] != '3'))
+    {
+        return -1;
+    }
+
+    return 1;
+}
+
+
+// Host of tcp backend is its address and port, unix socket backend gets localhost
+std::string UpstreamGroup::checkHost(const Backend &b)
+{
+    if(b.parameters->socketType != SocketType::tcp)
+    {
+        return "localhost";
+    }
+    if(b.parameters->port == 80)
+    {
+        return b.parameters->address;
+    }
+    return b.parameters->address + ":" + std::to_string(b.parameters->port);
+}
+
+
+// failed check is counted as failure of backend, checks of ejected backend do not extend ejection:
+// first successful check returns backend.
+void UpstreamGroup::finishHealthCheck(Backend &b, bool ok, long long int curMillis)
+{
+    if(b.checkFd >= 0)
+    {
+        close(b.checkFd);
+        b.checkFd = -1;
+    }
+
+    b.checkState = Backend::CheckState::idle;
+    b.nextCheckTime = curMillis + proxy->healthCheckIntervalMillis;
+
+    if(ok)
+    {
+        if(!b.healthy)
+        {
+            setHealthy(b, true, curMillis);
+        }
+        else
+        {
+            b.failures = 0;
+        }
+    }
+    else if(b.healthy)
+    {
+        ++b.failures;
+
+        if(b.failures >= std::max(proxy->maxFails, 1))
+        {
+            setHealthy(b, false, curMillis);
+        }
+    }
+}
+
+
+int UpstreamGroup::selectRoundRobin()
+{
+    int best = -1;
+
+    for(int i = 0; i < backendCount; ++i)
+    {
+        Backend &b = backends[i];
+
+        if(b.effectiveWeight == 0)
+        {
+            b.currentWeight = 0;
+            continue;
+        }
+
+        b.currentWeight += b.effectiveWeight;
+
+        if(best < 0 || b.currentWeight > backends[best].currentWeight)
+        {
+            best = i;
+        }
+    }
+
+    backends[best].currentWeight -= totalWeight;
+
+    return best;
+}
+
+
+// minimal outstanding / weight
+int UpstreamGroup::selectLeastOutstanding()
+{
+    int best = -1;
+
+    for(int k = 0; k < backendCount; ++k)
+    {
+        int i = (nextStart + k) % backendCount;
+
+        if(backends[i].effectiveWeight == 0)
+        {
+            continue;
+        }
+
+        if(best < 0 ||
+           static_cast<long long int>(backends[i].outstanding + 1) * backends[best].effectiveWeight <
+           static_cast<long long int>(backends[best].outstanding + 1) * backends[i].effectiveWeight)
+        {
+            best = i;
+        }
+    }
+
+    nextStart = (nextStart + 1) % backendCount;
+
+    return best;
+}
+
+
+// minimal latency * (outstanding + 1) / weight. backend without latency samples is tried first.
+int UpstreamGroup::selectEwma()
+{
+    int best = -1;
+    double bestScore = 0;
+
+    for(int k = 0; k < backendCount; ++k)
+    {
+        int i = (nextStart + k) % backendCount;
+        const Backend &b = backends[i];
+
+        if(b.effectiveWeight == 0)
+        {
+            continue;
+        }
+
+        double score = (b.ewmaMillis + 1) * (b.outstanding + 1) / b.effectiveWeight;
+
+        if(best < 0 || score < bestScore)
+        {
+            best = i;
+            bestScore = score;
+        }
+    }
+
+    nextStart = (nextStart + 1) % backendCount;
+
+    return best;
+}
+
+
+int UpstreamGroup::selectHash(const HttpRequest &request)
+{
+    const char *key;
+    int keyLength;
+
+    if(getHashKey(request, &key, &keyLength) != 0 || ring.empty())
+    {
+        return selectRoundRobin();
+    }
+
+    RingPoint rp;
+    rp.point = hash(key, keyLength);
+    rp.backend = 0;
+
+    auto iter = std::lower_bound(ring.begin(), ring.end(), rp, [](const RingPoint &a, const RingPoint &b)
+    {
+        return a.point < b.point;
+    });
+
+    // keys of ejected backend go to next backends on ring, other keys stay where they are
+    for(size_t k = 0; k < ring.size(); ++k)
+    {
+        if(iter == ring.end())
+        {
+            iter = ring.begin();
+        }
+
+        if(backends[iter->backend].effectiveWeight > 0)
+        {
+            return iter->backend;
+        }
+
+        ++iter;
+    }
+
+    return selectRoundRobin();
+}
+
+
+int UpstreamGroup::getHashKey(const HttpRequest &request, const char **key, int *keyLength) const
+{
+    if(proxy->hashKeyType == HashKeyType::path)
+    {
+        *key = request.getUrl();
+        if(*key == nullptr)
+        {
+            return -1;
+        }
+        *keyLength = strlen(*key);
+        return 0;
+    }
+
+    if(proxy->hashKeyType == HashKeyType::header)
+    {
+        return request.getHeaderValue(proxy->hashKeyName.c_str(), key, keyLength);
+    }
+
+    // cookie: "name1=value1; name2=value2"
+    const char *ptr;
+    int length;
+
+    if(request.getHeaderValue("Cookie", &ptr, &length) != 0)
+    {
+        return -1;
+    }
+
+    const char *name = proxy->hashKeyName.c_str();
+    int nameLength = static_cast<int>(proxy->hashKeyName.size());
+    const char *end = ptr + length;
+
+    while(ptr < end)
+    {
+        for(; ptr < end && (*ptr == ' ' || *ptr == ';'); ++ptr);
+
+        const char *pairEnd = static_cast<const char*>(memchr(ptr, ';', end - ptr));
+        if(pairEnd == nullptr)
+        {
+            pairEnd = end;
+        }
+
+        if(pairEnd - ptr > nameLength && ptr[nameLength] == '=' && strncmp(ptr, name, nameLength) == 0)
+        {
+            *key = ptr + nameLength + 1;
+            *keyLength = pairEnd - *key;
+            return 0;
+        }
+
+        ptr = pairEnd;
+    }
+
+    return -1;
+}
+
+
+// FNV-1a with murmur3 finalizer, so near keys are spread over ring
+uint32_t UpstreamGroup::hash(const char *data, int size)
+{
+    uint32_t h = 2166136261u;
+
+    for(int i = 0; i < size; ++i)
+    {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 16777619u;
+    }
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+
+    return h;
+}
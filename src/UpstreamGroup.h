@@ -0,0 +1,252 @@
+#ifndef UPSTREAM_GROUP_H
+#define UPSTREAM_GROUP_H
+
+#include <UpstreamConnectionPool.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class Log;
+class Resolver;
+struct ExecutorData;
+class HttpRequest;
+struct ProxyParameters;
+struct BackendParameters;
+
+// Backends of one proxy in one poll loop: connection pools, counters for load balancing, health and limits.
+// Every poll loop balances own requests with own counters, no locks are used.
+
+class UpstreamGroup
+{
+public:
+    UpstreamGroup() = default;
+
+    ~UpstreamGroup()
+    {
+        destroy();
+    }
+
+    UpstreamGroup(const UpstreamGroup &group) = delete;
+    UpstreamGroup(UpstreamGroup &&group) = delete;
+    UpstreamGroup& operator=(const UpstreamGroup &group) = delete;
+    UpstreamGroup& operator=(UpstreamGroup && group) = delete;
+
+    // sslCtx - client context for proxies with tls
+    int init(const ProxyParameters *proxy, Resolver *resolver, SSL_CTX *sslCtx, Log *log);
+
+    // returns index of backend for request or -1
+    int select(const HttpRequest &request, long long int curMillis);
+
+    UpstreamConnectionPool* getPool(int backend)
+    {
+        return &backends[backend].pool;
+    }
+
+    const BackendParameters* getBackendParameters(int backend) const
+    {
+        return backends[backend].parameters;
+    }
+
+    int getBackendCount() const
+    {
+        return backendCount;
+    }
+
+    // bodies can be spliced from and to connections of backend
+    bool canSplice(int backend) const
+    {
+        return backends[backend].splice;
+    }
+
+    // other backend for retry or hedged request: healthy backend with least outstanding / weight. -1 if there is none.
+    int selectOther(int backend, long long int curMillis);
+
+    // takes token of retry budget, returns false if budget is spent
+    bool takeRetry();
+
+    long long int getHedgeDelay() const
+    {
+        return hedgeDelayMillis;
+    }
+
+    // every backend is at limit of requests in flight
+    bool isFull() const;
+
+    // returns false if queue is full
+    bool enqueue(ExecutorData *data, long long int curMillis);
+
+    // request, which waits longer than queue timeout, or request, which can be started now. nullptr if there is none.
+    // request is removed from queue.
+    ExecutorData* dequeue(long long int curMillis);
+
+    void removeQueued(ExecutorData *data);
+
+    // request is sent to backend
+    void startRequest(int backend);
+
+    // backend finished response or request failed
+    void finishRequest(int backend);
+
+    // response headers are received. millis - time from start of request till response headers.
+    void reportResponse(int backend, long long int millis);
+
+    // connect to backend failed or backend closed connection without response
+    void reportFailure(int backend, long long int curMillis);
+
+    bool isHealthy(int backend) const
+    {
+        return backends[backend].healthy;
+    }
+
+    void prewarm(long long int curMillis);
+
+    // closes expired pool connections, runs active health checks
+    void onTimer(long long int curMillis);
+
+    void destroy();
+
+protected:
+
+    struct Backend;
+
+    int selectRoundRobin();
+    int selectLeastOutstanding();
+    int selectEwma();
+    int selectHash(const HttpRequest &request);
+
+    // sets effective weights of backends, returns total
+    int updateWeights(long long int curMillis);
+
+    void setHealthy(Backend &b, bool healthy, long long int curMillis);
+
+    void updateHedgeDelay();
+
+    bool hasCapacity(const Backend &b) const;
+
+    void updateLimit(Backend &b, long long int millis);
+
+    void runHealthCheck(Backend &b, long long int curMillis);
+    void startHealthCheck(Backend &b, long long int curMillis);
+    // returns 1 if check is finished successfully, 0 if check is not finished, -1 if check failed
+    int continueHealthCheck(Backend &b);
+    void finishHealthCheck(Backend &b, bool ok, long long int curMillis);
+
+    static std::string checkHost(const Backend &b);
+
+    int getHashKey(const HttpRequest &request, const char **key, int *keyLength) const;
+
+    static uint32_t hash(const char *data, int size);
+
+    struct Backend
+    {
+        const BackendParameters *parameters = nullptr;
+
+        UpstreamConnectionPool pool;
+
+        // tcp, or unix socket and kernel supports splice from it. bodies of tls backends are not spliced.
+        bool splice = true;
+
+        // requests sent to backend and not finished yet
+        int outstanding = 0;
+
+        double ewmaMillis = 0;
+        // baseline of adaptive limit
+        double longEwmaMillis = 0;
+
+        // limit of outstanding requests, 0 - no limit. backend at limit is skipped by select.
+        int maxInFlight = 0;
+        // adaptive limit follows gradient of response times: short term average over long term average
+        double limit = 0;
+
+        // smooth weighted round robin: backend with largest current weight is selected,
+        // its current weight is decreased by total weight.
+        int currentWeight = 0;
+
+        // weight * WEIGHT_SCALE, reduced during slow start, 0 if backend is ejected
+        int effectiveWeight = 0;
+
+        // backend is ejected after consecutive failures, reported by executors (passive checks)
+        // or found by checks run from onTimer (active checks). ejected backend is skipped by select,
+        // if there is a healthy backend.
+        bool healthy = true;
+        // consecutive failures of requests or active checks
+        int failures = 0;
+        // passive ejection ends, when active checks are disabled
+        long long int ejectedUntil = 0;
+        // backend became healthy again, 0 if it was not ejected
+        long long int recoverTime = 0;
+
+        enum class CheckState
+        {
+            idle, connecting, sending, receiving
+        };
+
+        // active health check connection
+        CheckState checkState = CheckState::idle;
+        int checkFd = -1;
+        long long int checkStartTime = 0;
+        long long int nextCheckTime = 0;
+        int checkBytes = 0;
+        char checkResponse[16];
+        // request of http health check with Host of backend, empty - check only connects (tls backend)
+        std::string checkRequest;
+    };
+
+    std::unique_ptr<Backend[]> backends;
+    int backendCount = 0;
+    int totalWeight = 0;
+
+    static const int WEIGHT_SCALE = 100;
+
+    // first backend checked by least outstanding and ewma policies, equal backends are selected in turn.
+    int nextStart = 0;
+
+    // consistent hash ring, sorted by point
+    struct RingPoint
+    {
+        uint32_t point;
+        int backend;
+    };
+
+    std::vector<RingPoint> ring;
+
+    static const int RING_POINTS_PER_WEIGHT = 40;
+
+    // retries of failed connects and hedged requests go to other backend, every request adds
+    // retryBudgetPercent of token, retry takes whole token. budget in hundredths of token, is full at start.
+    static const int RETRY_TOKEN = 100;
+    static const int RETRY_BUDGET_MAX = 10 * RETRY_TOKEN;
+    int retryBudget = RETRY_BUDGET_MAX;
+
+    // response times of recent requests to all backends, ring. is collected, if hedging is enabled.
+    static const int LATENCY_SAMPLES = 256;
+    // min delay of proxy is used, till there are less samples
+    static const int MIN_HEDGE_SAMPLES = 20;
+    std::vector<int> latencySamples;
+    // samples sorted by updateHedgeDelay, is kept to avoid allocations
+    std::vector<int> sortedSamples;
+    int nextSample = 0;
+    bool samplesChanged = false;
+    // percentile of latency samples, is updated by onTimer
+    long long int hedgeDelayMillis = 0;
+
+    // requests, which wait, while all backends are at limit, poll loop starts them, when backend finishes
+    // other request. list of ExecutorData::queuePrev and queueNext, head is oldest.
+    ExecutorData *queueHead = nullptr;
+    ExecutorData *queueTail = nullptr;
+    int queueLength = 0;
+
+    // weight of new latency sample
+    static constexpr double EWMA_ALPHA = 0.3;
+    static constexpr double LONG_EWMA_ALPHA = 0.02;
+    // short term average can exceed long term one by this factor, before limit is lowered
+    static constexpr double LIMIT_TOLERANCE = 1.5;
+    static constexpr double LIMIT_SMOOTHING = 0.2;
+
+    const ProxyParameters *proxy = nullptr;
+    Log *log = nullptr;
+};
+
+#endif
@@ -3,6 +3,15 @@
 #include <unistd.h>
 #include <errno.h>
 
+void Executor::onTimer(long long int /*curMillis*/)
+{
+}
+
+bool Executor::detachClient(ExecutorData &/*data*/)
+{
+    return false;
+}
+
 ssize_t Executor::readFd0(ExecutorData &data, void *buf, size_t count, int &errorCode)
 {
     ssize_t result = read(data.fd0, buf, count);
@@ -19,6 +28,11 @@ ssize_t Executor::readFd0(ExecutorData &data, void *buf, size_t count, int &erro
     return result;
 }
 
+bool Executor::pendingFd0(ExecutorData &/*data*/)
+{
+    return false;
+}
+
 ssize_t Executor::writeFd0(ExecutorData &data, const void *buf, size_t count, int &errorCode)
 {
     ssize_t result = write(data.fd0, buf, count);
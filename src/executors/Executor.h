@@ -13,17 +13,27 @@ public:
 
     virtual int init(PollLoopBase *loop) = 0;
 
+    // returns 0, if executor continues, 1, if request is answered and executor is removed, -1 on error
     virtual int up(ExecutorData &data) = 0;
 
     virtual ProcessResult process(ExecutorData &data, int fd, int events) = 0;
 
     virtual const char *name() const = 0;
 
+    // called by poll loop every PollLoopBase::TIMER_INTERVAL_MILLIS
+    virtual void onTimer(long long int curMillis);
+
+    // client is gone or timed out. returns true, if executor continues without client, otherwise it is removed.
+    virtual bool detachClient(ExecutorData &data);
+
 protected:
 
     virtual ssize_t readFd0(ExecutorData &data, void *buf, size_t count, int &errorCode);
     virtual ssize_t writeFd0(ExecutorData &data, const void *buf, size_t count, int &errorCode);
 
+    // fd0 has data, which is already read from socket and is not visible to poll (ssl)
+    virtual bool pendingFd0(ExecutorData &data);
+
 public:
 
     PollLoopBase *loop = nullptr;
@@ -223,7 +223,15 @@ ProcessResult FileExecutor::process_sendHeaders(ExecutorData &data)
 
 ProcessResult FileExecutor::process_sendFile(ExecutorData &data)
 {
-    ssize_t bytesWritten = sendfile(data.fd0, data.fd1, &data.filePosition, data.bytesToSend);
+    // send no more than budget, so large file does not delay other executors of loop.
+    // epoll is level triggered, so executor gets event again on next iteration.
+    size_t count = data.bytesToSend;
+    if(count > static_cast<size_t>(loop->parameters->sendBudgetBytes))
+    {
+        count = loop->parameters->sendBudgetBytes;
+    }
+
+    ssize_t bytesWritten = sendfile(data.fd0, data.fd1, &data.filePosition, count);
     if(bytesWritten <= 0)
     {
         if(errno == EAGAIN || errno == EWOULDBLOCK)
@@ -0,0 +1,2246 @@
+#include <ProxyExecutor.h>
+#include <RequestExecutor.h>
+#include <PollLoopBase.h>
+#include <NetworkUtils.h>
+#include <TimeUtils.h>
+#include <HttpResponse.h>
+#include <PollData.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <string.h>
+
+#ifdef USE_SSL
+#    include <SslUtils.h>
+#    include <openssl/err.h>
+#endif
+
+
+static const char *CACHE_HIT_HEADER = "X-Cache-Status: HIT\r\n";
+static const char *CACHE_STALE_HEADER = "X-Cache-Status: STALE\r\n";
+static const char *CACHE_MISS_HEADER = "X-Cache-Status: MISS\r\n";
+
+
+int ProxyExecutor::init(PollLoopBase *loop)
+{
+    this->loop = loop;
+    this->log = loop->log;
+    return 0;
+}
+
+
+int ProxyExecutor::up(ExecutorData &data)
+{
+    data.removeOnTimeout = true;
+
+    if(data.proxy == nullptr)
+    {
+        log->error("proxy parameters are not set\n");
+        return -1;
+    }
+
+    data.clientKeepAlive = data.request.keepAlive();
+
+    if(initRequestBody(data) != 0)
+    {
+        return -1;
+    }
+
+    long long int curMillis = getMilliseconds();
+
+    if(data.proxy->cache && loop->srv->cache.enabled())
+    {
+        bool revalidate = false;
+
+        if(ResponseCache::makeKey(data.request, *data.proxy, data.cacheKey, revalidate) == 0)
+        {
+            ResponseCache::Status status = ResponseCache::Status::miss;
+
+            if(!revalidate)
+            {
+                data.cacheEntry = loop->srv->cache.find(data.cacheKey, data.request, curMillis, status);
+
+                DiskCache::Hit hit;
+
+                if(!data.cacheEntry && useDiskCache(data) &&
+                   loop->srv->diskCache.open(data.cacheKey, curMillis, status, hit) == 0)
+                {
+                    return startDiskCachedResponse(data, status, hit);
+                }
+            }
+
+            if(data.cacheEntry)
+            {
+                return startCachedResponse(data, status);
+            }
+
+            data.responseInsert = CACHE_MISS_HEADER;
+
+            // response to HEAD has no body and is not stored
+            if(!isHeadRequest(data))
+            {
+                bool created = false;
+
+                data.cacheFill = loop->srv->cache.startFill(data.cacheKey, data.proxy->cacheCollapse, created);
+                data.cacheStore = true;
+
+                if(!created)
+                {
+                    return startCacheFillWait(data);
+                }
+            }
+        }
+        else
+        {
+            data.cacheKey.clear();
+        }
+    }
+
+    return startUpstream(data, curMillis);
+}
+
+
+int ProxyExecutor::startUpstream(ExecutorData &data, long long int curMillis)
+{
+    UpstreamGroup *upstream = loop->getUpstreamGroup(*data.proxy);
+
+    if(upstream->isFull())
+    {
+        return startWaitUpstream(data, upstream, curMillis);
+    }
+
+    data.backendIndex = upstream->select(data.request, curMillis);
+    if(data.backendIndex < 0)
+    {
+        log->warning("no backend for proxy %s\n", data.proxy->prefix.c_str());
+        return -1;
+    }
+
+    upstream->startRequest(data.backendIndex);
+    data.upstream = upstream;
+    data.upstreamStartTime = curMillis;
+
+    if(connectUpstream(data, true) != 0)
+    {
+        return -1;
+    }
+
+    if(pollFd(data, data.fd0, false, 0) != 0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+// only client connection is polled for close, while request is in queue
+int ProxyExecutor::startWaitUpstream(ExecutorData &data, UpstreamGroup *upstream, long long int curMillis)
+{
+    if(!upstream->enqueue(&data, curMillis))
+    {
+        log->info("queue of proxy %s is full\n", data.proxy->prefix.c_str());
+        rejectRequest(data);
+        return 1;
+    }
+
+    data.state = ExecutorData::State::waitUpstream;
+
+    if(data.pollData0 != nullptr)
+    {
+        return loop->editPollFd(data, data.fd0, 0);
+    }
+
+    return loop->addPollFd(data, data.fd0, 0);
+}
+
+
+ProcessResult ProxyExecutor::process_waitUpstream(ExecutorData &data)
+{
+    long long int curMillis = getMilliseconds();
+
+    if(curMillis - data.queueTime > data.proxy->queueTimeoutMillis)
+    {
+        log->info("request waited for backend of proxy %s longer than queue timeout\n", data.proxy->prefix.c_str());
+        rejectRequest(data);
+        return ProcessResult::removeExecutorOk;
+    }
+
+    return startUpstreamResult(startUpstream(data, curMillis));
+}
+
+
+ProcessResult ProxyExecutor::startUpstreamResult(int result) const
+{
+    if(result < 0)
+    {
+        return ProcessResult::removeExecutorError;
+    }
+
+    return (result > 0) ? ProcessResult::removeExecutorOk : ProcessResult::ok;
+}
+
+
+// request is read and nothing is written to client yet, so response fits into send buffer of socket
+void ProxyExecutor::rejectRequest(ExecutorData &data)
+{
+    char response[REJECT_RESPONSE_SIZE];
+    int size = HttpResponse::serviceUnavailable503(response, REJECT_RESPONSE_SIZE, loop->parameters->retryAfterSeconds);
+
+    if(size > 0)
+    {
+        int errorCode = 0;
+        writeFd0(data, response, size, errorCode);
+    }
+}
+
+
+// takes idle connection to selected backend from pool, if reuse is true, or opens new connection.
+int ProxyExecutor::connectUpstream(ExecutorData &data, bool reuse)
+{
+    UpstreamConnectionPool *pool = data.upstream->getPool(data.backendIndex);
+    long long int curMillis = getMilliseconds();
+    bool connected = false;
+
+    data.fd1 = -1;
+    data.upstreamReused = false;
+
+    if(reuse && pool->enabled())
+    {
+        data.fd1 = pool->get(curMillis, data.upstreamCreateTime, connected, data.upstreamSsl);
+        data.upstreamReused = (data.fd1 >= 0);
+    }
+
+    if(data.fd1 < 0)
+    {
+        data.fd1 = pool->connect(connected);
+        data.upstreamCreateTime = curMillis;
+
+        if(data.fd1 < 0)
+        {
+            reportUpstreamFailure(data);
+            return retryConnect(data);
+        }
+    }
+
+    // pooled connection keeps ssl after handshake, connection opened by prewarm has no ssl yet
+    bool handshake = false;
+
+    if(pool->tls() && data.upstreamSsl == nullptr)
+    {
+        if(pool->createSsl(data.fd1, data.upstreamSsl) != 0)
+        {
+            return -1;
+        }
+        handshake = true;
+    }
+
+    if(loop->addPollFd(data, data.fd1, EPOLLOUT) != 0)
+    {
+        return -1;
+    }
+
+    if(connected && handshake)
+    {
+        data.state = ExecutorData::State::upstreamHandshake;
+    }
+    else if(connected)
+    {
+        data.state = ExecutorData::State::forwardRequest;
+    }
+    else
+    {
+        data.state = ExecutorData::State::waitConnect;
+    }
+
+    return 0;
+}
+
+
+// reused connection can be closed by backend, while request is sent.
+// request is sent again over new connection, if response was not received yet and canResend allows it.
+ProcessResult ProxyExecutor::retryUpstream(ExecutorData &data)
+{
+    if(!canResend(data))
+    {
+        log->warning("reused upstream connection failed, request can not be sent again\n");
+        return ProcessResult::removeExecutorError;
+    }
+
+    log->debug("reused upstream connection failed, connect again\n");
+
+    closeFd1(data);
+
+    // whole request is still at start of buffer: request body was read with headers
+    // and nothing is read from upstream.
+    data.buffer.clear();
+    data.buffer.endWrite(static_cast<int>(data.requestBytes));
+    data.bytesToSend = data.requestBytes;
+
+    if(pollFd(data, data.fd0, false, 0) != 0)
+    {
+        return ProcessResult::removeExecutorError;
+    }
+
+    if(connectUpstream(data, false) != 0)
+    {
+        return ProcessResult::removeExecutorError;
+    }
+
+    return ProcessResult::ok;
+}
+
+
+// nothing is sent to failed backend yet, request is still in buffer.
+// retries are limited by proxy retryAttempts and retry budget of upstream group.
+int ProxyExecutor::retryConnect(ExecutorData &data)
+{
+    if(data.upstreamRetries >= data.proxy->retryAttempts)
+    {
+        return -1;
+    }
+
+    long long int curMillis = getMilliseconds();
+    int backend = data.upstream->selectOther(data.backendIndex, curMillis);
+
+    if(backend < 0 || !data.upstream->takeRetry())
+    {
+        log->debug("connect is not retried: no other backend or retry budget is spent\n");
+        return -1;
+    }
+
+    ++data.upstreamRetries;
+
+    log->info("connect to backend %d of proxy %s failed, request is sent to backend %d\n",
+              data.backendIndex, data.proxy->prefix.c_str(), backend);
+
+    if(data.fd1 >= 0 && closeFd1(data) != 0)
+    {
+        return -1;
+    }
+
+    data.upstream->finishRequest(data.backendIndex);
+    data.upstream->startRequest(backend);
+    data.backendIndex = backend;
+    data.upstreamStartTime = curMillis;
+
+    return connectUpstream(data, true);
+}
+
+
+// request, which is not sent yet, is sent again, if it is buffered. after any byte is sent,
+// only idempotent request is sent again.
+bool ProxyExecutor::canResend(const ExecutorData &data) const
+{
+    return data.requestBuffered && (data.bytesToSend == data.requestBytes || data.requestRetryable);
+}
+
+
+// only requests, which can be sent again without side effects, are hedged: GET and HEAD without body.
+bool ProxyExecutor::canHedge(const ExecutorData &data) const
+{
+    // hedge connection has no ssl
+    if(data.proxy->hedgePercentile == 0 || data.proxy->tls || !data.requestRetryable || data.upstream == nullptr ||
+       data.upstream->getBackendCount() < 2)
+    {
+        return false;
+    }
+
+    const char *method;
+    int methodLength;
+
+    if(data.request.getMethod(&method, &methodLength) != 0 ||
+       !((methodLength == 3 && strncmp(method, "GET", methodLength) == 0) || isHeadRequest(data)))
+    {
+        return false;
+    }
+
+    // request body or switch of protocol
+    const char *ptr;
+    int length;
+
+    return data.requestBytes == data.request.getContentStart() &&
+           data.request.getHeaderValue(HttpRequest::KnownHeader::upgrade, &ptr, &length) != 0;
+}
+
+
+int ProxyExecutor::startHedgeTimer(ExecutorData &data)
+{
+    data.fd2 = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if(data.fd2 < 0)
+    {
+        log->error("timerfd_create failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    long long int delay = data.upstream->getHedgeDelay();
+
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = 0;
+    spec.it_interval.tv_nsec = 0;
+    spec.it_value.tv_sec = delay / 1000;
+    spec.it_value.tv_nsec = (delay % 1000) * 1000000;
+
+    if(timerfd_settime(data.fd2, 0, &spec, nullptr) != 0)
+    {
+        log->error("timerfd_settime failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if(loop->addPollFd(data, data.fd2, EPOLLIN) != 0)
+    {
+        return -1;
+    }
+
+    data.hedgeState = ExecutorData::HedgeState::timer;
+
+    return 0;
+}
+
+
+// hedge is optional: if it can not be started, request waits for response of selected backend
+void ProxyExecutor::startHedge(ExecutorData &data)
+{
+    long long int curMillis = getMilliseconds();
+    UpstreamGroup *upstream = data.upstream;
+
+    int backend = upstream->selectOther(data.backendIndex, curMillis);
+
+    if(backend < 0 || !upstream->takeRetry())
+    {
+        log->debug("request is not hedged: no other backend or retry budget is spent\n");
+        return;
+    }
+
+    UpstreamConnectionPool *pool = upstream->getPool(backend);
+    bool connected = false;
+
+    data.hedgeReused = false;
+
+    if(pool->enabled())
+    {
+        SSL *ssl = nullptr;
+
+        data.fd2 = pool->get(curMillis, data.hedgeCreateTime, connected, ssl);
+        data.hedgeReused = (data.fd2 >= 0);
+    }
+
+    if(data.fd2 < 0)
+    {
+        data.fd2 = pool->connect(connected);
+        data.hedgeCreateTime = curMillis;
+
+        if(data.fd2 < 0)
+        {
+            upstream->reportFailure(backend, curMillis);
+            return;
+        }
+    }
+
+    upstream->startRequest(backend);
+    data.hedgeBackendIndex = backend;
+    data.hedgeStartTime = curMillis;
+    data.hedgeBytesSent = 0;
+    data.hedgeState = connected ? ExecutorData::HedgeState::send : ExecutorData::HedgeState::connect;
+
+    if(loop->addPollFd(data, data.fd2, EPOLLOUT) != 0)
+    {
+        cancelHedge(data);
+        return;
+    }
+
+    log->debug("request is hedged to backend %d after %lld ms\n", backend, curMillis - data.upstreamStartTime);
+}
+
+
+// failures of hedge connection do not fail request, it still waits for upstream connection
+ProcessResult ProxyExecutor::process_hedge(ExecutorData &data)
+{
+    switch(data.hedgeState)
+    {
+    case ExecutorData::HedgeState::timer:
+    {
+        uint64_t expirations;
+        if(read(data.fd2, &expirations, sizeof(expirations)) < 0 && errno == EAGAIN)
+        {
+            return ProcessResult::ok;
+        }
+
+        cancelHedge(data);
+
+        // nothing is received from upstream yet
+        if(data.state == ExecutorData::State::forwardResponse && data.upstream != nullptr &&
+           data.responseParser.getParsedBytes() == 0)
+        {
+            startHedge(data);
+        }
+        return ProcessResult::ok;
+    }
+    case ExecutorData::HedgeState::connect:
+    {
+        int socketError = socketConnectNonBlockCheck(data.fd2, log);
+
+        if(socketError == EINPROGRESS)
+        {
+            return ProcessResult::ok;
+        }
+        if(socketError != 0)
+        {
+            log->debug("connect of hedged request failed: %d\n", socketError);
+            if(!data.hedgeReused)
+            {
+                data.upstream->reportFailure(data.hedgeBackendIndex, getMilliseconds());
+            }
+            cancelHedge(data);
+            return ProcessResult::ok;
+        }
+
+        data.hedgeState = ExecutorData::HedgeState::send;
+        sendHedge(data);
+        return ProcessResult::ok;
+    }
+    case ExecutorData::HedgeState::send:
+        sendHedge(data);
+        return ProcessResult::ok;
+    case ExecutorData::HedgeState::wait:
+    {
+        char c;
+        ssize_t bytes = recv(data.fd2, &c, 1, MSG_PEEK);
+
+        if(bytes > 0)
+        {
+            if(promoteHedge(data) != 0)
+            {
+                return ProcessResult::removeExecutorError;
+            }
+            return process_forwardResponseRead(data);
+        }
+        if(bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return ProcessResult::ok;
+        }
+
+        log->debug("hedge connection is closed without response\n");
+        cancelHedge(data);
+        return ProcessResult::ok;
+    }
+    default:
+        log->warning("invalid process call (hedge)\n");
+        return ProcessResult::removeExecutorError;
+    }
+}
+
+
+void ProxyExecutor::sendHedge(ExecutorData &data)
+{
+    void *p;
+    int size;
+
+    // nothing is read from upstream connection yet, so request is still at start of buffer,
+    // as for retryUpstream. response bytes cancel hedge before it is written again.
+    data.buffer.startWrite(p, size);
+
+    ssize_t bytesWritten = write(data.fd2, static_cast<char*>(p) + data.hedgeBytesSent,
+                                 data.requestBytes - data.hedgeBytesSent);
+
+    if(bytesWritten < 0)
+    {
+        if(errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            log->debug("write of hedged request failed: %s\n", strerror(errno));
+            cancelHedge(data);
+        }
+        return;
+    }
+
+    data.hedgeBytesSent += bytesWritten;
+
+    if(data.hedgeBytesSent == data.requestBytes)
+    {
+        data.hedgeState = ExecutorData::HedgeState::wait;
+
+        if(loop->editPollFd(data, data.fd2, EPOLLIN) != 0)
+        {
+            cancelHedge(data);
+        }
+    }
+}
+
+
+// connection of first request is closed: its response can be still in transfer
+int ProxyExecutor::promoteHedge(ExecutorData &data)
+{
+    log->debug("hedged request to backend %d responded first\n", data.hedgeBackendIndex);
+
+    data.upstream->finishRequest(data.backendIndex);
+
+    if(closeFd1(data) != 0 || loop->removePollFd(data, data.fd2) != 0)
+    {
+        return -1;
+    }
+
+    data.fd1 = data.fd2;
+    data.fd2 = -1;
+    data.backendIndex = data.hedgeBackendIndex;
+    data.hedgeBackendIndex = -1;
+    data.hedgeState = ExecutorData::HedgeState::none;
+
+    data.upstreamReused = data.hedgeReused;
+    data.upstreamCreateTime = data.hedgeCreateTime;
+    data.upstreamStartTime = data.hedgeStartTime;
+
+    return loop->addPollFd(data, data.fd1, EPOLLIN);
+}
+
+
+void ProxyExecutor::cancelHedge(ExecutorData &data)
+{
+    if(data.hedgeState == ExecutorData::HedgeState::none)
+    {
+        return;
+    }
+
+    if(data.hedgeBackendIndex >= 0)
+    {
+        data.upstream->finishRequest(data.hedgeBackendIndex);
+        data.hedgeBackendIndex = -1;
+    }
+
+    if(data.fd2 >= 0)
+    {
+        loop->closeFd(data, data.fd2);
+    }
+
+    data.hedgeState = ExecutorData::HedgeState::none;
+}
+
+
+// response is sent from memory, upstream is not used
+int ProxyExecutor::startCachedResponse(ExecutorData &data, ResponseCache::Status status)
+{
+    const CacheEntry &entry = *data.cacheEntry;
+
+    data.responseInsert = (status == ResponseCache::Status::hit) ? CACHE_HIT_HEADER : CACHE_STALE_HEADER;
+    data.responseInsertLeft = strlen(data.responseInsert);
+    data.responseBytesWritten = 0;
+
+    // end of response in entry
+    data.bytesToSend = isHeadRequest(data) ? entry.bodyStart : entry.response.size();
+
+    if(loop->editPollFd(data, data.fd0, EPOLLOUT) != 0)
+    {
+        return -1;
+    }
+
+    data.state = ExecutorData::State::sendCachedResponse;
+
+    return 0;
+}
+
+
+// headers with inserted cache status are sent from buffer, body is sent from file by file executor
+int ProxyExecutor::startDiskCachedResponse(ExecutorData &data, ResponseCache::Status status, const DiskCache::Hit &hit)
+{
+    const char *insert = (status == ResponseCache::Status::hit) ? CACHE_HIT_HEADER : CACHE_STALE_HEADER;
+    int insertLength = strlen(insert);
+    int headersLength = hit.bodyStart + insertLength;
+
+    bool onlyHeaders = isHeadRequest(data) || hit.size == hit.bodyStart;
+
+    data.fd1 = hit.fd;
+
+    // request is not used after this point, its buffer is reused for headers
+    data.buffer.clear();
+
+    void *p;
+    int size;
+
+    if(!data.buffer.startWrite(p, size) || size < headersLength)
+    {
+        log->warning("headers of cached file do not fit into buffer\n");
+        return -1;
+    }
+
+    char *headers = static_cast<char*>(p);
+
+    if(pread(data.fd1, headers, hit.headersEnd, 0) != hit.headersEnd ||
+       pread(data.fd1, headers + hit.headersEnd + insertLength, hit.bodyStart - hit.headersEnd, hit.headersEnd) !=
+       hit.bodyStart - hit.headersEnd)
+    {
+        log->error("read of cached file failed\n");
+        return -1;
+    }
+
+    memcpy(headers + hit.headersEnd, insert, insertLength);
+    data.buffer.endWrite(headersLength);
+
+    // sendfile uses filePosition, ssl executor reads file from current offset
+    data.filePosition = hit.bodyStart;
+    lseek(data.fd1, hit.bodyStart, SEEK_SET);
+    data.bytesToSend = hit.size - hit.bodyStart;
+
+    if(loop->editPollFd(data, data.fd0, EPOLLOUT) != 0)
+    {
+        return -1;
+    }
+
+#ifdef USE_SSL
+    ExecutorType fileType = (data.ssl != nullptr) ? ExecutorType::sslFile : ExecutorType::file;
+#else
+    ExecutorType fileType = ExecutorType::file;
+#endif
+
+    data.pExecutor = loop->getExecutor(fileType);
+    data.state = onlyHeaders ? ExecutorData::State::sendOnlyHeaders : ExecutorData::State::sendHeaders;
+
+    return 0;
+}
+
+
+ProcessResult ProxyExecutor::process_sendCachedResponse(ExecutorData &data)
+{
+    const CacheEntry &entry = *data.cacheEntry;
+
+    if(data.responseInsertLeft > 0 && data.responseBytesWritten == entry.headersEnd)
+    {
+        return writeResponseInsert(data);
+    }
+
+    long long int size = data.bytesToSend - data.responseBytesWritten;
+
+    if(data.responseInsertLeft > 0 && size > entry.headersEnd - data.responseBytesWritten)
+    {
+        size = entry.headersEnd - data.responseBytesWritten;
+    }
+    if(size > loop->parameters->sendBudgetBytes)
+    {
+        size = loop->parameters->sendBudgetBytes;
+    }
+
+    int errorCode = 0;
+    ssize_t bytesWritten = writeFd0(data, entry.response.data() + data.responseBytesWritten, size, errorCode);
+
+    if(bytesWritten <= 0)
+    {
+        if(errorCode == EAGAIN || errorCode == EWOULDBLOCK)
+        {
+            ++data.retryCounter;
+            return ProcessResult::ok;
+        }
+
+        log->error("writeFd0 failed: %s\n", strerror(errorCode));
+        return ProcessResult::removeExecutorError;
+    }
+
+    data.retryCounter = 0;
+    data.responseBytesWritten += bytesWritten;
+
+    if(data.responseBytesWritten == data.bytesToSend)
+    {
+        return ProcessResult::removeExecutorOk;
+    }
+
+    return ProcessResult::ok;
+}
+
+
+// same response is received by other request, it is sent to client as it is received
+int ProxyExecutor::startCacheFillWait(ExecutorData &data)
+{
+    data.cacheStore = false;
+    data.cacheFillWaiter = true;
+
+    data.fd1 = eventfd(0, EFD_NONBLOCK);
+    if(data.fd1 < 0)
+    {
+        log->error("eventfd failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if(loop->addPollFd(data, data.fd1, EPOLLIN) != 0)
+    {
+        return -1;
+    }
+
+    if(loop->removePollFd(data, data.fd0) != 0)
+    {
+        return -1;
+    }
+
+    data.responseInsert = CACHE_HIT_HEADER;
+    data.responseInsertLeft = strlen(data.responseInsert);
+    data.responseBytesWritten = 0;
+
+    data.state = ExecutorData::State::sendCacheFill;
+
+    data.cacheFill->addWaiter(data.fd1);
+
+    return 0;
+}
+
+
+ProcessResult ProxyExecutor::process_sendCacheFill(ExecutorData &data, int fd)
+{
+    if(fd == data.fd1)
+    {
+        eventfd_t value;
+        eventfd_read(data.fd1, &value);
+    }
+
+    const CacheFill &fill = *data.cacheFill;
+    CacheFill::State state = fill.getState();
+
+    // request can go upstream, while nothing is sent to client
+    if(data.responseBytesWritten == 0)
+    {
+        if(state == CacheFill::State::receiving)
+        {
+            return ProcessResult::ok;
+        }
+        if(state == CacheFill::State::abandoned || !fill.varyMatches(data.request))
+        {
+            return leaveCacheFill(data);
+        }
+    }
+    else if(state == CacheFill::State::abandoned)
+    {
+        log->warning("upstream response for collapsed requests failed\n");
+        return ProcessResult::removeExecutorError;
+    }
+
+    long long int position = fill.getStart() + data.responseBytesWritten;
+
+    if(data.responseInsertLeft > 0 && position == fill.getHeadersEnd())
+    {
+        return writeResponseInsert(data);
+    }
+
+    const char *p;
+    long long int size = fill.read(position, &p);
+
+    if(size == 0)
+    {
+        if(state == CacheFill::State::finished)
+        {
+            return ProcessResult::removeExecutorOk;
+        }
+
+        // wait for more bytes from upstream
+        if(pollFd(data, data.fd0, false, 0) != 0)
+        {
+            return ProcessResult::removeExecutorError;
+        }
+        return ProcessResult::ok;
+    }
+
+    if(data.responseInsertLeft > 0 && size > fill.getHeadersEnd() - position)
+    {
+        size = fill.getHeadersEnd() - position;
+    }
+    if(size > loop->parameters->sendBudgetBytes)
+    {
+        size = loop->parameters->sendBudgetBytes;
+    }
+
+    int errorCode = 0;
+    ssize_t bytesWritten = writeFd0(data, p, size, errorCode);
+
+    if(bytesWritten <= 0)
+    {
+        if(errorCode == EAGAIN || errorCode == EWOULDBLOCK)
+        {
+            if(pollFd(data, data.fd0, true, EPOLLOUT) != 0)
+            {
+                return ProcessResult::removeExecutorError;
+            }
+
+            ++data.retryCounter;
+            return ProcessResult::ok;
+        }
+
+        log->error("writeFd0 failed: %s\n", strerror(errorCode));
+        return ProcessResult::removeExecutorError;
+    }
+
+    data.retryCounter = 0;
+    data.responseBytesWritten += bytesWritten;
+
+    if(state == CacheFill::State::finished && position + bytesWritten == fill.getSize())
+    {
+        return ProcessResult::removeExecutorOk;
+    }
+
+    if(pollFd(data, data.fd0, true, EPOLLOUT) != 0)
+    {
+        return ProcessResult::removeExecutorError;
+    }
+
+    return ProcessResult::ok;
+}
+
+
+// response of other request can not be used, request goes upstream
+ProcessResult ProxyExecutor::leaveCacheFill(ExecutorData &data)
+{
+    log->debug("collapsed request goes upstream\n");
+
+    data.cacheFill->removeWaiter(data.fd1);
+    data.cacheFillWaiter = false;
+
+    if(loop->closeFd(data, data.fd1) != 0)
+    {
+        return ProcessResult::removeExecutorError;
+    }
+
+    bool created = false;
+
+    data.cacheFill = loop->srv->cache.startFill(data.cacheKey, false, created);
+    data.cacheStore = true;
+    data.responseInsert = CACHE_MISS_HEADER;
+
+    return startUpstreamResult(startUpstream(data, getMilliseconds()));
+}
+
+
+// writes rest of inserted header, response continues after it is written
+ProcessResult ProxyExecutor::writeResponseInsert(ExecutorData &data)
+{
+    int length = strlen(data.responseInsert);
+
+    int errorCode = 0;
+    ssize_t bytesWritten = writeFd0(data, data.responseInsert + length - data.responseInsertLeft,
+                                    data.responseInsertLeft, errorCode);
+
+    if(bytesWritten <= 0)
+    {
+        if(errorCode == EAGAIN || errorCode == EWOULDBLOCK)
+        {
+            if(data.pollData0 == nullptr && loop->addPollFd(data, data.fd0, EPOLLOUT) != 0)
+            {
+                return ProcessResult::removeExecutorError;
+            }
+
+            ++data.retryCounter;
+            return ProcessResult::ok;
+        }
+
+        if(detachClient(data))
+        {
+            return ProcessResult::ok;
+        }
+
+        log->error("writeFd0 failed: %s\n", strerror(errorCode));
+        return ProcessResult::removeExecutorError;
+    }
+
+    data.retryCounter = 0;
+    data.responseInsertLeft -= bytesWritten;
+
+    // rest of response is in buffer
+    if(data.pollData0 == nullptr && loop->addPollFd(data, data.fd0, EPOLLOUT) != 0)
+    {
+        return ProcessResult::removeExecutorError;
+    }
+
+    return ProcessResult::ok;
+}
+
+
+// upstream response is collected, while it fits into cacheMaxEntryBytes.
+// when headers are received, fill is shared with waiting requests, if response is cacheable.
+// larger response continues in file of disk cache.
+void ProxyExecutor::collectCachedResponse(ExecutorData &data, const char *p, int size)
+{
+    if(data.cacheFileFd >= 0)
+    {
+        writeCacheFile(data, p, size);
+        return;
+    }
+
+    CacheFill &fill = *data.cacheFill;
+    const HttpResponseParser &parser = data.responseParser;
+
+    if(fill.getSize() + size > data.proxy->cacheMaxEntryBytes)
+    {
+        if(fill.getState() == CacheFill::State::ready && !fill.varies() && startCacheFile(data, fill.getStart()) == 0)
+        {
+            writeCacheFile(data, p, size);
+        }
+        else
+        {
+            abandonCachedResponse(data);
+        }
+        return;
+    }
+
+    fill.append(p, size);
+
+    if(fill.getState() != CacheFill::State::receiving || parser.getHeadersEnd() < 0)
+    {
+        return;
+    }
+
+    long long int start = parser.getResponseStart();
+
+    std::string headers;
+    fill.copy(start, parser.getHeadersEnd() - start, headers);
+
+    std::vector<std::string> varyNames;
+    std::vector<std::string> varyValues;
+
+    if(!ResponseCache::getFreshness(headers.data(), headers.size(), *data.proxy, getMilliseconds()).storable ||
+       ResponseCache::getVary(headers.data(), headers.size(), data.request, varyNames, varyValues) != 0)
+    {
+        // stored variant is replaced by response, which is not stored
+        eraseCachedResponse(data);
+        abandonCachedResponse(data);
+        return;
+    }
+
+    // response, which does not fit into memory, goes to disk before it is shared with waiters
+    if(parser.getBodyType() == HttpResponseParser::BodyType::length &&
+       fill.getSize() + parser.getBodyLeft() > data.proxy->cacheMaxEntryBytes)
+    {
+        eraseCachedResponse(data);
+
+        if(!varyNames.empty() || startCacheFile(data, start) != 0)
+        {
+            abandonCachedResponse(data);
+        }
+        return;
+    }
+
+    // response of unknown length can outgrow cacheMaxEntryBytes after waiters sent part of it,
+    // so it is collected by fill of this request only and waiters go upstream themselves
+    if(parser.getBodyType() != HttpResponseParser::BodyType::length && fill.shared())
+    {
+        bool created;
+        std::shared_ptr<CacheFill> privateFill = loop->srv->cache.startFill(data.cacheKey, false, created);
+
+        std::string received;
+        fill.copy(0, fill.getSize(), received);
+        privateFill->append(received.data(), received.size());
+
+        fill.abandon();
+        data.cacheFill = privateFill;
+    }
+
+    data.cacheFill->setReady(start, parser.getHeadersEnd(), std::move(varyNames), std::move(varyValues));
+}
+
+
+void ProxyExecutor::storeCachedResponse(ExecutorData &data)
+{
+    if(data.cacheStore && !data.responseParser.isMalformed())
+    {
+        if(data.cacheFileFd >= 0)
+        {
+            loop->srv->diskCache.store(data.cacheKey, *data.proxy, data.cacheFileId, data.cacheFileFd,
+                                       CACHE_FILE_MAX_HEADER_BYTES, getMilliseconds());
+            data.cacheFileFd = -1;
+        }
+        else if(data.cacheFill->getState() == CacheFill::State::ready)
+        {
+            CacheFill &fill = *data.cacheFill;
+
+            std::string response;
+            fill.copy(fill.getStart(), fill.getSize() - fill.getStart(), response);
+
+            if(loop->srv->cache.store(data.cacheKey, data.request, *data.proxy, std::move(response),
+                                      fill.getHeadersEnd() - fill.getStart(), getMilliseconds()) &&
+               useDiskCache(data))
+            {
+                loop->srv->diskCache.erase(data.cacheKey);
+            }
+
+            // entry is stored before fill is removed, so next requests find one of them
+            fill.finish();
+        }
+    }
+
+    abandonCachedResponse(data);
+}
+
+
+// waiters of shared fill would lose rest of response, which they started to send, if request is removed with client.
+// client connection is closed, response is read without buffer till it is finished and stored.
+bool ProxyExecutor::detachClient(ExecutorData &data)
+{
+    if(data.fd0 < 0 || data.state != ExecutorData::State::forwardResponse || !data.cacheStore ||
+       data.cacheFileFd >= 0 || !data.cacheFill->shared() || data.cacheFill->getState() != CacheFill::State::ready)
+    {
+        return false;
+    }
+
+    log->debug("client is gone, response is read for waiters of cache fill\n");
+
+#ifdef USE_SSL
+    // fd is closed, so ssl of client is freed without close_notify
+    if(data.ssl != nullptr)
+    {
+        SSL_free(data.ssl);
+        data.ssl = nullptr;
+    }
+#endif
+
+    if(loop->closeFd(data, data.fd0) != 0)
+    {
+        return false;
+    }
+
+    data.clientKeepAlive = false;
+    data.buffer.clear();
+    data.responseSpool.reset();
+
+    return pollResponseFd1(data) == 0;
+}
+
+
+// waiting requests go upstream themselves, if response is not finished. temporary file is removed.
+void ProxyExecutor::abandonCachedResponse(ExecutorData &data)
+{
+    if(data.cacheFill)
+    {
+        data.cacheFill->abandon();
+        data.cacheFill.reset();
+    }
+
+    if(data.cacheFileFd >= 0)
+    {
+        data.diskCache->discard(data.cacheFileId, data.cacheFileFd);
+        data.cacheFileFd = -1;
+    }
+
+    data.cacheStore = false;
+}
+
+
+// entries of both tiers are removed, when response for key is not stored or is stored in other tier
+void ProxyExecutor::eraseCachedResponse(ExecutorData &data)
+{
+    loop->srv->cache.erase(data.cacheKey, data.request);
+
+    if(useDiskCache(data))
+    {
+        loop->srv->diskCache.erase(data.cacheKey);
+    }
+}
+
+
+bool ProxyExecutor::useDiskCache(const ExecutorData &data) const
+{
+    return data.proxy->cacheDiskMaxEntryBytes > 0 && loop->srv->diskCache.enabled();
+}
+
+
+// response, which is too large for memory, continues in temporary file of disk cache.
+// bytes from start are copied from fill, waiters of fill go upstream themselves.
+int ProxyExecutor::startCacheFile(ExecutorData &data, long long int start)
+{
+    std::shared_ptr<CacheFill> fill = data.cacheFill;
+    const HttpResponseParser &parser = data.responseParser;
+
+    if(!useDiskCache(data) ||
+       (parser.getBodyType() == HttpResponseParser::BodyType::length &&
+        fill->getSize() - start + parser.getBodyLeft() > data.proxy->cacheDiskMaxEntryBytes))
+    {
+        return -1;
+    }
+
+    data.cacheFileFd = loop->srv->diskCache.create(data.cacheFileId);
+    if(data.cacheFileFd < 0)
+    {
+        return -1;
+    }
+
+    data.diskCache = &loop->srv->diskCache;
+    data.cacheFileSize = 0;
+
+    const char *p;
+    long long int size;
+
+    for(long long int position = start; (size = fill->read(position, &p)) > 0; position += size)
+    {
+        if(writeCacheFile(data, p, size) != 0)
+        {
+            return -1;
+        }
+    }
+
+    fill->abandon();
+    data.cacheFill.reset();
+
+    return 0;
+}
+
+
+int ProxyExecutor::writeCacheFile(ExecutorData &data, const char *p, long long int size)
+{
+    if(data.cacheFileSize + size > data.proxy->cacheDiskMaxEntryBytes)
+    {
+        abandonCachedResponse(data);
+        return -1;
+    }
+
+    while(size > 0)
+    {
+        ssize_t bytesWritten = write(data.cacheFileFd, p, size);
+
+        if(bytesWritten <= 0)
+        {
+            if(bytesWritten < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            log->error("write of cache file failed: %s\n", strerror(errno));
+            abandonCachedResponse(data);
+            return -1;
+        }
+
+        p += bytesWritten;
+        size -= bytesWritten;
+        data.cacheFileSize += bytesWritten;
+    }
+
+    return 0;
+}
+
+
+bool ProxyExecutor::isHeadRequest(const ExecutorData &data) const
+{
+    const char *method;
+    int methodLength;
+
+    return data.request.getMethod(&method, &methodLength) == 0 &&
+           methodLength == 4 && strncmp(method, "HEAD", methodLength) == 0;
+}
+
+
+bool ProxyExecutor::isTunnelResponse(const ExecutorData &data) const
+{
+    if(data.proxy->tunnelIdleTimeoutMillis == 0)
+    {
+        return false;
+    }
+
+    int status = data.responseParser.getStatus();
+
+    const char *ptr;
+    int length;
+
+    if(status == 101)
+    {
+        return data.request.getHeaderValue(HttpRequest::KnownHeader::upgrade, &ptr, &length) == 0;
+    }
+
+    return status >= 200 && status < 300 && data.request.isConnect();
+}
+
+
+bool ProxyExecutor::canTunnel(const ExecutorData &/*data*/) const
+{
+    return false;
+}
+
+
+ProcessResult ProxyExecutor::startTunnel(ExecutorData &/*data*/)
+{
+    log->error("tunnel is not supported by %s executor\n", name());
+    return ProcessResult::removeExecutorError;
+}
+
+
+ProcessResult ProxyExecutor::process_tunnel(ExecutorData &/*data*/)
+{
+    log->error("tunnel is not supported by %s executor\n", name());
+    return ProcessResult::removeExecutorError;
+}
+
+
+// passive health check: failure of new connection is counted for backend.
+// failures of reused connections are not counted, backend could close them by keep-alive timeout.
+void ProxyExecutor::reportUpstreamFailure(ExecutorData &data)
+{
+    if(data.upstream != nullptr && !data.upstreamReused)
+    {
+        data.upstream->reportFailure(data.backendIndex, getMilliseconds());
+    }
+}
+
+
+// upstream response is finished or upstream closed connection.
+// if reuse is true, connection is returned to pool.
+int ProxyExecutor::releaseUpstream(ExecutorData &data, bool reuse)
+{
+    data.state = ExecutorData::State::forwardResponseOnlyWrite;
+
+    UpstreamConnectionPool *pool = data.upstream->getPool(data.backendIndex);
+
+    data.upstream->finishRequest(data.backendIndex);
+    data.upstream = nullptr;
+
+    if(reuse && pool->enabled())
+    {
+        if(data.pollData1 != nullptr && loop->removePollFd(data, data.fd1) != 0)
+        {
+            return -1;
+        }
+
+        pool->put(data.fd1, data.upstreamSsl, data.upstreamCreateTime, getMilliseconds());
+        data.fd1 = -1;
+        data.upstreamSsl = nullptr;
+
+        return 0;
+    }
+
+    return closeFd1(data);
+}
+
+
+ProcessResult ProxyExecutor::process(ExecutorData &data, int fd, int events)
+{
+    if(fd == data.fd2)
+    {
+        return process_hedge(data);
+    }
+    if(data.state == ExecutorData::State::waitConnect && fd == data.fd1 && (events & EPOLLOUT))
+    {
+        return process_waitConnect(data);
+    }
+    if(data.state == ExecutorData::State::upstreamHandshake && fd == data.fd1)
+    {
+        return process_upstreamHandshake(data);
+    }
+    if(data.state == ExecutorData::State::sendCachedResponse && fd == data.fd0 && (events & EPOLLOUT))
+    {
+        return process_sendCachedResponse(data);
+    }
+    if(data.state == ExecutorData::State::sendCacheFill &&
+            ((fd == data.fd1 && (events & EPOLLIN)) || (fd == data.fd0 && (events & EPOLLOUT))))
+    {
+        return process_sendCacheFill(data, fd);
+    }
+    if(data.state == ExecutorData::State::forwardRequest && fd == data.fd1 && (events & EPOLLOUT))
+    {
+        return process_forwardRequest(data);
+    }
+    if(data.state == ExecutorData::State::forwardRequestBody &&
+            ((fd == data.fd0 && (events & EPOLLIN)) || (fd == data.fd1 && (events & EPOLLOUT))))
+    {
+        return process_forwardRequestBody(data);
+    }
+    // EPOLLOUT of fd1: ssl has pending data or waits for write
+    if(data.state == ExecutorData::State::forwardResponse && fd == data.fd1 && (events & (EPOLLIN | EPOLLOUT)))
+    {
+        return process_forwardResponseRead(data);
+    }
+    if((data.state == ExecutorData::State::forwardResponse ||
+            data.state == ExecutorData::State::forwardResponseOnlyWrite) && fd == data.fd0 && (events & EPOLLOUT))
+    {
+        return process_forwardResponseWrite(data);
+    }
+    if(data.state == ExecutorData::State::tunnel)
+    {
+        return process_tunnel(data);
+    }
+    if(data.state == ExecutorData::State::waitUpstream && events == 0)
+    {
+        return process_waitUpstream(data);
+    }
+
+    log->warning("invalid process call (proxy)\n");
+    return ProcessResult::removeExecutorError;
+}
+
+
+ProcessResult ProxyExecutor::process_waitConnect(ExecutorData &data)
+{
+    int socketError = socketConnectNonBlockCheck(data.fd1, log);
+
+    if(socketError == 0)
+    {
+        if(data.upstreamSsl != nullptr)
+        {
+            data.state = ExecutorData::State::upstreamHandshake;
+            return process_upstreamHandshake(data);
+        }
+
+        data.state = ExecutorData::State::forwardRequest;
+        return process_forwardRequest(data);
+    }
+    else if(socketError == EINPROGRESS)
+    {
+        ++data.retryCounter;
+        return ProcessResult::ok;
+    }
+    else
+    {
+        // connection opened by prewarm
+        if(data.upstreamReused)
+        {
+            return retryUpstream(data);
+        }
+
+        log->error("ProxyExecutor::process_waitConnect socketConnectNonBlockCheck failed: %d\n", socketError);
+        reportUpstreamFailure(data);
+
+        if(retryConnect(data) == 0)
+        {
+            return ProcessResult::ok;
+        }
+        return ProcessResult::removeExecutorError;
+    }
+}
+
+
+ProcessResult ProxyExecutor::process_upstreamHandshake(ExecutorData &data)
+{
+#ifdef USE_SSL
+    ERR_clear_error();
+
+    int result = SSL_do_handshake(data.upstreamSsl);
+
+    if(result == 1)
+    {
+        log->debug("TLS handshake with backend %d of proxy %s finished, session reused: %d\n",
+                   data.backendIndex, data.proxy->prefix.c_str(), SSL_session_reused(data.upstreamSsl));
+
+        if(loop->editPollFd(data, data.fd1, EPOLLOUT) != 0)
+        {
+            return ProcessResult::removeExecutorError;
+        }
+
+        data.state = ExecutorData::State::forwardRequest;
+        return process_forwardRequest(data);
+    }
+
+    int error = SSL_get_error(data.upstreamSsl, result);
+
+    if(error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE)
+    {
+        if(loop->editPollFd(data, data.fd1, (error == SSL_ERROR_WANT_READ) ? EPOLLIN : EPOLLOUT) != 0)
+        {
+            return ProcessResult::removeExecutorError;
+        }
+
+        ++data.retryCounter;
+        return ProcessResult::ok;
+    }
+
+    // connection opened by prewarm
+    if(data.upstreamReused)
+    {
+        return retryUpstream(data);
+    }
+
+    log->error("TLS handshake with backend %d of proxy %s failed. error: %d   %s\n", data.backendIndex,
+               data.proxy->prefix.c_str(), error, ERR_error_string(ERR_get_error(), nullptr));
+#endif
+
+    reportUpstreamFailure(data);
+
+    if(retryConnect(data) == 0)
+    {
+        return ProcessResult::ok;
+    }
+    return ProcessResult::removeExecutorError;
+}
+
+
+ProcessResult ProxyExecutor::process_forwardRequest(ExecutorData &data)
+{
+    void *p;
+    int size;
+
+    if(data.buffer.startRead(p, size))
+    {
+        // headers and part of body, which was read with headers
+        if(size > data.bytesToSend)
+        {
+            size = static_cast<int>(data.bytesToSend);
+        }
+
+        int errorCode = 0;
+        ssize_t bytesWritten = writeFd1(data, p, size, errorCode);
+
+        if(bytesWritten <= 0)
+        {
+            if(errorCode == EAGAIN || errorCode == EWOULDBLOCK)
+            {
+                ++data.retryCounter;
+                return ProcessResult::ok;
+            }
+            else if(data.upstreamReused && canResend(data))
+            {
+                return retryUpstream(data);
+            }
+            else
+            {
+                log->error("writeFd1 failed: %s\n", strerror(errorCode));
+                reportUpstreamFailure(data);
+                return ProcessResult::removeExecutorError;
+            }
+        }
+        data.retryCounter = 0;
+
+        data.buffer.endRead(bytesWritten);
+        data.bytesToSend -= bytesWritten;
+
+        if(data.bytesToSend == 0)
+        {
+            data.buffer.clear();
+
+            if(requestBodyRead(data))
+            {
+                return forwardResponse(data);
+            }
+
+            data.state = ExecutorData::State::forwardRequestBody;
+
+            if(sendContinue(data) != 0)
+            {
+                return ProcessResult::removeExecutorError;
+            }
+            if(startForwardRequestBody(data) != 0)
+            {
+                return ProcessResult::removeExecutorError;
+            }
+
+            return finishRequestBodyStep(data, true, false);
+        }
+
+        return ProcessResult::ok;
+    }
+    else
+    {
+        log->error("buffer.startRead failed\n");
+        return ProcessResult::removeExecutorError;
+    }
+}
+
+
+ProcessResult ProxyExecutor::process_forwardRequestBody(ExecutorData &data)
+{
+    bool progress = true;
+    long long int bytesTransferred = 0;
+
+    // level triggered poll can not see data, which is already read by ssl,
+    // so transfer until socket blocks or budget is spent.
+    while(progress && bytesTransferred < loop->parameters->sendBudgetBytes)
+    {
+        progress = false;
+
+        void *p;
+        int size;
+
+        if(!requestBodyRead(data) && data.buffer.startWrite(p, size))
+        {
+            if(!data.requestChunked && size > data.requestBodyLeft)
+            {
+                size = static_cast<int>(data.requestBodyLeft);
+            }
+
+            int errorCode = 0;
+            ssize_t bytesRead = readFd0(data, p, size, errorCode);
+
+            if(bytesRead == 0)
+            {
+                log->info("client closed connection before end of request body\n");
+                return ProcessResult::removeExecutorError;
+            }
+            else if(bytesRead < 0)
+            {
+                if(errorCode != EAGAIN && errorCode != EWOULDBLOCK)
+                {
+                    log->error("readFd0 failed: %s\n", strerror(errorCode));
+                    return ProcessResult::removeExecutorError;
+                }
+            }
+            else
+            {
+                if(data.requestChunked)
+                {
+                    int consumed = 0;
+
+                    if(data.chunkedDecoder.decode(static_cast<char*>(p), bytesRead, consumed) == ChunkedDecoder::Result::invalid)
+                    {
+                        log->info("invalid chunked request body\n");
+                        return ProcessResult::removeExecutorError;
+                    }
+
+                    // bytes after end of body are dropped, connection is closed after response
+                    if(consumed < bytesRead)
+                    {
+                        data.clientKeepAlive = false;
+                    }
+                    bytesRead = consumed;
+                }
+                else
+                {
+                    data.requestBodyLeft -= bytesRead;
+                }
+
+                data.buffer.endWrite(bytesRead);
+                progress = true;
+            }
+        }
+
+        if(data.buffer.startRead(p, size))
+        {
+            int errorCode = 0;
+            ssize_t bytesWritten = writeFd1(data, p, size, errorCode);
+
+            if(bytesWritten < 0)
+            {
+                if(errorCode != EAGAIN && errorCode != EWOULDBLOCK)
+                {
+                    log->error("writeFd1 failed: %s\n", strerror(errorCode));
+                    return ProcessResult::removeExecutorError;
+                }
+            }
+            else if(bytesWritten > 0)
+            {
+                data.buffer.endRead(bytesWritten);
+                bytesTransferred += bytesWritten;
+                progress = true;
+            }
+        }
+
+        if(progress)
+        {
+            data.retryCounter = 0;
+        }
+    }
+
+    if(bytesTransferred == 0)
+    {
+        ++data.retryCounter;
+    }
+
+    void *p;
+    int size;
+    bool canRead = !requestBodyRead(data) && data.buffer.startWrite(p, size);
+    bool canWrite = data.buffer.readAvailable();
+
+    // data, which is already read by ssl, is not visible to poll.
+    // upstream socket is polled to continue transfer in next iteration.
+    if(canRead && pendingFd0(data))
+    {
+        canWrite = true;
+    }
+
+    return finishRequestBodyStep(data, canRead, canWrite);
+}
+
+
+ProcessResult ProxyExecutor::finishRequestBodyStep(ExecutorData &data, bool canRead, bool canWrite)
+{
+    if(!canRead && !canWrite && requestBodyRead(data))
+    {
+        return forwardResponse(data);
+    }
+
+    if(pollFd(data, data.fd0, canRead, EPOLLIN) != 0)
+    {
+        return ProcessResult::removeExecutorError;
+    }
+    if(pollFd(data, data.fd1, canWrite, EPOLLOUT) != 0)
+    {
+        return ProcessResult::removeExecutorError;
+    }
+
+    return ProcessResult::ok;
+}
+
+
+ProcessResult ProxyExecutor::forwardResponse(ExecutorData &data)
+{
+    data.buffer.clear();
+
+    data.state = ExecutorData::State::forwardResponse;
+
+    data.responseParser.reset(isHeadRequest(data));
+    data.responseSplice = false;
+
+    data.responseInsertLeft = (data.responseInsert != nullptr) ? strlen(data.responseInsert) : 0;
+    data.responseBytesWritten = 0;
+
+    if(data.proxy->bufferResponse)
+    {
+        data.responseSpool.init(&loop->srv->spoolMemory, data.proxy->bufferMemoryBytes, data.proxy->bufferFileMaxBytes,
+                                &loop->parameters->responseBufferFolder, log);
+    }
+
+    if(pollFd(data, data.fd0, false, 0) != 0)
+    {
+        return ProcessResult::removeExecutorError;
+    }
+
+    if(pollResponseFd1(data) != 0)
+    {
+        return ProcessResult::removeExecutorError;
+    }
+
+    if(startForwardResponse(data) != 0)
+    {
+        return ProcessResult::removeExecutorError;
+    }
+
+    if(canHedge(data) && startHedgeTimer(data) != 0)
+    {
+        return ProcessResult::removeExecutorError;
+    }
+
+    return ProcessResult::ok;
+}
+
+
+ProcessResult ProxyExecutor::process_forwardResponseRead(ExecutorData &data)
+{
+    void *p;
+    int size;
+
+    // response goes to spool, when buffer is full, and stays there, till spool is empty, so order of bytes is kept
+    bool toSpool = data.responseSpool.active() && (!data.responseSpool.empty() || !data.buffer.startWrite(p, size));
+
+    if(toSpool ? data.responseSpool.startWrite(p, size) : data.buffer.startWrite(p, size))
+    {
+        int errorCode = 0;
+        ssize_t bytesRead = readFd1(data, p, size, errorCode);
+
+        log->debug("proxy read bytes: %zd\n", bytesRead);
+
+        if(bytesRead <= 0)
+        {
+            if(bytesRead < 0 && (errorCode == EAGAIN || errorCode == EWOULDBLOCK))
+            {
+                ++data.retryCounter;
+                return ProcessResult::ok;
+            }
+
+            // hedged request is sent already, its response is used
+            if(data.hedgeState == ExecutorData::HedgeState::wait && data.responseParser.getParsedBytes() == 0)
+            {
+                reportUpstreamFailure(data);
+
+                if(promoteHedge(data) != 0)
+                {
+                    return ProcessResult::removeExecutorError;
+                }
+                return ProcessResult::ok;
+            }
+
+            cancelHedge(data);
+
+            if(data.upstreamReused && data.responseParser.getParsedBytes() == 0 && canResend(data))
+            {
+                return retryUpstream(data);
+            }
+            else if(bytesRead == 0)
+            {
+                if(data.responseParser.getParsedBytes() == 0)
+                {
+                    reportUpstreamFailure(data);
+                }
+                // end of body is end of connection
+                if(data.responseParser.headersFinished() &&
+                   data.responseParser.getBodyType() == HttpResponseParser::BodyType::untilClose)
+                {
+                    storeCachedResponse(data);
+                }
+                releaseUpstream(data, false);
+                return process_forwardResponseWrite(data);
+            }
+            else
+            {
+                log->error("ProxyExecutor::process_forwardResponseRead   read failed: %s\n", strerror(errorCode));
+                if(data.responseParser.getParsedBytes() == 0)
+                {
+                    reportUpstreamFailure(data);
+                }
+                return ProcessResult::removeExecutorError;
+            }
+        }
+        else // bytesRead > 0
+        {
+            data.retryCounter = 0;
+
+            // upstream connection responded first
+            if(data.hedgeState != ExecutorData::HedgeState::none)
+            {
+                cancelHedge(data);
+            }
+
+            int consumed = 0;
+            data.responseParser.parse(static_cast<char*>(p), bytesRead, consumed);
+
+            if(!toSpool)
+            {
+                data.buffer.endWrite(consumed);
+            }
+            else if(data.responseSpool.endWrite(consumed) != 0)
+            {
+                return ProcessResult::removeExecutorError;
+            }
+
+            if(data.cacheStore)
+            {
+                collectCachedResponse(data, static_cast<char*>(p), consumed);
+            }
+
+            if(data.upstreamStartTime > 0 && data.responseParser.headersFinished())
+            {
+                data.upstream->reportResponse(data.backendIndex, getMilliseconds() - data.upstreamStartTime);
+                data.upstreamStartTime = 0;
+
+                if(isTunnelResponse(data) && canTunnel(data) && !toSpool)
+                {
+                    // bytes after headers are first bytes of other protocol
+                    data.buffer.endWrite(static_cast<int>(bytesRead) - consumed);
+                    return startTunnel(data);
+                }
+            }
+
+            if(data.responseParser.finished())
+            {
+                storeCachedResponse(data);
+
+                // bytes after end of response are not expected, such connection is not reused
+                if(releaseUpstream(data, data.responseParser.keepAlive() && consumed == bytesRead &&
+                                   !pendingFd1(data)) != 0)
+                {
+                    return ProcessResult::removeExecutorError;
+                }
+            }
+            else if(data.pollData1 != nullptr && data.upstreamSsl != nullptr && pollResponseFd1(data) != 0)
+            {
+                return ProcessResult::removeExecutorError;
+            }
+
+            return process_forwardResponseWrite(data);
+        }
+    }
+    else // no place in buffer
+    {
+        if(data.pollData1 != nullptr)
+        {
+            if(loop->removePollFd(data, data.fd1) != 0)
+            {
+                return ProcessResult::removeExecutorError;
+            }
+        }
+
+        if(data.pollData0 == nullptr)
+        {
+            if(loop->addPollFd(data, data.fd0, EPOLLOUT) != 0)
+            {
+                return ProcessResult::removeExecutorError;
+            }
+        }
+
+        ++data.retryCounter;
+        return ProcessResult::ok;
+    }
+}
+
+
+ProcessResult ProxyExecutor::process_forwardResponseWrite(ExecutorData &data)
+{
+    void *p;
+    int size;
+
+    // client is detached, response is read only for cache fill
+    if(data.fd0 < 0)
+    {
+        data.buffer.clear();
+        return (data.state == ExecutorData::State::forwardResponse) ? ProcessResult::ok : ProcessResult::removeExecutorOk;
+    }
+
+    if(data.buffer.startRead(p, size))
+    {
+        // buffer has only bytes, which are parsed, so place of inserted header is known before it is reached
+        long long int insertOffset = data.responseParser.getHeadersEnd();
+
+        if(data.responseInsertLeft > 0 && insertOffset >= 0)
+        {
+            if(data.responseBytesWritten == insertOffset)
+            {
+                return writeResponseInsert(data);
+            }
+            if(size > insertOffset - data.responseBytesWritten)
+            {
+                size = static_cast<int>(insertOffset - data.responseBytesWritten);
+            }
+        }
+
+        int errorCode = 0;
+        ssize_t bytesWritten = writeFd0(data, p, size, errorCode);
+
+        log->debug("proxy write bytes: %zd\n", bytesWritten);
+
+        if(bytesWritten <= 0)
+        {
+            if(errorCode == EAGAIN || errorCode == EWOULDBLOCK)
+            {
+                if(data.pollData0 == nullptr)
+                {
+                    if(loop->addPollFd(data, data.fd0, EPOLLOUT) != 0)
+                    {
+                        return ProcessResult::removeExecutorError;
+                    }
+                }
+
+                ++data.retryCounter;
+                return ProcessResult::ok;
+            }
+            else if(detachClient(data))
+            {
+                return ProcessResult::ok;
+            }
+            else
+            {
+                log->error("writeFd0 failed: %s\n", strerror(errorCode));
+                return ProcessResult::removeExecutorError;
+            }
+        }
+        else // bytesWritten > 0
+        {
+            data.retryCounter = 0;
+            data.buffer.endRead(bytesWritten);
+            data.responseBytesWritten += bytesWritten;
+
+            if(!data.responseSpool.empty() && fillFromSpool(data) != 0)
+            {
+                return ProcessResult::removeExecutorError;
+            }
+
+            if(data.state == ExecutorData::State::forwardResponseOnlyWrite && !data.buffer.readAvailable())
+            {
+                return finishResponse(data);
+            }
+
+            // write was stopped before inserted header
+            if(data.pollData0 == nullptr && data.responseInsertLeft > 0 && data.buffer.readAvailable())
+            {
+                if(loop->addPollFd(data, data.fd0, EPOLLOUT) != 0)
+                {
+                    return ProcessResult::removeExecutorError;
+                }
+            }
+
+            if(data.pollData1 == nullptr && data.state == ExecutorData::State::forwardResponse)
+            {
+                if(pollResponseFd1(data) != 0)
+                {
+                    return ProcessResult::removeExecutorError;
+                }
+            }
+
+            return ProcessResult::ok;
+        }
+    }
+    else // no data in buffer
+    {
+        if(data.state == ExecutorData::State::forwardResponseOnlyWrite)
+        {
+            return finishResponse(data);
+        }
+
+        if(data.pollData0 != nullptr)
+        {
+            if(loop->removePollFd(data, data.fd0) != 0)
+            {
+                return ProcessResult::removeExecutorError;
+            }
+        }
+    }
+
+    ++data.retryCounter;
+    return ProcessResult::ok;
+}
+
+
+// connection of client is read for next request, if client and upstream response allow it. other responses
+// end at close of connection, also response of malformed or unknown length.
+ProcessResult ProxyExecutor::finishResponse(ExecutorData &data)
+{
+    if(!data.clientKeepAlive || !data.responseParser.keepAlive() || data.fd1 >= 0 || data.fd2 >= 0)
+    {
+        return ProcessResult::removeExecutorOk;
+    }
+
+    ExecutorType requestType = ExecutorType::request;
+
+#ifdef USE_SSL
+    if(data.ssl != nullptr)
+    {
+        requestType = ExecutorType::requestSsl;
+    }
+#endif
+
+    RequestExecutor *requestExecutor = static_cast<RequestExecutor*>(loop->getExecutor(requestType));
+
+    data.finishRequest();
+    data.pExecutor = requestExecutor;
+
+    if(requestExecutor->startRequest(data) != 0)
+    {
+        return ProcessResult::removeExecutorError;
+    }
+
+    log->debug("client connection is kept for next request\n");
+
+    return ProcessResult::ok;
+}
+
+
+int ProxyExecutor::fillFromSpool(ExecutorData &data)
+{
+    void *p;
+    int size;
+
+    while(!data.responseSpool.empty() && data.buffer.startWrite(p, size))
+    {
+        int bytes = data.responseSpool.read(p, size);
+        if(bytes < 0)
+        {
+            return -1;
+        }
+
+        data.buffer.endWrite(bytes);
+    }
+
+    return 0;
+}
+
+
+int ProxyExecutor::startForwardRequestBody(ExecutorData &/*data*/)
+{
+    return 0;
+}
+
+
+int ProxyExecutor::startForwardResponse(ExecutorData &/*data*/)
+{
+    return 0;
+}
+
+
+int ProxyExecutor::initRequestBody(ExecutorData &data)
+{
+    void *p;
+    int size;
+
+    // whole request is one region: it is read to the start of buffer or buffer is mirrored.
+    data.buffer.startRead(p, size);
+
+    int contentStart = data.request.getContentStart();
+    const char *body = static_cast<const char*>(p) + contentStart;
+    int bodyInBuffer = size - contentStart;
+
+    data.requestChunked = data.request.isChunked();
+
+    if(data.requestChunked)
+    {
+        if(data.request.getContentLength() > 0)
+        {
+            log->info("request has both Content-Length and chunked Transfer-Encoding\n");
+            return -1;
+        }
+
+        data.chunkedDecoder.reset();
+
+        int consumed = 0;
+
+        if(data.chunkedDecoder.decode(body, bodyInBuffer, consumed) == ChunkedDecoder::Result::invalid)
+        {
+            log->info("invalid chunked request body\n");
+            return -1;
+        }
+
+        data.requestBodyLeft = 0;
+        data.bytesToSend = contentStart + consumed;
+    }
+    else
+    {
+        const char *ptr;
+        int length;
+
+        if(data.request.getHeaderValue(HttpRequest::KnownHeader::transferEncoding, &ptr, &length) == 0)
+        {
+            log->info("unsupported Transfer-Encoding: %.*s\n", length, ptr);
+            return -1;
+        }
+
+        long long int contentLength = data.request.getContentLength();
+        long long int inBuffer = (contentLength < bodyInBuffer) ? contentLength : bodyInBuffer;
+
+        data.requestBodyLeft = contentLength - inBuffer;
+        data.bytesToSend = contentStart + inBuffer;
+    }
+
+    // pipelined request was read with this one, it is not kept, so connection is closed after response
+    if(data.bytesToSend < size)
+    {
+        data.clientKeepAlive = false;
+    }
+
+    data.requestBytes = data.bytesToSend;
+    data.setRequestBuffered(requestBodyRead(data));
+
+    return 0;
+}
+
+
+bool ProxyExecutor::requestBodyRead(const ExecutorData &data) const
+{
+    if(data.requestChunked)
+    {
+        return data.chunkedDecoder.finished();
+    }
+    return data.requestBodyLeft == 0;
+}
+
+
+int ProxyExecutor::sendContinue(ExecutorData &data)
+{
+    const char *ptr;
+    int length;
+
+    const char *expectValue = "100-continue";
+    const int expectLength = 12;
+
+    if(data.request.getHeaderValue(HttpRequest::KnownHeader::expect, &ptr, &length) != 0 ||
+       length != expectLength || strncasecmp(ptr, expectValue, expectLength) != 0)
+    {
+        return 0;
+    }
+
+    // client waits for interim response before sending body.
+    // 100 Continue from upstream is forwarded later with response, several interim responses are allowed.
+    const char response[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    const int responseLength = sizeof(response) - 1;
+
+    int errorCode = 0;
+    ssize_t bytesWritten = writeFd0(data, response, responseLength, errorCode);
+
+    if(bytesWritten != responseLength)
+    {
+        if(bytesWritten < 0 && errorCode != EAGAIN && errorCode != EWOULDBLOCK)
+        {
+            log->error("send 100 Continue failed: %s\n", strerror(errorCode));
+            return -1;
+        }
+
+        // client sends body after timeout
+        log->warning("send 100 Continue failed, bytes written: %zd\n", bytesWritten);
+    }
+
+    return 0;
+}
+
+
+// registers fd in poll loop, if enable is true and fd is not registered.
+// removes fd from poll loop, if enable is false and fd is registered.
+int ProxyExecutor::pollFd(ExecutorData &data, int fd, bool enable, int events)
+{
+    PollData *pollData = (fd == data.fd0) ? data.pollData0 : data.pollData1;
+
+    if(enable && pollData == nullptr)
+    {
+        return loop->addPollFd(data, fd, events);
+    }
+    else if(!enable && pollData != nullptr)
+    {
+        return loop->removePollFd(data, fd);
+    }
+
+    return 0;
+}
+
+
+ssize_t ProxyExecutor::readFd1(ExecutorData &data, void *buf, size_t count, int &errorCode)
+{
+#ifdef USE_SSL
+    if(data.upstreamSsl != nullptr)
+    {
+        return sslReadFd1(this, data, buf, count, errorCode, log);
+    }
+#endif
+
+    ssize_t result = read(data.fd1, buf, count);
+    errorCode = (result < 0) ? errno : 0;
+    return result;
+}
+
+
+ssize_t ProxyExecutor::writeFd1(ExecutorData &data, const void *buf, size_t count, int &errorCode)
+{
+#ifdef USE_SSL
+    if(data.upstreamSsl != nullptr)
+    {
+        return sslWriteFd1(this, data, buf, count, errorCode, log);
+    }
+#endif
+
+    ssize_t result = write(data.fd1, buf, count);
+    errorCode = (result < 0) ? errno : 0;
+    return result;
+}
+
+
+bool ProxyExecutor::pendingFd1(const ExecutorData &data) const
+{
+#ifdef USE_SSL
+    return data.upstreamSsl != nullptr && SSL_pending(data.upstreamSsl) > 0;
+#else
+    (void)data;
+    return false;
+#endif
+}
+
+
+bool ProxyExecutor::ktlsSendFd1(const ExecutorData &data) const
+{
+#if defined(USE_SSL) && defined(BIO_get_ktls_send)
+    return data.upstreamSsl != nullptr && BIO_get_ktls_send(SSL_get_wbio(data.upstreamSsl));
+#else
+    (void)data;
+    return false;
+#endif
+}
+
+
+int ProxyExecutor::pollResponseFd1(ExecutorData &data)
+{
+    int events = pendingFd1(data) ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+
+    if(data.pollData1 == nullptr)
+    {
+        return loop->addPollFd(data, data.fd1, events);
+    }
+    if(data.pollData1->events != events)
+    {
+        return loop->editPollFd(data, data.fd1, events);
+    }
+    return 0;
+}
+
+
+// connection is not reused, close_notify is not sent
+int ProxyExecutor::closeFd1(ExecutorData &data)
+{
+#ifdef USE_SSL
+    if(data.upstreamSsl != nullptr)
+    {
+        SSL_free(data.upstreamSsl);
+        data.upstreamSsl = nullptr;
+    }
+#endif
+
+    return loop->closeFd(data, data.fd1);
+}
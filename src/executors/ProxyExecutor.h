@@ -0,0 +1,183 @@
+#ifndef PROXY_EXECUTOR_H
+#define PROXY_EXECUTOR_H
+
+#include <Executor.h>
+#include <ResponseCache.h>
+#include <DiskCache.h>
+
+// Connection to upstream and forwarding of request, common for proxy executors.
+// Request body is streamed to upstream after headers. Response goes through buffer, its framing is parsed
+// to return upstream connection to pool after end of response. Derived classes can forward response body other way.
+class ProxyExecutor: public Executor
+{
+public:
+
+    int init(PollLoopBase *loop) override;
+
+    int up(ExecutorData &data) override;
+
+    ProcessResult process(ExecutorData &data, int fd, int events) override;
+
+    // request, which fills shared cache fill, reads rest of response for waiters without client
+    bool detachClient(ExecutorData &data) override;
+
+protected:
+
+    ProcessResult process_waitConnect(ExecutorData &data);
+
+    // connect is finished, TLS handshake is started or continued.
+    // pooled connections keep their ssl, so handshake is done once per connection.
+    ProcessResult process_upstreamHandshake(ExecutorData &data);
+
+    ProcessResult process_forwardRequest(ExecutorData &data);
+
+    // forwards request body through data.buffer
+    virtual ProcessResult process_forwardRequestBody(ExecutorData &data);
+
+    virtual ProcessResult process_forwardResponseRead(ExecutorData &data);
+
+    virtual ProcessResult process_forwardResponseWrite(ExecutorData &data);
+
+    // called when request headers are sent and request body follows
+    virtual int startForwardRequestBody(ExecutorData &data);
+
+    // called when request is sent, before response is read from upstream
+    virtual int startForwardResponse(ExecutorData &data);
+
+    // returns 1, if request is rejected with 503, because queue of backends is full
+    int startUpstream(ExecutorData &data, long long int curMillis);
+
+    // all backends are at limit of requests in flight, request waits in queue of UpstreamGroup.
+    // returns 1, if queue is full and request is rejected.
+    int startWaitUpstream(ExecutorData &data, UpstreamGroup *upstream, long long int curMillis);
+
+    // poll loop calls process with no events, when request can be started or its queue time is over
+    ProcessResult process_waitUpstream(ExecutorData &data);
+
+    // result of startUpstream as result of process
+    ProcessResult startUpstreamResult(int result) const;
+
+    // writes 503 response, request is not sent to backend
+    void rejectRequest(ExecutorData &data);
+
+    int connectUpstream(ExecutorData &data, bool reuse);
+
+    ProcessResult retryUpstream(ExecutorData &data);
+
+    bool canResend(const ExecutorData &data) const;
+
+    // connect to selected backend failed, request is sent to other backend within retry budget
+    int retryConnect(ExecutorData &data);
+
+    bool canHedge(const ExecutorData &data) const;
+
+    // GET and HEAD requests without response after hedge delay are sent to other backend through fd2,
+    // connection, which responds first, is used
+    int startHedgeTimer(ExecutorData &data);
+
+    // connects to other backend, if response is still not received
+    void startHedge(ExecutorData &data);
+
+    ProcessResult process_hedge(ExecutorData &data);
+
+    void sendHedge(ExecutorData &data);
+
+    // hedge connection received response first, it becomes upstream connection
+    int promoteHedge(ExecutorData &data);
+
+    // closes hedge connection or timer
+    void cancelHedge(ExecutorData &data);
+
+    int releaseUpstream(ExecutorData &data, bool reuse);
+
+    void reportUpstreamFailure(ExecutorData &data);
+
+    // GET and HEAD requests of proxy with cache are served from ResponseCache, when it has fresh response
+    int startCachedResponse(ExecutorData &data, ResponseCache::Status status);
+
+    // response from DiskCache is sent by file executor
+    int startDiskCachedResponse(ExecutorData &data, ResponseCache::Status status, const DiskCache::Hit &hit);
+
+    ProcessResult process_sendCachedResponse(ExecutorData &data);
+
+    // GET request, which misses cache while same response is received, is sent from CacheFill of that request
+    int startCacheFillWait(ExecutorData &data);
+
+    ProcessResult process_sendCacheFill(ExecutorData &data, int fd);
+
+    ProcessResult leaveCacheFill(ExecutorData &data);
+
+    ProcessResult writeResponseInsert(ExecutorData &data);
+
+    void collectCachedResponse(ExecutorData &data, const char *p, int size);
+
+    void storeCachedResponse(ExecutorData &data);
+
+    void abandonCachedResponse(ExecutorData &data);
+
+    void eraseCachedResponse(ExecutorData &data);
+
+    bool useDiskCache(const ExecutorData &data) const;
+
+    int startCacheFile(ExecutorData &data, long long int start);
+
+    int writeCacheFile(ExecutorData &data, const char *p, long long int size);
+
+    static const int REJECT_RESPONSE_SIZE = 200;
+
+    // headers of response in disk cache and inserted header fit into buffer of executor
+    static const int CACHE_FILE_MAX_HEADER_BYTES = ExecutorData::REQUEST_BUFFER_SIZE / 2;
+
+    bool isHeadRequest(const ExecutorData &data) const;
+
+    int initRequestBody(ExecutorData &data);
+
+    bool requestBodyRead(const ExecutorData &data) const;
+
+    int sendContinue(ExecutorData &data);
+
+    ProcessResult finishRequestBodyStep(ExecutorData &data, bool canRead, bool canWrite);
+
+    ProcessResult forwardResponse(ExecutorData &data);
+
+    // response is written to client, executor is removed or connection waits for next request.
+    // connection is kept after response with known length, if client allows it.
+    ProcessResult finishResponse(ExecutorData &data);
+
+    // response of proxy with bufferResponse is read into ResponseSpool, when buffer is full, so upstream connection
+    // is released, when backend sent response, not when slow client received it.
+    // moves bytes of response spool to free space of buffer
+    int fillFromSpool(ExecutorData &data);
+
+    // response switches connection to other protocol: 101 to request with Upgrade or 2xx to CONNECT
+    bool isTunnelResponse(const ExecutorData &data) const;
+
+    // executor can forward both directions of connection to selected backend,
+    // otherwise response, which switches protocol, is forwarded as body till close
+    virtual bool canTunnel(const ExecutorData &data) const;
+
+    // called after headers of tunnel response are read, buffer has headers and bytes read after them
+    virtual ProcessResult startTunnel(ExecutorData &data);
+
+    virtual ProcessResult process_tunnel(ExecutorData &data);
+
+    int pollFd(ExecutorData &data, int fd, bool enable, int events);
+
+    // upstream connection (fd1) is read and written through ssl, if it has TLS
+    ssize_t readFd1(ExecutorData &data, void *buf, size_t count, int &errorCode);
+    ssize_t writeFd1(ExecutorData &data, const void *buf, size_t count, int &errorCode);
+
+    // fd1 has data, which is already read from socket and is not visible to poll (ssl)
+    bool pendingFd1(const ExecutorData &data) const;
+
+    // kernel encrypts bytes written to fd1 (kTLS), so they can be spliced to it
+    bool ktlsSendFd1(const ExecutorData &data) const;
+
+    // fd1 is polled for response. while ssl has pending data, fd1 is polled for write too, so read continues.
+    int pollResponseFd1(ExecutorData &data);
+
+    // closes upstream connection, its ssl is freed
+    int closeFd1(ExecutorData &data);
+};
+
+#endif
@@ -1,188 +1,186 @@
 #include <ProxyExecutorSplice.h>
 #include <PollLoopBase.h>
-#include <NetworkUtils.h>
+#include <UpstreamGroup.h>
+#include <ProxyParameters.h>
+#include <PollData.h>
 
 #include <sys/epoll.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <fcntl.h>
 #include <string.h>
+#include <errno.h>
+#include <algorithm>
 
 
-int ProxyExecutorSplice::init(PollLoopBase *loop)
+ProcessResult ProxyExecutorSplice::process_forwardRequestBody(ExecutorData &data)
 {
-    this->loop = loop;
-    this->log = loop->log;
-    return 0;
-}
+    if(!data.requestSplice)
+    {
+        return ProxyExecutor::process_forwardRequestBody(data);
+    }
 
+    bool progress = false;
 
-int ProxyExecutorSplice::up(ExecutorData &data)
-{
-    data.removeOnTimeout = true;
+    if(data.requestBodyLeft > 0 && data.bytesInPipe == 0)
+    {
+        long long int count = spliceCount(data);
+        if(count > data.requestBodyLeft)
+        {
+            count = data.requestBodyLeft;
+        }
 
-    bool connected = false;
+        ssize_t bytes = splice(data.fd0, NULL, data.pipeWriteFd, NULL, count, SPLICE_F_NONBLOCK | SPLICE_F_MORE);
 
-    if(data.proxy == nullptr)
-    {
-        log->error("proxy parameters are not set\n");
-        return -1;
-    }
+        log->debug("splice request body read bytes: %zd\n", bytes);
 
-    if(data.proxy->socketType == SocketType::tcp)
-    {
-        data.fd1 = socketConnectNonBlock(data.proxy->address.c_str(), data.proxy->port, connected, log);
-    }
-    // splice can not work with unix domain sockets
-    // left this code here, may be splice will work with unix domain sockets in the future
-    else if(data.proxy->socketType == SocketType::unix)
-    {
-        data.fd1 = socketConnectUnixNonBlock(data.proxy->address.c_str(), connected, log);
-    }
-    else
-    {
-        log->error("invalid socket type\n");
-        return -1;
+        if(bytes == 0)
+        {
+            log->info("client closed connection before end of request body\n");
+            return ProcessResult::removeExecutorError;
+        }
+        else if(bytes < 0)
+        {
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                log->error("splice failed: %s\n", strerror(errno));
+                return ProcessResult::removeExecutorError;
+            }
+        }
+        else
+        {
+            data.bytesInPipe += bytes;
+            data.requestBodyLeft -= bytes;
+            progress = true;
+        }
     }
 
-    if(data.fd1 < 0)
+    if(data.bytesInPipe > 0)
     {
-        return -1;
-    }
+        unsigned int flags = SPLICE_F_NONBLOCK | ((data.requestBodyLeft > 0) ? SPLICE_F_MORE : 0);
 
-    if(loop->addPollFd(data, data.fd1, EPOLLOUT) != 0)
-    {
-        return -1;
-    }
+        ssize_t bytes = splice(data.pipeReadFd, NULL, data.fd1, NULL, data.bytesInPipe, flags);
 
-    if(loop->removePollFd(data, data.fd0) != 0)
-    {
-        return -1;
+        log->debug("splice request body write bytes: %zd\n", bytes);
+
+        if(bytes < 0)
+        {
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                log->error("splice failed: %s\n", strerror(errno));
+                return ProcessResult::removeExecutorError;
+            }
+        }
+        else if(bytes > 0)
+        {
+            data.bytesInPipe -= bytes;
+            progress = true;
+        }
     }
 
-    if(connected)
+    if(progress)
     {
-        data.state = ExecutorData::State::forwardRequest;
+        data.retryCounter = 0;
     }
     else
     {
-        data.state = ExecutorData::State::waitConnect;
+        ++data.retryCounter;
     }
 
-    return 0;
+    return finishRequestBodyStep(data, data.requestBodyLeft > 0 && data.bytesInPipe == 0, data.bytesInPipe > 0);
 }
 
 
-ProcessResult ProxyExecutorSplice::process(ExecutorData &data, int fd, int events)
+// chunk sizes must be read to find end of chunked body, chunked body goes through buffer.
+// body is spliced to TLS backend, when kernel encrypts records of connection (kTLS).
+int ProxyExecutorSplice::startForwardRequestBody(ExecutorData &data)
 {
-    if(data.state == ExecutorData::State::waitConnect && fd == data.fd1 && (events & EPOLLOUT))
-    {
-        return process_waitConnect(data);
-    }
-    if(data.state == ExecutorData::State::forwardRequest && fd == data.fd1 && (events & EPOLLOUT))
-    {
-        return process_forwardRequest(data);
-    }
-    if(data.state == ExecutorData::State::forwardResponse && fd == data.fd1 && (events & EPOLLIN))
-    {
-        return process_forwardResponseRead(data);
-    }
-    if((data.state == ExecutorData::State::forwardResponse ||
-            data.state == ExecutorData::State::forwardResponseOnlyWrite) && fd == data.fd0 && (events & EPOLLOUT))
+    data.requestSplice = !data.requestChunked &&
+                         (spliceBody(data, data.requestBodyLeft) ||
+                          (ktlsSendFd1(data) && data.requestBodyLeft >= data.proxy->spliceMinBytes));
+
+    if(data.requestSplice && data.pipeReadFd < 0)
     {
-        return process_forwardResponseWrite(data);
+        return openPipe(data);
     }
+    return 0;
+}
+
 
-    log->warning("invalid process call (proxy)\n");
-    return ProcessResult::removeExecutorError;
+bool ProxyExecutorSplice::spliceBody(const ExecutorData &data, long long int bodySize) const
+{
+    return data.upstream != nullptr && data.upstream->canSplice(data.backendIndex) &&
+           (bodySize < 0 || bodySize >= data.proxy->spliceMinBytes);
 }
 
 
-ProcessResult ProxyExecutorSplice::process_waitConnect(ExecutorData &data)
+// response headers (and small responses) are forwarded through buffer, where framing is parsed.
+// after buffer is written to client, Content-Length body or body till close is spliced.
+// chunk sizes must be read to find end of chunked body, chunked body goes through buffer.
+bool ProxyExecutorSplice::spliceResponseBody(const ExecutorData &data) const
 {
-    int socketError = socketConnectNonBlockCheck(data.fd1, log);
+    const HttpResponseParser &parser = data.responseParser;
 
-    if(socketError == 0)
-    {
-        data.state = ExecutorData::State::forwardRequest;
-        return process_forwardRequest(data);
-    }
-    else if(socketError == EINPROGRESS)
+    // response, which is collected for cache, has header to insert or is buffered, goes through buffer
+    if(!parser.headersFinished() || parser.finished() || data.buffer.readAvailable() ||
+       data.cacheStore || data.responseInsertLeft > 0 || data.responseSpool.active())
     {
-        ++data.retryCounter;
-        return ProcessResult::ok;
+        return false;
     }
-    else
+
+    if(parser.getBodyType() == HttpResponseParser::BodyType::length)
     {
-        log->error("ProxyExecutor::process_waitConnect socketConnectNonBlockCheck failed: %d\n", socketError);
-        return ProcessResult::removeExecutorError;
+        return spliceBody(data, parser.getBodyLeft());
     }
+
+    return parser.getBodyType() == HttpResponseParser::BodyType::untilClose && spliceBody(data, -1);
 }
 
 
-ProcessResult ProxyExecutorSplice::process_forwardRequest(ExecutorData &data)
+ProcessResult ProxyExecutorSplice::process_forwardResponseRead(ExecutorData &data)
 {
-    void *p;
-    int size;
-
-    if(data.buffer.startRead(p, size))
+    if(!data.responseSplice)
     {
-        ssize_t bytesWritten = write(data.fd1, p, size);
-
-        if(bytesWritten <= 0)
+        if(!spliceResponseBody(data))
         {
-            if(errno == EAGAIN || errno == EWOULDBLOCK)
-            {
-                ++data.retryCounter;
-                return ProcessResult::ok;
-            }
-            else
-            {
-                log->error("write failed: %s\n", strerror(errno));
-                return ProcessResult::removeExecutorError;
-            }
+            return ProxyExecutor::process_forwardResponseRead(data);
         }
-        data.retryCounter = 0;
-
-        data.buffer.endRead(bytesWritten);
-
-        if(bytesWritten == size)
+        if(data.pipeReadFd < 0 && openPipe(data) != 0)
         {
-            data.buffer.clear();
+            return ProcessResult::removeExecutorError;
+        }
+        data.responseSplice = true;
+    }
 
-            data.state = ExecutorData::State::forwardResponse;
+    long long int count = spliceCount(data);
 
-            if(loop->editPollFd(data, data.fd1, EPOLLIN) != 0)
-            {
-                return ProcessResult::removeExecutorError;
-            }
-            if(openPipe(data) != 0)
-            {
-                return ProcessResult::removeExecutorError;
-            }
-            return ProcessResult::ok;
-        }
+    if(data.responseParser.getBodyType() == HttpResponseParser::BodyType::length &&
+       count > data.responseParser.getBodyLeft())
+    {
+        count = data.responseParser.getBodyLeft();
+    }
 
-        return ProcessResult::ok;
+    ssize_t bytes;
+
+    if(count > 0)
+    {
+        bytes = splice(data.fd1 , NULL, data.pipeWriteFd, NULL, count, SPLICE_F_NONBLOCK | SPLICE_F_MORE);
     }
     else
     {
-        log->error("buffer.startRead failed\n");
-        return ProcessResult::removeExecutorError;
+        // pipe is full, wait till it is written to client
+        bytes = -1;
+        errno = EAGAIN;
     }
-}
-
-
-ProcessResult ProxyExecutorSplice::process_forwardResponseRead(ExecutorData &data)
-{
-    ssize_t bytes = splice(data.fd1 , NULL, data.pipeWriteFd, NULL, 100000, SPLICE_F_NONBLOCK | SPLICE_F_MORE);
 
     log->debug("splice read bytes: %zd\n", bytes);
 
     if(bytes == 0)
     {
-        loop->closeFd(data, data.fd1);
-        data.state = ExecutorData::State::forwardResponseOnlyWrite;
+        if(releaseUpstream(data, false) != 0)
+        {
+            return ProcessResult::removeExecutorError;
+        }
         return process_forwardResponseWrite(data);
     }
     else if(bytes < 0)
@@ -213,6 +211,17 @@ ProcessResult ProxyExecutorSplice::process_forwardResponseRead(ExecutorData &dat
     {
         data.retryCounter = 0;
         data.bytesInPipe += bytes;
+
+        data.responseParser.skipBody(bytes);
+
+        if(data.responseParser.finished())
+        {
+            if(releaseUpstream(data, data.responseParser.keepAlive()) != 0)
+            {
+                return ProcessResult::removeExecutorError;
+            }
+        }
+
         return process_forwardResponseWrite(data);
     }
 }
@@ -220,9 +229,16 @@ ProcessResult ProxyExecutorSplice::process_forwardResponseRead(ExecutorData &dat
 
 ProcessResult ProxyExecutorSplice::process_forwardResponseWrite(ExecutorData &data)
 {
+    if(!data.responseSplice)
+    {
+        return ProxyExecutor::process_forwardResponseWrite(data);
+    }
+
     if(data.bytesInPipe > 0)
     {
-        ssize_t bytes = splice(data.pipeReadFd, NULL, data.fd0, NULL, 100000, SPLICE_F_NONBLOCK | SPLICE_F_MORE);
+        int count = std::min(data.bytesInPipe, loop->parameters->sendBudgetBytes);
+
+        ssize_t bytes = splice(data.pipeReadFd, NULL, data.fd0, NULL, count, SPLICE_F_NONBLOCK | SPLICE_F_MORE);
 
         log->debug("splice write bytes: %zd\n", bytes);
 
@@ -271,7 +287,7 @@ ProcessResult ProxyExecutorSplice::process_forwardResponseWrite(ExecutorData &da
                 {
                     if(data.bytesInPipe == 0)
                     {
-                        return ProcessResult::removeExecutorOk;
+                        return finishResponse(data);
                     }
                 }
 
@@ -312,7 +328,7 @@ ProcessResult ProxyExecutorSplice::process_forwardResponseWrite(ExecutorData &da
     {
         if(data.state == ExecutorData::State::forwardResponseOnlyWrite)
         {
-            return ProcessResult::removeExecutorOk;
+            return finishResponse(data);
         }
         else
         {
@@ -325,16 +341,223 @@ ProcessResult ProxyExecutorSplice::process_forwardResponseWrite(ExecutorData &da
 
 int ProxyExecutorSplice::openPipe(ExecutorData &data)
 {
-    int pipeFd[2];
+    PipePool *pool = loop->getPipePool();
 
-    if(pipe2(pipeFd, O_NONBLOCK) != 0)
+    data.pipeCapacity = pool->get(data.pipeReadFd, data.pipeWriteFd);
+    if(data.pipeCapacity < 0)
     {
-        log->error("pipe2 failed: %s\n", strerror(errno));
+        data.pipeCapacity = 0;
         return -1;
     }
 
-    data.pipeReadFd = pipeFd[0];
-    data.pipeWriteFd = pipeFd[1];
+    data.pipePool = pool;
+
+    return 0;
+}
+
+
+// bytes to move into pipe: not more than free space of pipe, so splice does not stop on full pipe,
+// and not more than send budget of loop iteration.
+long long int ProxyExecutorSplice::spliceCount(const ExecutorData &data) const
+{
+    return std::min(data.pipeCapacity - data.bytesInPipe, loop->parameters->sendBudgetBytes);
+}
+
+
+bool ProxyExecutorSplice::canTunnel(const ExecutorData &data) const
+{
+    return data.upstream != nullptr && data.upstream->canSplice(data.backendIndex);
+}
+
+
+ProcessResult ProxyExecutorSplice::startTunnel(ExecutorData &data)
+{
+    if(data.cacheStore)
+    {
+        abandonCachedResponse(data);
+    }
+
+    // tunnel is not counted as outstanding request of backend, its connection is not returned to pool
+    data.upstream->finishRequest(data.backendIndex);
+    data.upstream = nullptr;
+
+    if(data.pipeReadFd < 0 && openPipe(data) != 0)
+    {
+        return ProcessResult::removeExecutorError;
+    }
+
+    data.tunnelPipeCapacity = data.pipePool->get(data.tunnelPipeReadFd, data.tunnelPipeWriteFd);
+    if(data.tunnelPipeCapacity < 0)
+    {
+        data.tunnelPipeCapacity = 0;
+        return ProcessResult::removeExecutorError;
+    }
+
+    data.state = ExecutorData::State::tunnel;
+
+    log->debug("tunnel is started\n");
+
+    return process_tunnel(data);
+}
+
+
+ProcessResult ProxyExecutorSplice::process_tunnel(ExecutorData &data)
+{
+    bool progress = false;
+
+    void *p;
+    int size;
+
+    // response headers and bytes read with them are sent to client before spliced bytes
+    if(data.buffer.startRead(p, size) && data.bytesInPipe < data.pipeCapacity)
+    {
+        ssize_t bytes = write(data.pipeWriteFd, p, std::min(size, data.pipeCapacity - data.bytesInPipe));
+
+        if(bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            log->error("write to pipe failed: %s\n", strerror(errno));
+            return ProcessResult::removeExecutorError;
+        }
+        else if(bytes > 0)
+        {
+            data.buffer.endRead(bytes);
+            data.bytesInPipe += bytes;
+            progress = true;
+        }
+    }
+
+    bool bufferEmpty = !data.buffer.readAvailable();
+
+    if(spliceTunnel(data.fd1, data.fd0, data.pipeReadFd, data.pipeWriteFd, data.bytesInPipe, data.pipeCapacity,
+                    bufferEmpty, data.tunnelUpstreamClosed, progress) != 0 ||
+       spliceTunnel(data.fd0, data.fd1, data.tunnelPipeReadFd, data.tunnelPipeWriteFd, data.tunnelBytesInPipe,
+                    data.tunnelPipeCapacity, true, data.tunnelClientClosed, progress) != 0)
+    {
+        return ProcessResult::removeExecutorError;
+    }
+
+    // end of file is forwarded after last bytes of closed side, other side can still answer (WebSocket close).
+    // tunnel ends when both sides are closed and forwarded.
+    bool upstreamDone = data.tunnelUpstreamClosed && bufferEmpty && data.bytesInPipe == 0;
+    bool clientDone = data.tunnelClientClosed && data.tunnelBytesInPipe == 0;
+
+    if(upstreamDone && clientDone)
+    {
+        log->debug("tunnel is closed\n");
+        return ProcessResult::removeExecutorOk;
+    }
+
+    if(upstreamDone && !data.tunnelClientShutdown)
+    {
+        shutdown(data.fd0, SHUT_WR);
+        data.tunnelClientShutdown = true;
+    }
+
+    if(clientDone && !data.tunnelUpstreamShutdown)
+    {
+        shutdown(data.fd1, SHUT_WR);
+        data.tunnelUpstreamShutdown = true;
+    }
+
+    if(progress)
+    {
+        data.retryCounter = 0;
+    }
+    else
+    {
+        ++data.retryCounter;
+    }
+
+    int events0 = ((!data.tunnelClientClosed && data.tunnelBytesInPipe < data.tunnelPipeCapacity) ? EPOLLIN : 0) |
+                  ((data.bytesInPipe > 0) ? EPOLLOUT : 0);
+    int events1 = ((!data.tunnelUpstreamClosed && bufferEmpty && data.bytesInPipe < data.pipeCapacity) ? EPOLLIN : 0) |
+                  ((data.tunnelBytesInPipe > 0) ? EPOLLOUT : 0);
+
+    // hang up of closed side is reported once, otherwise it wakes loop while other side is slow to receive
+    if(data.tunnelClientClosed && events0 != 0)
+    {
+        events0 |= EPOLLET;
+    }
+
+    if(data.tunnelUpstreamClosed && events1 != 0)
+    {
+        events1 |= EPOLLET;
+    }
+
+    if(pollTunnelFd(data, data.fd0, events0) != 0 || pollTunnelFd(data, data.fd1, events1) != 0)
+    {
+        return ProcessResult::removeExecutorError;
+    }
+
+    return ProcessResult::ok;
+}
+
+
+int ProxyExecutorSplice::spliceTunnel(int from, int to, int pipeReadFd, int pipeWriteFd, int &bytesInPipe,
+                                      int pipeCapacity, bool canRead, bool &fromClosed, bool &progress)
+{
+    if(canRead && !fromClosed && bytesInPipe < pipeCapacity)
+    {
+        int count = std::min(pipeCapacity - bytesInPipe, loop->parameters->sendBudgetBytes);
+
+        // messages of interactive protocols are not delayed, SPLICE_F_MORE is not set
+        ssize_t bytes = splice(from, NULL, pipeWriteFd, NULL, count, SPLICE_F_NONBLOCK);
+
+        log->debug("tunnel splice read fd %d bytes: %zd\n", from, bytes);
+
+        if(bytes == 0)
+        {
+            fromClosed = true;
+            progress = true;
+        }
+        else if(bytes < 0)
+        {
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                log->info("tunnel splice failed: %s\n", strerror(errno));
+                return -1;
+            }
+        }
+        else
+        {
+            bytesInPipe += bytes;
+            progress = true;
+        }
+    }
+
+    if(bytesInPipe > 0)
+    {
+        ssize_t bytes = splice(pipeReadFd, NULL, to, NULL, bytesInPipe, SPLICE_F_NONBLOCK);
+
+        log->debug("tunnel splice write fd %d bytes: %zd\n", to, bytes);
+
+        if(bytes < 0)
+        {
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                log->info("tunnel splice failed: %s\n", strerror(errno));
+                return -1;
+            }
+        }
+        else if(bytes > 0)
+        {
+            bytesInPipe -= bytes;
+            progress = true;
+        }
+    }
 
     return 0;
 }
+
+
+int ProxyExecutorSplice::pollTunnelFd(ExecutorData &data, int fd, int events)
+{
+    PollData *pollData = (fd == data.fd0) ? data.pollData0 : data.pollData1;
+
+    if(pollData != nullptr && events != 0 && pollData->events != events)
+    {
+        return loop->editPollFd(data, fd, events);
+    }
+
+    return pollFd(data, fd, events != 0, events);
+}
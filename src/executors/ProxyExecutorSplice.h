@@ -1,18 +1,17 @@
 #ifndef PROXY_EXECUTOR_SPLICE_H
 #define PROXY_EXECUTOR_SPLICE_H
 
-#include <Executor.h>
-
-class ProxyExecutorSplice: public Executor
+#include <ProxyExecutor.h>
+
+// Bodies of known size shorter than ProxyParameters::spliceMinBytes go through buffer of ProxyExecutor,
+// copy is as fast for them and pipe is not needed. Longer bodies and bodies till close are spliced
+// socket -> pipe -> socket, if backend connection can be spliced (UpstreamGroup::canSplice).
+// Request body is spliced to TLS backend too, if kernel encrypts its connection (kTLS).
+// Tunnel (WebSocket, CONNECT) is spliced in both directions at once through two pipes, data is not copied.
+class ProxyExecutorSplice: public ProxyExecutor
 {
 public:
 
-    int init(PollLoopBase *loop) override;
-
-    int up(ExecutorData &data) override;
-
-    ProcessResult process(ExecutorData &data, int fd, int events) override;
-
     const char* name() const override
     {
         return "proxysplice";
@@ -22,13 +21,35 @@ protected:
 
     int openPipe(ExecutorData &data);
 
-    ProcessResult process_forwardRequest(ExecutorData &data);
+    // Content-Length body is spliced socket -> pipe -> socket
+    ProcessResult process_forwardRequestBody(ExecutorData &data) override;
+
+    ProcessResult process_forwardResponseRead(ExecutorData &data) override;
+
+    ProcessResult process_forwardResponseWrite(ExecutorData &data) override;
+
+    int startForwardRequestBody(ExecutorData &data) override;
+
+    // body of bodySize bytes, -1 if size is unknown, is spliced
+    bool spliceBody(const ExecutorData &data, long long int bodySize) const;
+
+    bool spliceResponseBody(const ExecutorData &data) const;
+
+    bool canTunnel(const ExecutorData &data) const override;
+
+    ProcessResult startTunnel(ExecutorData &data) override;
+
+    ProcessResult process_tunnel(ExecutorData &data) override;
 
-    ProcessResult process_forwardResponseRead(ExecutorData &data);
+    // one direction of tunnel: from -> pipe -> to. fromClosed is set when from socket is closed.
+    // progress is set if bytes were moved. returns -1 on error.
+    int spliceTunnel(int from, int to, int pipeReadFd, int pipeWriteFd, int &bytesInPipe, int pipeCapacity,
+                     bool canRead, bool &fromClosed, bool &progress);
 
-    ProcessResult process_forwardResponseWrite(ExecutorData &data);
+    // fd is registered for events, fd without events is removed from poll loop
+    int pollTunnelFd(ExecutorData &data, int fd, int events);
 
-    ProcessResult process_waitConnect(ExecutorData &data);
+    long long int spliceCount(const ExecutorData &data) const;
 };
 
 #endif
@@ -2,6 +2,7 @@
 
 #include <ProxyParameters.h>
 #include <PollLoopBase.h>
+#include <TimeUtils.h>
 
 #include <sys/epoll.h>
 #include <string.h>
@@ -20,11 +21,26 @@ int RequestExecutor::up(ExecutorData &data)
     data.removeOnTimeout = true;
     data.connectionType = (int)ConnectionType::clear;
 
+    return startRequest(data);
+}
+
+
+int RequestExecutor::startRequest(ExecutorData &data)
+{
     data.buffer.init(ExecutorData::REQUEST_BUFFER_SIZE);
 
     data.request.reset();
+    // body of proxied request is streamed to upstream
+    data.request.setWaitContent(false);
 
-    if(loop->addPollFd(data, data.fd0, EPOLLIN) != 0)
+    if(data.pollData0 != nullptr)
+    {
+        if(loop->editPollFd(data, data.fd0, EPOLLIN) != 0)
+        {
+            return -1;
+        }
+    }
+    else if(loop->addPollFd(data, data.fd0, EPOLLIN) != 0)
     {
         return -1;
     }
@@ -37,6 +53,8 @@ int RequestExecutor::up(ExecutorData &data)
 
 ProcessResult RequestExecutor::process(ExecutorData &data, int fd, int events)
 {
+    checkQueueDelay(data);
+
     if(data.state == ExecutorData::State::readRequest && fd == data.fd0 && (events & EPOLLIN))
     {
         return process_readRequest(data);
@@ -47,6 +65,17 @@ ProcessResult RequestExecutor::process(ExecutorData &data, int fd, int events)
 }
 
 
+void RequestExecutor::checkQueueDelay(ExecutorData &data)
+{
+    if(data.acceptTime > 0)
+    {
+        long long int curMillis = getMilliseconds();
+        loop->srv->admission.addDelay(curMillis - data.acceptTime, curMillis);
+        data.acceptTime = 0;
+    }
+}
+
+
 int RequestExecutor::readRequest(ExecutorData &data)
 {
     void *p;
@@ -101,11 +130,17 @@ int RequestExecutor::readRequest(ExecutorData &data)
 ProcessResult RequestExecutor::setExecutor(ExecutorData &data, Executor *pExecutor)
 {
     data.pExecutor = pExecutor;
-    if(pExecutor->up(data) != 0)
+    int result = pExecutor->up(data);
+
+    if(result < 0)
     {
         log->warning("RequestExecutor::setExecutor up failed\n");
         return ProcessResult::removeExecutorError;
     }
+    else if(result > 0)
+    {
+        return ProcessResult::removeExecutorOk;
+    }
     else
     {
         return ProcessResult::ok;
@@ -115,18 +150,16 @@ ProcessResult RequestExecutor::setExecutor(ExecutorData &data, Executor *pExecut
 
 ProxyParameters* RequestExecutor::findProxy(ExecutorData &data)
 {
-    typedef decltype(loop->parameters->proxies)::size_type iterType;
+    // target of CONNECT is not path
+    int index = data.request.isConnect() ? loop->parameters->proxyRoutes.findConnect() :
+                                           loop->parameters->proxyRoutes.find(data.request.getUrl());
 
-    iterType size = loop->parameters->proxies.size();
-    for(iterType i = 0; i < size ; ++i)
+    if(index < 0)
     {
-        if(data.request.isUrlPrefix(loop->parameters->proxies[i].prefix.c_str()))
-        {
-            return &loop->parameters->proxies[i];
-        }
+        return nullptr;
     }
 
-    return nullptr;
+    return &loop->parameters->proxies[index];
 }
 
 
@@ -162,7 +195,7 @@ RequestExecutor::ParseRequestResult RequestExecutor::parseRequest(ExecutorData &
             {
                 const char *url = data.request.getUrl();
 
-                if(url == nullptr)
+                if(url == nullptr || data.request.isConnect())
                 {
                     return ParseRequestResult::invalid;
                 }
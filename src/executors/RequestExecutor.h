@@ -13,6 +13,9 @@ public:
 
     ProcessResult process(ExecutorData &data, int fd, int events) override;
 
+    // reads next request over connection, which is established already (also after ssl handshake)
+    int startRequest(ExecutorData &data);
+
     const char* name() const override
     {
         return "request";
@@ -34,6 +37,8 @@ protected:
     virtual ProcessResult process_readRequest(ExecutorData &data);
 
     ProxyParameters* findProxy(ExecutorData &data);
+
+    void checkQueueDelay(ExecutorData &data);
 };
 
 #endif
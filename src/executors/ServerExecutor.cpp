@@ -1,6 +1,7 @@
 #include <ServerExecutor.h>
 #include <PollLoopBase.h>
 #include <NetworkUtils.h>
+#include <TimeUtils.h>
 
 #include <sys/epoll.h>
 #include <netinet/in.h>
@@ -22,7 +23,7 @@ int ServerExecutor::up(ExecutorData &data)
     data.removeOnTimeout = false;
     data.state = ExecutorData::State::ok;
 
-    data.fd0 = socketListen(data.port, log);
+    data.fd0 = socketListen(*data.listen, log);
     if(data.fd0 < 0)
     {
         return -1;
@@ -45,6 +46,13 @@ ProcessResult ServerExecutor::process(ExecutorData &data, int fd, int /*events*/
         return ProcessResult::ok;
     }
 
+    long long int curMillis = getMilliseconds();
+
+    if(loop->srv->admission.isOverloaded(curMillis))
+    {
+        return shedConnections(data, curMillis);
+    }
+
     struct sockaddr_in address;
     socklen_t addrlen = sizeof(address);
 
@@ -52,13 +60,79 @@ ProcessResult ServerExecutor::process(ExecutorData &data, int fd, int /*events*/
 
     if(clientSockFd == -1)
     {
+        if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED)
+        {
+            return ProcessResult::ok;
+        }
         log->error("accept failed: %s", strerror(errno));
         return ProcessResult::shutdown;
     }
 
-    log->debug("server accepted connection\n");
+    log->debug("%s accepted connection\n", name());
 
-    loop->createRequestExecutor(clientSockFd, ExecutorType::request);
+    loop->createRequestExecutor(clientSockFd, requestExecutorType(), curMillis);
 
     return ProcessResult::ok;
 }
+
+
+ProcessResult ServerExecutor::shedConnections(ExecutorData &data, long long int curMillis)
+{
+    // answer pending connections and stop accepting for one interval,
+    // new connections wait in listen queue till overload state is checked again.
+    int rejectCounter = 0;
+
+    for(; rejectCounter < MAX_REJECT_PER_EVENT; ++rejectCounter)
+    {
+        int clientSockFd = accept4(data.fd0, nullptr, nullptr, SOCK_NONBLOCK);
+
+        if(clientSockFd == -1)
+        {
+            if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED)
+            {
+                break;
+            }
+            log->error("accept failed: %s", strerror(errno));
+            return ProcessResult::shutdown;
+        }
+
+        rejectConnection(clientSockFd);
+    }
+
+    log->warning("%s overloaded, rejected connections: %d\n", name(), rejectCounter);
+
+    if(loop->removePollFd(data, data.fd0) != 0)
+    {
+        return ProcessResult::shutdown;
+    }
+
+    pausedListeners.push_back(&data);
+    resumeMillis = curMillis + loop->srv->admission.intervalMillis;
+
+    return ProcessResult::ok;
+}
+
+
+void ServerExecutor::rejectConnection(int fd)
+{
+    loop->srv->admission.reject(fd);
+}
+
+
+void ServerExecutor::onTimer(long long int curMillis)
+{
+    if(pausedListeners.empty() || curMillis < resumeMillis)
+    {
+        return;
+    }
+
+    for(ExecutorData *data : pausedListeners)
+    {
+        if(loop->addPollFd(*data, data->fd0, EPOLLIN) != 0)
+        {
+            log->error("%s resume failed\n", name());
+        }
+    }
+
+    pausedListeners.clear();
+}
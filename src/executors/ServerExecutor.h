@@ -2,6 +2,9 @@
 #define SERVER_EXECUTOR_H
 
 #include <Executor.h>
+#include <ExecutorType.h>
+
+#include <vector>
 
 class ServerExecutor: public Executor
 {
@@ -12,10 +15,29 @@ public:
 
     ProcessResult process(ExecutorData &data, int fd, int events) override;
 
+    void onTimer(long long int curMillis) override;
+
     const char* name() const override
     {
         return "server";
     }
+
+protected:
+
+    virtual ExecutorType requestExecutorType() const
+    {
+        return ExecutorType::request;
+    }
+
+    virtual void rejectConnection(int fd);
+
+    ProcessResult shedConnections(ExecutorData &data, long long int curMillis);
+
+    static const int MAX_REJECT_PER_EVENT = 100;
+
+    // listeners, which stopped accepting because of overload
+    std::vector<ExecutorData*> pausedListeners;
+    long long int resumeMillis = 0;
 };
 
 #endif
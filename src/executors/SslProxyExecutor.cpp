@@ -6,6 +6,16 @@
 #include <sys/epoll.h>
 #include <openssl/ssl.h>
 
+ssize_t SslProxyExecutor::readFd0(ExecutorData &data, void *buf, size_t count, int &errorCode)
+{
+    return sslReadFd0(this, data, buf, count, errorCode, log);
+}
+
+bool SslProxyExecutor::pendingFd0(ExecutorData &data)
+{
+    return SSL_pending(data.ssl) > 0;
+}
+
 ssize_t SslProxyExecutor::writeFd0(ExecutorData &data, const void *buf, size_t count, int &errorCode)
 {
     return sslWriteFd0(this, data, buf, count, errorCode, log);
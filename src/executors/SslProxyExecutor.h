@@ -14,7 +14,11 @@ public:
 
 protected:
 
+    ssize_t readFd0(ExecutorData &data, void *buf, size_t count, int &errorCode) override;
+
     ssize_t writeFd0(ExecutorData &data, const void *buf, size_t count, int &errorCode) override;
+
+    bool pendingFd0(ExecutorData &data) override;
 };
 
 #endif
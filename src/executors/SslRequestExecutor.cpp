@@ -1,5 +1,6 @@
 #include <SslRequestExecutor.h>
 #include <PollLoopBase.h>
+#include <SslUtils.h>
 
 #include <sys/epoll.h>
 #include <openssl/ssl.h>
@@ -20,6 +21,8 @@ int SslRequestExecutor::up(ExecutorData &data)
     data.buffer.init(ExecutorData::REQUEST_BUFFER_SIZE);
 
     data.request.reset();
+    // body of proxied request is streamed to upstream
+    data.request.setWaitContent(false);
 
     if(sslInit(data) != 0)
     {
@@ -122,6 +125,8 @@ SslRequestExecutor::HandleHandshakeResult SslRequestExecutor::handleHandshake(Ex
 
 ProcessResult SslRequestExecutor::process(ExecutorData &data, int fd, int events)
 {
+    checkQueueDelay(data);
+
     if(data.state == ExecutorData::State::sslHandshake && fd == data.fd0)
     {
         return process_handshake(data);
@@ -140,39 +145,7 @@ ProcessResult SslRequestExecutor::process(ExecutorData &data, int fd, int events
 
 ssize_t SslRequestExecutor::readFd0(ExecutorData &data, void *buf, size_t count, int &errorCode)
 {
-    int result = SSL_read(data.ssl, buf, static_cast<int>(count));
-
-    if(result > 0)
-    {
-        errorCode = 0;
-    }
-    else
-    {
-        int error = SSL_get_error(data.ssl, result);
-
-        if(error == SSL_ERROR_WANT_READ)
-        {
-            errorCode = EAGAIN;
-        }
-        else if(error == SSL_ERROR_WANT_WRITE)
-        {
-            if(loop->editPollFd(data, data.fd0, EPOLLIN | EPOLLOUT) == 0)
-            {
-                errorCode = EAGAIN;
-            }
-            else
-            {
-                errorCode = EINVAL;
-            }
-        }
-        else
-        {
-            errorCode = EINVAL;
-            log->error("SSL_read failed. result: %d   error: %d   errno: %d   strerror: %s\n", result, error, errno, strerror(errno));
-        }
-    }
-
-    return result;
+    return sslReadFd0(this, data, buf, count, errorCode, log);
 }
 
 
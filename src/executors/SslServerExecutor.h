@@ -1,21 +1,26 @@
 #ifndef SSL_SERVER_EXECUTOR_H
 #define SSL_SERVER_EXECUTOR_H
 
-#include <Executor.h>
+#include <ServerExecutor.h>
 
-class SslServerExecutor: public Executor
+class SslServerExecutor: public ServerExecutor
 {
 public:
-    int init(PollLoopBase *loop) override;
-
-    int up(ExecutorData &data) override;
-
-    ProcessResult process(ExecutorData &data, int fd, int events) override;
 
     const char* name() const override
     {
         return "sslserver";
     }
+
+protected:
+
+    ExecutorType requestExecutorType() const override
+    {
+        return ExecutorType::requestSsl;
+    }
+
+    // http response can not be sent before handshake, connection is just closed
+    void rejectConnection(int fd) override;
 };
 
 #endif
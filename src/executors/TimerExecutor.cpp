@@ -0,0 +1,41 @@
+#include <TimerExecutor.h>
+#include <PollLoopBase.h>
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+
+int TimerExecutor::init(PollLoopBase *loop)
+{
+    this->loop = loop;
+    log = loop->log;
+    return 0;
+}
+
+
+int TimerExecutor::up(ExecutorData &data)
+{
+    data.removeOnTimeout = false;
+    data.state = ExecutorData::State::ok;
+
+    return 0;
+}
+
+ProcessResult TimerExecutor::process(ExecutorData &data, int fd, int /*events*/)
+{
+    uint64_t expirations;
+    if(read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+    {
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return ProcessResult::ok;
+        }
+        log->error("timerfd read failed: %s\n", strerror(errno));
+        return ProcessResult::shutdown;
+    }
+
+    loop->checkTimers();
+    return ProcessResult::ok;
+}
@@ -0,0 +1,21 @@
+#ifndef TIMER_EXECUTOR_H
+#define TIMER_EXECUTOR_H
+
+#include <Executor.h>
+
+class TimerExecutor: public Executor
+{
+public:
+    int init(PollLoopBase *loop) override;
+
+    int up(ExecutorData &data) override;
+
+    ProcessResult process(ExecutorData &data, int fd, int events) override;
+
+    const char* name() const override
+    {
+        return "timer";
+    }
+};
+
+#endif
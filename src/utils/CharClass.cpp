@@ -0,0 +1,226 @@
+#include <CharClass.h>
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    define CHAR_CLASS_X86
+#    include <immintrin.h>
+#endif
+
+
+CharClass::CharClass(const char *ranges, Level level): level(level)
+{
+    memset(table, 0, sizeof(table));
+    memset(this->ranges, 0, sizeof(this->ranges));
+
+    rangesLength = static_cast<int>(strlen(ranges));
+    if(rangesLength > MAX_RANGES * 2)
+    {
+        rangesLength = MAX_RANGES * 2;
+    }
+    rangesLength -= rangesLength % 2;
+
+    memcpy(this->ranges, ranges, rangesLength);
+
+    for(int i = 0; i < rangesLength; i += 2)
+    {
+        memset(avxLows + i * 16, ranges[i], 32);
+        memset(avxWidths + i * 16, ranges[i + 1] - ranges[i], 32);
+    }
+
+    for(int i = 0; i < rangesLength; i += 2)
+    {
+        for(int c = static_cast<unsigned char>(ranges[i]); c <= static_cast<unsigned char>(ranges[i + 1]); ++c)
+        {
+            table[c] = true;
+        }
+    }
+}
+
+
+CharClass::Level CharClass::detectLevel()
+{
+#ifdef CHAR_CLASS_X86
+    static Level detected = []()
+    {
+        __builtin_cpu_init();
+
+        if(__builtin_cpu_supports("avx2"))
+        {
+            return Level::avx2;
+        }
+        else if(__builtin_cpu_supports("sse4.2"))
+        {
+            return Level::sse42;
+        }
+        return Level::scalar;
+    }();
+
+    return detected;
+#else
+    return Level::scalar;
+#endif
+}
+
+
+const char* CharClass::levelString(Level level)
+{
+    switch(level)
+    {
+    case Level::scalar:
+        return "scalar";
+    case Level::sse42:
+        return "sse4.2";
+    case Level::avx2:
+        return "avx2";
+    default:
+        return "unknown";
+    }
+}
+
+
+int CharClass::skip(const char *data, int size) const
+{
+    switch(level)
+    {
+    case Level::avx2:
+        return scanAvx2(data, size, true);
+    case Level::sse42:
+        return scanSse42(data, size, true);
+    default:
+        return skipScalar(data, size);
+    }
+}
+
+
+int CharClass::find(const char *data, int size) const
+{
+    switch(level)
+    {
+    case Level::avx2:
+        return scanAvx2(data, size, false);
+    case Level::sse42:
+        return scanSse42(data, size, false);
+    default:
+        return findScalar(data, size);
+    }
+}
+
+
+int CharClass::skipScalar(const char *data, int size) const
+{
+    int i = 0;
+    for(; i < size && table[static_cast<unsigned char>(data[i])]; ++i);
+    return i;
+}
+
+
+int CharClass::findScalar(const char *data, int size) const
+{
+    int i = 0;
+    for(; i < size && !table[static_cast<unsigned char>(data[i])]; ++i);
+    return i;
+}
+
+
+#ifdef CHAR_CLASS_X86
+
+__attribute__((target("sse4.2")))
+int CharClass::scanSse42(const char *data, int size, bool inClass) const
+{
+    const __m128i rangesVector = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ranges));
+
+    int i = 0;
+
+    // pcmpestri mode must be compile time constant
+    if(inClass)
+    {
+        for(; i + 16 <= size; i += 16)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            int index = _mm_cmpestri(rangesVector, rangesLength, block, 16,
+                                     _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT);
+            if(index < 16)
+            {
+                return i + index;
+            }
+        }
+        return i + skipScalar(data + i, size - i);
+    }
+    else
+    {
+        for(; i + 16 <= size; i += 16)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            int index = _mm_cmpestri(rangesVector, rangesLength, block, 16,
+                                     _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+            if(index < 16)
+            {
+                return i + index;
+            }
+        }
+        return i + findScalar(data + i, size - i);
+    }
+}
+
+
+__attribute__((target("avx2")))
+int CharClass::scanAvx2(const char *data, int size, bool inClass) const
+{
+    // most tokens of request are short, first block is checked with sse4.2,
+    // avx2 loop pays off only on long tokens (cookies, long urls).
+    int i = scanSse42(data, (size < 16) ? size : 16, inClass);
+    if(i < 16)
+    {
+        return i;
+    }
+
+    int rangeCount = rangesLength / 2;
+
+    for(; i + 32 <= size; i += 32)
+    {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i match = _mm256_setzero_si256();
+
+        for(int r = 0; r < rangeCount; ++r)
+        {
+            // unsigned low <= c <= high is checked as (c - low) <= (high - low)
+            __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(avxLows + r * 32));
+            __m256i width = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(avxWidths + r * 32));
+            __m256i shifted = _mm256_sub_epi8(block, low);
+            match = _mm256_or_si256(match, _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, width), shifted));
+        }
+
+        unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(match));
+        if(inClass)
+        {
+            mask = ~mask;
+        }
+
+        if(mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    // tail is shorter than avx2 block. clear upper halves of ymm registers
+    // before legacy sse code, otherwise every sse instruction pays transition penalty.
+    _mm256_zeroupper();
+
+    return i + scanSse42(data + i, size - i, inClass);
+}
+
+#else
+
+int CharClass::scanSse42(const char *data, int size, bool inClass) const
+{
+    return inClass ? skipScalar(data, size) : findScalar(data, size);
+}
+
+
+int CharClass::scanAvx2(const char *data, int size, bool inClass) const
+{
+    return inClass ? skipScalar(data, size) : findScalar(data, size);
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef CHAR_CLASS_H
+#define CHAR_CLASS_H
+
+// Set of symbols, described by up to 8 ranges of symbols.
+// skip and find scan 16 (sse4.2) or 32 (avx2) bytes at a time,
+// instruction set is selected at runtime.
+
+class CharClass
+{
+public:
+    enum class Level
+    {
+        scalar, sse42, avx2
+    };
+
+    static const int MAX_RANGES = 8;
+
+    // ranges: pairs of first and last symbol of range. for example "azAZ--"
+    CharClass(const char *ranges, Level level = detectLevel());
+
+    CharClass(const CharClass &cc) = default;
+    CharClass& operator=(const CharClass &cc) = default;
+
+    inline bool contains(char c) const
+    {
+        return table[static_cast<unsigned char>(c)];
+    }
+
+    // returns index of first symbol, which is not in class, or size
+    int skip(const char *data, int size) const;
+
+    // returns index of first symbol, which is in class, or size
+    int find(const char *data, int size) const;
+
+    static Level detectLevel();
+
+    static const char* levelString(Level level);
+
+protected:
+
+    int skipScalar(const char *data, int size) const;
+    int findScalar(const char *data, int size) const;
+
+    int scanSse42(const char *data, int size, bool inClass) const;
+    int scanAvx2(const char *data, int size, bool inClass) const;
+
+    bool table[256];
+
+    // pcmpestri ranges operand
+    char ranges[16];
+    int rangesLength = 0;
+
+    // avx2 operands: first symbol and width of every range, repeated 32 times
+    char avxLows[MAX_RANGES * 32];
+    char avxWidths[MAX_RANGES * 32];
+
+    Level level = Level::scalar;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include "NetworkUtils.h"
 
 #include <Log.h>
+#include <ListenParameters.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -8,6 +9,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <string.h>
 #include <errno.h>
 #include <arpa/inet.h>
@@ -15,7 +17,7 @@
 #include <sys/un.h>
 
 
-int socketConnectNonBlock(const char *address, int port, bool &connected, Log *log)
+int socketConnectNonBlock(uint32_t address, int port, bool &connected, Log *log)
 {
     connected = false;
 
@@ -29,7 +31,7 @@ int socketConnectNonBlock(const char *address, int port, bool &connected, Log *l
 
     struct sockaddr_in remoteaddr;
     remoteaddr.sin_family = AF_INET;
-    remoteaddr.sin_addr.s_addr = inet_addr(address);
+    remoteaddr.sin_addr.s_addr = address;
     remoteaddr.sin_port = htons(port);
 
     if(connect(sock, (struct sockaddr*)&remoteaddr, sizeof(remoteaddr)) != 0)
@@ -105,9 +107,26 @@ int socketConnectNonBlockCheck(int fd, Log *log)
 }
 
 
-int socketListen(int port, Log *log)
+static int setSocketOption(int sockfd, int level, int option, int value, const char *optionName, Log *log)
 {
-    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if(value <= 0)
+    {
+        return 0;
+    }
+
+    if(setsockopt(sockfd, level, option, &value, sizeof(int)) != 0)
+    {
+        log->error("setsockopt %s failed: %s\n", optionName, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int socketListen(const ListenParameters &listen, Log *log)
+{
+    int sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
 
     if(sockfd < 0)
     {
@@ -129,7 +148,20 @@ int socketListen(int port, Log *log)
 
     serv_addr.sin_family = AF_INET;
     serv_addr.sin_addr.s_addr = INADDR_ANY;
-    serv_addr.sin_port = htons(port);
+    serv_addr.sin_port = htons(listen.port);
+
+    // options are set before listen, so accepted sockets inherit them
+    // and buffer sizes are taken into account in tcp window scaling.
+    if(setSocketOption(sockfd, SOL_SOCKET, SO_SNDBUF, listen.sendBufferSize, "SO_SNDBUF", log) != 0 ||
+       setSocketOption(sockfd, SOL_SOCKET, SO_RCVBUF, listen.receiveBufferSize, "SO_RCVBUF", log) != 0 ||
+       setSocketOption(sockfd, IPPROTO_TCP, TCP_NODELAY, listen.tcpNoDelay, "TCP_NODELAY", log) != 0 ||
+       setSocketOption(sockfd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, listen.tcpNotSentLowat, "TCP_NOTSENT_LOWAT", log) != 0 ||
+       setSocketOption(sockfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, listen.tcpDeferAcceptSeconds, "TCP_DEFER_ACCEPT", log) != 0 ||
+       setSocketOption(sockfd, IPPROTO_TCP, TCP_FASTOPEN, listen.tcpFastOpenQueue, "TCP_FASTOPEN", log) != 0)
+    {
+        close(sockfd);
+        return -1;
+    }
 
     if(bind(sockfd, (struct sockaddr *) &serv_addr, sizeof(struct sockaddr_in)) != 0)
     {
@@ -138,7 +170,7 @@ int socketListen(int port, Log *log)
         return -1;
     }
 
-    if(listen(sockfd, 1000) != 0) //length of queue of pending connections
+    if(::listen(sockfd, 1000) != 0) //length of queue of pending connections
     {
         log->error("listen failed: %s\n", strerror(errno));
         close(sockfd);
@@ -168,3 +200,35 @@ int setNonBlock(int fd, Log *log)
     return 0;
 }
 
+
+
+bool spliceUnixSupported(Log *log)
+{
+    int sockets[2];
+    int pipeFds[2];
+
+    if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sockets) != 0)
+    {
+        log->error("socketpair failed: %s\n", strerror(errno));
+        return false;
+    }
+
+    if(pipe2(pipeFds, O_NONBLOCK) != 0)
+    {
+        log->error("pipe2 failed: %s\n", strerror(errno));
+        close(sockets[0]);
+        close(sockets[1]);
+        return false;
+    }
+
+    // socket is empty: EAGAIN if splice is supported, EINVAL if it is not
+    ssize_t bytes = splice(sockets[0], NULL, pipeFds[1], NULL, 1, SPLICE_F_NONBLOCK);
+    bool supported = (bytes >= 0 || errno == EAGAIN || errno == EWOULDBLOCK);
+
+    close(sockets[0]);
+    close(sockets[1]);
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+
+    return supported;
+}
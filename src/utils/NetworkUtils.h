@@ -1,15 +1,22 @@
 #ifndef NETWORK_UTILS_H
 #define NETWORK_UTILS_H
 
+#include <stdint.h>
+
 class Log;
+struct ListenParameters;
 
-int socketConnectNonBlock(const char *address, int port, bool &connected, Log *log);
+// address in network byte order
+int socketConnectNonBlock(uint32_t address, int port, bool &connected, Log *log);
 int socketConnectUnixNonBlock(const char *path, bool &connected, Log *log);
 int socketConnectNonBlockCheck(int fd, Log *log);
 
-int socketListen(int port, Log *log);
+int socketListen(const ListenParameters &listen, Log *log);
 
 int setNonBlock(int fd, Log *log);
 
+// splice from unix domain stream socket to pipe is supported by kernel
+bool spliceUnixSupported(Log *log);
+
 #endif
 
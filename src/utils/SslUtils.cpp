@@ -4,9 +4,49 @@
 #include <Log.h>
 
 #include <errno.h>
+#include <string.h>
 #include <openssl/ssl.h>
+#include <openssl/err.h>
 #include <sys/epoll.h>
 
+ssize_t sslReadFd0(Executor *exec, ExecutorData &data, void *buf, size_t count, int &errorCode, Log *log)
+{
+    int result = SSL_read(data.ssl, buf, static_cast<int>(count));
+
+    if(result > 0)
+    {
+        errorCode = 0;
+    }
+    else
+    {
+        int error = SSL_get_error(data.ssl, result);
+
+        if(error == SSL_ERROR_WANT_READ)
+        {
+            errorCode = EAGAIN;
+        }
+        else if(error == SSL_ERROR_WANT_WRITE)
+        {
+            if(exec->loop->editPollFd(data, data.fd0, EPOLLIN | EPOLLOUT) == 0)
+            {
+                errorCode = EAGAIN;
+            }
+            else
+            {
+                errorCode = EINVAL;
+            }
+        }
+        else
+        {
+            errorCode = EINVAL;
+            log->error("SSL_read failed. result: %d   error: %d   errno: %d   strerror: %s\n", result, error, errno, strerror(errno));
+        }
+    }
+
+    return result;
+}
+
+
 ssize_t sslWriteFd0(Executor *exec, ExecutorData &data, const void *buf, size_t count, int &errorCode, Log *log)
 {
     int result = SSL_write(data.ssl, buf, static_cast<int>(count));
@@ -44,3 +84,80 @@ ssize_t sslWriteFd0(Executor *exec, ExecutorData &data, const void *buf, size_t
     return result;
 }
 
+
+// error queue of thread is cleared, so SSL_get_error reports only error of this call
+ssize_t sslReadFd1(Executor *exec, ExecutorData &data, void *buf, size_t count, int &errorCode, Log *log)
+{
+    ERR_clear_error();
+
+    int result = SSL_read(data.upstreamSsl, buf, static_cast<int>(count));
+
+    if(result > 0)
+    {
+        errorCode = 0;
+    }
+    else
+    {
+        int error = SSL_get_error(data.upstreamSsl, result);
+
+        if(error == SSL_ERROR_ZERO_RETURN)
+        {
+            errorCode = 0;
+            result = 0;
+        }
+        else if(error == SSL_ERROR_WANT_READ)
+        {
+            errorCode = EAGAIN;
+            result = -1;
+        }
+        else if(error == SSL_ERROR_WANT_WRITE)
+        {
+            errorCode = (exec->loop->editPollFd(data, data.fd1, EPOLLIN | EPOLLOUT) == 0) ? EAGAIN : EINVAL;
+            result = -1;
+        }
+        else
+        {
+            log->error("SSL_read of upstream failed. result: %d   error: %d   %s\n", result, error,
+                       ERR_error_string(ERR_get_error(), nullptr));
+            errorCode = EIO;
+            result = -1;
+        }
+    }
+
+    return result;
+}
+
+
+ssize_t sslWriteFd1(Executor *exec, ExecutorData &data, const void *buf, size_t count, int &errorCode, Log *log)
+{
+    ERR_clear_error();
+
+    int result = SSL_write(data.upstreamSsl, buf, static_cast<int>(count));
+
+    if(result > 0)
+    {
+        errorCode = 0;
+    }
+    else
+    {
+        int error = SSL_get_error(data.upstreamSsl, result);
+
+        if(error == SSL_ERROR_WANT_WRITE)
+        {
+            errorCode = EAGAIN;
+        }
+        else if(error == SSL_ERROR_WANT_READ)
+        {
+            errorCode = (exec->loop->editPollFd(data, data.fd1, EPOLLIN | EPOLLOUT) == 0) ? EAGAIN : EINVAL;
+        }
+        else
+        {
+            log->error("SSL_write of upstream failed. result: %d   error: %d   %s\n", result, error,
+                       ERR_error_string(ERR_get_error(), nullptr));
+            errorCode = EPIPE;
+        }
+        result = -1;
+    }
+
+    return result;
+}
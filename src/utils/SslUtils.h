@@ -6,8 +6,15 @@
 class Executor;
 class Log;
 
+ssize_t sslReadFd0(Executor *exec, ExecutorData &data, void *buf, size_t count, int &errorCode, Log *log);
+
 ssize_t sslWriteFd0(Executor *exec, ExecutorData &data, const void *buf, size_t count, int &errorCode, Log *log);
 
+// upstream connection of proxy with tls (ExecutorData::upstreamSsl), close_notify of backend is returned as 0
+ssize_t sslReadFd1(Executor *exec, ExecutorData &data, void *buf, size_t count, int &errorCode, Log *log);
+
+ssize_t sslWriteFd1(Executor *exec, ExecutorData &data, const void *buf, size_t count, int &errorCode, Log *log);
+
 #endif
 
 
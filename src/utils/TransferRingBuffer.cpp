@@ -0,0 +1,98 @@
+#include <TransferRingBuffer.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+void TransferRingBuffer::init(int newSize)
+{
+    if(newSize != requestedSize || buf == nullptr)
+    {
+        freeBuffer();
+
+        requestedSize = newSize;
+
+        if(!allocateMirrored(newSize))
+        {
+            bufSize = newSize;
+            buf = new char[bufSize];
+        }
+    }
+    writeHead = 0;
+    readHead = 0;
+}
+
+
+bool TransferRingBuffer::allocateMirrored(int size)
+{
+    long pageSize = sysconf(_SC_PAGESIZE);
+
+    if(pageSize <= 0)
+    {
+        return false;
+    }
+
+    int mappedSize = static_cast<int>((size + pageSize - 1) / pageSize * pageSize);
+
+    int fd = memfd_create("ring_buffer", MFD_CLOEXEC);
+
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    if(ftruncate(fd, mappedSize) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    // reserve address range for two mappings
+    char *addr = static_cast<char*>(mmap(nullptr, 2 * mappedSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+
+    if(addr == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+
+    if(mmap(addr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+       mmap(addr + mappedSize, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        munmap(addr, 2 * mappedSize);
+        close(fd);
+        return false;
+    }
+
+    // mappings keep memory alive
+    close(fd);
+
+    buf = addr;
+    bufSize = mappedSize;
+    mirrored = true;
+
+    return true;
+}
+
+
+void TransferRingBuffer::freeBuffer()
+{
+    if(buf != nullptr)
+    {
+        if(mirrored)
+        {
+            munmap(buf, 2 * bufSize);
+        }
+        else
+        {
+            delete[] buf;
+        }
+    }
+
+    buf = nullptr;
+    bufSize = 0;
+    requestedSize = 0;
+    mirrored = false;
+    writeHead = 0;
+    readHead = 0;
+}
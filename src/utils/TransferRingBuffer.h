@@ -1,22 +1,24 @@
 #ifndef TRANSFER_RING_BUFFER_H
 #define TRANSFER_RING_BUFFER_H
 
+// Ring buffer. If possible, memory of buffer is mapped twice, one mapping after another
+// (memfd "magic" ring). In this case startRead and startWrite return all data and
+// all free space as one contiguous region, also when region wraps around end of buffer.
+// If mirrored mapping fails, regions end at the end of buffer.
+
 class TransferRingBuffer
 {
 public:
     TransferRingBuffer() = default;
 
-    TransferRingBuffer(int size): bufSize(size)
+    TransferRingBuffer(int size)
     {
-        buf = new char[size];
+        init(size);
     }
 
     ~TransferRingBuffer()
     {
-        if(buf != nullptr)
-        {
-            delete[] buf;
-        }
+        freeBuffer();
     }
 
     TransferRingBuffer(const TransferRingBuffer &tm) = delete;
@@ -24,21 +26,7 @@ public:
     TransferRingBuffer& operator=(const TransferRingBuffer &tm) = delete;
     TransferRingBuffer& operator=(TransferRingBuffer && tm) = delete;
 
-    void init(int newSize)
-    {
-        if(newSize != bufSize)
-        {
-            if(buf != nullptr)
-            {
-                delete[] buf;
-                buf = nullptr;
-            }
-            bufSize = newSize;
-            buf = new char[bufSize];
-        }
-        writeHead = 0;
-        readHead = 0;
-    }
+    void init(int newSize);
 
     void clear()
     {
@@ -48,6 +36,13 @@ public:
 
     bool startWrite(void* &data, int &size)
     {
+        if(mirrored)
+        {
+            data = buf + writeHead;
+            size = bufSize - 1 - dataSize();
+            return (size > 0);
+        }
+
         if(writeHead == bufSize)
         {
             if(readHead == 0)
@@ -77,13 +72,22 @@ public:
     void endWrite(int size)
     {
         writeHead += size;
+
+        if(mirrored && writeHead >= bufSize)
+        {
+            writeHead -= bufSize;
+        }
     }
 
     bool startRead(void* &data, int &size) const
     {
         data = buf + readHead;
 
-        if(readHead < writeHead)
+        if(mirrored)
+        {
+            size = dataSize();
+        }
+        else if(readHead < writeHead)
         {
             size = writeHead - readHead;
         }
@@ -102,6 +106,16 @@ public:
     void endRead(int size)
     {
         readHead += size;
+
+        if(mirrored)
+        {
+            if(readHead >= bufSize)
+            {
+                readHead -= bufSize;
+            }
+            return;
+        }
+
         if(readHead == bufSize)
         {
             readHead = 0;
@@ -119,6 +133,11 @@ public:
         return startRead(data, size);
     }
 
+    bool isMirrored() const
+    {
+        return mirrored;
+    }
+
 #ifdef TRANSFER_RING_BUFFER_DEBUG
     void printInfo()
     {
@@ -127,8 +146,23 @@ public:
 #endif
 
 protected:
+
+    int dataSize() const
+    {
+        return (writeHead >= readHead) ? writeHead - readHead : bufSize - readHead + writeHead;
+    }
+
+    bool allocateMirrored(int size);
+
+    void freeBuffer();
+
     char *buf = nullptr;
     int readHead = 0, writeHead = 0, bufSize = 0;
+
+    // size passed to init, bufSize of mirrored buffer is rounded to page size
+    int requestedSize = 0;
+
+    bool mirrored = false;
 };
 
 #endif // TRANSFER_RING_BUFFER_H
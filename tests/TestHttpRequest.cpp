@@ -1,9 +1,62 @@
 #include <HttpRequest.h>
+#include <CharClass.h>
+#include <ChunkedDecoder.h>
+#include <HttpResponseParser.h>
+#include <TransferRingBuffer.h>
+#include <ResponseCache.h>
+#include <DiskCache.h>
+#include <ProxyRoutes.h>
+#include <UpstreamGroup.h>
+#include <Resolver.h>
+#include <ResponseSpool.h>
+#include <TimeUtils.h>
+#include <ProxyParameters.h>
+#include <ExecutorData.h>
+#include <AdmissionControl.h>
+#include <PipePool.h>
+#include <ServerParameters.h>
+#include <PollLoopBase.h>
+#include <PollData.h>
+#include <ProxyExecutorSplice.h>
+#include <Log.h>
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <atomic>
 #include <chrono>
+#include <memory>
+#include <new>
+#include <thread>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+
+
+long long int allocationCount = 0;
+
+void* operator new(std::size_t size)
+{
+    ++allocationCount;
+
+    void *p = malloc(size);
+    if(p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
 
 void check_true(bool x, const char *file, int line, const char *function, const char *expression)
 {
@@ -135,53 +188,1904 @@ void test2()
     CHECK_TRUE(strcmp(url, "/calendar/year/month/day") == 0);
 }
 
-long long int getMilliseconds()
+void testKnownHeaders()
 {
-    return std::chrono::duration_cast<std::chrono::milliseconds>(
-               std::chrono::system_clock::now().time_since_epoch()
-           ).count();
+    const char *data =
+        "GET /index.html HTTP/1.1\r\n"
+        "host: example.com\r\n"
+        "Content-Length: 0\r\n"
+        "X-Custom: custom\r\n"
+        "CONNECTION: keep-alive\r\n"
+        "Connection: close\r\n\r\n";
+
+    HttpRequest request;
+    CHECK_TRUE(request.parse(data, strlen(data)) == HttpRequest::ParseResult::finishOk);
+
+    const char *ptr;
+    int length;
+
+    CHECK_TRUE(request.getHeaderValue(HttpRequest::KnownHeader::host, &ptr, &length) == 0);
+    CHECK_TRUE(length == 11 && strncmp(ptr, "example.com", length) == 0);
+
+    CHECK_TRUE(request.getHeaderValue("HOST", &ptr, &length) == 0);
+    CHECK_TRUE(length == 11 && strncmp(ptr, "example.com", length) == 0);
+
+    // first header wins
+    CHECK_TRUE(request.getHeaderValue(HttpRequest::KnownHeader::connection, &ptr, &length) == 0);
+    CHECK_TRUE(length == 10 && strncmp(ptr, "keep-alive", length) == 0);
+
+    CHECK_TRUE(request.getHeaderValue("x-custom", &ptr, &length) == 0);
+    CHECK_TRUE(length == 6 && strncmp(ptr, "custom", length) == 0);
+
+    // prefix of header name must not match
+    CHECK_TRUE(request.getHeaderValue("Content", &ptr, &length) != 0);
+    CHECK_TRUE(request.getHeaderValue("X-Custo", &ptr, &length) != 0);
+    CHECK_TRUE(request.getHeaderValue("X-Customer", &ptr, &length) != 0);
+
+    CHECK_TRUE(request.getHeaderValue(HttpRequest::KnownHeader::range, &ptr, &length) != 0);
+    CHECK_TRUE(request.getHeaderValue("Range", &ptr, &length) != 0);
+
+    request.reset();
+    const char *noHost = "GET / HTTP/1.1\r\nAccept: */*\r\n\r\n";
+    CHECK_TRUE(request.parse(noHost, strlen(noHost)) == HttpRequest::ParseResult::finishOk);
+    CHECK_TRUE(request.getHeaderValue(HttpRequest::KnownHeader::host, &ptr, &length) != 0);
+
+    const char *twoLengths = "POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\nab";
+    HttpRequest request2;
+    CHECK_TRUE(request2.parse(twoLengths, strlen(twoLengths)) == HttpRequest::ParseResult::finishInvalid);
 }
 
-void testPerformance()
+
+void testAllocations()
 {
-    const char *data =
-        "GET /gallery/album/flowers%202016/1?album-view=3 HTTP/1.1\r\n"
-        "Host: 127.0.0.1:7000\r\n"
-        "User-Agent: Mozilla Firefox\r\n"
-        "Accept: text/html,application/xhtml+xml,application/xml\r\n"
-        "Accept-Language: en-US,en\r\n"
-        "Accept-Encoding: gzip, deflate\r\n"
-        "Connection: keep-alive\r\n"
-        "If-Modified-Since: Mon, 26 Sep 2016 10:15:30 GMT\r\n"
-        "Cache-Control: max-age=0\r\n\r\n";
+    static char data[5000];
+    int length = sprintf(data, "GET /a/b%%20c/d.html HTTP/1.1\r\n");
+    for(int i = 0; i < HttpRequest::MAX_HEADERS + 10; ++i)
+    {
+        // digits are not allowed in header names
+        length += sprintf(data + length, "X-Header-%c%c: value %d\r\n", 'a' + i / 26, 'a' + i % 26, i);
+    }
+    length += sprintf(data + length, "Host: example.com\r\n\r\n");
+
+    HttpRequest request;
+
+    long long int allocationsBefore = allocationCount;
+
+    for(int i = 0; i < 100; ++i)
+    {
+        request.reset();
+        CHECK_TRUE(request.parse(data, length) == HttpRequest::ParseResult::finishOk);
+    }
+
+    CHECK_TRUE(allocationCount == allocationsBefore);
+
+    CHECK_TRUE(strcmp(request.getUrl(), "/a/b c/d.html") == 0);
+
+    const char *ptr;
+    int valueLength;
+
+    CHECK_TRUE(request.getHeaderValue("X-Header-aa", &ptr, &valueLength) == 0);
+    CHECK_TRUE(valueLength == 7 && strncmp(ptr, "value 0", valueLength) == 0);
+
+    // headers in overflow block
+    CHECK_TRUE(request.getHeaderValue("x-header-bo", &ptr, &valueLength) == 0);
+    CHECK_TRUE(valueLength == 8 && strncmp(ptr, "value 40", valueLength) == 0);
+    CHECK_TRUE(request.getHeaderValue("X-Header-bf", &ptr, &valueLength) == 0);
+    CHECK_TRUE(valueLength == 8 && strncmp(ptr, "value 31", valueLength) == 0);
+    CHECK_TRUE(request.getHeaderValue("X-Header-bg", &ptr, &valueLength) == 0);
+    CHECK_TRUE(valueLength == 8 && strncmp(ptr, "value 32", valueLength) == 0);
+    CHECK_TRUE(request.getHeaderValue("X-Header-zz", &ptr, &valueLength) != 0);
+
+    CHECK_TRUE(request.getHeaderValue(HttpRequest::KnownHeader::host, &ptr, &valueLength) == 0);
+    CHECK_TRUE(valueLength == 11 && strncmp(ptr, "example.com", valueLength) == 0);
+
+    length = sprintf(data, "GET /");
+    for(int i = 0; i < HttpRequest::MAX_URL_LENGTH; ++i)
+    {
+        data[length++] = 'a';
+    }
+    length += sprintf(data + length, " HTTP/1.1\r\nHost: a\r\n\r\n");
+
+    request.reset();
+    CHECK_TRUE(request.parse(data, length) == HttpRequest::ParseResult::finishInvalid);
+}
 
-    int dataLen = strlen(data);
+
+void testWrappedBuffer()
+{
+    printf("--- wrapped buffer ---\n");
+
+    const char *data = "GET /wrapped/url HTTP/1.1\r\nHost: example.com\r\nX-Custom: custom\r\n\r\n";
+    int dataSize = strlen(data);
+
+    TransferRingBuffer buffer(1000);
+
+    if(!buffer.isMirrored())
+    {
+        printf("buffer is not mirrored, skip\n");
+        return;
+    }
+
+    void *p;
+    int size;
+
+    // move heads close to the end of buffer, so request wraps around it
+    CHECK_TRUE(buffer.startWrite(p, size));
+    int skipSize = size - 20;
+    buffer.endWrite(skipSize);
+    CHECK_TRUE(buffer.startRead(p, size) && size == skipSize);
+    buffer.endRead(skipSize);
+
+    CHECK_TRUE(buffer.startWrite(p, size) && size > dataSize);
+    memcpy(p, data, dataSize);
+    buffer.endWrite(dataSize);
+
+    CHECK_TRUE(buffer.startRead(p, size) && size == dataSize);
 
     HttpRequest request;
+    CHECK_TRUE(request.parse(static_cast<char*>(p), size) == HttpRequest::ParseResult::finishOk);
+    CHECK_TRUE(strcmp(request.getUrl(), "/wrapped/url") == 0);
 
-    const int iterCount = 10000000;
+    const char *ptr;
+    int length;
+    CHECK_TRUE(request.getHeaderValue("X-Custom", &ptr, &length) == 0);
+    CHECK_TRUE(length == 6 && strncmp(ptr, "custom", length) == 0);
 
-    unsigned long long int millisStart = getMilliseconds();
+    buffer.endRead(size);
+    CHECK_TRUE(!buffer.readAvailable());
+}
 
-    for(int i = 0; i < iterCount; ++i)
+void testUrlParameters()
+{
+    printf("--- url parameters ---\n");
+
+    const char *data = "GET /search?q=a+b%21&page=2&&flag&empty=&utm_source=mail&b%61d=%zz HTTP/1.1\r\nHost: a\r\n\r\n";
+
+    HttpRequest request;
+    CHECK_TRUE(request.parse(data, strlen(data)) == HttpRequest::ParseResult::finishOk);
+
+    long long int allocationsBefore = allocationCount;
+
+    CHECK_TRUE(request.getUrlParameterCount() == 6);
+
+    const char *key, *value;
+    int keyLength, valueLength;
+
+    CHECK_TRUE(request.getUrlParameter(0, &key, &keyLength, &value, &valueLength) == 0);
+    CHECK_TRUE(keyLength == 1 && key[0] == 'q' && valueLength == 6 && strncmp(value, "a+b%21", valueLength) == 0);
+
+    CHECK_TRUE(request.getUrlParameter(2, &key, &keyLength, &value, &valueLength) == 0);
+    CHECK_TRUE(keyLength == 4 && strncmp(key, "flag", keyLength) == 0 && value == nullptr);
+
+    CHECK_TRUE(request.getUrlParameter(6, &key, &keyLength, &value, &valueLength) != 0);
+
+    CHECK_TRUE(request.getUrlParameter("empty", &value, &valueLength) == 0);
+    CHECK_TRUE(value != nullptr && valueLength == 0);
+
+    // key is compared after decoding
+    CHECK_TRUE(request.getUrlParameter("bad", &value, &valueLength) == 0);
+    CHECK_TRUE(valueLength == 3 && strncmp(value, "%zz", valueLength) == 0);
+    CHECK_TRUE(request.getUrlParameter("missing", &value, &valueLength) != 0);
+
+    char decoded[20];
+    CHECK_TRUE(request.getUrlParameter("q", &value, &valueLength) == 0);
+    int decodedLength = HttpRequest::decodeUrlParameter(value, valueLength, decoded, sizeof(decoded));
+    CHECK_TRUE(decodedLength == 4 && strncmp(decoded, "a b!", decodedLength) == 0);
+    CHECK_TRUE(HttpRequest::decodeUrlParameter(value, valueLength, decoded, 3) == -1);
+
+    const char *exclude[] = { "utm_source", nullptr };
+    char normalized[200];
+    int length = request.getNormalizedUrlParameters(normalized, sizeof(normalized), exclude);
+    CHECK_TRUE(length == static_cast<int>(strlen(normalized)));
+    CHECK_TRUE(strcmp(normalized, "bad=%25zz&empty=&flag&page=2&q=a%20b%21") == 0);
+
+    CHECK_TRUE(request.getNormalizedUrlParameters(normalized, 10, exclude) == -1);
+
+    CHECK_TRUE(allocationCount == allocationsBefore);
+
+    // same parameters in other order and encoding give same key
+    const char *other = "GET /search?%62ad=%25zz&q=a%20b!&utm_source=web&flag&page=2&empty= HTTP/1.1\r\nHost: a\r\n\r\n";
+    HttpRequest otherRequest;
+    CHECK_TRUE(otherRequest.parse(other, strlen(other)) == HttpRequest::ParseResult::finishOk);
+    char otherNormalized[200];
+    CHECK_TRUE(otherRequest.getNormalizedUrlParameters(otherNormalized, sizeof(otherNormalized), exclude) == length);
+    CHECK_TRUE(strcmp(normalized, otherNormalized) == 0);
+
+    // table is built again after reset
+    const char *noParams = "GET /search HTTP/1.1\r\nHost: a\r\n\r\n";
+    request.reset();
+    CHECK_TRUE(request.parse(noParams, strlen(noParams)) == HttpRequest::ParseResult::finishOk);
+    CHECK_TRUE(request.getUrlParameterCount() == 0);
+    CHECK_TRUE(request.getNormalizedUrlParameters(normalized, sizeof(normalized)) == 0 && normalized[0] == 0);
+
+    // parameters after MAX_URL_PARAMETERS are lost, request has no normalized form
+    char many[1000] = "GET /?";
+    for(int i = 0; i <= HttpRequest::MAX_URL_PARAMETERS; ++i)
     {
-        if(request.parse(data, dataLen) != HttpRequest::ParseResult::finishOk)
-        {
-            printf("parse failed!\n");
-            exit(-1);
-        }
+        strcat(many, "a=1&");
     }
+    strcat(many, " HTTP/1.1\r\nHost: a\r\n\r\n");
+    request.reset();
+    CHECK_TRUE(request.parse(many, strlen(many)) == HttpRequest::ParseResult::finishOk);
+    CHECK_TRUE(request.getUrlParameterCount() == HttpRequest::MAX_URL_PARAMETERS);
+    CHECK_TRUE(request.getNormalizedUrlParameters(normalized, sizeof(normalized)) == -1);
+}
 
-    unsigned long long int millisDif = getMilliseconds() - millisStart;
+// parses response in pieces of given size, returns consumed bytes
+int parseResponse(HttpResponseParser &parser, const char *data, int pieceSize, bool headRequest = false)
+{
+    parser.reset(headRequest);
 
-    printf("performance test milliseconds: %llu\n", millisDif);
+    int size = strlen(data);
+    int total = 0;
+
+    for(int i = 0; i < size && !parser.finished(); i += pieceSize)
+    {
+        int length = (size - i < pieceSize) ? size - i : pieceSize;
+        int consumed = 0;
+        parser.parse(data + i, length, consumed);
+        total += consumed;
+    }
+
+    return total;
+}
+
+
+void testKeepAlive()
+{
+    printf("--- keep-alive ---\n");
+
+    struct
+    {
+        const char *request;
+        int minorVersion;
+        bool keepAlive;
+    } cases[] =
+    {
+        { "GET /a HTTP/1.1\r\nHost: x\r\n\r\n", 1, true },
+        { "GET /a HTTP/1.1\r\nConnection: TE, close\r\n\r\n", 1, false },
+        { "GET /a HTTP/1.0\r\nHost: x\r\n\r\n", 0, false },
+        { "GET /a HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n", 0, true },
+        { "GET /a?b=1  HTTP/1.1\r\nConnection: keep-alive-x\r\n\r\n", 1, true },
+        { "GET /a HTTP/2.0\r\nConnection: keep-alive\r\n\r\n", -1, false },
+    };
+
+    HttpRequest request;
+
+    for(auto &c : cases)
+    {
+        request.reset();
+        CHECK_TRUE(request.parse(c.request, strlen(c.request)) == HttpRequest::ParseResult::finishOk);
+        CHECK_TRUE(request.getMinorVersion() == c.minorVersion && request.keepAlive() == c.keepAlive);
+    }
+
+    const char *tokens = " gzip ,chunked,, Close\t";
+    CHECK_TRUE(HttpRequest::hasToken(tokens, strlen(tokens), "close"));
+    CHECK_TRUE(HttpRequest::hasToken(tokens, strlen(tokens), "gzip"));
+    CHECK_TRUE(!HttpRequest::hasToken(tokens, strlen(tokens), "chunk"));
+    CHECK_TRUE(HttpRequest::knownHeaderIndex("content-LENGTH", 14) == static_cast<int>(HttpRequest::KnownHeader::contentLength));
+    CHECK_TRUE(HttpRequest::knownHeaderIndex("Content-Lengthx", 15) == -1);
 }
 
+
+// buffered request is sent again after failure of reused connection before it is sent,
+// after it is sent only with idempotent method
+void testRequestRetryable()
+{
+    printf("--- request retryable ---\n");
+
+    struct
+    {
+        const char *request;
+        bool retryable;
+    } cases[] =
+    {
+        { "POST /a HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello", false },
+        { "PATCH /a HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello", false },
+        { "PUT /a HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello", true },
+        { "GET /a HTTP/1.1\r\nHost: x\r\n\r\n", true },
+        { "DELETE /a HTTP/1.1\r\nHost: x\r\n\r\n", true },
+        { "GETX /a HTTP/1.1\r\nHost: x\r\n\r\n", false },
+    };
+
+    ExecutorData data;
+
+    for(auto &c : cases)
+    {
+        data.request.reset();
+        CHECK_TRUE(data.request.parse(c.request, strlen(c.request)) == HttpRequest::ParseResult::finishOk);
+
+        data.setRequestBuffered(true);
+        CHECK_TRUE(data.requestBuffered && data.requestRetryable == c.retryable);
+
+        data.setRequestBuffered(false);
+        CHECK_TRUE(!data.requestBuffered && !data.requestRetryable);
+    }
+}
+
+
+void testResponseParser()
+{
+    printf("--- response parser ---\n");
+
+    HttpResponseParser parser;
+
+    const char *lengthResponse = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\ncontent-length:  5 \r\n\r\nhelloNEXT";
+    int lengthSize = strlen(lengthResponse) - 4;
+
+    for(int piece = 1; piece <= lengthSize + 4; ++piece)
+    {
+        CHECK_TRUE(parseResponse(parser, lengthResponse, piece) == lengthSize);
+        CHECK_TRUE(parser.finished() && parser.keepAlive() && parser.getStatus() == 200);
+        CHECK_TRUE(parser.getBodyType() == HttpResponseParser::BodyType::length);
+    }
+
+    const char *chunkedResponse = "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, chunked\r\n\r\n5\r\nhello\r\n0\r\n\r\n";
+    for(int piece = 1; piece <= 10; ++piece)
+    {
+        CHECK_TRUE(parseResponse(parser, chunkedResponse, piece) == static_cast<int>(strlen(chunkedResponse)));
+        CHECK_TRUE(parser.keepAlive() && parser.getBodyType() == HttpResponseParser::BodyType::chunked);
+    }
+
+    // interim response before final response
+    const char *continueResponse = "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 201 Created\r\nContent-Length: 2\r\n\r\nok";
+    CHECK_TRUE(parseResponse(parser, continueResponse, 7) == static_cast<int>(strlen(continueResponse)));
+    CHECK_TRUE(parser.keepAlive() && parser.getStatus() == 201);
+    CHECK_TRUE(parser.getResponseStart() == 25 && parser.getHeadersEnd() == 66);
+
+    // no body
+    const char *headResponse = "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n";
+    CHECK_TRUE(parseResponse(parser, headResponse, 100, true) == static_cast<int>(strlen(headResponse)));
+    CHECK_TRUE(parser.keepAlive() && parser.getBodyType() == HttpResponseParser::BodyType::none);
+
+    const char *notModified = "HTTP/1.1 304 Not Modified\r\nContent-Length: 100\r\n\r\n";
+    CHECK_TRUE(parseResponse(parser, notModified, 100) == static_cast<int>(strlen(notModified)));
+    CHECK_TRUE(parser.keepAlive());
+
+    // connection is not reused
+    const char *closeResponse = "HTTP/1.1 200 OK\r\nConnection: upgrade, Close\r\nContent-Length: 0\r\n\r\n";
+    parseResponse(parser, closeResponse, 100);
+    CHECK_TRUE(parser.finished() && !parser.keepAlive());
+
+    const char *http10 = "HTTP/1.0 200 OK\r\nContent-Length: 0\r\n\r\n";
+    parseResponse(parser, http10, 100);
+    CHECK_TRUE(parser.finished() && !parser.keepAlive());
+
+    const char *http10KeepAlive = "HTTP/1.0 200 OK\r\nConnection: keep-alive\r\nContent-Length: 0\r\n\r\n";
+    parseResponse(parser, http10KeepAlive, 100);
+    CHECK_TRUE(parser.finished() && parser.keepAlive());
+
+    const char *untilClose = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n\r\nbody till end";
+    CHECK_TRUE(parseResponse(parser, untilClose, 10) == static_cast<int>(strlen(untilClose)));
+    CHECK_TRUE(!parser.finished() && parser.getBodyType() == HttpResponseParser::BodyType::untilClose);
+
+    const char *malformed[] =
+    {
+        "HTTP/2 200 OK\r\nContent-Length: 1\r\n\r\nx",
+        "HTTP/1.1 200 OK\r\nContent-Length: 1x\r\n\r\nx",
+        "HTTP/1.1 200 OK\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\nx",
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+    };
+    for(const char *m : malformed)
+    {
+        CHECK_TRUE(parseResponse(parser, m, 3) == static_cast<int>(strlen(m)));
+        CHECK_TRUE(parser.isMalformed() && !parser.keepAlive());
+    }
+
+    // long headers, which are not interpreted, do not break parsing
+    char longHeader[2000] = "HTTP/1.1 200 OK\r\nSet-Cookie: ";
+    memset(longHeader + strlen(longHeader), 'c', 1000);
+    strcat(longHeader, "\r\nContent-Length: 0\r\n\r\n");
+    CHECK_TRUE(parseResponse(parser, longHeader, 64) == static_cast<int>(strlen(longHeader)));
+    CHECK_TRUE(parser.keepAlive());
+
+    // body transferred without parse
+    const char *headers = "HTTP/1.1 200 OK\r\nContent-Length: 1000\r\n\r\n";
+    parseResponse(parser, headers, 100);
+    CHECK_TRUE(parser.headersFinished() && parser.getBodyLeft() == 1000);
+    parser.skipBody(999);
+    CHECK_TRUE(!parser.finished());
+    parser.skipBody(1);
+    CHECK_TRUE(parser.keepAlive());
+}
+
+class NullLog: public Log
+{
+public:
+    int init(ServerParameters * /*params*/) override { return 0; }
+    void debug(const char* /*format*/, ...) override { }
+    void info(const char* /*format*/, ...) override { }
+    void warning(const char* /*format*/, ...) override { }
+    void error(const char* /*format*/, ...) override { }
+    void writeLog(Level /*argLevel*/, const char* /*format*/, ...) override { }
+};
+
+
+int headersEnd(const char *response)
+{
+    return strstr(response, "\r\n\r\n") - response + 2;
+}
+
+
+void testResponseCache()
+{
+    printf("--- response cache ---\n");
+
+    ProxyParameters proxy;
+    ResponseCache::Freshness freshness;
+
+    const char *maxAge = "HTTP/1.1 200 OK\r\nCache-Control: public, max-age=5, stale-while-revalidate=10\r\n\r\n";
+    freshness = ResponseCache::getFreshness(maxAge, headersEnd(maxAge), proxy, 0);
+    CHECK_TRUE(freshness.storable && freshness.freshMillis == 5000 && freshness.staleMillis == 10000);
+
+    const char *expires = "HTTP/1.1 200 OK\r\nDate: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+                          "Expires: Sun, 06 Nov 1994 08:50:37 GMT\r\nAge: 20\r\n\r\n";
+    freshness = ResponseCache::getFreshness(expires, headersEnd(expires), proxy, 0);
+    CHECK_TRUE(freshness.storable && freshness.freshMillis == 40000);
+
+    const char *notStorable[] =
+    {
+        "HTTP/1.1 200 OK\r\nCache-Control: max-age=5, private\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nCache-Control: no-store\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nCache-Control: max-age=5\r\nSet-Cookie: a=b\r\n\r\n",
+        "HTTP/1.1 500 Error\r\nCache-Control: max-age=5\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n",
+    };
+    for(const char *response : notStorable)
+    {
+        CHECK_TRUE(!ResponseCache::getFreshness(response, headersEnd(response), proxy, 0).storable);
+    }
+
+    proxy.cacheDefaultSeconds = 2;
+    freshness = ResponseCache::getFreshness(notStorable[4], headersEnd(notStorable[4]), proxy, 0);
+    CHECK_TRUE(freshness.storable && freshness.freshMillis == 2000);
+
+    // variants by Vary, stale-while-revalidate
+    NullLog log;
+    ResponseCache cache;
+    cache.init(1024 * 1024, &log);
+
+    HttpRequest gzipRequest, plainRequest, reorderedRequest;
+    const char *gzip = "GET /app/x?b=2&a=1 HTTP/1.1\r\nAccept-Encoding: gzip\r\n\r\n";
+    const char *plain = "GET /app/x?b=2&a=1 HTTP/1.1\r\nAccept: */*\r\n\r\n";
+    const char *reordered = "GET /app/x?a=1&b=2 HTTP/1.1\r\nAccept-Encoding: gzip\r\n\r\n";
+    CHECK_TRUE(gzipRequest.parse(gzip, strlen(gzip)) == HttpRequest::ParseResult::finishOk);
+    CHECK_TRUE(plainRequest.parse(plain, strlen(plain)) == HttpRequest::ParseResult::finishOk);
+    CHECK_TRUE(reorderedRequest.parse(reordered, strlen(reordered)) == HttpRequest::ParseResult::finishOk);
+
+    std::string key, plainKey, reorderedKey;
+    bool revalidate;
+    CHECK_TRUE(ResponseCache::makeKey(gzipRequest, proxy, key, revalidate) == 0 && !revalidate);
+    CHECK_TRUE(ResponseCache::makeKey(plainRequest, proxy, plainKey, revalidate) == 0);
+    CHECK_TRUE(ResponseCache::makeKey(reorderedRequest, proxy, reorderedKey, revalidate) == 0);
+    CHECK_TRUE(key == plainKey && key == reorderedKey);
+
+    const char *response = "HTTP/1.1 200 OK\r\nCache-Control: max-age=1, stale-while-revalidate=10\r\n"
+                           "Vary: accept-encoding\r\nContent-Length: 2\r\n\r\nok";
+    CHECK_TRUE(cache.store(key, gzipRequest, proxy, response, headersEnd(response), 1000));
+
+    ResponseCache::Status status;
+    std::shared_ptr<const CacheEntry> entry = cache.find(key, reorderedRequest, 1500, status);
+    CHECK_TRUE(entry && status == ResponseCache::Status::hit && entry->response.compare(entry->bodyStart, 2, "ok") == 0);
+    CHECK_TRUE(!cache.find(key, plainRequest, 1500, status) && status == ResponseCache::Status::miss);
+
+    // first request after expiration revalidates, next requests get stale response
+    CHECK_TRUE(!cache.find(key, gzipRequest, 2500, status) && status == ResponseCache::Status::miss);
+    CHECK_TRUE(cache.find(key, gzipRequest, 2600, status) && status == ResponseCache::Status::stale);
+    CHECK_TRUE(!cache.find(key, gzipRequest, 20000, status));
+
+    // requests with same key share one fill, while it is received
+    bool created = false;
+    std::shared_ptr<CacheFill> fill = cache.startFill(key, true, created);
+    CHECK_TRUE(fill && created);
+    CHECK_TRUE(cache.startFill(key, true, created) == fill && !created);
+    CHECK_TRUE(cache.startFill(key, false, created) != fill && created);
+
+    std::string body(CacheFill::CHUNK_SIZE * 2, 'x');
+    fill->append(response, strlen(response));
+    fill->append(body.data(), body.size());
+    CHECK_TRUE(fill->getSize() == static_cast<long long int>(strlen(response) + body.size()));
+
+    const char *p;
+    CHECK_TRUE(fill->read(CacheFill::CHUNK_SIZE - 10, &p) == 10 && *p == 'x');
+    CHECK_TRUE(fill->read(fill->getSize(), &p) == 0);
+
+    std::string copy;
+    fill->copy(0, fill->getSize(), copy);
+    CHECK_TRUE(copy == std::string(response) + body);
+
+    std::vector<std::string> varyNames, varyValues;
+    CHECK_TRUE(ResponseCache::getVary(response, headersEnd(response), gzipRequest, varyNames, varyValues) == 0);
+    fill->setReady(0, headersEnd(response), std::move(varyNames), std::move(varyValues));
+    CHECK_TRUE(fill->getState() == CacheFill::State::ready);
+    CHECK_TRUE(fill->varyMatches(reorderedRequest) && !fill->varyMatches(plainRequest));
+
+    // finished fill is not shared anymore
+    fill->finish();
+    CHECK_TRUE(fill->getState() == CacheFill::State::finished);
+    CHECK_TRUE(cache.startFill(key, true, created) != fill && created);
+}
+
+
+void testDiskCache()
+{
+    printf("--- disk cache ---\n");
+
+    char folder[] = "/tmp/test_disk_cache_XXXXXX";
+    CHECK_TRUE(mkdtemp(folder) != nullptr);
+
+    NullLog log;
+    ProxyParameters proxy;
+    const char *response = "HTTP/1.1 200 OK\r\nCache-Control: max-age=100\r\nContent-Length: 4\r\n\r\nbody";
+    const int length = strlen(response);
+    const int bodyStart = length - 4;
+    // expired entries are dropped, when index is loaded
+    long long int now = getMilliseconds();
+
+    {
+        DiskCache cache;
+        CHECK_TRUE(cache.init(folder, 1024 * 1024, &log) == 0 && cache.enabled());
+
+        long long int fileId = 0;
+        int fd = cache.create(fileId);
+        CHECK_TRUE(fd >= 0 && write(fd, response, length) == length);
+        CHECK_TRUE(cache.store("key", proxy, fileId, fd, 1000, now));
+
+        // response with Vary is not stored
+        const char *vary = "HTTP/1.1 200 OK\r\nCache-Control: max-age=100\r\nVary: Accept\r\n\r\n";
+        fd = cache.create(fileId);
+        CHECK_TRUE(fd >= 0 && write(fd, vary, strlen(vary)) == static_cast<ssize_t>(strlen(vary)));
+        CHECK_TRUE(!cache.store("vary", proxy, fileId, fd, 1000, now));
+
+        // temporary file, which is left by stopped server
+        cache.create(fileId);
+    }
+
+    // index is loaded on start, so entry survives restart
+    DiskCache cache;
+    CHECK_TRUE(cache.init(folder, 1024 * 1024, &log) == 0);
+
+    ResponseCache::Status status;
+    DiskCache::Hit hit;
+
+    CHECK_TRUE(cache.open("key", now + 1000, status, hit) == 0 && status == ResponseCache::Status::hit);
+    CHECK_TRUE(hit.size == length && hit.bodyStart == bodyStart && hit.headersEnd == bodyStart - 2);
+
+    char body[4];
+    CHECK_TRUE(pread(hit.fd, body, 4, hit.bodyStart) == 4 && strncmp(body, "body", 4) == 0);
+    close(hit.fd);
+
+    CHECK_TRUE(cache.open("vary", now + 1000, status, hit) != 0 && status == ResponseCache::Status::miss);
+    CHECK_TRUE(cache.open("key", now + 200000, status, hit) != 0);
+
+    cache.destroy();
+
+    // expired entry is removed with its file, only index is left
+    CHECK_TRUE(unlink((std::string(folder) + "/index").c_str()) == 0 && rmdir(folder) == 0);
+}
+
+
+void testProxyRoutes()
+{
+    printf("--- testProxyRoutes ---\n");
+
+    std::vector<ProxyParameters> proxies(6);
+    const char *prefixes[] = {"/gallery", "/gallery/album/", "/gal", "/app", "/application", "/gallery"};
+
+    for(int i = 0; i < 6; ++i)
+    {
+        proxies[i].prefix = prefixes[i];
+        proxies[i].index = i;
+    }
+
+    ProxyRoutes routes;
+    routes.build(proxies);
+
+    CHECK_TRUE(routes.find("/gallery") == 0);
+    CHECK_TRUE(routes.find("/gallery/") == 0);
+    CHECK_TRUE(routes.find("//gallery/x") == 0);
+    CHECK_TRUE(routes.find("/gallery/albu") == 0);
+    CHECK_TRUE(routes.find("/gallery/album") == 1);
+    CHECK_TRUE(routes.find("/gallery/album/1.jpg") == 1);
+    CHECK_TRUE(routes.find("/gal/x") == 2);
+    CHECK_TRUE(routes.find("/galleryy") == -1);
+    CHECK_TRUE(routes.find("/app/x") == 3);
+    CHECK_TRUE(routes.find("/application") == 4);
+    CHECK_TRUE(routes.find("/appl") == -1);
+    CHECK_TRUE(routes.find("/") == -1);
+    CHECK_TRUE(routes.find(nullptr) == -1);
+
+    proxies.resize(7);
+    proxies[6].prefix = "/";
+    proxies[6].index = 6;
+    routes.build(proxies);
+
+    CHECK_TRUE(routes.find("/appl") == 6);
+    CHECK_TRUE(routes.find("/") == 6);
+    CHECK_TRUE(routes.find("/app/x") == 3);
+
+    // CONNECT goes to first proxy with connect, not by prefix
+    CHECK_TRUE(routes.findConnect() == -1);
+    proxies[4].connect = true;
+    proxies[5].connect = true;
+    routes.build(proxies);
+    CHECK_TRUE(routes.findConnect() == 4);
+}
+
+
+void testConnectRequest()
+{
+    printf("--- testConnectRequest ---\n");
+
+    HttpRequest request;
+    const char *connect = "CONNECT example.com:443 HTTP/1.1\r\nHost: example.com:443\r\n\r\n";
+
+    CHECK_TRUE(request.parse(connect, strlen(connect)) == HttpRequest::ParseResult::finishOk);
+    CHECK_TRUE(request.isConnect() && strcmp(request.getUrl(), "example.com:443") == 0);
+
+    const char *invalid[] =
+    {
+        "CONNECT example.com HTTP/1.1\r\n\r\n",
+        "CONNECT :443 HTTP/1.1\r\n\r\n",
+        "CONNECT example.com:0 HTTP/1.1\r\n\r\n",
+        "CONNECT example.com:65536 HTTP/1.1\r\n\r\n",
+        "CONNECT example.com:44a HTTP/1.1\r\n\r\n",
+        "CONNECT a:1:443 HTTP/1.1\r\n\r\n",
+        "CONNECT example.com:443?x=1 HTTP/1.1\r\n\r\n",
+        "CONNECT /a/b HTTP/1.1\r\n\r\n",
+        "GET example.com:443 HTTP/1.1\r\n\r\n",
+    };
+
+    for(const char *r : invalid)
+    {
+        request.reset();
+        CHECK_TRUE(request.parse(r, strlen(r)) == HttpRequest::ParseResult::finishInvalid);
+    }
+
+    const char *get = "GET /a HTTP/1.1\r\nHost: x\r\n\r\n";
+    request.reset();
+    CHECK_TRUE(request.parse(get, strlen(get)) == HttpRequest::ParseResult::finishOk && !request.isConnect());
+}
+
+
+void addBackends(ProxyParameters &proxy, const std::vector<int> &weights)
+{
+    for(int weight : weights)
+    {
+        BackendParameters backend;
+        backend.address = "10.0.0." + std::to_string(proxy.backends.size() + 1);
+        backend.port = 8080;
+        backend.socketType = SocketType::tcp;
+        backend.weight = weight;
+        proxy.backends.push_back(backend);
+    }
+}
+
+
+void parseGet(HttpRequest &request, const std::string &path)
+{
+    std::string get = "GET " + path + " HTTP/1.1\r\nHost: x\r\n\r\n";
+
+    request.reset();
+    CHECK_TRUE(request.parse(get.c_str(), get.size()) == HttpRequest::ParseResult::finishOk);
+}
+
+
+void testUpstreamGroup()
+{
+    printf("--- upstream group ---\n");
+
+    NullLog log;
+    Resolver resolver;
+    HttpRequest request;
+    parseGet(request, "/a");
+
+    // smooth weighted round robin, ejection and slow start
+    ProxyParameters proxy;
+    proxy.prefix = "/app";
+    proxy.poolSize = 0;
+    proxy.slowStartMillis = 10000;
+    addBackends(proxy, {1, 2, 3});
+
+    UpstreamGroup group;
+    CHECK_TRUE(group.init(&proxy, &resolver, nullptr, &log) == 0);
+
+    int counts[3] = {0, 0, 0};
+    int previous = -1;
+    bool repeated = false;
+
+    for(int i = 0; i < 600; ++i)
+    {
+        int backend = group.select(request, 1000);
+        repeated = repeated || (backend == previous && backend != 2);
+        previous = backend;
+        ++counts[backend];
+    }
+    CHECK_TRUE(counts[0] == 100 && counts[1] == 200 && counts[2] == 300);
+    CHECK_TRUE(!repeated);
+
+    for(int i = 0; i < proxy.maxFails; ++i)
+    {
+        group.reportFailure(2, 1000);
+    }
+    CHECK_TRUE(!group.isHealthy(2));
+
+    bool ejectedSelected = false;
+    for(int i = 0; i < 30; ++i)
+    {
+        ejectedSelected = ejectedSelected || group.select(request, 2000) == 2;
+    }
+    CHECK_TRUE(!ejectedSelected);
+    CHECK_TRUE(group.selectOther(0, 2000) == 1);
+
+    // backend returns after fail timeout with 10% of weight, share grows during slow start
+    long long int recoverTime = 1000 + proxy.failTimeoutMillis;
+    group.onTimer(recoverTime);
+    CHECK_TRUE(group.isHealthy(2));
+
+    memset(counts, 0, sizeof(counts));
+    for(int i = 0; i < 330; ++i)
+    {
+        ++counts[group.select(request, recoverTime)];
+    }
+    CHECK_TRUE(counts[2] >= 28 && counts[2] <= 32);
+
+    memset(counts, 0, sizeof(counts));
+    for(int i = 0; i < 450; ++i)
+    {
+        ++counts[group.select(request, recoverTime + proxy.slowStartMillis / 2)];
+    }
+    CHECK_TRUE(counts[2] >= 148 && counts[2] <= 152);
+
+    // least outstanding
+    ProxyParameters leastProxy = proxy;
+    leastProxy.balance = BalancePolicy::leastOutstanding;
+    leastProxy.backends.clear();
+    addBackends(leastProxy, {1, 1, 2});
+
+    UpstreamGroup leastGroup;
+    CHECK_TRUE(leastGroup.init(&leastProxy, &resolver, nullptr, &log) == 0);
+    leastGroup.startRequest(0);
+    leastGroup.startRequest(2);
+    leastGroup.startRequest(2);
+    CHECK_TRUE(leastGroup.select(request, 1000) == 1);
+    leastGroup.startRequest(1);
+    CHECK_TRUE(leastGroup.select(request, 1000) == 2);
+
+    // consistent hash: keys of other backends stay, when backend is removed or ejected
+    ProxyParameters hashProxy = proxy;
+    hashProxy.balance = BalancePolicy::hash;
+    hashProxy.backends.clear();
+    addBackends(hashProxy, {1, 1, 1, 1});
+
+    ProxyParameters smallerProxy = hashProxy;
+    smallerProxy.backends.erase(smallerProxy.backends.begin() + 1);
+
+    UpstreamGroup hashGroup;
+    UpstreamGroup smallerGroup;
+    CHECK_TRUE(hashGroup.init(&hashProxy, &resolver, nullptr, &log) == 0);
+    CHECK_TRUE(smallerGroup.init(&smallerProxy, &resolver, nullptr, &log) == 0);
+
+    const int keys = 400;
+    std::vector<int> selected(keys);
+    int moved = 0;
+    memset(counts, 0, sizeof(counts));
+
+    for(int i = 0; i < keys; ++i)
+    {
+        parseGet(request, "/item/" + std::to_string(i));
+
+        selected[i] = hashGroup.select(request, 1000);
+        CHECK_TRUE(hashGroup.select(request, 1000) == selected[i]);
+
+        const std::string &address = hashProxy.backends[selected[i]].address;
+        const std::string &smallerAddress = smallerProxy.backends[smallerGroup.select(request, 1000)].address;
+
+        if(selected[i] == 1)
+        {
+            ++moved;
+        }
+        else
+        {
+            CHECK_TRUE(address == smallerAddress);
+        }
+    }
+    CHECK_TRUE(moved > keys / 8 && moved < keys * 3 / 8);
+
+    for(int i = 0; i < hashProxy.maxFails; ++i)
+    {
+        hashGroup.reportFailure(1, 1000);
+    }
+
+    for(int i = 0; i < keys; ++i)
+    {
+        parseGet(request, "/item/" + std::to_string(i));
+
+        int backend = hashGroup.select(request, 1000);
+        CHECK_TRUE(backend != 1 && (selected[i] == 1 || backend == selected[i]));
+    }
+
+    // retry budget: full budget is 10 tokens, every request adds retryBudgetPercent of token
+    UpstreamGroup retryGroup;
+    CHECK_TRUE(retryGroup.init(&proxy, &resolver, nullptr, &log) == 0);
+
+    int retries = 0;
+    while(retryGroup.takeRetry())
+    {
+        ++retries;
+    }
+    CHECK_TRUE(retries == 10);
+
+    for(int i = 0; i < 100 / proxy.retryBudgetPercent; ++i)
+    {
+        retryGroup.select(request, 1000);
+    }
+    CHECK_TRUE(retryGroup.takeRetry() && !retryGroup.takeRetry());
+
+    // hedge delay is percentile of response times, min delay is used till there are enough samples
+    ProxyParameters hedgeProxy = proxy;
+    hedgeProxy.hedgePercentile = 50;
+
+    UpstreamGroup hedgeGroup;
+    CHECK_TRUE(hedgeGroup.init(&hedgeProxy, &resolver, nullptr, &log) == 0);
+
+    for(int i = 1; i <= 10; ++i)
+    {
+        hedgeGroup.reportResponse(0, 100 * i);
+    }
+    hedgeGroup.onTimer(1000);
+    CHECK_TRUE(hedgeGroup.getHedgeDelay() == hedgeProxy.hedgeMinDelayMillis);
+
+    for(int i = 11; i <= 100; ++i)
+    {
+        hedgeGroup.reportResponse(0, 100 * i);
+    }
+    hedgeGroup.onTimer(1000);
+    CHECK_TRUE(hedgeGroup.getHedgeDelay() == 5100);
+}
+
+
+// limit of requests in flight, adaptive limit and queue of requests over limit
+void testUpstreamQueue()
+{
+    printf("--- upstream queue ---\n");
+
+    NullLog log;
+    Resolver resolver;
+
+    ProxyParameters proxy;
+    proxy.prefix = "/app";
+    proxy.poolSize = 0;
+    proxy.maxInFlight = 10;
+    proxy.maxInFlightAdaptive = true;
+    proxy.queueSize = 3;
+    proxy.queueTimeoutMillis = 1000;
+    addBackends(proxy, {1});
+
+    // limit is lowered, when response times grow, and comes back, when they recover
+    UpstreamGroup group;
+    CHECK_TRUE(group.init(&proxy, &resolver, nullptr, &log) == 0);
+
+    for(int i = 0; i < 9; ++i)
+    {
+        group.startRequest(0);
+    }
+    for(int i = 0; i < 50; ++i)
+    {
+        group.reportResponse(0, 10);
+    }
+    CHECK_TRUE(!group.isFull());
+
+    for(int i = 0; i < 10; ++i)
+    {
+        group.reportResponse(0, 200);
+    }
+    CHECK_TRUE(group.isFull());
+
+    for(int i = 0; i < 100; ++i)
+    {
+        group.reportResponse(0, 10);
+    }
+    CHECK_TRUE(!group.isFull());
+
+    // oldest request is started first, newest one, when oldest waited more than half of queue timeout
+    proxy.maxInFlight = 1;
+    proxy.maxInFlightAdaptive = false;
+
+    UpstreamGroup queueGroup;
+    CHECK_TRUE(queueGroup.init(&proxy, &resolver, nullptr, &log) == 0);
+    queueGroup.startRequest(0);
+    CHECK_TRUE(queueGroup.isFull());
+
+    ExecutorData requests[4];
+    CHECK_TRUE(queueGroup.enqueue(&requests[0], 0));
+    CHECK_TRUE(queueGroup.enqueue(&requests[1], 100));
+    CHECK_TRUE(queueGroup.enqueue(&requests[2], 200));
+    CHECK_TRUE(!queueGroup.enqueue(&requests[3], 300));
+
+    CHECK_TRUE(queueGroup.dequeue(300) == nullptr);
+
+    queueGroup.finishRequest(0);
+    CHECK_TRUE(queueGroup.dequeue(400) == &requests[0] && requests[0].upstreamQueue == nullptr);
+
+    CHECK_TRUE(queueGroup.enqueue(&requests[3], 400));
+    CHECK_TRUE(queueGroup.dequeue(700) == &requests[3]);
+
+    // request over queue timeout is removed, also while backend is full
+    queueGroup.startRequest(0);
+    CHECK_TRUE(queueGroup.dequeue(1150) == &requests[1]);
+    CHECK_TRUE(queueGroup.dequeue(1150) == nullptr);
+
+    queueGroup.removeQueued(&requests[2]);
+    queueGroup.finishRequest(0);
+    CHECK_TRUE(queueGroup.dequeue(1150) == nullptr);
+}
+
+
+void testAdmissionControl()
+{
+    printf("--- testAdmissionControl ---\n");
+
+    AdmissionControl ac;
+    CHECK_TRUE(ac.init(5, 100, 1) == 0);
+    CHECK_TRUE(ac.enabled());
+
+    // first interval starts
+    CHECK_TRUE(!ac.isOverloaded(1000));
+
+    // minimal delay of interval is above target
+    ac.addDelay(10, 1010);
+    ac.addDelay(7, 1050);
+    CHECK_TRUE(!ac.isOverloaded(1099));
+    CHECK_TRUE(ac.isOverloaded(1100));
+
+    // one connection below target ends overload at end of interval
+    ac.addDelay(20, 1120);
+    ac.addDelay(3, 1150);
+    CHECK_TRUE(ac.isOverloaded(1199));
+    CHECK_TRUE(!ac.isOverloaded(1200));
+
+    // interval without connections ends overload
+    ac.addDelay(9, 1210);
+    CHECK_TRUE(ac.isOverloaded(1300));
+    CHECK_TRUE(!ac.isOverloaded(1400));
+
+    // delay equal to target is overload
+    ac.addDelay(5, 1450);
+    CHECK_TRUE(ac.isOverloaded(1500));
+
+    CHECK_TRUE(ac.init(0, 100, 1) == 0);
+    CHECK_TRUE(!ac.enabled());
+    ac.addDelay(1000, 5000);
+    CHECK_TRUE(!ac.isOverloaded(5100));
+    CHECK_TRUE(!ac.isOverloaded(5200));
+}
+
+
+void testPipePool()
+{
+    printf("--- testPipePool ---\n");
+
+    NullLog log;
+    PipePool pool;
+    CHECK_TRUE(pool.init(2, 128 * 1024, &log) == 0);
+
+    int readFd[3];
+    int writeFd[3];
+    int capacity[3];
+
+    for(int i = 0; i < 3; ++i)
+    {
+        capacity[i] = pool.get(readFd[i], writeFd[i]);
+        CHECK_TRUE(capacity[i] > 0 && capacity[i] == fcntl(writeFd[i], F_GETPIPE_SZ));
+    }
+
+    // pipe with data left by executor is drained, when it is returned
+    char data[1000] = {};
+    CHECK_TRUE(write(writeFd[0], data, sizeof(data)) == static_cast<ssize_t>(sizeof(data)));
+
+    pool.put(readFd[0], writeFd[0], capacity[0]);
+
+    int fdRead;
+    int fdWrite;
+    int bytes = -1;
+
+    CHECK_TRUE(pool.get(fdRead, fdWrite) == capacity[0]);
+    CHECK_TRUE(fdRead == readFd[0] && fdWrite == writeFd[0]);
+    CHECK_TRUE(ioctl(fdRead, FIONREAD, &bytes) == 0 && bytes == 0);
+    CHECK_TRUE(fcntl(fdWrite, F_GETPIPE_SZ) == capacity[0]);
+
+    // pool keeps maxPipes pipes, other pipes are closed
+    for(int i = 0; i < 3; ++i)
+    {
+        pool.put(readFd[i], writeFd[i], capacity[i]);
+    }
+
+    CHECK_TRUE(fcntl(readFd[2], F_GETFD) == -1 && fcntl(writeFd[2], F_GETFD) == -1);
+
+    CHECK_TRUE(pool.get(fdRead, fdWrite) == capacity[1] && fdRead == readFd[1]);
+    CHECK_TRUE(pool.get(fdRead, fdWrite) == capacity[0] && fdRead == readFd[0]);
+
+    pool.put(readFd[0], writeFd[0], capacity[0]);
+    pool.put(readFd[1], writeFd[1], capacity[1]);
+    pool.destroy();
+
+    CHECK_TRUE(fcntl(readFd[0], F_GETFD) == -1 && fcntl(readFd[1], F_GETFD) == -1);
+}
+
+
+void testResolver()
+{
+    printf("--- testResolver ---\n");
+
+    unsigned char query[512];
+    int size = Resolver::buildQuery("api.example.com", 0x1234, query, sizeof(query));
+
+    const unsigned char expected[] = "\x12\x34\x01\x00\x00\x01\x00\x00\x00\x00\x00\x00"
+                                     "\x03" "api" "\x07" "example" "\x03" "com" "\x00\x00\x01\x00\x01";
+
+    CHECK_TRUE(size == static_cast<int>(sizeof(expected)) - 1 && memcmp(query, expected, size) == 0);
+
+    // answer: CNAME with ttl 300, then two A records of canonical name with ttl 60 and 30
+    unsigned char answer[512];
+    memcpy(answer, query, size);
+    answer[2] = 0x81;
+    answer[3] = 0x80;
+    answer[7] = 3;
+
+    const unsigned char records[] = "\xc0\x0c\x00\x05\x00\x01\x00\x00\x01\x2c\x00\x06" "\x03" "web" "\xc0\x10"
+                                    "\xc0\x2d\x00\x01\x00\x01\x00\x00\x00\x3c\x00\x04" "\x0a\x00\x00\x01"
+                                    "\xc0\x2d\x00\x01\x00\x01\x00\x00\x00\x1e\x00\x04" "\x0a\x00\x00\x02";
+    int answerSize = size + static_cast<int>(sizeof(records)) - 1;
+    memcpy(answer + size, records, sizeof(records) - 1);
+
+    std::vector<uint32_t> addresses;
+    long long int ttl = 0;
+
+    CHECK_TRUE(Resolver::parseAnswer(answer, answerSize, 0x1234, addresses, ttl) == 0);
+    CHECK_TRUE(addresses.size() == 2 && ttl == 30);
+    CHECK_TRUE(memcmp(&addresses[0], "\x0a\x00\x00\x01", 4) == 0 && memcmp(&addresses[1], "\x0a\x00\x00\x02", 4) == 0);
+
+    // other id, truncated message
+    addresses.clear();
+    CHECK_TRUE(Resolver::parseAnswer(answer, answerSize, 0x4321, addresses, ttl) == -1);
+    CHECK_TRUE(Resolver::parseAnswer(answer, answerSize - 2, 0x1234, addresses, ttl) == -1);
+
+    // name does not exist
+    answer[3] = 0x83;
+    CHECK_TRUE(Resolver::parseAnswer(answer, size, 0x1234, addresses, ttl) == 1);
+
+    CHECK_TRUE(Resolver::buildQuery("api..com", 1, query, sizeof(query)) == -1);
+    CHECK_TRUE(Resolver::buildQuery(std::string(64, 'a') + ".com", 1, query, sizeof(query)) == -1);
+}
+
+
+// nameserver on 127.0.0.1, which answers A query with one address and TTL of 1 second
+class StubNameserver
+{
+public:
+
+    enum class Mode
+    {
+        answer, wrongIdFirst, silent, noName
+    };
+
+    int start()
+    {
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        socklen_t length = sizeof(addr);
+
+        if(fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || getsockname(fd, (sockaddr*)&addr, &length) != 0)
+        {
+            return -1;
+        }
+
+        port = ntohs(addr.sin_port);
+        thread = std::thread(&StubNameserver::run, this);
+
+        return 0;
+    }
+
+    void stop()
+    {
+        stopFlag = true;
+        thread.join();
+        close(fd);
+    }
+
+    void run()
+    {
+        while(!stopFlag)
+        {
+            pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+
+            if(poll(&pfd, 1, 20) <= 0)
+            {
+                continue;
+            }
+
+            unsigned char buf[512];
+            sockaddr_in from;
+            socklen_t fromLength = sizeof(from);
+
+            ssize_t size = recvfrom(fd, buf, sizeof(buf) - 16, 0, (sockaddr*)&from, &fromLength);
+            if(size < 12)
+            {
+                continue;
+            }
+
+            ++queries;
+
+            if(mode == Mode::silent)
+            {
+                continue;
+            }
+
+            if(mode == Mode::wrongIdFirst)
+            {
+                buf[1] ^= 1;
+                reply(buf, size, from, inet_addr("10.0.0.9"));
+                buf[1] ^= 1;
+            }
+
+            reply(buf, size, from, address);
+        }
+    }
+
+    void reply(unsigned char *buf, ssize_t size, const sockaddr_in &to, uint32_t replyAddress)
+    {
+        const unsigned char record[] = "\xc0\x0c\x00\x01\x00\x01\x00\x00\x00\x01\x00\x04";
+
+        buf[2] = 0x81;
+        buf[3] = (mode == Mode::noName) ? 0x83 : 0x80;
+        buf[7] = (mode == Mode::noName) ? 0 : 1;
+
+        memcpy(buf + size, record, sizeof(record) - 1);
+        memcpy(buf + size + sizeof(record) - 1, &replyAddress, 4);
+
+        ssize_t result = sendto(fd, buf, (mode == Mode::noName) ? size : size + sizeof(record) - 1 + 4, 0,
+                                (const sockaddr*)&to, sizeof(to));
+        (void)result;
+    }
+
+    int fd = -1;
+    int port = 0;
+    std::atomic<Mode> mode { Mode::answer };
+    std::atomic<uint32_t> address { 0 };
+    std::atomic<int> queries { 0 };
+    std::atomic_bool stopFlag { false };
+    std::thread thread;
+};
+
+
+class TestResolver: public Resolver
+{
+public:
+    using Resolver::query;
+    using Resolver::loadNameserver;
+};
+
+
+// address is expected from resolver within millis
+bool waitAddress(Resolver &resolver, int host, uint32_t expected, int millis)
+{
+    uint32_t address = 0;
+
+    for(int i = 0; i < millis / 10; ++i)
+    {
+        if(resolver.getAddress(host, address) && address == expected)
+        {
+            return true;
+        }
+        usleep(10000);
+    }
+
+    return false;
+}
+
+
+void testResolverQuery()
+{
+    printf("--- testResolverQuery ---\n");
+
+    NullLog log;
+    StubNameserver nameserver;
+    nameserver.address = inet_addr("10.0.0.1");
+    CHECK_TRUE(nameserver.start() == 0);
+
+    std::string server = "127.0.0.1:" + std::to_string(nameserver.port);
+
+    // query is sent directly, resolver without backends has no thread
+    ServerParameters parameters;
+    parameters.resolverTimeoutMillis = 200;
+
+    TestResolver stub;
+    CHECK_TRUE(stub.init(parameters, &log) == 0);
+    CHECK_TRUE(stub.loadNameserver(server) == 0);
+
+    std::vector<uint32_t> addresses;
+    long long int ttl = 0;
+
+    CHECK_TRUE(stub.query("backend.test", addresses, ttl) == 0);
+    CHECK_TRUE(addresses.size() == 1 && addresses[0] == inet_addr("10.0.0.1") && ttl == 1);
+
+    // answer with other id is skipped, answer to query is used
+    nameserver.mode = StubNameserver::Mode::wrongIdFirst;
+    addresses.clear();
+    CHECK_TRUE(stub.query("backend.test", addresses, ttl) == 0);
+    CHECK_TRUE(addresses.size() == 1 && addresses[0] == inet_addr("10.0.0.1"));
+
+    nameserver.mode = StubNameserver::Mode::noName;
+    CHECK_TRUE(stub.query("backend.test", addresses, ttl) == 1);
+
+    nameserver.mode = StubNameserver::Mode::silent;
+    long long int start = getMilliseconds();
+    CHECK_TRUE(stub.query("backend.test", addresses, ttl) == -1);
+    long long int elapsed = getMilliseconds() - start;
+    CHECK_TRUE(elapsed >= 200 && elapsed < 1000);
+
+    // names of backends are resolved by init and refreshed by thread after TTL
+    nameserver.mode = StubNameserver::Mode::answer;
+
+    BackendParameters backend;
+    backend.address = "backend.test";
+    backend.port = 8080;
+    backend.socketType = SocketType::tcp;
+
+    parameters.proxies.resize(1);
+    parameters.proxies[0].backends.push_back(backend);
+    parameters.resolver = server;
+
+    Resolver resolver;
+    CHECK_TRUE(resolver.init(parameters, &log) == 0);
+
+    int host = resolver.findHost("backend.test");
+    uint32_t address = 0;
+    CHECK_TRUE(host == 0 && resolver.getAddress(host, address) && address == inet_addr("10.0.0.1"));
+
+    nameserver.address = inet_addr("10.0.0.2");
+    CHECK_TRUE(waitAddress(resolver, host, inet_addr("10.0.0.2"), 3000));
+
+    // previous addresses are used, while nameserver does not answer
+    nameserver.mode = StubNameserver::Mode::silent;
+    int queries = nameserver.queries;
+    for(int i = 0; i < 300 && nameserver.queries < queries + 2; ++i)
+    {
+        usleep(10000);
+    }
+    CHECK_TRUE(nameserver.queries >= queries + 2);
+    CHECK_TRUE(resolver.getAddress(host, address) && address == inet_addr("10.0.0.2"));
+
+    resolver.destroy();
+    nameserver.stop();
+}
+
+
+void testResponseSpool()
+{
+    printf("--- testResponseSpool ---\n");
+
+    NullLog log;
+    std::string folder = "/tmp";
+    const int chunk = ResponseSpool::CHUNK_SIZE;
+    std::vector<char> data(chunk * 5);
+    for(size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = static_cast<char>(i * 7 + i / 251);
+    }
+
+    ResponseSpool::Memory memory;
+    memory.init(chunk * 4);
+
+    ResponseSpool spool;
+    CHECK_TRUE(!spool.active());
+
+    // two chunks in memory, rest in file, bytes are read in order, also when written after partial read
+    spool.init(&memory, chunk * 2, chunk * 16, &folder, &log);
+    CHECK_TRUE(spool.active() && spool.empty());
+
+    std::vector<char> result;
+    char out[10000];
+    size_t written = 0;
+
+    while(written < data.size())
+    {
+        void *buf = nullptr;
+        int size = 0;
+        CHECK_TRUE(spool.startWrite(buf, size) && size > 0);
+
+        size = std::min(size, std::min(30000, static_cast<int>(data.size() - written)));
+        memcpy(buf, &data[written], size);
+        CHECK_TRUE(spool.endWrite(size) == 0);
+        written += size;
+
+        CHECK_TRUE(memory.getUsed() <= chunk * 2);
+
+        if(written > static_cast<size_t>(chunk * 3))
+        {
+            int bytes = spool.read(out, sizeof(out));
+            CHECK_TRUE(bytes > 0);
+            result.insert(result.end(), out, out + bytes);
+        }
+    }
+
+    CHECK_TRUE(spool.size() == static_cast<long long int>(data.size() - result.size()));
+
+    while(!spool.empty())
+    {
+        int bytes = spool.read(out, sizeof(out));
+        CHECK_TRUE(bytes > 0);
+        result.insert(result.end(), out, out + bytes);
+    }
+
+    CHECK_TRUE(result == data);
+    CHECK_TRUE(memory.getUsed() == 0);
+
+    // memory of server is shared, spool without file stops at limits
+    ResponseSpool other;
+    other.init(&memory, chunk * 4, 0, &folder, &log);
+    spool.init(&memory, chunk * 4, 0, &folder, &log);
+
+    void *buf = nullptr;
+    int size = 0;
+    for(int i = 0; i < 3; ++i)
+    {
+        CHECK_TRUE(other.startWrite(buf, size) && size == chunk && other.endWrite(size) == 0);
+    }
+    CHECK_TRUE(spool.startWrite(buf, size) && spool.endWrite(size) == 0);
+    CHECK_TRUE(!spool.startWrite(buf, size) && !other.startWrite(buf, size));
+    CHECK_TRUE(memory.getUsed() == chunk * 4);
+
+    other.reset();
+    CHECK_TRUE(memory.getUsed() == chunk && spool.startWrite(buf, size));
+
+    spool.reset();
+    CHECK_TRUE(memory.getUsed() == 0 && !spool.active());
+}
+
+
+void testWaitContent()
+{
+    const char *data = "POST /upload HTTP/1.1\r\n"
+                       "Host: 127.0.0.1:7000\r\n"
+                       "Content-Length: 1000000\r\n\r\n"
+                       "12345";
+
+    HttpRequest request;
+    request.setWaitContent(false);
+
+    CHECK_TRUE(request.parse(data, strlen(data)) == HttpRequest::ParseResult::finishOk);
+    CHECK_TRUE(request.getContentLength() == 1000000);
+    CHECK_TRUE(strcmp(data + request.getContentStart(), "12345") == 0);
+    CHECK_TRUE(request.isChunked() == false);
+
+    const char *chunked = "POST /upload HTTP/1.1\r\n"
+                          "Transfer-Encoding: gzip, Chunked\r\n\r\n";
+
+    request.reset();
+    CHECK_TRUE(request.parse(chunked, strlen(chunked)) == HttpRequest::ParseResult::finishOk);
+    CHECK_TRUE(request.isChunked());
+    CHECK_TRUE(request.getContentStart() == (int)strlen(chunked));
+
+    const char *notChunked = "POST /upload HTTP/1.1\r\n"
+                             "Transfer-Encoding: notchunked\r\n\r\n";
+
+    request.reset();
+    CHECK_TRUE(request.parse(notChunked, strlen(notChunked)) == HttpRequest::ParseResult::finishOk);
+    CHECK_TRUE(request.isChunked() == false);
+
+    const char *negative = "POST /upload HTTP/1.1\r\nContent-Length: -5\r\n\r\n";
+
+    request.reset();
+    CHECK_TRUE(request.parse(negative, strlen(negative)) == HttpRequest::ParseResult::finishInvalid);
+}
+
+
+void testChunkedDecoder()
+{
+    const char *body = "5\r\nhello\r\n"
+                       "0b;name=value\r\n world 1234\r\n"
+                       "0\r\n"
+                       "Trailer: x\r\n\r\n"
+                       "GET";
+
+    int bodyLength = strlen(body);
+    int chunkedLength = bodyLength - 3;
+
+    // every split of input must give the same result
+    for(int split = 0; split <= bodyLength; ++split)
+    {
+        ChunkedDecoder decoder;
+        char payload[100];
+        int consumed1, consumed2, size1, size2;
+
+        ChunkedDecoder::Result r1 = decoder.decode(body, split, consumed1, payload, &size1);
+        ChunkedDecoder::Result r2 = decoder.decode(body + consumed1, bodyLength - consumed1, consumed2, payload + size1, &size2);
+
+        if(r1 == ChunkedDecoder::Result::invalid || r2 != ChunkedDecoder::Result::finish ||
+           consumed1 + consumed2 != chunkedLength || size1 + size2 != 16 ||
+           strncmp(payload, "hello world 1234", 16) != 0)
+        {
+            printf("split: %d\n", split);
+            CHECK_TRUE(false);
+        }
+    }
+
+    // decoding in place
+    char buf[100];
+    strcpy(buf, "3\r\nabc\r\n2\r\nde\r\n0\r\n\r\n");
+    ChunkedDecoder decoder;
+    int consumed, size;
+    CHECK_TRUE(decoder.decode(buf, strlen(buf), consumed, buf, &size) == ChunkedDecoder::Result::finish);
+    CHECK_TRUE(size == 5 && strncmp(buf, "abcde", 5) == 0);
+    CHECK_TRUE(decoder.finished());
+
+    const char *invalid[] = { "x\r\n", "5\r\nhelloX", "\r\n", "1234567890123456\r\n" };
+
+    for(const char *s : invalid)
+    {
+        decoder.reset();
+        CHECK_TRUE(decoder.decode(s, strlen(s), consumed) == ChunkedDecoder::Result::invalid);
+    }
+}
+
+
+void testCharClass()
+{
+    const char *ranges = "%%-9==AZ__az";
+
+    CharClass::Level level = CharClass::detectLevel();
+
+    printf("char class level: %s\n", CharClass::levelString(level));
+
+    CharClass scalar(ranges, CharClass::Level::scalar);
+    CharClass sse42(ranges, (level == CharClass::Level::scalar) ? CharClass::Level::scalar : CharClass::Level::sse42);
+    CharClass detected(ranges);
+
+    char data[300];
+
+    srand(1);
+
+    for(int iter = 0; iter < 10000; ++iter)
+    {
+        int size = rand() % (int)sizeof(data);
+        for(int i = 0; i < size; ++i)
+        {
+            // mostly symbols from class, so scans run over several blocks
+            data[i] = (rand() % 50 == 0) ? static_cast<char>(rand() % 256) : 'a' + rand() % 26;
+        }
+
+        int offset = rand() % (size + 1);
+        const char *p = data + offset;
+        int length = size - offset;
+
+        if(scalar.skip(p, length) != sse42.skip(p, length) || scalar.skip(p, length) != detected.skip(p, length) ||
+           scalar.find(p, length) != sse42.find(p, length) || scalar.find(p, length) != detected.find(p, length))
+        {
+            CHECK_TRUE(false);
+        }
+    }
+
+    CHECK_TRUE(detected.skip("abc%20def ", 10) == 9);
+    CHECK_TRUE(detected.find("\x80\xff ?a", 5) == 4);
+    CHECK_TRUE(detected.skip("", 0) == 0);
+}
+
+
+void testUrlDecode()
+{
+    struct
+    {
+        const char *request;
+        HttpRequest::ParseResult result;
+        const char *url;
+    } cases[] =
+    {
+        { "GET /a%20b/c HTTP/1.1\r\nHost: a\r\n\r\n", HttpRequest::ParseResult::finishOk, "/a b/c" },
+        { "GET /a/b/c/d/e/f/g/h/i/j/k/l/m/n/o/p/q/r/s/t/u/v/w/x/y/z.html HTTP/1.1\r\nHost: a\r\n\r\n",
+          HttpRequest::ParseResult::finishOk, "/a/b/c/d/e/f/g/h/i/j/k/l/m/n/o/p/q/r/s/t/u/v/w/x/y/z.html" },
+        { "GET /a/../b HTTP/1.1\r\nHost: a\r\n\r\n", HttpRequest::ParseResult::finishInvalid, nullptr },
+        { "GET /a/.%2e/b HTTP/1.1\r\nHost: a\r\n\r\n", HttpRequest::ParseResult::finishInvalid, nullptr },
+        { "GET /a/%2e%2E/b HTTP/1.1\r\nHost: a\r\n\r\n", HttpRequest::ParseResult::finishInvalid, nullptr },
+        { "GET /a%00b HTTP/1.1\r\nHost: a\r\n\r\n", HttpRequest::ParseResult::finishInvalid, nullptr },
+        { "GET /a%2 HTTP/1.1\r\nHost: a\r\n\r\n", HttpRequest::ParseResult::finishInvalid, nullptr },
+        { "GET /a%zz HTTP/1.1\r\nHost: a\r\n\r\n", HttpRequest::ParseResult::finishInvalid, nullptr },
+        { "GET /a%3F HTTP/1.1\r\nHost: a\r\n\r\n", HttpRequest::ParseResult::finishInvalid, nullptr },
+        { "GET /a?x=1\r\nHost: a\r\n\r\n", HttpRequest::ParseResult::finishInvalid, nullptr },
+        { "GET /a?x=1&y=2 HTTP/1.1\r\nHost: a\r\n\r\n", HttpRequest::ParseResult::finishOk, "/a" },
+    };
+
+    for(auto &c : cases)
+    {
+        HttpRequest request;
+        HttpRequest::ParseResult result = request.parse(c.request, strlen(c.request));
+        printf("%s", c.request);
+        CHECK_TRUE(result == c.result);
+        if(c.url != nullptr)
+        {
+            CHECK_TRUE(strcmp(request.getUrl(), c.url) == 0);
+        }
+    }
+
+    const char *partial = "GET /a?x=1&y=2";
+    HttpRequest request;
+    CHECK_TRUE(request.parse(partial, strlen(partial)) == HttpRequest::ParseResult::needMoreData);
+}
+
+
+long long int getMilliseconds()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch()
+           ).count();
+}
+
+void testPerformance()
+{
+    const char *data =
+        "GET /gallery/album/flowers%202016/1?album-view=3 HTTP/1.1\r\n"
+        "Host: 127.0.0.1:7000\r\n"
+        "User-Agent: Mozilla Firefox\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml\r\n"
+        "Accept-Language: en-US,en\r\n"
+        "Accept-Encoding: gzip, deflate\r\n"
+        "Connection: keep-alive\r\n"
+        "If-Modified-Since: Mon, 26 Sep 2016 10:15:30 GMT\r\n"
+        "Cache-Control: max-age=0\r\n\r\n";
+
+    int dataLen = strlen(data);
+
+    HttpRequest request;
+
+    const int iterCount = 10000000;
+
+    unsigned long long int millisStart = getMilliseconds();
+
+    for(int i = 0; i < iterCount; ++i)
+    {
+        if(request.parse(data, dataLen) != HttpRequest::ParseResult::finishOk)
+        {
+            printf("parse failed!\n");
+            exit(-1);
+        }
+    }
+
+    unsigned long long int millisDif = getMilliseconds() - millisStart;
+
+    printf("performance test milliseconds: %llu\n", millisDif);
+}
+
+// connected tcp sockets on loopback
+void loopbackPair(int fds[2])
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK_TRUE(bind(listenFd, (sockaddr*)&addr, sizeof(addr)) == 0 && listen(listenFd, 1) == 0);
+    CHECK_TRUE(getsockname(listenFd, (sockaddr*)&addr, &len) == 0);
+
+    fds[0] = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK_TRUE(connect(fds[0], (sockaddr*)&addr, sizeof(addr)) == 0);
+    fds[1] = accept(listenFd, nullptr, nullptr);
+    CHECK_TRUE(fds[1] >= 0);
+
+    int noDelay = 1;
+    setsockopt(fds[0], IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    setsockopt(fds[1], IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    close(listenFd);
+}
+
+
+// poll loop of one executor, registered events are kept for checks
+class TunnelLoop: public PollLoopBase
+{
+public:
+    ExecutorData* createExecutorData() override { return nullptr; }
+    void removeExecutorData(ExecutorData* /*data*/) override {}
+    Executor* getExecutor(ExecutorType /*execType*/) override { return nullptr; }
+
+    int addPollFd(ExecutorData &data, int fd, int events) override
+    {
+        PollData *pollData = (fd == data.fd0) ? &pollData0 : &pollData1;
+        pollData->fd = fd;
+        pollData->execData = &data;
+        pollData->events = events;
+        ((fd == data.fd0) ? data.pollData0 : data.pollData1) = pollData;
+        return 0;
+    }
+
+    int editPollFd(ExecutorData &data, int fd, int events) override
+    {
+        ((fd == data.fd0) ? data.pollData0 : data.pollData1)->events = events;
+        return 0;
+    }
+
+    int removePollFd(ExecutorData &data, int fd) override
+    {
+        PollData *&pollData = (fd == data.fd0) ? data.pollData0 : data.pollData1;
+        pollData->down();
+        pollData = nullptr;
+        return 0;
+    }
+
+    int closeFd(ExecutorData& /*data*/, int /*fd*/) override { return 0; }
+    int createRequestExecutor(int /*fd*/, ExecutorType /*execType*/, long long int /*acceptTime*/) override { return 0; }
+    int checkNewFd() override { return 0; }
+    int checkTimers() override { return 0; }
+    UpstreamGroup* getUpstreamGroup(const ProxyParameters& /*proxy*/) override { return nullptr; }
+    PipePool* getPipePool() override { return nullptr; }
+
+    PollData pollData0;
+    PollData pollData1;
+};
+
+
+// tunnel is processed till result is not ok or bytes are received by peers of client and backend
+ProcessResult pumpTunnel(ProxyExecutorSplice &executor, ExecutorData &data, int clientPeer, int backendPeer,
+                         std::string &toClient, std::string &toBackend, size_t clientBytes, size_t backendBytes)
+{
+    ProcessResult result = ProcessResult::ok;
+
+    for(int i = 0; i < 1000 && result == ProcessResult::ok &&
+        (toClient.size() < clientBytes || toBackend.size() < backendBytes); ++i)
+    {
+        result = executor.process(data, data.fd0, EPOLLIN | EPOLLOUT);
+
+        char buf[1000];
+        ssize_t bytes;
+
+        while((bytes = recv(clientPeer, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+        {
+            toClient.append(buf, bytes);
+        }
+
+        while((bytes = recv(backendPeer, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+        {
+            toBackend.append(buf, bytes);
+        }
+
+        usleep(1000);
+    }
+
+    return result;
+}
+
+
+void testTunnel()
+{
+    printf("--- testTunnel ---\n");
+
+    NullLog log;
+    ServerParameters parameters;
+    TunnelLoop loop;
+    loop.log = &log;
+    loop.parameters = &parameters;
+
+    ProxyExecutorSplice executor;
+    CHECK_TRUE(executor.init(&loop) == 0);
+
+    PipePool pool;
+    CHECK_TRUE(pool.init(2, 64 * 1024, &log) == 0);
+
+    int client[2];
+    int upstream[2];
+    loopbackPair(client);
+    loopbackPair(upstream);
+    fcntl(client[1], F_SETFL, O_NONBLOCK);
+    fcntl(upstream[0], F_SETFL, O_NONBLOCK);
+
+    std::string toClient;
+    std::string toBackend;
+
+    {
+        ExecutorData data;
+        data.fd0 = client[1];
+        data.fd1 = upstream[0];
+        data.pipePool = &pool;
+        data.pipeCapacity = pool.get(data.pipeReadFd, data.pipeWriteFd);
+        data.tunnelPipeCapacity = pool.get(data.tunnelPipeReadFd, data.tunnelPipeWriteFd);
+        data.state = ExecutorData::State::tunnel;
+
+        // response headers in buffer are sent before bytes of backend
+        const char *headers = "HTTP/1.1 101 Switching Protocols\r\n\r\n";
+        data.buffer.init(ExecutorData::REQUEST_BUFFER_SIZE);
+        void *p;
+        int size;
+        data.buffer.startWrite(p, size);
+        memcpy(p, headers, strlen(headers));
+        data.buffer.endWrite(strlen(headers));
+
+        CHECK_TRUE(send(upstream[1], "hello", 5, 0) == 5);
+        CHECK_TRUE(send(client[0], "ping", 4, 0) == 4);
+
+        CHECK_TRUE(pumpTunnel(executor, data, client[0], upstream[1], toClient, toBackend,
+                              strlen(headers) + 5, 4) == ProcessResult::ok);
+        CHECK_TRUE(toClient == std::string(headers) + "hello");
+        CHECK_TRUE(toBackend == "ping");
+
+        // client closes after last bytes (close frame of WebSocket), backend gets them and end of file,
+        // its answer still goes to client
+        CHECK_TRUE(send(client[0], "last", 4, 0) == 4);
+        CHECK_TRUE(shutdown(client[0], SHUT_WR) == 0);
+
+        CHECK_TRUE(pumpTunnel(executor, data, client[0], upstream[1], toClient, toBackend,
+                              0, 8) == ProcessResult::ok);
+        CHECK_TRUE(toBackend == "pinglast");
+        usleep(10000);
+        CHECK_TRUE(executor.process(data, data.fd0, EPOLLRDHUP) == ProcessResult::ok);
+        CHECK_TRUE(data.tunnelClientClosed && data.tunnelUpstreamShutdown);
+        CHECK_TRUE(data.pollData0 == nullptr);
+
+        char buf[10];
+        CHECK_TRUE(recv(upstream[1], buf, sizeof(buf), 0) == 0);
+
+        CHECK_TRUE(send(upstream[1], "bye", 3, 0) == 3);
+        CHECK_TRUE(shutdown(upstream[1], SHUT_WR) == 0);
+
+        // tunnel ends, when both sides are closed and forwarded
+        ProcessResult result = ProcessResult::ok;
+        for(int i = 0; i < 1000 && result == ProcessResult::ok; ++i)
+        {
+            usleep(1000);
+            result = executor.process(data, data.fd1, EPOLLIN);
+        }
+
+        CHECK_TRUE(result == ProcessResult::removeExecutorOk);
+    }
+
+    // fds of tunnel are closed with executor data
+    char buf[1000];
+    ssize_t bytes;
+    while((bytes = recv(client[0], buf, sizeof(buf), 0)) > 0)
+    {
+        toClient.append(buf, bytes);
+    }
+
+    CHECK_TRUE(bytes == 0);
+    CHECK_TRUE(toClient == std::string("HTTP/1.1 101 Switching Protocols\r\n\r\nhellobye"));
+
+    close(client[0]);
+    close(upstream[1]);
+    pool.destroy();
+}
+
+
+// body is moved upstream socket -> client socket as ProxyExecutor does it: read and write through buffer of
+// ExecutorData::REQUEST_BUFFER_SIZE bytes, or splice through pipe. results are basis of ProxyParameters::spliceMinBytes.
+void testSplicePerformance()
+{
+    printf("--- testSplicePerformance ---\n");
+
+    int upstream[2];
+    int client[2];
+    int pipeFds[2];
+
+    loopbackPair(upstream);
+    loopbackPair(client);
+    CHECK_TRUE(pipe2(pipeFds, O_NONBLOCK) == 0);
+    fcntl(pipeFds[1], F_SETPIPE_SZ, 1024 * 1024);
+
+    const int maxSize = 1024 * 1024;
+    std::unique_ptr<char[]> data(new char[maxSize]);
+    memset(data.get(), 'x', maxSize);
+    char buffer[10000];
+
+    const int sizes[] = {1024, 4096, 8192, 16384, 65536, 1024 * 1024};
+
+    for(int size : sizes)
+    {
+        int iterCount = (size <= 65536) ? 1000 : 50;
+        long long int nanos[2] = {0, 0};
+
+        for(int useSplice = 0; useSplice < 2; ++useSplice)
+        {
+            for(int i = 0; i < iterCount; ++i)
+            {
+                int written = 0;
+                int moved = 0;
+                int received = 0;
+
+                while(received < size)
+                {
+                    if(written < size)
+                    {
+                        ssize_t bytes = send(upstream[0], data.get() + written, size - written, MSG_DONTWAIT);
+                        written += (bytes > 0) ? bytes : 0;
+                    }
+
+                    auto start = std::chrono::steady_clock::now();
+
+                    if(moved < written)
+                    {
+                        ssize_t bytes;
+
+                        if(useSplice == 0)
+                        {
+                            bytes = recv(upstream[1], buffer, sizeof(buffer), MSG_DONTWAIT);
+                            for(ssize_t sent = 0; sent < bytes; )
+                            {
+                                ssize_t s = send(client[0], buffer + sent, bytes - sent, 0);
+                                sent += (s > 0) ? s : 0;
+                            }
+                        }
+                        else
+                        {
+                            bytes = splice(upstream[1], NULL, pipeFds[1], NULL, maxSize, SPLICE_F_NONBLOCK);
+                            for(ssize_t sent = 0; sent < bytes; )
+                            {
+                                ssize_t s = splice(pipeFds[0], NULL, client[0], NULL, bytes - sent, 0);
+                                sent += (s > 0) ? s : 0;
+                            }
+                        }
+
+                        moved += (bytes > 0) ? bytes : 0;
+                    }
+
+                    nanos[useSplice] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                          std::chrono::steady_clock::now() - start).count();
+
+                    ssize_t bytes = recv(client[1], data.get(), maxSize, MSG_DONTWAIT);
+                    received += (bytes > 0) ? bytes : 0;
+                }
+            }
+
+            nanos[useSplice] /= iterCount;
+        }
+
+        printf("body %7d bytes   read/write: %6lld ns   splice: %6lld ns\n", size, nanos[0], nanos[1]);
+    }
+
+    close(upstream[0]);
+    close(upstream[1]);
+    close(client[0]);
+    close(client[1]);
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+}
+
+
 int main()
 {
     test1();
     test2();
+    testKnownHeaders();
+    testAllocations();
+    testWrappedBuffer();
+    testUrlParameters();
+    testWaitContent();
+    testChunkedDecoder();
+    testKeepAlive();
+    testRequestRetryable();
+    testResponseParser();
+    testResponseCache();
+    testDiskCache();
+    testProxyRoutes();
+    testConnectRequest();
+    testUpstreamGroup();
+    testUpstreamQueue();
+    testAdmissionControl();
+    testPipePool();
+    testResolver();
+    testResolverQuery();
+    testResponseSpool();
+    testTunnel();
+    testCharClass();
+    testUrlDecode();
     testPerformance();
+    testSplicePerformance();
 
     printf("\n============\nall tests ok\n");
 